@@ -0,0 +1,312 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This file implements the CRC-15 engines, the CRC-17 and CRC-21
+   bit engines, and the XL PCRC and FCRC engines.  See CAN_XR_CRC.h
+   for more information.
+*/
+
+#include <stdint.h>
+#include "CAN_XR_CRC.h"
+
+/* nibble_table[x] and byte_table[x] are the CRC of x, from a zero
+   CRC.  Due to linearity, feeding w bits d into crc is the same as
+   shifting crc left by w bits and adding the table entry of d xor the
+   w MSbs of crc (w <= 15).
+*/
+static const uint16_t nibble_table[16] = {
+    0x0000, 0x4599, 0x4EAB, 0x0B32, 0x58CF, 0x1D56, 0x1664, 0x53FD,
+    0x7407, 0x319E, 0x3AAC, 0x7F35, 0x2CC8, 0x6951, 0x6263, 0x27FA
+};
+
+static const uint16_t byte_table[256] = {
+    0x0000, 0x4599, 0x4EAB, 0x0B32, 0x58CF, 0x1D56, 0x1664, 0x53FD,
+    0x7407, 0x319E, 0x3AAC, 0x7F35, 0x2CC8, 0x6951, 0x6263, 0x27FA,
+    0x2D97, 0x680E, 0x633C, 0x26A5, 0x7558, 0x30C1, 0x3BF3, 0x7E6A,
+    0x5990, 0x1C09, 0x173B, 0x52A2, 0x015F, 0x44C6, 0x4FF4, 0x0A6D,
+    0x5B2E, 0x1EB7, 0x1585, 0x501C, 0x03E1, 0x4678, 0x4D4A, 0x08D3,
+    0x2F29, 0x6AB0, 0x6182, 0x241B, 0x77E6, 0x327F, 0x394D, 0x7CD4,
+    0x76B9, 0x3320, 0x3812, 0x7D8B, 0x2E76, 0x6BEF, 0x60DD, 0x2544,
+    0x02BE, 0x4727, 0x4C15, 0x098C, 0x5A71, 0x1FE8, 0x14DA, 0x5143,
+    0x73C5, 0x365C, 0x3D6E, 0x78F7, 0x2B0A, 0x6E93, 0x65A1, 0x2038,
+    0x07C2, 0x425B, 0x4969, 0x0CF0, 0x5F0D, 0x1A94, 0x11A6, 0x543F,
+    0x5E52, 0x1BCB, 0x10F9, 0x5560, 0x069D, 0x4304, 0x4836, 0x0DAF,
+    0x2A55, 0x6FCC, 0x64FE, 0x2167, 0x729A, 0x3703, 0x3C31, 0x79A8,
+    0x28EB, 0x6D72, 0x6640, 0x23D9, 0x7024, 0x35BD, 0x3E8F, 0x7B16,
+    0x5CEC, 0x1975, 0x1247, 0x57DE, 0x0423, 0x41BA, 0x4A88, 0x0F11,
+    0x057C, 0x40E5, 0x4BD7, 0x0E4E, 0x5DB3, 0x182A, 0x1318, 0x5681,
+    0x717B, 0x34E2, 0x3FD0, 0x7A49, 0x29B4, 0x6C2D, 0x671F, 0x2286,
+    0x2213, 0x678A, 0x6CB8, 0x2921, 0x7ADC, 0x3F45, 0x3477, 0x71EE,
+    0x5614, 0x138D, 0x18BF, 0x5D26, 0x0EDB, 0x4B42, 0x4070, 0x05E9,
+    0x0F84, 0x4A1D, 0x412F, 0x04B6, 0x574B, 0x12D2, 0x19E0, 0x5C79,
+    0x7B83, 0x3E1A, 0x3528, 0x70B1, 0x234C, 0x66D5, 0x6DE7, 0x287E,
+    0x793D, 0x3CA4, 0x3796, 0x720F, 0x21F2, 0x646B, 0x6F59, 0x2AC0,
+    0x0D3A, 0x48A3, 0x4391, 0x0608, 0x55F5, 0x106C, 0x1B5E, 0x5EC7,
+    0x54AA, 0x1133, 0x1A01, 0x5F98, 0x0C65, 0x49FC, 0x42CE, 0x0757,
+    0x20AD, 0x6534, 0x6E06, 0x2B9F, 0x7862, 0x3DFB, 0x36C9, 0x7350,
+    0x51D6, 0x144F, 0x1F7D, 0x5AE4, 0x0919, 0x4C80, 0x47B2, 0x022B,
+    0x25D1, 0x6048, 0x6B7A, 0x2EE3, 0x7D1E, 0x3887, 0x33B5, 0x762C,
+    0x7C41, 0x39D8, 0x32EA, 0x7773, 0x248E, 0x6117, 0x6A25, 0x2FBC,
+    0x0846, 0x4DDF, 0x46ED, 0x0374, 0x5089, 0x1510, 0x1E22, 0x5BBB,
+    0x0AF8, 0x4F61, 0x4453, 0x01CA, 0x5237, 0x17AE, 0x1C9C, 0x5905,
+    0x7EFF, 0x3B66, 0x3054, 0x75CD, 0x2630, 0x63A9, 0x689B, 0x2D02,
+    0x276F, 0x62F6, 0x69C4, 0x2C5D, 0x7FA0, 0x3A39, 0x310B, 0x7492,
+    0x5368, 0x16F1, 0x1DC3, 0x585A, 0x0BA7, 0x4E3E, 0x450C, 0x0095
+};
+
+/* Same as byte_table, for the XL FCRC.  Since the FCRC is 32 bits
+   wide, the byte engine does not need to mask it.
+*/
+static const uint32_t fcrc_byte_table[256] = {
+    0x00000000, 0xF1922815, 0x12B6783F, 0xE324502A,
+    0x256CF07E, 0xD4FED86B, 0x37DA8841, 0xC648A054,
+    0x4AD9E0FC, 0xBB4BC8E9, 0x586F98C3, 0xA9FDB0D6,
+    0x6FB51082, 0x9E273897, 0x7D0368BD, 0x8C9140A8,
+    0x95B3C1F8, 0x6421E9ED, 0x8705B9C7, 0x769791D2,
+    0xB0DF3186, 0x414D1993, 0xA26949B9, 0x53FB61AC,
+    0xDF6A2104, 0x2EF80911, 0xCDDC593B, 0x3C4E712E,
+    0xFA06D17A, 0x0B94F96F, 0xE8B0A945, 0x19228150,
+    0xDAF5ABE5, 0x2B6783F0, 0xC843D3DA, 0x39D1FBCF,
+    0xFF995B9B, 0x0E0B738E, 0xED2F23A4, 0x1CBD0BB1,
+    0x902C4B19, 0x61BE630C, 0x829A3326, 0x73081B33,
+    0xB540BB67, 0x44D29372, 0xA7F6C358, 0x5664EB4D,
+    0x4F466A1D, 0xBED44208, 0x5DF01222, 0xAC623A37,
+    0x6A2A9A63, 0x9BB8B276, 0x789CE25C, 0x890ECA49,
+    0x059F8AE1, 0xF40DA2F4, 0x1729F2DE, 0xE6BBDACB,
+    0x20F37A9F, 0xD161528A, 0x324502A0, 0xC3D72AB5,
+    0x44797FDF, 0xB5EB57CA, 0x56CF07E0, 0xA75D2FF5,
+    0x61158FA1, 0x9087A7B4, 0x73A3F79E, 0x8231DF8B,
+    0x0EA09F23, 0xFF32B736, 0x1C16E71C, 0xED84CF09,
+    0x2BCC6F5D, 0xDA5E4748, 0x397A1762, 0xC8E83F77,
+    0xD1CABE27, 0x20589632, 0xC37CC618, 0x32EEEE0D,
+    0xF4A64E59, 0x0534664C, 0xE6103666, 0x17821E73,
+    0x9B135EDB, 0x6A8176CE, 0x89A526E4, 0x78370EF1,
+    0xBE7FAEA5, 0x4FED86B0, 0xACC9D69A, 0x5D5BFE8F,
+    0x9E8CD43A, 0x6F1EFC2F, 0x8C3AAC05, 0x7DA88410,
+    0xBBE02444, 0x4A720C51, 0xA9565C7B, 0x58C4746E,
+    0xD45534C6, 0x25C71CD3, 0xC6E34CF9, 0x377164EC,
+    0xF139C4B8, 0x00ABECAD, 0xE38FBC87, 0x121D9492,
+    0x0B3F15C2, 0xFAAD3DD7, 0x19896DFD, 0xE81B45E8,
+    0x2E53E5BC, 0xDFC1CDA9, 0x3CE59D83, 0xCD77B596,
+    0x41E6F53E, 0xB074DD2B, 0x53508D01, 0xA2C2A514,
+    0x648A0540, 0x95182D55, 0x763C7D7F, 0x87AE556A,
+    0x88F2FFBE, 0x7960D7AB, 0x9A448781, 0x6BD6AF94,
+    0xAD9E0FC0, 0x5C0C27D5, 0xBF2877FF, 0x4EBA5FEA,
+    0xC22B1F42, 0x33B93757, 0xD09D677D, 0x210F4F68,
+    0xE747EF3C, 0x16D5C729, 0xF5F19703, 0x0463BF16,
+    0x1D413E46, 0xECD31653, 0x0FF74679, 0xFE656E6C,
+    0x382DCE38, 0xC9BFE62D, 0x2A9BB607, 0xDB099E12,
+    0x5798DEBA, 0xA60AF6AF, 0x452EA685, 0xB4BC8E90,
+    0x72F42EC4, 0x836606D1, 0x604256FB, 0x91D07EEE,
+    0x5207545B, 0xA3957C4E, 0x40B12C64, 0xB1230471,
+    0x776BA425, 0x86F98C30, 0x65DDDC1A, 0x944FF40F,
+    0x18DEB4A7, 0xE94C9CB2, 0x0A68CC98, 0xFBFAE48D,
+    0x3DB244D9, 0xCC206CCC, 0x2F043CE6, 0xDE9614F3,
+    0xC7B495A3, 0x3626BDB6, 0xD502ED9C, 0x2490C589,
+    0xE2D865DD, 0x134A4DC8, 0xF06E1DE2, 0x01FC35F7,
+    0x8D6D755F, 0x7CFF5D4A, 0x9FDB0D60, 0x6E492575,
+    0xA8018521, 0x5993AD34, 0xBAB7FD1E, 0x4B25D50B,
+    0xCC8B8061, 0x3D19A874, 0xDE3DF85E, 0x2FAFD04B,
+    0xE9E7701F, 0x1875580A, 0xFB510820, 0x0AC32035,
+    0x8652609D, 0x77C04888, 0x94E418A2, 0x657630B7,
+    0xA33E90E3, 0x52ACB8F6, 0xB188E8DC, 0x401AC0C9,
+    0x59384199, 0xA8AA698C, 0x4B8E39A6, 0xBA1C11B3,
+    0x7C54B1E7, 0x8DC699F2, 0x6EE2C9D8, 0x9F70E1CD,
+    0x13E1A165, 0xE2738970, 0x0157D95A, 0xF0C5F14F,
+    0x368D511B, 0xC71F790E, 0x243B2924, 0xD5A90131,
+    0x167E2B84, 0xE7EC0391, 0x04C853BB, 0xF55A7BAE,
+    0x3312DBFA, 0xC280F3EF, 0x21A4A3C5, 0xD0368BD0,
+    0x5CA7CB78, 0xAD35E36D, 0x4E11B347, 0xBF839B52,
+    0x79CB3B06, 0x88591313, 0x6B7D4339, 0x9AEF6B2C,
+    0x83CDEA7C, 0x725FC269, 0x917B9243, 0x60E9BA56,
+    0xA6A11A02, 0x57333217, 0xB417623D, 0x45854A28,
+    0xC9140A80, 0x38862295, 0xDBA272BF, 0x2A305AAA,
+    0xEC78FAFE, 0x1DEAD2EB, 0xFECE82C1, 0x0F5CAAD4
+};
+
+/* Get bit 'i' of 'data'. */
+#define get_bit(data, i) (((data)[(i) >> 3] >> (7 - ((i) & 0x7))) & 0x1)
+
+/* From [1], 10.4.2.6.  Same as crc_nxtbit in CAN_XR_MAC_Common.c. */
+uint16_t CAN_XR_CRC_Bit(uint16_t crc, int nxtbit)
+{
+    int crcnxt = ((crc & 0x4000) >> 14) ^ (nxtbit & 0x1);
+    crc = (crc << 1) & 0x7FFF; /* Shift in 0 */
+    if(crcnxt)  crc ^= CAN_XR_CRC_POLYNOMIAL;
+    return crc;
+}
+
+/* Same as CAN_XR_CRC_Bit, on 17 and 21 bits. */
+uint32_t CAN_XR_CRC17_Bit(uint32_t crc, int nxtbit)
+{
+    int crcnxt = ((crc >> 16) ^ nxtbit) & 0x1;
+    crc = (crc << 1) & 0x1FFFF;
+    if(crcnxt)  crc ^= CAN_XR_CRC17_POLYNOMIAL;
+    return crc;
+}
+
+uint32_t CAN_XR_CRC21_Bit(uint32_t crc, int nxtbit)
+{
+    int crcnxt = ((crc >> 20) ^ nxtbit) & 0x1;
+    crc = (crc << 1) & 0x1FFFFF;
+    if(crcnxt)  crc ^= CAN_XR_CRC21_POLYNOMIAL;
+    return crc;
+}
+
+/* Same as CAN_XR_CRC_Bit, for the XL PCRC and FCRC. */
+uint32_t CAN_XR_PCRC_Bit(uint32_t crc, int nxtbit)
+{
+    int crcnxt = ((crc >> 12) ^ nxtbit) & 0x1;
+    crc = (crc << 1) & 0x1FFF;
+    if(crcnxt)  crc ^= CAN_XR_PCRC_POLYNOMIAL;
+    return crc;
+}
+
+uint32_t CAN_XR_FCRC_Bit(uint32_t crc, int nxtbit)
+{
+    int crcnxt = ((crc >> 31) ^ nxtbit) & 0x1;
+    crc = (crc << 1) & 0xFFFFFFFF;
+    if(crcnxt)  crc ^= CAN_XR_FCRC_POLYNOMIAL;
+    return crc;
+}
+
+uint32_t CAN_XR_FCRC_Byte(uint32_t crc, uint8_t byte)
+{
+    return ((crc << 8) & 0xFFFFFFFF)
+	^ fcrc_byte_table[((crc >> 24) ^ byte) & 0xFF];
+}
+
+uint16_t CAN_XR_CRC_Nibble(uint16_t crc, int nibble)
+{
+    return ((crc << 4) & 0x7FFF) ^ nibble_table[((crc >> 11) ^ nibble) & 0xF];
+}
+
+uint16_t CAN_XR_CRC_Byte(uint16_t crc, uint8_t byte)
+{
+    return ((crc << 8) & 0x7FFF) ^ byte_table[((crc >> 7) ^ byte) & 0xFF];
+}
+
+uint16_t CAN_XR_CRC_Bits_Update(
+    uint16_t crc, const uint8_t *data,
+    unsigned long first_bit, unsigned long n_bits)
+{
+    unsigned long i;
+
+    for(i=first_bit; i<first_bit+n_bits; i++)
+	crc = CAN_XR_CRC_Bit(crc, get_bit(data, i));
+    return crc;
+}
+
+/* Update '*crc' up to the first byte boundary, or 'end', and return
+   the updated bit index.  Bit by bit up to the first nibble boundary,
+   then a nibble if possible.
+*/
+static unsigned long align(
+    uint16_t *crc, const uint8_t *data, unsigned long i, unsigned long end)
+{
+    while(i < end && (i & 0x3))
+    {
+	*crc = CAN_XR_CRC_Bit(*crc, get_bit(data, i));
+	i++;
+    }
+
+    if((i & 0x7) && end - i >= 4)
+    {
+	*crc = CAN_XR_CRC_Nibble(*crc, data[i >> 3]);
+	i += 4;
+    }
+
+    return i;
+}
+
+uint16_t CAN_XR_CRC_Update(
+    uint16_t crc, const uint8_t *data,
+    unsigned long first_bit, unsigned long n_bits)
+{
+    unsigned long end = first_bit + n_bits;
+    unsigned long i = align(&crc, data, first_bit, end);
+
+    /* Now i is byte-aligned, or there are less than 4 bits left. */
+    for(; end - i >= 8; i += 8)
+	crc = CAN_XR_CRC_Byte(crc, data[i >> 3]);
+
+    if(end - i >= 4)
+    {
+	crc = CAN_XR_CRC_Nibble(crc, data[i >> 3] >> 4);
+	i += 4;
+    }
+
+    for(; i < end; i++)
+	crc = CAN_XR_CRC_Bit(crc, get_bit(data, i));
+
+    return crc;
+}
+
+void CAN_XR_CRC_Slice_Init(struct CAN_XR_CRC_Slice_Tables *tables)
+{
+    int s, x;
+
+    /* table[s][x] is the CRC of x followed by s zero bytes. */
+    for(x=0; x<256; x++)
+	tables->table[0][x] = byte_table[x];
+    for(s=1; s<CAN_XR_CRC_SLICES; s++)
+	for(x=0; x<256; x++)
+	    tables->table[s][x] = CAN_XR_CRC_Byte(tables->table[s-1][x], 0);
+}
+
+uint16_t CAN_XR_CRC_Slice_Update(
+    const struct CAN_XR_CRC_Slice_Tables *tables,
+    uint16_t crc, const uint8_t *data,
+    unsigned long first_bit, unsigned long n_bits)
+{
+    unsigned long end = first_bit + n_bits;
+    unsigned long i = align(&crc, data, first_bit, end);
+    const uint8_t *p;
+    uint64_t x;
+    int s;
+
+    /* Like the byte engine, but crc goes into the MSbs of a
+       CAN_XR_CRC_SLICES bytes word, then each byte of the word is
+       looked up in the table that accounts for the bytes that follow
+       it.
+    */
+    for(; end - i >= 8 * CAN_XR_CRC_SLICES; i += 8 * CAN_XR_CRC_SLICES)
+    {
+	p = &data[i >> 3];
+	x = (uint64_t)crc << (8 * CAN_XR_CRC_SLICES - 15);
+	for(s=0; s<CAN_XR_CRC_SLICES; s++)
+	    x ^= (uint64_t)p[s] << (8 * (CAN_XR_CRC_SLICES - 1 - s));
+
+	crc = 0;
+	for(s=0; s<CAN_XR_CRC_SLICES; s++)
+	    crc ^= tables->table[s][(x >> (8 * s)) & 0xFF];
+    }
+
+    /* Aligned, or less than 4 bits left, the byte engine does the
+       rest.
+    */
+    return CAN_XR_CRC_Update(crc, data, i, end - i);
+}
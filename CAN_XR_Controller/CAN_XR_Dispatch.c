@@ -0,0 +1,99 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This file implements the dispatch table.  See CAN_XR_Dispatch.h for
+   more information.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "CAN_XR_Dispatch.h"
+
+void CAN_XR_Dispatch_Init(struct CAN_XR_Dispatch *dispatch)
+{
+    memset(dispatch->index, 0, sizeof(dispatch->index));
+    dispatch->n_subscribers = 0;
+}
+
+int CAN_XR_Dispatch_Subscribe(
+    struct CAN_XR_Dispatch *dispatch, uint32_t first, uint32_t last,
+    CAN_XR_Dispatch_Callback_t callback, void *ctx)
+{
+    uint32_t id;
+    int s;
+
+    if(first > last || last >= CAN_XR_DISPATCH_IDS)
+	return -1;
+
+    /* Look for the same subscriber first */
+    for(s=0; s<dispatch->n_subscribers; s++)
+	if(dispatch->subscribers[s].callback == callback
+	   && dispatch->subscribers[s].ctx == ctx)
+	    break;
+
+    if(s == dispatch->n_subscribers)
+    {
+	if(s == CAN_XR_DISPATCH_SUBSCRIBERS)
+	    return -1;
+
+	dispatch->subscribers[s].callback = callback;
+	dispatch->subscribers[s].ctx = ctx;
+	dispatch->n_subscribers++;
+    }
+
+    for(id=first; id<=last; id++)
+	dispatch->index[id] = s + 1;
+
+    return s;
+}
+
+void CAN_XR_Dispatch_Unsubscribe(
+    struct CAN_XR_Dispatch *dispatch, uint32_t first, uint32_t last)
+{
+    uint32_t id;
+
+    if(last >= CAN_XR_DISPATCH_IDS)
+	last = CAN_XR_DISPATCH_IDS - 1;
+
+    for(id=first; id<=last; id++)
+	dispatch->index[id] = 0;
+}
+
+int CAN_XR_Dispatch_Ind(
+    const struct CAN_XR_Dispatch *dispatch, unsigned long ts,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc,
+    uint8_t *data)
+{
+    unsigned int i = dispatch->index[identifier];
+    const struct CAN_XR_Dispatch_Subscriber *s;
+
+    if(i == 0)
+	return 0;
+
+    s = &(dispatch->subscribers[i - 1]);
+    s->callback(s->ctx, ts, identifier, format, dlc, data);
+    return 1;
+}
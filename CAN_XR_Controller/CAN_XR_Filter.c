@@ -0,0 +1,73 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This file implements the acceptance filter.  See CAN_XR_Filter.h for
+   more information.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "CAN_XR_Filter.h"
+
+void CAN_XR_Filter_Init(struct CAN_XR_Filter *filter, int accept_all)
+{
+    memset(filter->bitmap, accept_all ? 0xFF : 0x00, sizeof(filter->bitmap));
+}
+
+void CAN_XR_Filter_Add_Id(struct CAN_XR_Filter *filter, uint32_t identifier)
+{
+    if(identifier < CAN_XR_FILTER_IDS)
+	filter->bitmap[identifier >> 5] |= (uint32_t)1 << (identifier & 0x1F);
+}
+
+void CAN_XR_Filter_Remove_Id(
+    struct CAN_XR_Filter *filter, uint32_t identifier)
+{
+    if(identifier < CAN_XR_FILTER_IDS)
+	filter->bitmap[identifier >> 5] &= ~((uint32_t)1 << (identifier & 0x1F));
+}
+
+void CAN_XR_Filter_Add_Mask(
+    struct CAN_XR_Filter *filter, uint32_t code, uint32_t mask)
+{
+    uint32_t dont_care = ~mask & (CAN_XR_FILTER_IDS - 1);
+    uint32_t base = code & mask & (CAN_XR_FILTER_IDS - 1);
+    uint32_t sub = 0;
+
+    /* Enumerate all subsets of the "don't care" bits. */
+    do
+    {
+	CAN_XR_Filter_Add_Id(filter, base | sub);
+	sub = (sub - dont_care) & dont_care;
+    } while(sub != 0);
+}
+
+int CAN_XR_Filter_Accepts(
+    const struct CAN_XR_Filter *filter, uint32_t identifier)
+{
+    return identifier < CAN_XR_FILTER_IDS
+	&& CAN_XR_FILTER_ACCEPTS(filter, identifier);
+}
@@ -0,0 +1,249 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This file implements the store-and-forward gateway.  See
+   CAN_XR_Gateway.h for more information.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "CAN_XR_Gateway.h"
+#include "CAN_XR_Trace.h"
+
+/* Queue a frame of route 'r' on side 'to', which has a free TX slot.
+   Record it before the request, because an unsupported format is
+   confirmed right away.
+*/
+static void submit(
+    struct CAN_XR_Gateway_Side *to, int route, unsigned long rx_ts,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct CAN_XR_Gateway_Pending *p = &to->pending[to->n_pending++];
+
+    p->identifier = identifier;
+    p->route = route;
+    p->measured = 0;
+    p->rx_ts = rx_ts;
+
+    to->gw->routes[route].n_forwarded++;
+    CAN_XR_MAC_Data_Req(to->mac, identifier, format, dlc, data);
+}
+
+/* Submit the frames in the backlog of side 's', while it has free TX
+   slots.
+*/
+static void drain(struct CAN_XR_Gateway_Side *s)
+{
+    struct CAN_XR_Gateway_Held h;
+    int i;
+
+    while(s->n_held > 0
+	  && s->mac->state.data_req_pending < CAN_XR_MAC_TX_SLOTS)
+    {
+	h = s->held[0];
+	s->n_held--;
+	for(i=0; i<s->n_held; i++)
+	    s->held[i] = s->held[i+1];
+
+	submit(s, h.route, h.rx_ts, h.identifier, h.format, h.dlc,
+	       CAN_XR_Pool_Data(h.pool, h.frame));
+	CAN_XR_Pool_Release(h.pool, h.frame);
+    }
+}
+
+/* Dispatch callback of all routes, 'ctx' is the route. */
+static void forward(
+    void *ctx, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct CAN_XR_Gateway_Route *r = ctx;
+    struct CAN_XR_MAC *from = r->gw->side[r->from].mac;
+    struct CAN_XR_Gateway_Side *to = &r->gw->side[1 - r->from];
+    struct CAN_XR_Gateway_Held *h;
+    int frame;
+
+    /* The transmitter receives its own frames, too.  Do not send
+       them back.
+    */
+    if(from->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME)
+	return;
+
+    identifier = r->identifier + (identifier - r->first);
+    if(r->transform)
+	dlc = r->transform(r->ctx, identifier, format, dlc, data);
+
+    if(dlc < 0)
+	frame = -1;
+
+    /* Keep the order of the backlog */
+    else if(to->n_held == 0
+	    && to->mac->state.data_req_pending < CAN_XR_MAC_TX_SLOTS)
+    {
+	submit(to, r - r->gw->routes, ts, identifier, format, dlc, data);
+	return;
+    }
+
+    else if(to->n_held < CAN_XR_GATEWAY_BACKLOG)
+	frame = CAN_XR_Pool_Hold(from->pool, data);
+
+    else
+	frame = -1;
+
+    if(frame < 0)
+    {
+	TRACE(2, "Gateway::forward(%lu) dropped", (unsigned long)identifier);
+	r->n_dropped++;
+	return;
+    }
+
+    h = &to->held[to->n_held++];
+    h->pool = from->pool;
+    h->frame = frame;
+    h->identifier = identifier;
+    h->format = format;
+    h->dlc = dlc;
+    h->route = r - r->gw->routes;
+    h->rx_ts = ts;
+    r->n_backlogged++;
+}
+
+/* SOF of a frame on side 'llc'.  Frames with the same identifier go
+   out in order, so the first one not measured yet is this one.
+   Retransmissions are not measured again.
+*/
+static void tx_sof_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier)
+{
+    struct CAN_XR_Gateway_Side *s = (struct CAN_XR_Gateway_Side *)llc;
+    struct CAN_XR_Gateway_Route *r;
+    unsigned long latency;
+    int i;
+
+    for(i=0; i<s->n_pending; i++)
+	if(s->pending[i].identifier == identifier)
+	    break;
+
+    if(i == s->n_pending || s->pending[i].measured)
+	return;
+
+    s->pending[i].measured = 1;
+    r = &s->gw->routes[s->pending[i].route];
+    latency = ts - s->pending[i].rx_ts;
+    if(!r->n_measured || latency < r->latency_min)
+	r->latency_min = latency;
+    if(!r->n_measured || latency > r->latency_max)
+	r->latency_max = latency;
+    r->latency_sum += latency;
+    r->n_measured++;
+}
+
+/* Confirmation of a frame on side 'llc', forget it and make room
+   for the backlog.
+*/
+static void data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    struct CAN_XR_Gateway_Side *s = (struct CAN_XR_Gateway_Side *)llc;
+    int i;
+
+    for(i=0; i<s->n_pending; i++)
+	if(s->pending[i].identifier == identifier)
+	    break;
+
+    if(i < s->n_pending)
+    {
+	if(transmission_status != CAN_XR_MAC_TX_STATUS_SUCCESS)
+	    s->gw->routes[s->pending[i].route].n_failed++;
+
+	s->n_pending--;
+	for(; i<s->n_pending; i++)
+	    s->pending[i] = s->pending[i+1];
+    }
+
+    /* The slot is free already */
+    drain(s);
+}
+
+void CAN_XR_Gateway_Init(
+    struct CAN_XR_Gateway *gw, struct CAN_XR_MAC *mac0,
+    struct CAN_XR_MAC *mac1)
+{
+    struct CAN_XR_MAC *mac[2] = { mac0, mac1 };
+    int i;
+
+    for(i=0; i<2; i++)
+    {
+	gw->side[i].gw = gw;
+	gw->side[i].mac = mac[i];
+	gw->side[i].n_pending = 0;
+	gw->side[i].n_held = 0;
+	CAN_XR_Dispatch_Init(&gw->side[i].dispatch);
+
+	CAN_XR_MAC_Set_LLC(mac[i], (struct CAN_XR_LLC *)&gw->side[i]);
+	CAN_XR_MAC_Set_Data_Conf(mac[i], data_conf);
+	CAN_XR_MAC_Set_TX_SOF_Ind(mac[i], tx_sof_ind);
+	CAN_XR_MAC_Set_Dispatch(mac[i], &gw->side[i].dispatch);
+    }
+
+    gw->n_routes = 0;
+}
+
+int CAN_XR_Gateway_Add_Route(
+    struct CAN_XR_Gateway *gw, int from, uint32_t first, uint32_t last,
+    uint32_t identifier, CAN_XR_Gateway_Transform_t transform, void *ctx)
+{
+    struct CAN_XR_Gateway_Route *r;
+
+    if(from < 0 || from > 1 || first > last || last >= CAN_XR_DISPATCH_IDS
+       || identifier + (last - first) >= CAN_XR_DISPATCH_IDS
+       || gw->n_routes == CAN_XR_GATEWAY_ROUTES)
+	return -1;
+
+    r = &gw->routes[gw->n_routes];
+    memset(r, 0, sizeof(*r));
+    r->gw = gw;
+    r->from = from;
+    r->first = first;
+    r->last = last;
+    r->identifier = identifier;
+    r->transform = transform;
+    r->ctx = ctx;
+
+    if(CAN_XR_MAC_Subscribe(gw->side[from].mac, first, last, forward, r) < 0)
+	return -1;
+
+    return gw->n_routes++;
+}
+
+const struct CAN_XR_Gateway_Route *CAN_XR_Gateway_Get_Route(
+    const struct CAN_XR_Gateway *gw, int n)
+{
+    if(n < 0 || n >= gw->n_routes)
+	return NULL;
+
+    return &gw->routes[n];
+}
@@ -35,6 +35,7 @@
 #include <string.h>
 #include "CAN_XR_PCS.h"
 #include "CAN_XR_MAC.h"
+#include "CAN_XR_CRC.h"
 #include "CAN_XR_Trace.h"
 
 
@@ -55,19 +56,532 @@
     } while(0)
 
 
+/* Bit stream encoder state, used by tx_encode.  The CRC and stuff
+   bit count are used only by tx_encode_fd.  tx_encode_xl uses nc_bits
+   and nc_pol for fixed stuff bits, see put_fixed.
+*/
+struct encoder
+{
+    uint32_t *bitstream;
+    int n_bits;
+    int nc_bits;
+    int nc_pol;
+    uint32_t crc;
+    uint32_t (*crc_bit)(uint32_t crc, int nxtbit);
+    int stuff_count;
+};
+
+/* Append bit b to the bit stream at position n, without stuffing.
+   The bit stream must have been cleared beforehand.
+*/
+#define put_raw(bitstream, n, b)					\
+    do {								\
+	(bitstream)[(n) >> 5] |= (uint32_t)(b) << (31 - ((n) & 0x1F));	\
+	(n)++;								\
+    } while(0)
+
+/* Append the n_bits LSbs of v to the bit stream, MSb first, and
+   insert stuff bits after 5 consecutive bits of the same polarity,
+   [1] 10.5.
+*/
+static void put_stuffed(struct encoder *e, uint32_t v, int n_bits)
+{
+    uint32_t *bitstream = e->bitstream;
+    int n = e->n_bits, nc_bits = e->nc_bits, nc_pol = e->nc_pol;
+    int b;
+
+    while(n_bits-- > 0)
+    {
+	b = (v >> n_bits) & 0x1;
+	put_raw(bitstream, n, b);
+
+	if(b == nc_pol)
+	{
+	    if(++nc_bits == 5)
+	    {
+		nc_pol = 1 - b;
+		nc_bits = 1;
+		put_raw(bitstream, n, nc_pol);
+	    }
+	}
+
+	else
+	{
+	    nc_bits = 1;
+	    nc_pol = b;
+	}
+    }
+
+    e->n_bits = n;
+    e->nc_bits = nc_bits;
+    e->nc_pol = nc_pol;
+}
+
+/* Same as put_stuffed, for FD frames.  The CRC covers all bits, stuff
+   bits included, [1] 10.4.2.6.  A stuff bit is inserted only when the
+   next bit comes, because a fixed stuff bit takes its place at the
+   end of the data field, [1] 10.5.  Dynamic stuff bits are counted
+   for the stuff count.
+*/
+static void put_stuffed_fd(struct encoder *e, uint32_t v, int n_bits)
+{
+    uint32_t *bitstream = e->bitstream;
+    int n = e->n_bits, nc_bits = e->nc_bits, nc_pol = e->nc_pol;
+    int b;
+
+    while(n_bits-- > 0)
+    {
+	b = (v >> n_bits) & 0x1;
+
+	if(nc_bits == 5)
+	{
+	    nc_pol = 1 - nc_pol;
+	    nc_bits = 1;
+	    put_raw(bitstream, n, nc_pol);
+	    e->crc = e->crc_bit(e->crc, nc_pol);
+	    e->stuff_count++;
+	}
+
+	put_raw(bitstream, n, b);
+	e->crc = e->crc_bit(e->crc, b);
+
+	if(b == nc_pol)
+	    nc_bits++;
+
+	else
+	{
+	    nc_bits = 1;
+	    nc_pol = b;
+	}
+    }
+
+    e->n_bits = n;
+    e->nc_bits = nc_bits;
+    e->nc_pol = nc_pol;
+}
+
+/* Append the n_bits LSbs of v to the bit stream, MSb first, with a
+   fixed stuff bit, the complement of the bit before it, after every
+   10 bits, as in the data phase of XL frames, [2].  nc_bits counts
+   the bits since the last fixed stuff bit, and nc_pol is the last
+   bit.  Like in put_stuffed_fd, a stuff bit is inserted only when the
+   next bit comes.
+*/
+static void put_fixed(struct encoder *e, uint32_t v, int n_bits)
+{
+    while(n_bits-- > 0)
+    {
+	if(e->nc_bits == 10)
+	{
+	    put_raw(e->bitstream, e->n_bits, 1 - e->nc_pol);
+	    e->nc_bits = 0;
+	}
+
+	e->nc_pol = (v >> n_bits) & 0x1;
+	put_raw(e->bitstream, e->n_bits, e->nc_pol);
+	e->nc_bits++;
+    }
+}
+
+/* Update 'crc' with the n_bits LSbs of v, MSb first, with the bit
+   engine 'crc_bit'.
+*/
+static uint32_t crc_update(
+    uint32_t crc, uint32_t (*crc_bit)(uint32_t, int), uint32_t v, int n_bits)
+{
+    while(n_bits-- > 0)
+	crc = crc_bit(crc, (v >> n_bits) & 0x1);
+    return crc;
+}
+
+/* Return the stuff count field for 'n_stuff' dynamic stuff bits:
+   their number modulo 8, Gray-coded, followed by its even parity bit,
+   [1] 10.4.2.6.  XL frames have the same field, [2].
+*/
+static int stuff_count_code(int n_stuff)
+{
+    int sc = n_stuff & 0x7;
+
+    sc ^= sc >> 1;
+    return (sc << 1) | ((sc ^ (sc >> 1) ^ (sc >> 2)) & 0x1);
+}
+
+/* Clear the first words of 'bitstream', enough for 'n_bits' bits.
+   Clearing the whole of it would be a waste of time with long XL
+   frames enabled.
+*/
+static void clear_bitstream(uint32_t *bitstream, int n_bits)
+{
+    memset(bitstream, 0, ((n_bits + 31) >> 5) * sizeof(uint32_t));
+}
+
+/* Encode the CBFF frame described by the identifier, dlc, and data
+   of 'slot' into its bitstream, from SOF to EOF, stuff bits
+   included, so that the transmit automaton just has to shift it out.
+   FBFF and XLFF frames are encoded by tx_encode_fd and tx_encode_xl.
+
+   The header, from SOF to DLC, and the CRC and bit stuffing state at
+   its end are taken from tx_header_cache if possible.  The CRC is
+   calculated here with the table-driven engines of CAN_XR_CRC.h,
+   rather than by the receive automaton while transmitting.
+*/
+static void tx_encode(struct CAN_XR_MAC *mac, struct CAN_XR_MAC_TX_Slot *slot)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+    uint16_t key = ((slot->identifier & 0x7FF) << 4) | (slot->dlc & 0xF);
+    struct CAN_XR_MAC_TX_Header *h =
+	&s->tx_header_cache[
+	    slot->identifier & (CAN_XR_MAC_TX_HEADER_CACHE_SIZE - 1)];
+    int n_data = (slot->dlc > 8) ? 8 : slot->dlc;
+    struct encoder e;
+    uint32_t header;
+    uint16_t crc;
+    int i;
+
+    clear_bitstream(slot->bitstream, CAN_XR_MAC_FD_MAX_BITS(8));
+    e.bitstream = slot->bitstream;
+
+    if(h->key != key)
+    {
+	/* Cache miss, encode SOF, identifier, RTR, IDE, FDF, all
+	   dominant in CBFF, and DLC.  The header is 19 bits long, 3
+	   of them go into the CRC one at a time, the others a nibble
+	   at a time.
+	*/
+	TRACE(2, "MAC Common::tx_encode header cache miss %04x", key);
+
+	header = ((slot->identifier & 0x7FF) << 7) | (slot->dlc & 0xF);
+	e.n_bits = 0;
+	e.nc_bits = 0;
+	e.nc_pol = -1;
+	put_stuffed(&e, header, 19);
+
+	crc = 0x0000;
+	for(i=18; i>=16; i--)
+	    crc = CAN_XR_CRC_Bit(crc, header >> i);
+	for(i=12; i>=0; i-=4)
+	    crc = CAN_XR_CRC_Nibble(crc, header >> i);
+
+	h->key = key;
+	h->crc = crc;
+	h->bits = slot->bitstream[0];
+	h->n_bits = e.n_bits;
+	h->nc_bits = e.nc_bits;
+	h->nc_pol = e.nc_pol;
+    }
+
+    else
+    {
+	/* The header is shorter than 32 bits, even with stuff bits */
+	slot->bitstream[0] = h->bits;
+	e.n_bits = h->n_bits;
+	e.nc_bits = h->nc_bits;
+	e.nc_pol = h->nc_pol;
+	crc = h->crc;
+    }
+
+    for(i=0; i<n_data; i++)
+    {
+	crc = CAN_XR_CRC_Byte(crc, slot->data[i]);
+	put_stuffed(&e, slot->data[i], 8);
+    }
+
+    /* A stuff bit may follow the last bit of CRC */
+    put_stuffed(&e, crc, 15);
+
+    /* CDEL, ACK, ADEL, EOF, all recessive and not stuffed.  We don't
+       want to self-acknowledge the frame, see tx_processing_ind.
+    */
+    for(i=0; i<10; i++)
+	put_raw(e.bitstream, e.n_bits, 1);
+
+    slot->bitstream_bits = e.n_bits;
+}
+
+/* Return non-zero if the node is error passive, [1] 12.1.4.1. */
+static int error_passive(const struct CAN_XR_MAC_State *s)
+{
+    return s->tec > 127 || s->rec > 127;
+}
+
+/* Same as tx_encode, for FBFF frames, [1] 10.4.2.  The header cache is
+   not used, and the CRC is calculated bit by bit, because it covers
+   the stuff bits, too.
+
+   After the data field, the stuff count is the number of dynamic
+   stuff bits modulo 8, Gray-coded, followed by its even parity bit,
+   [1] 10.4.2.6.  It is followed by the CRC, and a fixed stuff bit,
+   the complement of the bit before it, precedes the stuff count and
+   every 4 bits after it, [1] 10.5.
+
+   The ESI bit tells whether the transmitter is error passive.  It
+   changes rarely, so it is encoded here according to the current
+   state, and the frame is encoded again if the state has changed when
+   the transmission starts, see tx_processing_ind.
+*/
+static void tx_encode_fd(
+    struct CAN_XR_MAC *mac, struct CAN_XR_MAC_TX_Slot *slot)
+{
+    int n_data = CAN_XR_FD_DATA_LENGTH(slot->dlc & 0xF);
+    int crc_bits = (n_data > 16) ? 21 : 17;
+    int brs = (mac->fd_mode == CAN_XR_MAC_FD_BRS);
+    struct encoder e;
+    uint32_t header, v;
+    int i, b, last;
+
+    clear_bitstream(slot->bitstream, CAN_XR_MAC_FD_MAX_BITS(n_data));
+    e.bitstream = slot->bitstream;
+    e.n_bits = 0;
+    e.nc_bits = 0;
+    e.nc_pol = -1;
+    e.crc = (crc_bits == 21) ? CAN_XR_CRC21_INIT : CAN_XR_CRC17_INIT;
+    e.crc_bit = (crc_bits == 21) ? CAN_XR_CRC21_Bit : CAN_XR_CRC17_Bit;
+    e.stuff_count = 0;
+
+    /* SOF, identifier, RRS, IDE, FDF, res, BRS, ESI and DLC.  Only
+       FDF is always recessive.
+    */
+    slot->esi = error_passive(&mac->state);
+    header = ((slot->identifier & 0x7FF) << 10) | (1 << 7)
+	| (brs << 5) | (slot->esi << 4) | (slot->dlc & 0xF);
+    put_stuffed_fd(&e, header, 22);
+
+    for(i=0; i<n_data; i++)
+	put_stuffed_fd(&e, slot->data[i], 8);
+
+    /* Stuff count, then CRC, in v */
+    v = stuff_count_code(e.stuff_count);
+    for(i=3; i>=0; i--)
+	e.crc = e.crc_bit(e.crc, v >> i);
+    v = (v << crc_bits) | e.crc;
+
+    last = e.nc_pol;
+    for(i=4+crc_bits-1; i>=0; i--)
+    {
+	if((4 + crc_bits - 1 - i) % 4 == 0)
+	    put_raw(e.bitstream, e.n_bits, 1 - last);
+
+	b = (v >> i) & 0x1;
+	put_raw(e.bitstream, e.n_bits, b);
+	last = b;
+    }
+
+    /* CDEL, ACK, ADEL, EOF, as in tx_encode */
+    for(i=0; i<10; i++)
+	put_raw(e.bitstream, e.n_bits, 1);
+
+    slot->bitstream_bits = e.n_bits;
+}
+
+/* Same as tx_encode, for XL frames, [2].
+
+   The arbitration field, SOF to resXL, has dynamic stuff bits like
+   the other formats.  Then comes the arbitration to data sequence
+   (ADS), ADH, DH1, DH2 and DL1, whose bit rate switch and edges must
+   not be disturbed by stuff bits.  From SDT to FCRC, a fixed stuff
+   bit comes every 10 bits.  FCP, the data to arbitration sequence
+   (DAS), DAH, AH1, AL1 and AH2, and the frame trailer have none.
+
+   The PCRC covers the bits from SOF to SBC, dynamic stuff bits
+   included, and the FCRC covers the same bits and the following ones
+   up to the end of the data field.  ADS and fixed stuff bits are
+   covered by neither.  The data bytes go into the FCRC a byte at a
+   time.
+*/
+static void tx_encode_xl(
+    struct CAN_XR_MAC *mac, struct CAN_XR_MAC_TX_Slot *slot)
+{
+    int n_data = CAN_XR_XL_DATA_LENGTH(slot->dlc);
+    const struct CAN_XR_XL_Control *xl = &slot->xl;
+    struct encoder e;
+    uint32_t pcrc = CAN_XR_PCRC_INIT, fcrc = CAN_XR_FCRC_INIT;
+    uint32_t v;
+    int i, b;
+
+    clear_bitstream(slot->bitstream, CAN_XR_MAC_XL_MAX_BITS(n_data));
+    e.bitstream = slot->bitstream;
+    e.n_bits = 0;
+    e.nc_bits = 0;
+    e.nc_pol = -1;
+
+    /* SOF, identifier, RRS, IDE, FDF, XLF and resXL.  FDF and XLF
+       are recessive, and resXL dominant right after them never needs
+       a stuff bit.  Both CRCs cover the bits we just encoded, stuff
+       bits included.
+    */
+    put_stuffed(&e, ((slot->identifier & 0x7FF) << 5) | 0x6, 17);
+    for(i=0; i<e.n_bits; i++)
+    {
+	b = (e.bitstream[i >> 5] << (i & 0x1F)) >> 31;
+	pcrc = CAN_XR_PCRC_Bit(pcrc, b);
+	fcrc = CAN_XR_FCRC_Bit(fcrc, b);
+    }
+
+    /* SDT, SEC, DLC and SBC, after ADS */
+    v = ((uint32_t)xl->sdt << 16) | ((uint32_t)(xl->sec & 0x1) << 15)
+	| ((uint32_t)(slot->dlc & 0x7FF) << 4)
+	| stuff_count_code(e.n_bits - 17);
+
+    for(i=0; i<3; i++)
+	put_raw(e.bitstream, e.n_bits, 1);
+    put_raw(e.bitstream, e.n_bits, 0);
+    e.nc_bits = 0;
+    e.nc_pol = 0;
+
+    pcrc = crc_update(pcrc, CAN_XR_PCRC_Bit, v, 24);
+    fcrc = crc_update(fcrc, CAN_XR_FCRC_Bit, v, 24);
+    put_fixed(&e, v, 24);
+
+    /* PCRC, VCID, AF, and data field */
+    fcrc = crc_update(fcrc, CAN_XR_FCRC_Bit, pcrc, 13);
+    put_fixed(&e, pcrc, 13);
+    fcrc = crc_update(fcrc, CAN_XR_FCRC_Bit, xl->vcid, 8);
+    put_fixed(&e, xl->vcid, 8);
+    fcrc = crc_update(fcrc, CAN_XR_FCRC_Bit, xl->af, 32);
+    put_fixed(&e, xl->af, 32);
+
+    for(i=0; i<n_data; i++)
+    {
+	fcrc = CAN_XR_FCRC_Byte(fcrc, slot->data[i]);
+	put_fixed(&e, slot->data[i], 8);
+    }
+
+    put_fixed(&e, fcrc, 32);
+
+    /* FCP 1100, DAS 1101, then ACK, ADEL and EOF, all recessive */
+    for(i=7; i>=0; i--)
+	put_raw(e.bitstream, e.n_bits, (0xCD >> i) & 0x1);
+    for(i=0; i<9; i++)
+	put_raw(e.bitstream, e.n_bits, 1);
+
+    slot->bitstream_bits = e.n_bits;
+}
+
+/* Insert slot 'n' into tx_queue, after all frames with the same or a
+   higher priority.
+*/
+static void tx_queue_insert(struct CAN_XR_MAC_State *s, int n)
+{
+    uint32_t identifier = s->tx_slots[n].identifier;
+    int i = s->data_req_pending;
+
+    while(i > 0 && s->tx_slots[s->tx_queue[i-1]].identifier > identifier)
+    {
+	s->tx_queue[i] = s->tx_queue[i-1];
+	i--;
+    }
+
+    s->tx_queue[i] = n;
+    s->tx_slot_map |= (uint32_t)1 << n;
+    s->data_req_pending++;
+}
+
+/* Remove tx_queue[i] from tx_queue and free its slot. */
+static void tx_queue_remove(struct CAN_XR_MAC_State *s, int i)
+{
+    s->tx_slot_map &= ~((uint32_t)1 << s->tx_queue[i]);
+    s->data_req_pending--;
+    for(; i<s->data_req_pending; i++)
+	s->tx_queue[i] = s->tx_queue[i+1];
+}
+
+/* Load the frame with the highest priority in tx_queue, which must
+   not be empty, as the frame being transmitted.  The data and the
+   bitstream are not copied, they are used right from the slot, which
+   stays in tx_queue until tx_release.
+*/
+static void tx_load(struct CAN_XR_MAC_State *s)
+{
+    const struct CAN_XR_MAC_TX_Slot *slot = &s->tx_slots[s->tx_queue[0]];
+
+    s->tx_slot = s->tx_queue[0];
+    s->tx_identifier = slot->identifier;
+    s->tx_format = slot->format;
+    s->tx_dlc = slot->dlc;
+    s->tx_bitstream_bits = slot->bitstream_bits;
+}
+
+/* Return the bit of the frame being transmitted at 'index'. */
+static inline int tx_bit(const struct CAN_XR_MAC_State *s, int index)
+{
+    return (s->tx_slots[s->tx_slot].bitstream[index >> 5]
+	    << (index & 0x1F)) >> 31;
+}
+
+/* Free the slot of the frame being transmitted, if any. */
+static void tx_release(struct CAN_XR_MAC_State *s)
+{
+    int i;
+
+    for(i=0; i<s->data_req_pending; i++)
+	if(s->tx_queue[i] == s->tx_slot)
+	{
+	    tx_queue_remove(s, i);
+	    break;
+	}
+
+    s->tx_slot = -1;
+}
+
+/* Encode an XL frame into a free TX slot and queue it, see
+   mac_data_req.  'xl' holds its additional fields.
+*/
+static void mac_xl_data_req(
+    struct CAN_XR_MAC *mac, uint32_t identifier,
+    const struct CAN_XR_XL_Control *xl, int dlc, uint8_t *data)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+    struct CAN_XR_MAC_TX_Slot *slot;
+    int n;
+
+    TRACE(2, "MAC Common::mac_xl_data_req(%lu, ...)",
+	  (unsigned long)identifier);
+
+    /* Same checks as mac_data_req, and the data must fit */
+    if(s->data_req_pending == CAN_XR_MAC_TX_SLOTS || !mac->xl_mode
+       || CAN_XR_XL_DATA_LENGTH(dlc) > CAN_XR_MAX_DATA)
+    {
+	/* TBD: ts not in scope, as in mac_data_req. */
+	if(mac->primitives.data_conf)
+	    mac->primitives.data_conf(
+		mac->llc, 0, identifier, CAN_XR_MAC_TX_STATUS_NO_SUCCESS);
+	return;
+    }
+
+    n = __builtin_ctz(~s->tx_slot_map);
+    slot = &s->tx_slots[n];
+    slot->identifier = identifier;
+    slot->format = CAN_XR_FORMAT_XLFF;
+    slot->dlc = dlc & 0x7FF;
+    slot->xl = *xl;
+    memcpy(slot->data, data, CAN_XR_XL_DATA_LENGTH(dlc));
+    tx_encode_xl(mac, slot);
+    tx_queue_insert(s, n);
+}
+
 /* MAC_Data.Request primitive invoked by upper later (typically LLC) to
-   request the transmission of a frame.
+   request the transmission of a frame.  The frame is encoded into a
+   free TX slot right away, and queued by priority.  The transmit
+   automaton picks the frame with the highest priority whenever it
+   starts a transmission, so several frames can be submitted in a row
+   and go out back to back, without waiting for their
+   MAC_Data.Confirm.
 */
 static void mac_data_req(
     struct CAN_XR_MAC *mac,
     uint32_t identifier, enum CAN_XR_Format format, int dlc, uint8_t *data)
 {
+    static const struct CAN_XR_XL_Control no_xl_control = { 0, 0, 0, 0 };
+    struct CAN_XR_MAC_State *s = &mac->state;
+    struct CAN_XR_MAC_TX_Slot *slot;
+    int n;
+
     TRACE(2, "MAC Common::mac_data_req(%lu, ...)", (unsigned long)identifier);
 
-    /* Check if there is a pending transmission request already, of
-       any kind.  This would be an LLC handshake error.
+    /* Check if there is a free TX slot.  If not, this is an LLC
+       flow control error.
     */
-    if(mac->state.data_req_pending)
+    if(s->data_req_pending == CAN_XR_MAC_TX_SLOTS)
     {
 	if(mac->primitives.data_conf)
 	    mac->primitives.data_conf(
@@ -80,16 +594,42 @@ static void mac_data_req(
 	switch(format)
 	{
 	case CAN_XR_FORMAT_CBFF:
-	    /* Save arguments in MAC state for later use. */
-	    mac->state.tx_identifier = identifier;
-	    mac->state.tx_format = format; /* TBD: We'll support more */
-	    mac->state.tx_dlc = dlc;
-	    /* Clear tx_data completely, then fill the right amount */
-	    memset(mac->state.tx_data, 0, sizeof(mac->state.tx_data));
-	    memcpy(mac->state.tx_data, data, dlc);
-	    mac->state.data_req_pending = 1;
+	    /* Save arguments in the lowest free slot for later use. */
+	    n = __builtin_ctz(~s->tx_slot_map);
+	    slot = &s->tx_slots[n];
+	    slot->identifier = identifier;
+	    slot->format = format; /* TBD: We'll support more */
+	    slot->dlc = dlc;
+	    /* Clear data completely, then fill the right amount */
+	    memset(slot->data, 0, CAN_XR_MAC_FD_MAX_DATA);
+	    memcpy(slot->data, data, (dlc > 8) ? 8 : dlc);
+	    tx_encode(mac, slot);
+	    tx_queue_insert(s, n);
 	    break;
 
+	case CAN_XR_FORMAT_XLFF:
+	    /* No additional fields, see CAN_XR_MAC_Set_XL_Mode */
+	    mac_xl_data_req(mac, identifier, &no_xl_control, dlc, data);
+	    break;
+
+	case CAN_XR_FORMAT_FBFF:
+	    /* Only if enabled, and if the data fit */
+	    if(mac->fd_mode != CAN_XR_MAC_FD_DISABLED
+	       && CAN_XR_FD_DATA_LENGTH(dlc & 0xF) <= CAN_XR_MAX_DATA)
+	    {
+		n = __builtin_ctz(~s->tx_slot_map);
+		slot = &s->tx_slots[n];
+		slot->identifier = identifier;
+		slot->format = format;
+		slot->dlc = dlc;
+		memset(slot->data, 0, CAN_XR_MAC_FD_MAX_DATA);
+		memcpy(slot->data, data, CAN_XR_FD_DATA_LENGTH(dlc & 0xF));
+		tx_encode_fd(mac, slot);
+		tx_queue_insert(s, n);
+		break;
+	    }
+	    /* Fall through */
+
 	default:
 	    /* Unsupported format.  Confirm with
 	       CAN_XR_MAC_TX_STATUS_NO_SUCCESS.
@@ -103,34 +643,321 @@ static void mac_data_req(
     }
 }
 
-#define CRC_POLYNOMIAL 0x4599 /* It's monic, MSb omitted */
+/* Abort primitive, see CAN_XR_MAC_Abort_Req_t.  Slots are freed
+   first, and confirmed afterwards, so that data_conf can submit new
+   frames right away.
+*/
+static void mac_abort_req(struct CAN_XR_MAC *mac, uint32_t identifier)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+    int n_aborted = 0;
+    int i = 0;
+
+    TRACE(2, "MAC Common::mac_abort_req(%lu)", (unsigned long)identifier);
+
+    while(i < s->data_req_pending)
+    {
+	if(s->tx_slots[s->tx_queue[i]].identifier == identifier
+	   && s->tx_queue[i] != s->tx_slot)
+	{
+	    tx_queue_remove(s, i);
+	    n_aborted++;
+	}
+	else
+	    i++;
+    }
+
+    /* TBD: ts not in scope, as in mac_data_req. */
+    while(n_aborted-- > 0)
+	if(mac->primitives.data_conf)
+	    mac->primitives.data_conf(
+		mac->llc, 0, identifier, CAN_XR_MAC_TX_STATUS_NO_SUCCESS);
+}
 
 /* From [1], 10.4.2.6.  Update crc considering the LSb of nxtbit.  It
-   is meant to be correct, not fast.
+   is meant to be correct, not fast.  It is the same as
+   CAN_XR_CRC_Bit, but static so that it can be inlined.  Table-driven
+   engines are of no use here, because bits arrive one at a time.
 */
 static uint16_t crc_nxtbit(uint16_t crc, uint16_t nxtbit)
 {
     int crcnxt = ((crc & 0x4000) >> 14) ^ nxtbit;
     crc = (crc << 1) & 0x7FFF; /* Shift in 0 */
-    if(crcnxt)  crc ^= CRC_POLYNOMIAL;
+    if(crcnxt)  crc ^= CAN_XR_CRC_POLYNOMIAL;
     return crc;
 }
 
+/* Update the FD CRCs with nxtbit.  We don't know which one we need,
+   if any, until FDF and DLC, so both run from SOF when FD frames are
+   enabled.
+*/
+static void rx_crc_fd(struct CAN_XR_MAC *mac, int nxtbit)
+{
+    if(mac->fd_mode != CAN_XR_MAC_FD_DISABLED)
+    {
+	mac->state.crc17 = CAN_XR_CRC17_Bit(mac->state.crc17, nxtbit);
+	mac->state.crc21 = CAN_XR_CRC21_Bit(mac->state.crc21, nxtbit);
+    }
+}
+
+/* Same as rx_crc_fd, for the XL CRCs.  They are needed only after
+   XLF, but run from SOF, too.
+*/
+static void rx_crc_xl(struct CAN_XR_MAC *mac, int nxtbit)
+{
+    if(mac->xl_mode)
+    {
+	mac->state.pcrc = CAN_XR_PCRC_Bit(mac->state.pcrc, nxtbit);
+	mac->state.fcrc = CAN_XR_FCRC_Bit(mac->state.fcrc, nxtbit);
+    }
+}
+
+/* Update all CRCs with nxtbit, from SOF to the end of the data field
+   or, in XL frames, to the end of the arbitration field.
+*/
+static void rx_crc(struct CAN_XR_MAC *mac, int nxtbit)
+{
+    mac->state.crc = crc_nxtbit(mac->state.crc, nxtbit);
+    rx_crc_fd(mac, nxtbit);
+    rx_crc_xl(mac, nxtbit);
+}
+
+/* Start receiving the CRC field, after the data field or after DLC if
+   there is none.  In FD frames, the stuff count comes first, [1]
+   10.4.2.6, and we calculate its expected value from the number of
+   stuff bits seen so far.  From now on, fixed stuff bits replace
+   dynamic ones, and nc_bits counts the bits since the last one, see
+   pcs_data_ind.  The first one comes right now.
+
+   In XL frames, the FCRC comes right after the data field, and fixed
+   stuff bits are already in place.
+*/
+static void rx_crc_start(struct CAN_XR_MAC *mac)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+
+    if(s->rx_xl)
+    {
+	s->field_bits = 31;
+	s->rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_FCRC;
+    }
+
+    else if(s->rx_fd)
+    {
+	s->rx_stuff_count =
+	    stuff_count_code(s->bus_bits - s->de_stuffed_bits);
+	s->rx_byte = 0;
+	s->rx_fixed_stuff = 4;
+	s->nc_bits = 4;
+	s->field_bits = 3;
+	s->rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_STUFF_COUNT;
+    }
+
+    else
+    {
+	s->field_bits = 14;
+	s->rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_CRC;
+    }
+}
+
+/* Error counting, [1] 12.1.4.2.  Add 'tec_n' to the transmit error
+   counter if we are the transmitter of the frame being signalled,
+   'rec_n' to the receive error counter otherwise.  The receive error
+   counter saturates at 255, whereas a transmit error counter above
+   255 brings the node bus off, [1] 12.1.4.3.  Return non-zero in
+   that case.
+
+   A bus off node drives the bus recessive and waits for 128
+   sequences of 11 recessive bits, counted with the bus integration
+   counter.
+*/
+static int error_count(
+    struct CAN_XR_MAC *mac, unsigned long ts, int tec_n, int rec_n)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+
+    if(!s->error_tx)
+    {
+	s->rec += rec_n;
+	if(s->rec > 255)  s->rec = 255;
+	return 0;
+    }
+
+    s->tec += tec_n;
+    if(s->tec <= 255)
+	return 0;
+
+    TRACE(9, ">>> MAC @%lu bus off", ts);
+
+    CAN_XR_PCS_Data_Req(mac->pcs, 1);
+    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
+    s->bus_integration_counter = 0;
+    s->bus_off_count = 0;
+    s->rx_fsm_state = CAN_XR_MAC_RX_FSM_BUS_OFF;
+    return 1;
+}
+
+/* End of a frame, of an error frame or of the bus off state.  An
+   error passive node that has been the transmitter suspends
+   transmission for 8 bits after intermission, [1] 10.4.6.4, but
+   still receives any frame that starts meanwhile.
+*/
+static void frame_end(struct CAN_XR_MAC *mac, int transmitter)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+
+    s->suspend_bits = (transmitter && error_passive(s)) ? 8 : 0;
+    s->error_tx = 0;
+    s->tec_exception = CAN_XR_MAC_TEC_EXCEPTION_NONE;
+}
+
+/* Start intermission, [1] 10.4.6.2, after a frame, an error frame or
+   an overload frame.  It consists of 3 recessive bits, counted down
+   in field_bits, and hard synchronization is not allowed in the
+   first one, [1] 11.3.2.1 c).
+*/
+static void intermission(struct CAN_XR_MAC *mac)
+{
+    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 0);
+    mac->state.field_bits = 2;
+    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_INTERMISSION;
+}
+
+/* Overload condition detected at this sample point, [1] 10.4.5.1.
+   Start the overload flag at the next bit boundary.  Unlike the error
+   flag, it is dominant even if the node is error passive.
+
+   In bus monitoring mode, we can't, so we handle the overload
+   condition like an error instead, see pcs_data_ind.
+*/
+static void overload_detected(struct CAN_XR_MAC *mac, unsigned long ts)
+{
+    if(mac->bus_monitoring)
+    {
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+	return;
+    }
+
+    TRACE(2, ">>> MAC @%lu overload flag", ts);
+
+    CAN_XR_PCS_Data_Req(mac->pcs, 0);
+    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 0);
+    mac->state.nc_bits = 0;
+    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_OVERLOAD_FLAG;
+}
+
+/* The header of an accepted frame is complete, see
+   CAN_XR_MAC_Stream_Header_Ind_t.  From now on, the other stream
+   indications are due as well, until the frame is either delivered or
+   discarded.
+*/
+static void rx_stream_header(struct CAN_XR_MAC *mac, unsigned long ts)
+{
+    if(!mac->state.rx_accept)
+	return;
+
+    mac->state.rx_streaming = 1;
+    if(mac->primitives.stream_header_ind)
+	mac->primitives.stream_header_ind(
+	    mac->llc, ts, mac->state.rx_identifier,
+	    mac->state.rx_xl ? CAN_XR_FORMAT_XLFF
+	    : mac->state.rx_fd ? CAN_XR_FORMAT_FBFF
+	    : CAN_XR_FORMAT_CBFF,
+	    mac->state.rx_dlc);
+}
+
+/* The frame being received has been discarded, tell the stream
+   consumer if it knew about the frame.
+*/
+static void rx_stream_abort(struct CAN_XR_MAC *mac, unsigned long ts)
+{
+    if(!mac->state.rx_streaming)
+	return;
+
+    mac->state.rx_streaming = 0;
+    if(mac->primitives.stream_abort_ind)
+	mac->primitives.stream_abort_ind(mac->llc, ts);
+}
+
+/* Return the buffer the data of the frame being received go into,
+   the current pool buffer if there is one, rx_data[] otherwise.
+*/
+static uint8_t *rx_buffer(struct CAN_XR_MAC *mac)
+{
+    return (mac->state.rx_frame >= 0)
+	? CAN_XR_Pool_Data(mac->pool, mac->state.rx_frame)
+	: mac->state.rx_data;
+}
+
+/* The data field of an accepted frame is about to start.  Make sure
+   we have a pool buffer for it, if we have a pool, and return the
+   buffer to use.
+*/
+static uint8_t *rx_buffer_acquire(struct CAN_XR_MAC *mac)
+{
+    if(mac->pool && mac->state.rx_frame < 0)
+	mac->state.rx_frame = CAN_XR_Pool_Alloc(mac->pool);
+
+    return rx_buffer(mac);
+}
+
+/* We got a frame, eventually.  Generate Data_Ind for LLC, unless the
+   acceptance filter rejected it, and feed the RX FIFO and the
+   dispatcher.  They all get the same buffer.  If somebody kept it,
+   leave it to them and take a new one at the next frame.
+*/
+static void rx_deliver(struct CAN_XR_MAC *mac, unsigned long ts)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+    enum CAN_XR_Format format =
+	s->rx_xl ? CAN_XR_FORMAT_XLFF
+	: s->rx_fd ? CAN_XR_FORMAT_FBFF
+	: CAN_XR_FORMAT_CBFF;
+    uint8_t *data = rx_buffer(mac);
+
+    s->rx_streaming = 0;
+    if(!s->rx_accept)
+	return;
+
+    if(s->rx_xl && mac->primitives.xl_data_ind)
+	mac->primitives.xl_data_ind(
+	    mac->llc, ts, s->rx_identifier, &s->rx_xl_control,
+	    s->rx_dlc, data);
+
+    else if(mac->primitives.data_ind)
+	mac->primitives.data_ind(
+	    mac->llc, ts, s->rx_identifier, format, s->rx_dlc, data);
+
+    if(mac->rx_fifo)
+	CAN_XR_RX_FIFO_Put(
+	    mac->rx_fifo, ts, s->rx_identifier, format, s->rx_dlc, data);
+
+    if(mac->dispatch)
+	CAN_XR_Dispatch_Ind(
+	    mac->dispatch, ts, s->rx_identifier, format, s->rx_dlc, data);
+
+    if(s->rx_frame >= 0 && CAN_XR_Pool_Refs(mac->pool, s->rx_frame) > 1)
+    {
+	CAN_XR_Pool_Release(mac->pool, s->rx_frame);
+	s->rx_frame = -1;
+    }
+}
+
 /* Static primitive invoked on all de-stuffed bits after SOF while the
    MAC is receiving.  It performs CRC calculation using crc_nextibt
    and deserialization and recompiling of the frame structure, [1]
    10.3.3.
 
-   TBD:
-
-   - We currently support only CBFF
-   - We don't implement OF
-   - We don't handle intermission
-   - We allow hard synchronization even in the first bit of intermission
+   Supported formats are CBFF and, when enabled by
+   CAN_XR_MAC_Set_FD_Mode and CAN_XR_MAC_Set_XL_Mode, FBFF and XLFF.
+   Other frames are ignored until the bus is idle again, see RX_IDE
+   and RX_FDF.
 */
 static void de_stuffed_data_ind(
     struct CAN_XR_MAC *mac, unsigned long ts, int input_unit)
 {
+    int n_data;
+
     TRACE(2, "MAC @%lu Common::de_stuffed_data_ind(%d)", ts, input_unit);
 
     switch(mac->state.rx_fsm_state)
@@ -147,8 +974,18 @@ static void de_stuffed_data_ind(
 	/* Disable hard synchronization per [1] 11.3.2.1 c) */
 	CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 0);
 
-	/* Initialize CRC and start receiving the identifier field */
-	mac->state.crc = crc_nxtbit(0x0000, input_unit);
+	/* Initialize CRCs and start receiving the identifier field */
+	mac->state.crc = 0x0000;
+	mac->state.crc17 = CAN_XR_CRC17_INIT;
+	mac->state.crc21 = CAN_XR_CRC21_INIT;
+	mac->state.pcrc = CAN_XR_PCRC_INIT;
+	mac->state.fcrc = CAN_XR_FCRC_INIT;
+	rx_crc(mac, input_unit);
+	mac->state.rx_fd = 0;
+	mac->state.rx_brs = 0;
+	mac->state.rx_xl = 0;
+	mac->state.rx_fixed_stuff = 0;
+	mac->state.rx_streaming = 0;
 	mac->state.field_bits = 10;
 	mac->state.rx_identifier = 0;
 	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_IDENTIFIER;
@@ -168,194 +1005,591 @@ static void de_stuffed_data_ind(
 	    shift_in(mac->state.rx_identifier, input_unit);
 
 	/* Update CRC and switch to the control field if needed. */
-	mac->state.crc = crc_nxtbit(mac->state.crc, input_unit);
+	rx_crc(mac, input_unit);
 	if(mac->state.field_bits-- == 0)
 	{
 	    TRACE(2, "MAC @%lu rx_identifier=%lu", ts,
 		  (unsigned long)mac->state.rx_identifier);
 
-	    mac->state.field_bits = 1;
-	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_RTR;
+	    /* Acceptance filtering.  The identifier has 11 bits here,
+	       no need to check its range.
+	    */
+	    mac->state.rx_accept = !mac->filter
+		|| CAN_XR_FILTER_ACCEPTS(mac->filter,
+					 mac->state.rx_identifier);
+
+	    mac->state.field_bits = 1;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_RTR;
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_RTR:
+	TRACE(2, "MAC @%lu RTR bit (%d)", ts, input_unit);
+
+	/* TBD: RTR bit unchecked, shall be dominant because we do not
+	   support RTR frames at this time.
+	*/
+	mac->state.rx_rtr = input_unit;
+	rx_crc(mac, input_unit);
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_IDE;
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_IDE:
+	TRACE(2, "MAC @%lu IDE bit (%d)", ts, input_unit);
+	mac->state.rx_ide = input_unit;
+	rx_crc(mac, input_unit);
+
+	/* TBD: We currently support only CBFF, it must be IDE=0. */
+	if(mac->state.rx_ide != 0)
+	{
+	    /* Not an error, we just don't understand the frame.  Wait
+	       for the bus to be idle without signalling anything.
+	    */
+	    TRACE(2, "MAC @%lu xEFF formats unsupported", ts);
+	    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_BUS_INTEGRATION;
+	}
+
+	else
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_FDF;
+
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_FDF:
+	TRACE(2, "MAC @%lu FDF bit (%d)", ts, input_unit);
+	mac->state.rx_fdf = input_unit;
+	rx_crc(mac, input_unit);
+
+	if(input_unit != 0
+	   && (mac->fd_mode != CAN_XR_MAC_FD_DISABLED || mac->xl_mode))
+	{
+	    /* FD or XL frame, [1] 10.4.2.4 and [2], the next bit
+	       tells.
+	    */
+	    mac->state.rx_fd = (mac->fd_mode != CAN_XR_MAC_FD_DISABLED);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_RES;
+	}
+
+	/* With FD and XL frames disabled, FDF recessive is a frame we
+	   don't understand.  Like xEFF frames, see RX_IDE, wait for
+	   the bus to be idle without signalling anything, rather than
+	   destroying the frame with an error flag.
+	*/
+	else if(input_unit != 0)
+	{
+	    TRACE(2, "MAC @%lu FDF recessive, FD frames disabled", ts);
+	    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_BUS_INTEGRATION;
+	}
+
+	else
+	{
+	    mac->state.field_bits= 3;
+	    mac->state.rx_dlc = 0;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_DLC;
+	}
+
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_RES:
+	TRACE(2, "MAC @%lu res bit (%d)", ts, input_unit);
+	rx_crc(mac, input_unit);
+
+	if(input_unit != 0 && mac->xl_mode)
+	{
+	    /* It is the XLF bit of an XL frame, [2].  Remember how
+	       many stuff bits we have seen, as they are all before
+	       the data phase.
+	    */
+	    mac->state.rx_fd = 0;
+	    mac->state.rx_xl = 1;
+	    mac->state.rx_stuff_count =
+		stuff_count_code(mac->state.bus_bits
+				 - mac->state.de_stuffed_bits);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_RESXL;
+	}
+
+	else if(input_unit != 0 || !mac->state.rx_fd)
+	{
+	    /* Protocol exception, the frame follows a protocol we don't
+	       know.  Wait for the bus to be idle, as above.
+	    */
+	    TRACE(2, "MAC @%lu protocol exception", ts);
+	    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_BUS_INTEGRATION;
+	}
+
+	else
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_BRS;
+
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_BRS:
+	TRACE(2, "MAC @%lu BRS bit (%d)", ts, input_unit);
+	mac->state.rx_brs = input_unit;
+	rx_crc(mac, input_unit);
+
+	/* Switch to the data phase bit time right now, at the sample
+	   point, [1] 11.3.1.2.  Back at the sample point of CDEL.
+	*/
+	if(input_unit != 0)
+	    CAN_XR_PCS_Data_Phase_Req(
+		mac->pcs, CAN_XR_PCS_PHASE_FD_DATA,
+		mac->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME);
+
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_ESI;
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_ESI:
+	TRACE(2, "MAC @%lu ESI bit (%d)", ts, input_unit);
+	mac->state.rx_esi = input_unit;
+	rx_crc(mac, input_unit);
+	mac->state.field_bits= 3;
+	mac->state.rx_dlc = 0;
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_DLC;
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_DLC:
+	TRACE(2, "MAC @%lu DLC bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
+
+	mac->state.rx_dlc = shift_in(mac->state.rx_dlc, input_unit);
+	rx_crc(mac, input_unit);
+	if(mac->state.field_bits-- == 0)
+	{
+	    TRACE(2, "MAC @%lu rx_dlc=%d", ts, mac->state.rx_dlc);
+
+	    /* Calculate how many bits the data field has.  It may be
+	       empty, skip directly to the CRC in that case.  We can't
+	       deliver frames longer than rx_data[].
+	    */
+	    n_data = mac->state.rx_fd
+		? CAN_XR_FD_DATA_LENGTH(mac->state.rx_dlc)
+		: ((mac->state.rx_dlc > 8) ? 8 : mac->state.rx_dlc);
+	    if(n_data > CAN_XR_MAX_DATA)
+		mac->state.rx_accept = 0;
+	    mac->state.field_bits = 8 * n_data - 1;
+	    rx_stream_header(mac, ts);
+
+	    if(mac->state.field_bits > 0)
+	    {
+		/* Clear the used part of .rx_data[], initialize byte
+		   buffer .rx_byte and byte index .rx_byte_index
+		   within rx_data[].  Nobody will look at .rx_data[] if
+		   the frame has been rejected.
+		*/
+		if(mac->state.rx_accept)
+		    memset(rx_buffer_acquire(mac), 0, n_data);
+		mac->state.rx_byte = 0;
+		mac->state.rx_byte_index = 0;
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_DATA;
+
+		/* If an ext_tx_data_ind primitive has been registered
+		   to extend the base MAC, switch the transmit
+		   automaton to the appropriate state.
+
+		   To help the ext_tx_data_ind primitive, in case it
+		   has to start transmitting immediately, we also set
+		   tx_byte_index and prepare the first data byte for
+		   transmission in tx_shift_reg.  It comes from the
+		   slot of the frame being transmitted, if any, or else
+		   of the first frame in tx_queue, and is zero if
+		   tx_queue is empty.
+		*/
+		if(mac->primitives.ext_tx_data_ind)
+		{
+		    mac->state.tx_byte_index = 0;
+		    mac->state.tx_shift_reg = shift_prepare(
+			mac->state.tx_slot >= 0
+			? mac->state.tx_slots[mac->state.tx_slot].data[0]
+			: mac->state.data_req_pending
+			? mac->state.tx_slots[mac->state.tx_queue[0]].data[0]
+			: 0, 8);
+		    mac->state.tx_bit_count = mac->state.field_bits;
+		    mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_EXT_DATA;
+		}
+	    }
+
+	    else
+		rx_crc_start(mac);
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_DATA:
+	TRACE(2, "MAC @%lu data bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
+
+	mac->state.rx_byte = shift_in(mac->state.rx_byte, input_unit);
+	if(mac->state.rx_xl)
+	    mac->state.fcrc = CAN_XR_FCRC_Bit(mac->state.fcrc, input_unit);
+	else
+	    rx_crc(mac, input_unit);
+	if(mac->state.field_bits % 8 == 0)
+	{
+	    /* Byte boundary, move reassembled byte from .rx_byte into
+	       the RX buffer at the right position.  Even though bits
+	       within a byte are transmitted big-endian, bytes within
+	       the data field are transmitted little-endian.  See [1],
+	       Figures 12-17.Interesting.
+
+	       TBD: Are we sure we don't read rx_data[8] in this way?
+	    */
+	    if(mac->state.rx_accept)
+		rx_buffer(mac)[mac->state.rx_byte_index] = mac->state.rx_byte;
+	    if(mac->state.rx_streaming && mac->primitives.stream_byte_ind)
+		mac->primitives.stream_byte_ind(
+		    mac->llc, ts, mac->state.rx_byte_index,
+		    mac->state.rx_byte);
+	    mac->state.rx_byte_index++;
+	    mac->state.rx_byte = 0;
+	}
+
+	if(mac->state.field_bits-- == 0)
+	    rx_crc_start(mac);
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_STUFF_COUNT:
+	TRACE(2, "MAC @%lu stuff count bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
+
+	/* A wrong stuff count is a CRC error, [1] 10.4.2.6. */
+	mac->state.rx_byte = shift_in(mac->state.rx_byte, input_unit);
+	rx_crc_fd(mac, input_unit);
+	if(mac->state.field_bits-- == 0)
+	{
+	    if(mac->state.rx_byte != mac->state.rx_stuff_count)
+	    {
+		TRACE(9, ">>> MAC @%lu stuff count error id=%lu", ts,
+		      (unsigned long)mac->state.rx_identifier);
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+	    }
+
+	    else
+	    {
+		mac->state.field_bits =
+		    (CAN_XR_FD_DATA_LENGTH(mac->state.rx_dlc) > 16) ? 20 : 16;
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_CRC;
+	    }
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_CRC:
+	TRACE(2, "MAC @%lu CRC bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
+
+	/* No need to store the CRC being received anywhere, just keep
+	   going with the CRC calculation.  Due to a well-known
+	   property, if the received CRC was ok, the calculated CRC
+	   must be 0 at the end.  Wow, magic! :)  In FD frames,
+	   field_bits tells which CRC we need.
+	*/
+	if(mac->state.rx_fd)
+	    rx_crc_fd(mac, input_unit);
+	else
+	    mac->state.crc = crc_nxtbit(mac->state.crc, input_unit);
+
+	if(mac->state.field_bits-- == 0)
+	{
+	    if(!mac->state.rx_fd ? mac->state.crc != 0
+	       : mac->state.rx_dlc > 10 ? mac->state.crc21 != 0
+	       : mac->state.crc17 != 0)
+	    {
+		TRACE(9, ">>> MAC @%lu CRC error id=%lu dlc=%d", ts,
+		      (unsigned long)mac->state.rx_identifier,
+		      mac->state.rx_dlc);
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+	    }
+
+	    else
+	    {
+		/* CRC Ok */
+		if(mac->state.rx_streaming && mac->primitives.stream_crc_ind)
+		    mac->primitives.stream_crc_ind(mac->llc, ts);
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_CDEL;
+	    }
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_CDEL:
+	TRACE(2, "MAC @%lu CDEL bit (%d)", ts, input_unit);
+
+	/* Back to the nominal bit time, [1] 11.3.1.2 */
+	if(mac->state.rx_brs)
+	    CAN_XR_PCS_Data_Phase_Req(mac->pcs, CAN_XR_PCS_PHASE_NOMINAL, 0);
+
+	if(input_unit != 1)
+	{
+	    TRACE(9, ">>> MAC @%lu CDEL form error", ts);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+	}
+
+	else
+	{
+	    /* Acknowledge the frame by starting the transmission of a
+	       dominant ACK bit at the next bit boundary.  PCS takes
+	       care of bit boundary synchronization.
+
+	       TBD: If we are transmitting, we should not acknowledge
+	       our own frame.  At this time we data data_req_pending,
+	       but we don't have data_req_active, we probably need it.
+
+	       TBD: This is also a (strong) hint at how to implement
+	       SRR mode.
+	    */
+	    CAN_XR_PCS_Data_Req(mac->pcs, 0);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_ACK;
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_RX_RESXL:
+	TRACE(2, "MAC @%lu resXL bit (%d)", ts, input_unit);
+	rx_crc(mac, input_unit);
+
+	if(input_unit != 0)
+	{
+	    /* Protocol exception, as for res above. */
+	    TRACE(2, "MAC @%lu protocol exception", ts);
+	    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_BUS_INTEGRATION;
+	}
+
+	else
+	{
+	    mac->state.field_bits = 3;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_ADS;
 	}
 	break;
 
-    case CAN_XR_MAC_RX_FSM_RX_RTR:
-	TRACE(2, "MAC @%lu RTR bit (%d)", ts, input_unit);
+    case CAN_XR_MAC_RX_FSM_RX_ADS:
+	TRACE(2, "MAC @%lu ADS bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
 
-	/* TBD: RTR bit unchecked, shall be dominant because we do not
-	   support RTR frames at this time.
+	/* The arbitration to data sequence is ADH, DH1, DH2 recessive
+	   and DL1 dominant, [2].  It is neither stuffed nor covered by
+	   the CRCs.  Switch to the XL data phase bit time at the
+	   sample point of ADH, like at BRS of FD frames.
 	*/
-	mac->state.rx_rtr = input_unit;
-	mac->state.crc = crc_nxtbit(mac->state.crc, input_unit);
-	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_IDE;
-	break;
-
-    case CAN_XR_MAC_RX_FSM_RX_IDE:
-	TRACE(2, "MAC @%lu IDE bit (%d)", ts, input_unit);
-	mac->state.rx_ide = input_unit;
-	mac->state.crc = crc_nxtbit(mac->state.crc, input_unit);
+	if(mac->state.field_bits == 3)
+	    CAN_XR_PCS_Data_Phase_Req(
+		mac->pcs, CAN_XR_PCS_PHASE_XL_DATA,
+		mac->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME);
 
-	/* TBD: We currently support only CBFF, it must be IDE=0. */
-	if(mac->state.rx_ide != 0)
+	if(input_unit != (mac->state.field_bits != 0))
 	{
-	    TRACE(2, "MAC @%lu xEFF formats unsupported", ts);
+	    TRACE(9, ">>> MAC @%lu ADS form error", ts);
 	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
 	}
 
-	else
-	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_FDF;
-
+	else if(mac->state.field_bits-- == 0)
+	{
+	    /* Fixed stuffing starts from SDT, see pcs_data_ind. */
+	    mac->state.rx_fixed_stuff = 10;
+	    mac->state.nc_bits = 0;
+	    mac->state.nc_pol = input_unit;
+	    mac->state.rx_byte = 0;
+	    mac->state.field_bits = 7;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_SDT;
+	}
 	break;
 
-    case CAN_XR_MAC_RX_FSM_RX_FDF:
-	TRACE(2, "MAC @%lu FDF bit (%d)", ts, input_unit);
-	mac->state.rx_fdf = input_unit;
-	mac->state.crc = crc_nxtbit(mac->state.crc, input_unit);
+    case CAN_XR_MAC_RX_FSM_RX_SDT:
+	TRACE(2, "MAC @%lu SDT bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
 
-	/* TBD: We currently support only CBFF, it must be FDF=0. */
-	if(mac->state.rx_ide != 0)
+	mac->state.rx_byte = shift_in(mac->state.rx_byte, input_unit);
+	rx_crc_xl(mac, input_unit);
+	if(mac->state.field_bits-- == 0)
 	{
-	    TRACE(2, "MAC @%lu FBFF format unsupported", ts);
-	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+	    mac->state.rx_xl_control.sdt = mac->state.rx_byte;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_SEC;
 	}
+	break;
 
-	else
-	{
-	    mac->state.field_bits= 3;
-	    mac->state.rx_dlc = 0;
-	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_DLC;
-	}
+    case CAN_XR_MAC_RX_FSM_RX_SEC:
+	TRACE(2, "MAC @%lu SEC bit (%d)", ts, input_unit);
 
+	mac->state.rx_xl_control.sec = input_unit;
+	rx_crc_xl(mac, input_unit);
+	mac->state.rx_dlc = 0;
+	mac->state.field_bits = 10;
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_XL_DLC;
 	break;
 
-    case CAN_XR_MAC_RX_FSM_RX_DLC:
-	TRACE(2, "MAC @%lu DLC bit #%d (%d)",
+    case CAN_XR_MAC_RX_FSM_RX_XL_DLC:
+	TRACE(2, "MAC @%lu XL DLC bit #%d (%d)",
 	      ts, mac->state.field_bits, input_unit);
 
 	mac->state.rx_dlc = shift_in(mac->state.rx_dlc, input_unit);
-	mac->state.crc = crc_nxtbit(mac->state.crc, input_unit);
+	rx_crc_xl(mac, input_unit);
 	if(mac->state.field_bits-- == 0)
 	{
 	    TRACE(2, "MAC @%lu rx_dlc=%d", ts, mac->state.rx_dlc);
 
-	    /* Calculate how many bits the data field has.  It may be
-	       empty, skip directly to the CRC in that case.
+	    /* The data field of XL frames is never empty, but may
+	       still be longer than rx_data[].
 	    */
-	    mac->state.field_bits =
-		8 * ((mac->state.rx_dlc > 8) ? 8 : mac->state.rx_dlc) - 1;
+	    if(CAN_XR_XL_DATA_LENGTH(mac->state.rx_dlc) > CAN_XR_MAX_DATA)
+		mac->state.rx_accept = 0;
+	    mac->state.rx_byte = 0;
+	    mac->state.field_bits = 3;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_SBC;
+	}
+	break;
 
-	    if(mac->state.field_bits > 0)
+    case CAN_XR_MAC_RX_FSM_RX_SBC:
+	TRACE(2, "MAC @%lu SBC bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
+
+	/* Stuff bit count, same encoding as the stuff count of FD
+	   frames, computed at XLF.
+	*/
+	mac->state.rx_byte = shift_in(mac->state.rx_byte, input_unit);
+	rx_crc_xl(mac, input_unit);
+	if(mac->state.field_bits-- == 0)
+	{
+	    if(mac->state.rx_byte != mac->state.rx_stuff_count)
 	    {
-		/* Clear the whole .rx_data[] buffer, initialize byte
-		   buffer .rx_byte and byte index .rx_byte_index
-		   within rx_data[]
-		*/
-		memset(mac->state.rx_data, 0, sizeof(mac->state.rx_data));
-		mac->state.rx_byte = 0;
-		mac->state.rx_byte_index = 0;
-		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_DATA;
+		TRACE(9, ">>> MAC @%lu SBC error id=%lu", ts,
+		      (unsigned long)mac->state.rx_identifier);
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+	    }
 
-		/* If an ext_tx_data_ind primitive has been registered
-		   to extend the base MAC, switch the transmit
-		   automaton to the appropriate state.
+	    else
+	    {
+		mac->state.field_bits = 12;
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_PCRC;
+	    }
+	}
+	break;
 
-		   To help the ext_tx_data_ind primitive, in case it
-		   has to start transmitting immediately, we also set
-		   tx_byte_index and prepare tx_data[0] for
-		   transmission in tx_shift_reg.
-		*/
-		if(mac->primitives.ext_tx_data_ind)
-		{
-		    mac->state.tx_byte_index = 0;
-		    mac->state.tx_shift_reg = shift_prepare(mac->state.tx_data[0], 8);
-		    mac->state.tx_bit_count = mac->state.field_bits;
-		    mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_EXT_DATA;
-		}
+    case CAN_XR_MAC_RX_FSM_RX_PCRC:
+	TRACE(2, "MAC @%lu PCRC bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
+
+	/* Same magic as in RX_CRC.  FCRC covers PCRC, too. */
+	rx_crc_xl(mac, input_unit);
+	if(mac->state.field_bits-- == 0)
+	{
+	    if(mac->state.pcrc != 0)
+	    {
+		TRACE(9, ">>> MAC @%lu PCRC error id=%lu", ts,
+		      (unsigned long)mac->state.rx_identifier);
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
 	    }
 
 	    else
 	    {
-		mac->state.field_bits = 14;
-		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_CRC;
+		rx_stream_header(mac, ts);
+		mac->state.rx_byte = 0;
+		mac->state.field_bits = 7;
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_VCID;
 	    }
 	}
 	break;
 
-    case CAN_XR_MAC_RX_FSM_RX_DATA:
-	TRACE(2, "MAC @%lu data bit #%d (%d)",
+    case CAN_XR_MAC_RX_FSM_RX_VCID:
+	TRACE(2, "MAC @%lu VCID bit #%d (%d)",
 	      ts, mac->state.field_bits, input_unit);
 
 	mac->state.rx_byte = shift_in(mac->state.rx_byte, input_unit);
-	mac->state.crc = crc_nxtbit(mac->state.crc, input_unit);
-	if(mac->state.field_bits % 8 == 0)
+	mac->state.fcrc = CAN_XR_FCRC_Bit(mac->state.fcrc, input_unit);
+	if(mac->state.field_bits-- == 0)
 	{
-	    /* Byte boundary, move reassembled byte from .rx_byte into
-	       .rx_data[] at the right position.  Even though bits
-	       within a byte are transmitted big-endian, bytes within
-	       the data field are transmitted little-endian.  See [1],
-	       Figures 12-17.Interesting.
-
-	       TBD: Are we sure we don't read rx_data[8] in this way?
-	    */
-	    mac->state.rx_data[mac->state.rx_byte_index++] = mac->state.rx_byte;
-	    mac->state.rx_byte = 0;
+	    mac->state.rx_xl_control.vcid = mac->state.rx_byte;
+	    mac->state.rx_xl_control.af = 0;
+	    mac->state.field_bits = 31;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_AF;
 	}
+	break;
 
+    case CAN_XR_MAC_RX_FSM_RX_AF:
+	TRACE(2, "MAC @%lu AF bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
+
+	mac->state.rx_xl_control.af =
+	    shift_in(mac->state.rx_xl_control.af, input_unit);
+	mac->state.fcrc = CAN_XR_FCRC_Bit(mac->state.fcrc, input_unit);
 	if(mac->state.field_bits-- == 0)
 	{
-	    mac->state.field_bits = 14;
-	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_CRC;
+	    /* On to the data field, as in RX_DLC.  There is no
+	       ext_tx_data_ind support for XL frames.
+	    */
+	    n_data = CAN_XR_XL_DATA_LENGTH(mac->state.rx_dlc);
+	    if(mac->state.rx_accept)
+		memset(rx_buffer_acquire(mac), 0, n_data);
+	    mac->state.rx_byte = 0;
+	    mac->state.rx_byte_index = 0;
+	    mac->state.field_bits = 8 * n_data - 1;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_DATA;
 	}
 	break;
 
-    case CAN_XR_MAC_RX_FSM_RX_CRC:
-	TRACE(2, "MAC @%lu CRC bit #%d (%d)",
+    case CAN_XR_MAC_RX_FSM_RX_FCRC:
+	TRACE(2, "MAC @%lu FCRC bit #%d (%d)",
 	      ts, mac->state.field_bits, input_unit);
 
-	/* No need to store the CRC being received anywhere, just keep
-	   going with the CRC calculation.  Due to a well-known
-	   property, if the received CRC was ok, the calculated CRC
-	   must be 0 at the end.  Wow, magic! :)
-	*/
-	mac->state.crc = crc_nxtbit(mac->state.crc, input_unit);
+	mac->state.fcrc = CAN_XR_FCRC_Bit(mac->state.fcrc, input_unit);
 	if(mac->state.field_bits-- == 0)
 	{
-	    if(mac->state.crc != 0)
+	    if(mac->state.fcrc != 0)
 	    {
-		TRACE(9, ">>> MAC @%lu CRC error id=%lu dlc=%d", ts,
+		TRACE(9, ">>> MAC @%lu FCRC error id=%lu dlc=%d", ts,
 		      (unsigned long)mac->state.rx_identifier,
 		      mac->state.rx_dlc);
 		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
 	    }
 
 	    else
-		/* CRC Ok */
-		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_CDEL;
+	    {
+		if(mac->state.rx_streaming && mac->primitives.stream_crc_ind)
+		    mac->primitives.stream_crc_ind(mac->llc, ts);
+		mac->state.field_bits = 3;
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_FCP;
+	    }
 	}
 	break;
 
-    case CAN_XR_MAC_RX_FSM_RX_CDEL:
-	TRACE(2, "MAC @%lu CDEL bit (%d)", ts, input_unit);
+    case CAN_XR_MAC_RX_FSM_RX_FCP:
+	TRACE(2, "MAC @%lu FCP bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
 
-	if(input_unit != 1)
+	/* Format check pattern, two recessive and two dominant bits,
+	   [2].
+	*/
+	if(input_unit != (mac->state.field_bits >= 2))
 	{
-	    TRACE(9, ">>> MAC @%lu CDEL form error", ts);
+	    TRACE(9, ">>> MAC @%lu FCP form error", ts);
 	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
 	}
 
-	else
+	else if(mac->state.field_bits-- == 0)
 	{
-	    /* Acknowledge the frame by starting the transmission of a
-	       dominant ACK bit at the next bit boundary.  PCS takes
-	       care of bit boundary synchronization.
+	    mac->state.field_bits = 3;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_DAS;
+	}
+	break;
 
-	       TBD: If we are transmitting, we should not acknowledge
-	       our own frame.  At this time we data data_req_pending,
-	       but we don't have data_req_active, we probably need it.
+    case CAN_XR_MAC_RX_FSM_RX_DAS:
+	TRACE(2, "MAC @%lu DAS bit #%d (%d)",
+	      ts, mac->state.field_bits, input_unit);
 
-	       TBD: This is also a (strong) hint at how to implement
-	       SRR mode.
-	    */
+	/* The data to arbitration sequence is DAH, AH1 recessive, AL1
+	   dominant and AH2 recessive, [2].  Back to the nominal bit
+	   time at the sample point of DAH, like at CDEL of FD frames.
+	*/
+	if(mac->state.field_bits == 3)
+	    CAN_XR_PCS_Data_Phase_Req(
+		mac->pcs, CAN_XR_PCS_PHASE_NOMINAL, 0);
+
+	if(input_unit != (mac->state.field_bits != 1))
+	{
+	    TRACE(9, ">>> MAC @%lu DAS form error", ts);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+	}
+
+	else if(mac->state.field_bits-- == 0)
+	{
+	    /* Acknowledge the frame, as in RX_CDEL. */
 	    CAN_XR_PCS_Data_Req(mac->pcs, 0);
 	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_RX_ACK;
 	}
@@ -366,7 +1600,16 @@ static void de_stuffed_data_ind(
 
 	if(input_unit != 0)
 	{
+	    /* Only the transmitter can see a recessive ACK slot, since
+	       receivers drive it dominant.  If it is error passive, it
+	       may be alone on the bus, and it increments its transmit
+	       error counter only if its error flag meets a dominant
+	       bit, [1] 12.1.4.2 c) 1).
+	    */
 	    TRACE(9, ">>> MAC @%lu ACK bit error", ts);
+	    if(mac->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME
+	       && error_passive(&mac->state))
+		mac->state.tec_exception = CAN_XR_MAC_TEC_EXCEPTION_PASSIVE_ACK;
 	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
 	}
 
@@ -403,10 +1646,13 @@ static void de_stuffed_data_ind(
 	   inhibit frame validation and a dominant value shall not
 	   lead to a form error.  A receiver that detects a dominant
 	   bit at the last bit of EOF shall respond with an OF" ([1]
-	   10.7).
+	   10.7).  The transmitter does the same here, and considers
+	   the frame valid as well.
 
-	   TBD: We don't implement OF, so we simply ignore the 7th bit
-	   of EOF for the time being.
+	   The same clause lets receivers validate the frame at the
+	   last but one bit of EOF.  With early_validation, they
+	   deliver it right then, field_bits being already decremented
+	   to 0.
 	*/
 	if(input_unit != 1 && mac->state.field_bits != 0)
 	{
@@ -418,22 +1664,43 @@ static void de_stuffed_data_ind(
 
 	else if(mac->state.field_bits-- == 0)
 	{
+	    int transmitter =
+		(mac->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME);
+
 	    TRACE(2, "MAC @%lu Frame OK id=%lu dlc=%d", ts,
 		  (unsigned long)mac->state.rx_identifier,
 		  mac->state.rx_dlc);
 
-	    /* We got a frame, eventually.  Generate Data_Ind for LLC. */
-	    if(mac->primitives.data_ind)
-		mac->primitives.data_ind(
-		    mac->llc, ts, mac->state.rx_identifier,
-		    CAN_XR_FORMAT_CBFF, mac->state.rx_dlc, mac->state.rx_data);
-
-	    /* TBD: We don't handle intermission properly.  Moreover,
-	       we shouldn't allow hard synchronization in the first
-	       bit of intermission 11.3.2.1 c)
+	    /* Successful transmission or reception, [1] 12.1.4.2 g)
+	       and h).
 	    */
-	    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
-	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_IDLE;
+	    if(transmitter)
+	    {
+		if(mac->state.tec > 0)  mac->state.tec--;
+	    }
+	    else if(mac->state.rec > 127)
+		mac->state.rec = 119;
+	    else if(mac->state.rec > 0)
+		mac->state.rec--;
+
+	    /* Unless we did it at the previous bit, see below */
+	    if(transmitter || !mac->early_validation)
+		rx_deliver(mac, ts);
+
+	    frame_end(mac, transmitter);
+	    if(input_unit == 0)
+		overload_detected(mac, ts);
+	    else
+		intermission(mac);
+	}
+
+	else if(mac->state.field_bits == 0 && mac->early_validation
+		&& mac->state.tx_fsm_state != CAN_XR_MAC_TX_FSM_TX_FRAME)
+	{
+	    TRACE(2, "MAC @%lu Frame OK id=%lu dlc=%d (early)", ts,
+		  (unsigned long)mac->state.rx_identifier,
+		  mac->state.rx_dlc);
+	    rx_deliver(mac, ts);
 	}
 	break;
 
@@ -448,6 +1715,7 @@ static void de_stuffed_data_ind(
 static void tx_processing_ind(
     struct CAN_XR_MAC *mac, unsigned long ts, int input_unit)
 {
+    struct CAN_XR_MAC_TX_Slot *slot;
     int bit;
 
     TRACE(2, "MAC @%lu Common::tx_processing_ind(%d)", ts, input_unit);
@@ -455,166 +1723,67 @@ static void tx_processing_ind(
     switch(mac->state.tx_fsm_state)
     {
     case CAN_XR_MAC_TX_FSM_IDLE:
-	/* Transmit SOF.  At the next sample point, this will also
-	   cause the rx automaton to exit from the idle state.
-	*/
-	CAN_XR_PCS_Data_Req(mac->pcs, 0);
+	/* Load the frame with the highest priority, then transmit
+	   SOF, the first bit of its bitstream.  At the next sample
+	   point, this will also cause the rx automaton to exit from
+	   the idle state.
 
-	/* Prepare for transmitting the identifier */
-	mac->state.tx_shift_reg = shift_prepare(mac->state.tx_identifier, 11);
-	mac->state.tx_bit_count = 10;
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_IDENTIFIER;
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_IDENTIFIER:
-	shift_out(bit, mac->state.tx_shift_reg);
-	CAN_XR_PCS_Data_Req(mac->pcs, bit);
-
-	if(mac->state.tx_bit_count-- == 0)
-	    mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_RTR;
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_RTR:
-	/* TBD: RTR is dominant in CBFF frames, other frame formats
-	   are unsupported for now.
-	*/
-	CAN_XR_PCS_Data_Req(mac->pcs, 0);
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_IDE;
-	break;
+	   If the rx automaton is not idle, it has just received a SOF
+	   at the third bit of intermission, and that SOF is ours as
+	   well, [1] 10.4.2.2.  Skip it and go on with the identifier.
 
-    case CAN_XR_MAC_TX_FSM_TX_IDE:
-	/* TBD: IDE is dominant in CBFF frames, other frame formats
-	   are unsupported for now.
+	   The ESI bit of an FD frame must tell whether we are error
+	   passive now, see tx_encode_fd.
 	*/
-	CAN_XR_PCS_Data_Req(mac->pcs, 0);
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_FDF;
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_FDF:
-	/* TBD: FDF is dominant in CBFF frames, other frame formats
-	   are unsupported for now.
+	slot = &mac->state.tx_slots[mac->state.tx_queue[0]];
+	if(slot->format == CAN_XR_FORMAT_FBFF
+	   && slot->esi != error_passive(&mac->state))
+	    tx_encode_fd(mac, slot);
+
+	tx_load(&mac->state);
+	mac->state.tx_bit_index =
+	    (mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_IDLE) ? 0 : 1;
+	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_FRAME;
+
+	if(mac->primitives.tx_sof_ind)
+	    mac->primitives.tx_sof_ind(
+		mac->llc, ts, mac->state.tx_identifier);
+	/* Fall through */
+
+    case CAN_XR_MAC_TX_FSM_TX_FRAME:
+	/* The bitstream in the slot was encoded by MAC_Data.Request,
+	   stuff bits included, so we just have to shift it out one
+	   bit at a time.  The recessive ACK bit in the bitstream
+	   overrides the dominant one the receive automaton just asked
+	   to transmit, because we don't want to self-acknowledge the
+	   frame.
+
+	   After the last bit of EOF has been sampled, at this
+	   sampling point, there is nothing left to transmit.  The
+	   transmitter returns to the IDLE state, and the next frame
+	   waits for the end of intermission like all others.
 	*/
-	CAN_XR_PCS_Data_Req(mac->pcs, 0);
-	mac->state.tx_shift_reg = shift_prepare(mac->state.tx_dlc, 4);
-	mac->state.tx_bit_count = 3;
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_DLC;
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_DLC:
-	shift_out(bit, mac->state.tx_shift_reg);
-	CAN_XR_PCS_Data_Req(mac->pcs, bit);
-
-	if(mac->state.tx_bit_count-- == 0)
+	if(mac->state.tx_bit_index < mac->state.tx_bitstream_bits)
 	{
-	    if(mac->state.tx_dlc > 0)
-	    {
-		mac->state.tx_byte_index = 0;
-		mac->state.tx_shift_reg = shift_prepare(mac->state.tx_data[0], 8);
-		mac->state.tx_bit_count =
-		    8 * ((mac->state.tx_dlc > 8) ? 8 : mac->state.tx_dlc) - 1;
-		mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_DATA;
-	    }
-
-	    else
-		mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_CRC_LATCH;
+	    bit = tx_bit(&mac->state, mac->state.tx_bit_index++);
+	    CAN_XR_PCS_Data_Req(mac->pcs, bit);
 	}
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_DATA:
-	shift_out(bit, mac->state.tx_shift_reg);
-	CAN_XR_PCS_Data_Req(mac->pcs, bit);
-
-	if(mac->state.tx_bit_count == 0)
-	    /* Done with data bits */
-	    mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_CRC_LATCH;
-
-	else if(mac->state.tx_bit_count-- % 8 == 0)
-	    /* Byte boundary, switch to the next */
-	    mac->state.tx_shift_reg =
-		shift_prepare(mac->state.tx_data[++mac->state.tx_byte_index], 8);
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_CRC_LATCH:
-	/* At this sampling point, the receiver has kindly performed
-	   the CRC calculation up to the last bit of the data field.
-	   The result is stored in mac->state.crc, so we can latch it
-	   into tx_shift_reg and start transmitting it.
-	*/
-	mac->state.tx_shift_reg = shift_prepare(mac->state.crc, 15);
-	mac->state.tx_bit_count = 14;
-
-	/* The first bit of the CRC must be transmitted at the next
-	   bit boundary, so issue the Data_Req here, without state
-	   transitions in between.  tx_bit_count is adjusted
-	   accordingly.
-	*/
-	shift_out(bit, mac->state.tx_shift_reg);
-	CAN_XR_PCS_Data_Req(mac->pcs, bit);
-	mac->state.tx_bit_count--;
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_CRC;
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_CRC:
-	shift_out(bit, mac->state.tx_shift_reg);
-	CAN_XR_PCS_Data_Req(mac->pcs, bit);
-
-	if(mac->state.tx_bit_count-- == 0)
-	    mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_CDEL;
-	break;
 
-    case CAN_XR_MAC_TX_FSM_TX_CDEL:
-	TRACE(2, ">>> MAC @%lu Sending CDEL", ts);
-	CAN_XR_PCS_Data_Req(mac->pcs, 1);
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_ACK;
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_ACK:
-	/* The ACK bit is sent recessive and shall be sampled
-	   dominant, otherwise an ACK error occurs [1] 10.4.2.7.
-
-	   Here we issue
-	   CAN_XR_PCS_Data_Req(mac->pcs, 1);
-
-	   because we don't want to self-acknowledge the frame, but
-	   the receive automaton just asked to transmit a dominant ACK
-	   at the next bit boundary if it received the frame
-	   successfully.
-	*/
-	CAN_XR_PCS_Data_Req(mac->pcs, 1);
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_ADEL;
-	break;
-
-    case CAN_XR_MAC_TX_FSM_TX_ADEL:
-	CAN_XR_PCS_Data_Req(mac->pcs, 1);
-	mac->state.tx_bit_count = 6;
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_EOF;
-	break;
+	else
+	{
+	    TRACE(2, ">>> MAC @%lu back to TX_FSM_IDLE", ts);
 
-    case CAN_XR_MAC_TX_FSM_TX_EOF:
-	CAN_XR_PCS_Data_Req(mac->pcs, 1);
-	if(mac->state.tx_bit_count-- == 0)
-	    /* Delay the return to TX_FSM_IDLE by one bit, to have
-	       time to sample the last bit of EOF.
+	    /* Free the slot, if there are other frames in tx_queue
+	       the next one starts as soon as the bus is idle.
 	    */
-	    mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_TX_EOF_TAIL;
-	break;
+	    tx_release(&mac->state);
+	    mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_IDLE;
 
-    case CAN_XR_MAC_TX_FSM_TX_EOF_TAIL:
-	/* At this sampling point, the last bit of EOF has been
-	   sampled.
-
-	   TBD: No intermission, the transmitter returns to the IDLE
-	   state immediately after sampling the last bit of EOF.
-	*/
-	TRACE(2, ">>> MAC @%lu back to TX_FSM_IDLE", ts);
-
-	mac->state.data_req_pending = 0;
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_IDLE;
-
-	if(mac->primitives.data_conf)
-	    mac->primitives.data_conf(
-		mac->llc, ts, mac->state.tx_identifier,
-		CAN_XR_MAC_TX_STATUS_SUCCESS);
+	    if(mac->primitives.data_conf)
+		mac->primitives.data_conf(
+		    mac->llc, ts, mac->state.tx_identifier,
+		    CAN_XR_MAC_TX_STATUS_SUCCESS);
+	}
 	break;
 
     case CAN_XR_MAC_TX_FSM_TX_EXT_DATA:
@@ -656,18 +1825,148 @@ static void tx_processing_ind(
 }
 
 
+/* Bit monitoring.  At this sample point, 'input_unit' is the bus
+   level of the last bit we transmitted, tx_bit(tx_bit_index-1),
+   and the rx FSM has not processed it yet, so its state tells which
+   field the bit belongs to.
+
+   - In the arbitration field, [1] 10.4.2.3, sampling dominant while
+     transmitting recessive means that we lost arbitration to a frame
+     with a lower identifier.  Stop transmitting and go on as a
+     receiver of that frame.  Stuff bits are the same for all
+     contenders, so a recessive stuff bit sampled dominant is a stuff
+     error instead, for which the transmit error counter is not
+     incremented, [1] 12.1.4.2 c) 2).
+
+   - In the ACK slot, the transmitter sends recessive and expects
+     dominant.  The rx FSM checks it.
+
+   - A dominant last bit of EOF is an overload condition for the
+     transmitter as well, see de_stuffed_data_ind.
+
+   - In the data phase of FD frames with transmitter delay
+     compensation, the PCS checks the bits at their secondary sample
+     point instead, and we get the outcome for the bits checked so
+     far.
+
+   - Anywhere else, a mismatch is a bit error.  The rx FSM goes to
+     the error state, and the error flag stops the transmission
+     right away.
+
+   In both cases, the frame stays in tx_queue and is transmitted
+   again as soon as the bus is idle.
+*/
+static void bit_monitoring(
+    struct CAN_XR_MAC *mac, unsigned long ts, int input_unit)
+{
+    int index = mac->state.tx_bit_index - 1;
+    int bit = tx_bit(&mac->state, index);
+    int ssp_error =
+	(mac->state.rx_fd || mac->state.rx_xl)
+	? CAN_XR_PCS_Get_SSP_Error(mac->pcs) : -1;
+
+    if((ssp_error < 0 ? input_unit == bit : !ssp_error)
+       || mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_RX_ACK
+       || (mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_RX_EOF
+	   && mac->state.field_bits == 0))
+	return;
+
+    if(bit == 1
+       && (mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_RX_IDENTIFIER
+	   || mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_RX_RTR)
+       && mac->state.nc_bits == 5)
+    {
+	TRACE(9, ">>> MAC @%lu stuff error in arbitration id=%lu bit #%d",
+	      ts, (unsigned long)mac->state.tx_identifier, index);
+
+	mac->state.tec_exception = CAN_XR_MAC_TEC_EXCEPTION_ARBITRATION_STUFF;
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+    }
+
+    else if(bit == 1
+	    && (mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_RX_IDENTIFIER
+		|| mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_RX_RTR))
+    {
+	TRACE(2, ">>> MAC @%lu arbitration lost id=%lu bit #%d", ts,
+	      (unsigned long)mac->state.tx_identifier, index);
+
+	CAN_XR_PCS_Data_Req(mac->pcs, 1);
+	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_IDLE;
+	mac->state.tx_slot = -1;
+    }
+
+    else
+    {
+	TRACE(9, ">>> MAC @%lu bit error id=%lu bit #%d sent %d", ts,
+	      (unsigned long)mac->state.tx_identifier, index, bit);
+
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+    }
+}
+
+/* Error detected at this sample point, by bit monitoring or by the rx
+   FSM.  Count it and start the error flag at the next bit boundary,
+   [1] 10.4.4.2: an error active node transmits 6 dominant bits, an
+   error passive one 6 recessive bits.  The frame being transmitted,
+   if any, stays in tx_queue and is transmitted again as soon as the
+   bus is idle.
+
+   An active error flag violates bit stuffing, so that all other
+   nodes detect an error by the end of it, if not earlier, and
+   transmit their own error flag.  Then, all nodes transmit the
+   recessive error delimiter together, and the bus is idle again
+   much sooner than if they had to detect the error by themselves
+   and wait for bus integration.
+*/
+static void error_detected(struct CAN_XR_MAC *mac, unsigned long ts)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+
+    rx_stream_abort(mac, ts);
+
+    /* Error frames are at the nominal bit rate, [1] 11.3.1.2 */
+    CAN_XR_PCS_Data_Phase_Req(mac->pcs, CAN_XR_PCS_PHASE_NOMINAL, 0);
+
+    if(s->tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME)
+	s->error_tx = 1;
+
+    s->tx_fsm_state = CAN_XR_MAC_TX_FSM_IDLE;
+    s->tx_slot = -1;
+
+    /* [1] 12.1.4.2 a) and c) */
+    if(error_count(
+	   mac, ts,
+	   (s->tec_exception == CAN_XR_MAC_TEC_EXCEPTION_NONE) ? 8 : 0, 1))
+	return;
+
+    TRACE(2, ">>> MAC @%lu error flag tec=%d rec=%d", ts, s->tec, s->rec);
+
+    CAN_XR_PCS_Data_Req(mac->pcs, error_passive(s));
+    s->nc_bits = 0;
+    s->rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR_FLAG;
+}
+
 /* PCS_Data.Indicate primitive invoked by PCS the arrival of a bit.
    This is the starting point for MAC-layer processing.
 
-   Bus off condition unchecked / recovery unsupported.
-   FD tolerant / FD enabled MAC unsupported.
+   FD enabled MAC, see CAN_XR_MAC_Set_FD_Mode.  FD tolerant MAC
+   unsupported.
 */
 static void pcs_data_ind(
     struct CAN_XR_MAC *mac, unsigned long ts, int input_unit)
 {
+    int early_sof = 0; /* SOF at the third bit of intermission */
+
     TRACE(2, "MAC @%lu Common::pcs_data_ind(%d)", ts, input_unit);
 
-    /* Handle rx FSM first */
+    /* Bit monitoring comes first, because the rx FSM must know
+       whether we are still transmitting the frame it is receiving.
+    */
+    if(mac->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME
+       && mac->state.tx_bit_index > 0)
+	bit_monitoring(mac, ts, input_unit);
+
+    /* Handle rx FSM next */
     switch(mac->state.rx_fsm_state)
     {
     case CAN_XR_MAC_RX_FSM_BUS_INTEGRATION:
@@ -698,11 +1997,44 @@ static void pcs_data_ind(
 	}
 	break;
 
+    case CAN_XR_MAC_RX_FSM_INTERMISSION:
+	/* Intermission, [1] 10.4.6.2.  A dominant bit in one of its
+	   first two bits is an overload condition, [1] 10.4.5.1.
+	   Hard synchronization is allowed again after the first one.
+	*/
+	if(input_unit == 1 || mac->state.field_bits > 0)
+	{
+	    if(input_unit == 0)
+		overload_detected(mac, ts);
+
+	    else
+	    {
+		CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
+		if(mac->state.field_bits-- == 0)
+		{
+		    TRACE(2, ">>> MAC @%lu end of intermission", ts);
+		    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_IDLE;
+		}
+	    }
+	    break;
+	}
+
+	/* A dominant third bit is a SOF, [1] 10.4.2.2.  If we have a
+	   frame pending and are not suspended, we transmit it along
+	   with the frame we start receiving, see below.
+	*/
+	early_sof = (mac->state.suspend_bits == 0);
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_IDLE;
+	/* Fall through */
+
     case CAN_XR_MAC_RX_FSM_IDLE:
 	if(input_unit == 0)
 	{
 	    /* SOF received, [1] 10.4.2.2 and 10.4.6.3.  Initialize
-	       bit de-stuffing state, received 1 bit @ 0. */
+	       bit de-stuffing state, received 1 bit @ 0.  A
+	       suspended transmitter becomes a receiver.
+	    */
+	    mac->state.suspend_bits = 0;
 	    mac->state.nc_bits = 1;
 	    mac->state.nc_pol = input_unit;
 	    mac->state.bus_bits = 1;
@@ -710,16 +2042,32 @@ static void pcs_data_ind(
 
 	    de_stuffed_data_ind(mac, ts, input_unit);
 	}
+
+	else if(mac->state.suspend_bits > 0)
+	    mac->state.suspend_bits--;
 	break;
 
     case CAN_XR_MAC_RX_FSM_RX_IDENTIFIER:
     case CAN_XR_MAC_RX_FSM_RX_RTR:
     case CAN_XR_MAC_RX_FSM_RX_IDE:
     case CAN_XR_MAC_RX_FSM_RX_FDF:
+    case CAN_XR_MAC_RX_FSM_RX_RES:
+    case CAN_XR_MAC_RX_FSM_RX_BRS:
+    case CAN_XR_MAC_RX_FSM_RX_ESI:
     case CAN_XR_MAC_RX_FSM_RX_DLC:
     case CAN_XR_MAC_RX_FSM_RX_DATA:
+    case CAN_XR_MAC_RX_FSM_RX_STUFF_COUNT:
     case CAN_XR_MAC_RX_FSM_RX_CRC:
     case CAN_XR_MAC_RX_FSM_RX_CDEL:
+    case CAN_XR_MAC_RX_FSM_RX_RESXL:
+    case CAN_XR_MAC_RX_FSM_RX_SDT:
+    case CAN_XR_MAC_RX_FSM_RX_SEC:
+    case CAN_XR_MAC_RX_FSM_RX_XL_DLC:
+    case CAN_XR_MAC_RX_FSM_RX_SBC:
+    case CAN_XR_MAC_RX_FSM_RX_PCRC:
+    case CAN_XR_MAC_RX_FSM_RX_VCID:
+    case CAN_XR_MAC_RX_FSM_RX_AF:
+    case CAN_XR_MAC_RX_FSM_RX_FCRC:
 	/* Common entry point for all states in which the MAC is
 	   receiving and bit de-stuffing is needed.  Do it, then call
 	   de_stuffed_data_ind to continue processing.
@@ -728,10 +2076,44 @@ static void pcs_data_ind(
 	   after the last bit of CRC, as it must not be considered as
 	   CDEL by itself.
 
-	   TBD: This is probably also a good place to implement bit
-	   monitoring and detect arbitration loss.  Neither of those
-	   are implemented for now.
+	   Bit monitoring and arbitration loss detection are done
+	   beforehand, by bit_monitoring.
+
+	   In the CRC field of FD frames, from the stuff count on, a
+	   fixed stuff bit, the complement of the bit before it, comes
+	   every 4 bits instead, [1] 10.5.  It is not covered by the
+	   CRC, and there is none after the last bit of CRC.
+
+	   XL frames do the same every 10 bits, from SDT to the end of
+	   FCRC, [2].  rx_fixed_stuff tells the period, 0 while dynamic
+	   stuffing is still in use.
 	*/
+	if(mac->state.rx_fixed_stuff)
+	{
+	    if(mac->state.nc_bits == mac->state.rx_fixed_stuff)
+	    {
+		if(input_unit == mac->state.nc_pol)
+		{
+		    TRACE(9, ">>> MAC @%lu fixed stuff error", ts);
+		    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+		}
+
+		else
+		{
+		    mac->state.nc_bits = 0;
+		    mac->state.nc_pol = input_unit;
+		}
+	    }
+
+	    else
+	    {
+		mac->state.nc_bits++;
+		mac->state.nc_pol = input_unit;
+		de_stuffed_data_ind(mac, ts, input_unit);
+	    }
+	    break;
+	}
+
 	mac->state.bus_bits++;
 
 	if(mac->state.nc_bits == 5)
@@ -748,6 +2130,8 @@ static void pcs_data_ind(
 		TRACE(2, ">>> MAC @%lu discarding stuff bit @%d", ts, input_unit);
 		mac->state.nc_bits = 1;
 		mac->state.nc_pol = input_unit;
+		rx_crc_fd(mac, input_unit);
+		rx_crc_xl(mac, input_unit);
 	    }
 	}
 
@@ -771,37 +2155,230 @@ static void pcs_data_ind(
 	break;
 
     case CAN_XR_MAC_RX_FSM_RX_ACK:
-	/* TBD: This is probably a good place to detect ACK errors.
-	   The transmitter transmits a recessive bit, we should sample
-	   dominant here.
-	*/
     case CAN_XR_MAC_RX_FSM_RX_ADEL:
     case CAN_XR_MAC_RX_FSM_RX_EOF:
+    case CAN_XR_MAC_RX_FSM_RX_ADS:
+    case CAN_XR_MAC_RX_FSM_RX_FCP:
+    case CAN_XR_MAC_RX_FSM_RX_DAS:
 	/* Bypass bit de-stuffing in the frame trailer [1] 10.5 last
 	   sentence.  See above for the special tratment of the
-	   CAN_XR_MAC_RX_FSM_RX_CDEL state.
+	   CAN_XR_MAC_RX_FSM_RX_CDEL state.  The same goes for the ADS,
+	   FCP and DAS fields of XL frames, [2].
 	*/
 	de_stuffed_data_ind(mac, ts, input_unit);
 	break;
 
-    default:
-	/* This currently catches CAN_XR_MAC_RX_FSM_ERROR, too.
+    case CAN_XR_MAC_RX_FSM_ERROR_FLAG:
+	/* Error flag, [1] 10.4.4.2.  It is over when we have seen 6
+	   consecutive bits of the same polarity since its start,
+	   counted in nc_bits and nc_pol.  An error active node
+	   transmits them dominant, so they are its own 6 bits unless
+	   it detects a bit error, which starts a new error flag.  An
+	   error passive node transmits them recessive, and may have to
+	   wait for the error flags of other nodes to be over.
+	*/
+	if(input_unit == 0
+	   && mac->state.tec_exception == CAN_XR_MAC_TEC_EXCEPTION_PASSIVE_ACK)
+	{
+	    /* Somebody else is there, see RX_ACK */
+	    mac->state.tec_exception = CAN_XR_MAC_TEC_EXCEPTION_NONE;
+	    if(error_count(mac, ts, 8, 0))
+		break;
+	}
 
-	   TBD: Very simple error recovery, transmit recessive at next
-	   bit boundary, enable hard synchronization, bring the tx
-	   automaton to idle and the rx automaton to the bus
-	   integration state.
+	if(input_unit == 1 && !error_passive(&mac->state))
+	{
+	    /* [1] 12.1.4.2 d) and e) */
+	    TRACE(9, ">>> MAC @%lu bit error in error flag", ts);
+
+	    if(error_count(mac, ts, 8, 8))
+		break;
+
+	    CAN_XR_PCS_Data_Req(mac->pcs, error_passive(&mac->state));
+	    mac->state.nc_bits = 0;
+	}
+
+	else
+	{
+	    if(mac->state.nc_bits == 0 || input_unit != mac->state.nc_pol)
+	    {
+		mac->state.nc_bits = 1;
+		mac->state.nc_pol = input_unit;
+	    }
+
+	    else
+		mac->state.nc_bits++;
+
+	    if(mac->state.nc_bits == 6)
+	    {
+		/* Start the error delimiter, and wait for the bus to
+		   be recessive.  field_bits counts the dominant bits
+		   seen meanwhile, -1 before the first one.
+		*/
+		CAN_XR_PCS_Data_Req(mac->pcs, 1);
+		mac->state.tec_exception = CAN_XR_MAC_TEC_EXCEPTION_NONE;
+		mac->state.field_bits = -1;
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR_WAIT;
+	    }
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_ERROR_WAIT:
+	/* Other nodes may still be transmitting their error flags.
+	   A receiver that sees a dominant bit right after its own
+	   flag was likely the first to detect the error, [1]
+	   12.1.4.2 b), and any node that sees 8 dominant bits in a
+	   row here has been waiting too long, [1] 12.1.4.2 f).  The
+	   first recessive bit is also the first bit of the error
+	   delimiter.
 	*/
+	if(input_unit == 1)
+	{
+	    mac->state.field_bits = 6;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR_DELIM;
+	}
+
+	else if(mac->state.field_bits == -1)
+	{
+	    mac->state.field_bits = 1;
+	    error_count(mac, ts, 0, 8);
+	}
+
+	else if(++mac->state.field_bits == 8)
+	{
+	    mac->state.field_bits = 0;
+	    error_count(mac, ts, 8, 8);
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_ERROR_DELIM:
+    case CAN_XR_MAC_RX_FSM_OVERLOAD_DELIM:
+	/* The error and overload delimiters consist of 8 recessive
+	   bits, [1] 10.4.4.3 and 10.4.5.3, the first one already seen
+	   in ERROR_WAIT or OVERLOAD_WAIT.  A dominant last bit is an
+	   overload condition, [1] 10.4.5.1.
+	*/
+	if(input_unit != 1 && mac->state.field_bits != 0)
+	{
+	    TRACE(9, ">>> MAC @%lu delimiter form error", ts);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
+	}
+
+	else if(mac->state.field_bits-- == 0)
+	{
+	    if(mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_ERROR_DELIM)
+	    {
+		TRACE(2, ">>> MAC @%lu end of error frame tec=%d rec=%d",
+		      ts, mac->state.tec, mac->state.rec);
+		frame_end(mac, mac->state.error_tx);
+	    }
+
+	    if(input_unit == 0)
+		overload_detected(mac, ts);
+	    else
+		intermission(mac);
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_OVERLOAD_FLAG:
+	/* Overload flag, [1] 10.4.5.2, 6 dominant bits counted in
+	   nc_bits.  A recessive one is a bit error, [1] 12.1.4.2 d)
+	   and e), and starts a new overload flag.
+	*/
+	if(input_unit == 1)
+	{
+	    TRACE(9, ">>> MAC @%lu bit error in overload flag", ts);
+
+	    if(error_count(mac, ts, 8, 8))
+		break;
+
+	    mac->state.nc_bits = 0;
+	}
+
+	else if(++mac->state.nc_bits == 6)
+	{
+	    /* Start the overload delimiter, and wait for the bus to
+	       be recessive, like after an error flag.
+	    */
+	    CAN_XR_PCS_Data_Req(mac->pcs, 1);
+	    mac->state.field_bits = 0;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_OVERLOAD_WAIT;
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_OVERLOAD_WAIT:
+	/* Same as ERROR_WAIT, but [1] 12.1.4.2 b) applies to error
+	   flags only.
+	*/
+	if(input_unit == 1)
+	{
+	    mac->state.field_bits = 6;
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_OVERLOAD_DELIM;
+	}
+
+	else if(++mac->state.field_bits == 8)
+	{
+	    mac->state.field_bits = 0;
+	    error_count(mac, ts, 8, 8);
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_BUS_OFF:
+	/* Bus off recovery, [1] 12.1.4.3.  The node is back to error
+	   active after 128 sequences of 11 recessive bits.  By then,
+	   the bus is idle.
+	*/
+	if(input_unit == 0)
+	    mac->state.bus_integration_counter = 0;
+
+	else if(++mac->state.bus_integration_counter == 11)
+	{
+	    mac->state.bus_integration_counter = 0;
+	    if(++mac->state.bus_off_count == 128)
+	    {
+		TRACE(2, ">>> MAC @%lu bus off recovery", ts);
+
+		mac->state.bus_off_count = 0;
+		mac->state.tec = 0;
+		mac->state.rec = 0;
+		frame_end(mac, 0);
+		CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
+		mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_IDLE;
+	    }
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_ERROR:
+	/* Set by bit_monitoring, handled below.
+
+	   In bus monitoring mode, error_detected is not invoked and
+	   we get here at the next bit instead, also after an overload
+	   condition.  Transmit recessive at
+	   next bit boundary, enable hard synchronization and wait for
+	   bus integration, without counting the error.
+	*/
+	if(mac->bus_monitoring)
+	{
+	    rx_stream_abort(mac, ts);
+	    CAN_XR_PCS_Data_Phase_Req(mac->pcs, CAN_XR_PCS_PHASE_NOMINAL, 0);
+	    CAN_XR_PCS_Data_Req(mac->pcs, 1);
+	    CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
+	    mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_BUS_INTEGRATION;
+	}
+	break;
+
+    default:
 	TRACE(9, ">>> MAC @%lu Common::pcs_data_ind invalid rx_fsm_state %d",
 	      ts, mac->state.rx_fsm_state);
 
-	CAN_XR_PCS_Data_Req(mac->pcs, 1);
-	CAN_XR_PCS_Hard_Sync_Allowed_Req(mac->pcs, 1);
-	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_BUS_INTEGRATION;
-	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_IDLE;
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_ERROR;
 	break;
     }
 
+    if(mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_ERROR
+       && !mac->bus_monitoring)
+	error_detected(mac, ts);
+
     /* Handle tx FSM next */
     switch(mac->state.tx_fsm_state)
     {
@@ -817,47 +2394,41 @@ static void pcs_data_ind(
 
 	   In this way, the rx automaton can keep track of stuff bit
 	   insertion, receive messages being transmitted by the tx
-	   automaton and perform bit monitoring (TBD: although bit
-	   monitoring is not implemented at this time).  It also
-	   calculates the CRC to transmit for us.
-
-	   TBD: According to [1], 10.4.2.2 we should bypass sending
-	   SOF if we sample a SOF at the third bit of intermission and
-	   several other conditions are met.  At this time we do not
-	   implement intermission.  So, we stay with the stricter
-	   constraint that we honor a pending transmission request
-	   only if the bus was sampled idle.  We transmit the SOF at
-	   the next bit boundary.
+	   automaton and perform bit monitoring, see bit_monitoring.
+
+	   We honor a pending transmission request if the transmission
+	   is not suspended and the bus was sampled idle, which
+	   includes the third bit of intermission when it is
+	   recessive.  We transmit the SOF at the next bit boundary,
+	   right after intermission.  If instead the third bit of
+	   intermission is dominant, it is also our SOF, [1] 10.4.2.2,
+	   and we transmit the first bit of the identifier at the next
+	   bit boundary.
 
 	   The transmission-related processing is implemented in
 	   tx_processing_ind().
 	*/
 	if(mac->state.data_req_pending &&
-	   mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_IDLE)
+	   (mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_IDLE || early_sof) &&
+	   mac->state.suspend_bits == 0 && !mac->bus_monitoring)
 	    tx_processing_ind(mac, ts, input_unit);
 	break;
 
-    case CAN_XR_MAC_TX_FSM_TX_IDENTIFIER:
-    case CAN_XR_MAC_TX_FSM_TX_RTR:
-    case CAN_XR_MAC_TX_FSM_TX_IDE:
-    case CAN_XR_MAC_TX_FSM_TX_FDF:
-    case CAN_XR_MAC_TX_FSM_TX_DLC:
-    case CAN_XR_MAC_TX_FSM_TX_DATA:
-    case CAN_XR_MAC_TX_FSM_TX_CRC_LATCH:
-    case CAN_XR_MAC_TX_FSM_TX_CRC:
-    case CAN_XR_MAC_TX_FSM_TX_CDEL:
+    case CAN_XR_MAC_TX_FSM_TX_FRAME:
+	/* The bitstream already contains the stuff bits, and no
+	   stuffing is needed in the frame trailer anyway, [1] 10.5
+	   last sentence.
+	*/
+	tx_processing_ind(mac, ts, input_unit);
+	break;
 
     case CAN_XR_MAC_TX_FSM_TX_EXT_DATA:
-	/* Common entry point for all states in which the MAC is
-	   transmitting and bit stuffing is needed.  Do it, then call
-	   tx_processing_ind to continue processing.
+	/* The data field transmitted by ext_tx_data_ind needs bit
+	   stuffing.  Do it, then call tx_processing_ind to continue
+	   processing.
 
 	   Bit stuff state information is kindly kept by the rx
 	   automaton and we thankfully use it.
-
-	   TX_CDEL is in the list because a stuff bit may be required
-	   after the last bit of CRC, at it must be transmitted before
-	   tx_processing_ind() transmits CDEL.
 	*/
 	if(mac->state.nc_bits == 5)
 	{
@@ -895,22 +2466,11 @@ static void pcs_data_ind(
 	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_IDLE;
 	break;
 
-    case CAN_XR_MAC_TX_FSM_TX_ACK:
-    case CAN_XR_MAC_TX_FSM_TX_ADEL:
-    case CAN_XR_MAC_TX_FSM_TX_EOF:
-    case CAN_XR_MAC_TX_FSM_TX_EOF_TAIL:
-	/* Bypass bit stuffing in the frame trailer [1] 10.5 last
-	   sentence.  See above for the special treatment of the
-	   CAN_XR_MAC_TX_FSM_TX_CDEL state.
-	*/
-	tx_processing_ind(mac, ts, input_unit);
-	break;
-
     default:
 	/* This currently catches CAN_XR_MAC_TX_FSM_ERROR, too.
 
-	   TBD: Very simple error recovery: clear data_req_pending,
-	   notify LLC, ask the PCS to transmit recessive at next bit
+	   TBD: Very simple error recovery: drop the frame being
+	   transmitted, notify LLC, ask the PCS to transmit recessive at next bit
 	   boundary, enable hard synchronization, bring the tx
 	   automaton to idle and the rx automaton to the bus
 	   integration state.
@@ -918,7 +2478,7 @@ static void pcs_data_ind(
 	TRACE(9, ">>> MAC @%lu Common::pcs_data_ind invalid tx_fsm_state %d",
 	      ts, mac->state.tx_fsm_state);
 
-	mac->state.data_req_pending = 0;
+	tx_release(&mac->state);
 	if(mac->primitives.data_conf)
 	    mac->primitives.data_conf(
 		mac->llc, ts, mac->state.tx_identifier,
@@ -931,11 +2491,124 @@ static void pcs_data_ind(
     }
 }
 
+/* Bulk PCS_Data.Indicate primitive, 'n' sample points at the same
+   level 'input_unit', see CAN_XR_PCS_Advance.  We take only those in
+   which pcs_data_ind would just count bits, with the transmitter
+   idle, and stop before the one that would do anything else, for
+   instance end bus integration, start a transmission or count an
+   error.  That one goes through pcs_data_ind.
+*/
+static unsigned long pcs_bulk_data_ind(
+    struct CAN_XR_MAC *mac, unsigned long ts, int input_unit,
+    unsigned long n)
+{
+    struct CAN_XR_MAC_State *s = &mac->state;
+    unsigned long k = 0;
+    unsigned long bits;
+
+    TRACE(2, "MAC @%lu Common::pcs_bulk_data_ind(%d, %lu)",
+	  ts, input_unit, n);
+
+    if(s->tx_fsm_state != CAN_XR_MAC_TX_FSM_IDLE)
+	return 0;
+
+    switch(s->rx_fsm_state)
+    {
+    case CAN_XR_MAC_RX_FSM_BUS_INTEGRATION:
+	/* Up to the 10th recessive bit, the 11th declares the bus idle */
+	if(input_unit == 0)
+	{
+	    s->bus_integration_counter = 0;
+	    k = n;
+	}
+
+	else
+	{
+	    k = 10 - s->bus_integration_counter;
+	    if(k > n)  k = n;
+	    s->bus_integration_counter += k;
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_IDLE:
+	/* Recessive bits count down the suspension, a pending frame
+	   goes on the bus in the bit that ends it.
+	*/
+	if(input_unit == 0)
+	    break;
+
+	if(!s->data_req_pending || mac->bus_monitoring)
+	{
+	    k = n;
+	    s->suspend_bits = (k < (unsigned long)s->suspend_bits)
+		? s->suspend_bits - k : 0;
+	}
+
+	else if(s->suspend_bits > 1)
+	{
+	    k = s->suspend_bits - 1;
+	    if(k > n)  k = n;
+	    s->suspend_bits -= k;
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_BUS_OFF:
+	/* Up to the last recessive bit of the 128th sequence */
+	if(input_unit == 0)
+	{
+	    s->bus_integration_counter = 0;
+	    k = n;
+	}
+
+	else
+	{
+	    k = (127 - s->bus_off_count) * 11UL
+		+ 10 - s->bus_integration_counter;
+	    if(k > n)  k = n;
+	    bits = s->bus_off_count * 11UL + s->bus_integration_counter + k;
+	    s->bus_off_count = bits / 11;
+	    s->bus_integration_counter = bits % 11;
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_ERROR_WAIT:
+    case CAN_XR_MAC_RX_FSM_OVERLOAD_WAIT:
+	/* Dominant bits up to the 7th of each group of 8, the 8th is
+	   an error, and the first one after an error flag, too.
+	*/
+	if(input_unit == 0 && s->field_bits >= 0)
+	{
+	    k = 7 - s->field_bits;
+	    if(k > n)  k = n;
+	    s->field_bits += k;
+	}
+	break;
+
+    case CAN_XR_MAC_RX_FSM_ERROR_DELIM:
+    case CAN_XR_MAC_RX_FSM_OVERLOAD_DELIM:
+	/* Recessive bits up to the last one */
+	if(input_unit == 1)
+	{
+	    k = s->field_bits;
+	    if(k > n)  k = n;
+	    s->field_bits -= k;
+	}
+	break;
+
+    default:
+	break;
+    }
+
+    return k;
+}
+
 
 void CAN_XR_MAC_Common_Init(
     struct CAN_XR_MAC *mac,
     struct CAN_XR_PCS *pcs)
 {
+    int i;
+
     TRACE(2, "CAN_XR_MAC_Common_Init");
 
     /* No LLC for now, link to PCS */
@@ -949,8 +2622,19 @@ void CAN_XR_MAC_Common_Init(
     mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_BUS_INTEGRATION;
     mac->state.bus_integration_counter = 0;
 
+    mac->state.tec = 0;
+    mac->state.rec = 0;
+    mac->state.error_tx = 0;
+    mac->state.tec_exception = CAN_XR_MAC_TEC_EXCEPTION_NONE;
+    mac->state.suspend_bits = 0;
+    mac->state.bus_off_count = 0;
+
     mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_IDLE;
     mac->state.data_req_pending = 0;
+    mac->state.tx_slot_map = 0;
+    mac->state.tx_slot = -1;
+    for(i=0; i<CAN_XR_MAC_TX_HEADER_CACHE_SIZE; i++)
+	mac->state.tx_header_cache[i].key = CAN_XR_MAC_TX_HEADER_EMPTY;
 
     /* No data_ind, data_conf for now.  Link the common, static
        data_req, may be overridden by implementation-specific
@@ -959,11 +2643,35 @@ void CAN_XR_MAC_Common_Init(
     mac->primitives.data_ind = NULL;
     mac->primitives.data_conf = NULL;
     mac->primitives.data_req = mac_data_req;
+    mac->primitives.abort_req = mac_abort_req;
     mac->primitives.ext_tx_data_ind = NULL;
+    mac->primitives.xl_data_req = mac_xl_data_req;
+    mac->primitives.xl_data_ind = NULL;
+    mac->primitives.stream_header_ind = NULL;
+    mac->primitives.stream_byte_ind = NULL;
+    mac->primitives.stream_crc_ind = NULL;
+    mac->primitives.stream_abort_ind = NULL;
+    mac->primitives.tx_sof_ind = NULL;
+    mac->rx_fifo = NULL;
+    mac->filter = NULL;
+    mac->dispatch = NULL;
+    mac->pool = NULL;
+    mac->state.rx_frame = -1;
+    mac->bus_monitoring = 0;
+    mac->fd_mode = CAN_XR_MAC_FD_DISABLED;
+    mac->xl_mode = 0;
+    mac->early_validation = 0;
+    mac->state.rx_accept = 1;
+    mac->state.rx_streaming = 0;
+    mac->state.rx_fd = 0;
+    mac->state.rx_brs = 0;
+    mac->state.rx_xl = 0;
+    mac->state.rx_fixed_stuff = 0;
 
     /* Link PCS to MAC, register the common, static data_ind */
     CAN_XR_PCS_Set_MAC(pcs, mac);
     CAN_XR_PCS_Set_Data_Ind(pcs, pcs_data_ind);
+    CAN_XR_PCS_Set_Bulk_Data_Ind(pcs, pcs_bulk_data_ind);
 }
 
 void CAN_XR_MAC_Set_LLC(struct CAN_XR_MAC *mac, struct CAN_XR_LLC *llc)
@@ -983,13 +2691,113 @@ void CAN_XR_MAC_Set_Data_Conf(
     mac->primitives.data_conf = data_conf;
 }
 
+void CAN_XR_MAC_Set_RX_FIFO(
+    struct CAN_XR_MAC *mac, struct CAN_XR_RX_FIFO *fifo)
+{
+    mac->rx_fifo = fifo;
+}
+
+void CAN_XR_MAC_Set_Filter(
+    struct CAN_XR_MAC *mac, const struct CAN_XR_Filter *filter)
+{
+    mac->filter = filter;
+}
+
+void CAN_XR_MAC_Set_Dispatch(
+    struct CAN_XR_MAC *mac, struct CAN_XR_Dispatch *dispatch)
+{
+    mac->dispatch = dispatch;
+}
+
+int CAN_XR_MAC_Subscribe(
+    struct CAN_XR_MAC *mac, uint32_t first, uint32_t last,
+    CAN_XR_Dispatch_Callback_t callback, void *ctx)
+{
+    if(!mac->dispatch)
+	return -1;
+
+    return CAN_XR_Dispatch_Subscribe(mac->dispatch, first, last,
+				     callback, ctx);
+}
+
+void CAN_XR_MAC_Set_Pool(struct CAN_XR_MAC *mac, struct CAN_XR_Pool *pool)
+{
+    mac->pool = pool;
+    mac->state.rx_frame = -1;
+}
+
+void CAN_XR_MAC_Set_Bus_Monitoring(
+    struct CAN_XR_MAC *mac, int bus_monitoring)
+{
+    mac->bus_monitoring = bus_monitoring;
+}
+
+void CAN_XR_MAC_Set_FD_Mode(
+    struct CAN_XR_MAC *mac, enum CAN_XR_MAC_FD_Mode fd_mode)
+{
+    mac->fd_mode = fd_mode;
+}
+
+void CAN_XR_MAC_Set_XL_Mode(struct CAN_XR_MAC *mac, int xl_mode)
+{
+    mac->xl_mode = xl_mode;
+}
+
+void CAN_XR_MAC_Set_XL_Data_Ind(
+    struct CAN_XR_MAC *mac, CAN_XR_MAC_XL_Data_Ind_t xl_data_ind)
+{
+    mac->primitives.xl_data_ind = xl_data_ind;
+}
+
+void CAN_XR_MAC_Set_Stream_Ind(
+    struct CAN_XR_MAC *mac,
+    CAN_XR_MAC_Stream_Header_Ind_t stream_header_ind,
+    CAN_XR_MAC_Stream_Byte_Ind_t stream_byte_ind,
+    CAN_XR_MAC_Stream_CRC_Ind_t stream_crc_ind,
+    CAN_XR_MAC_Stream_Abort_Ind_t stream_abort_ind)
+{
+    mac->primitives.stream_header_ind = stream_header_ind;
+    mac->primitives.stream_byte_ind = stream_byte_ind;
+    mac->primitives.stream_crc_ind = stream_crc_ind;
+    mac->primitives.stream_abort_ind = stream_abort_ind;
+}
+
+void CAN_XR_MAC_Set_TX_SOF_Ind(
+    struct CAN_XR_MAC *mac, CAN_XR_MAC_TX_SOF_Ind_t tx_sof_ind)
+{
+    mac->primitives.tx_sof_ind = tx_sof_ind;
+}
+
+void CAN_XR_MAC_Set_Early_Validation(
+    struct CAN_XR_MAC *mac, int early_validation)
+{
+    mac->early_validation = early_validation;
+}
+
 void CAN_XR_MAC_Set_Ext_Tx_Data_Ind(
     struct CAN_XR_MAC *mac, CAN_XR_MAC_Ext_Tx_Data_Ind_t ext_tx_data_ind)
 {
     mac->primitives.ext_tx_data_ind = ext_tx_data_ind;
 }
 
+int CAN_XR_MAC_Is_Idle(const struct CAN_XR_MAC *mac)
+{
+    return mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_IDLE
+	&& mac->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_IDLE
+	&& !mac->state.data_req_pending
+	&& !mac->state.suspend_bits;
+}
 
+enum CAN_XR_MAC_Fault_State CAN_XR_MAC_Get_Fault_State(
+    const struct CAN_XR_MAC *mac)
+{
+    if(mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_BUS_OFF)
+	return CAN_XR_MAC_FAULT_BUS_OFF;
+    else if(error_passive(&mac->state))
+	return CAN_XR_MAC_FAULT_ERROR_PASSIVE;
+    else
+	return CAN_XR_MAC_FAULT_ERROR_ACTIVE;
+}
 
 void CAN_XR_MAC_Data_Req(
     struct CAN_XR_MAC *mac,
@@ -998,3 +2806,27 @@ void CAN_XR_MAC_Data_Req(
     if(mac->primitives.data_req)
 	mac->primitives.data_req(mac, identifier, format, dlc, data);
 }
+
+void CAN_XR_MAC_XL_Data_Req(
+    struct CAN_XR_MAC *mac, uint32_t identifier,
+    const struct CAN_XR_XL_Control *xl, int dlc, uint8_t *data)
+{
+    if(mac->primitives.xl_data_req)
+	mac->primitives.xl_data_req(mac, identifier, xl, dlc, data);
+}
+
+void CAN_XR_MAC_Data_Req_Burst(
+    struct CAN_XR_MAC *mac, const struct CAN_XR_MAC_Frame *frames, int n)
+{
+    int i;
+
+    for(i=0; i<n; i++)
+	CAN_XR_MAC_Data_Req(mac, frames[i].identifier, frames[i].format,
+			    frames[i].dlc, frames[i].data);
+}
+
+void CAN_XR_MAC_Abort_Req(struct CAN_XR_MAC *mac, uint32_t identifier)
+{
+    if(mac->primitives.abort_req)
+	mac->primitives.abort_req(mac, identifier);
+}
@@ -42,6 +42,14 @@ static void dump_array(FILE *f, const char *desc, const uint8_t *d, int len)
     fprintf(f, "},\n");
 }
 
+/* Length of the data field, within the buffers. */
+static int data_length(enum CAN_XR_Format format, int dlc)
+{
+    int n_data = CAN_XR_DATA_LENGTH(format, dlc);
+
+    return (n_data > CAN_XR_MAX_DATA) ? CAN_XR_MAX_DATA : n_data;
+}
+
 void CAN_XR_MAC_Dump(
     const char *desc, const struct CAN_XR_MAC *mac)
 {
@@ -54,7 +62,9 @@ void CAN_XR_MAC_Dump(
 	    "  nc_bits=%d, nc_pol=%d,\n"
 	    "  crc=0x%04x,\n"
 	    "  field_bits=%d, bus_bits=%d, de_stuffed_bits=%d,\n"
-	    "  rx_identifier=%u, rx_rtr=%d, rx_ide=%d, rx_fdf=%d, rx_dlc=%d,\n"
+	    "  rx_identifier=%u, rx_accept=%d, rx_rtr=%d, rx_ide=%d, rx_fdf=%d, rx_dlc=%d,\n"
+	    "  rx_fd=%d, rx_brs=%d, rx_esi=%d, crc17=0x%05lx, crc21=0x%06lx,\n"
+	    "  rx_xl=%d, pcrc=0x%04lx, fcrc=0x%08lx,\n"
 	    "  rx_byte=0x%02x, rx_byte_index=%d,\n",
 	    desc,
 	    state->rx_fsm_state,
@@ -62,27 +72,49 @@ void CAN_XR_MAC_Dump(
 	    state->nc_bits, state->nc_pol,
 	    state->crc,
 	    state->field_bits, state->bus_bits, state->de_stuffed_bits,
-	    (unsigned int)state->rx_identifier, state->rx_rtr,
+	    (unsigned int)state->rx_identifier, state->rx_accept,
+	    state->rx_rtr,
 	    state->rx_ide, state->rx_fdf, state->rx_dlc,
+	    state->rx_fd, state->rx_brs, state->rx_esi,
+	    (unsigned long)state->crc17, (unsigned long)state->crc21,
+	    state->rx_xl,
+	    (unsigned long)state->pcrc, (unsigned long)state->fcrc,
 	    state->rx_byte, state->rx_byte_index
 	);
     dump_array(stderr, "  rx_data[]= ", state->rx_data,
-	       state->rx_dlc <= 8 ? state->rx_dlc : 8);
+	       data_length(state->rx_xl ? CAN_XR_FORMAT_XLFF
+			   : state->rx_fd ? CAN_XR_FORMAT_FBFF
+			   : CAN_XR_FORMAT_CBFF, state->rx_dlc));
 
     fprintf(stderr,
 	    "\n"
 	    "  tx_fsm_state=%d,\n"
-	    "  data_req_pending=%d,\n"
-	    "  tx_identifier=%u, tx_format=%d, tx_dlc=%d,\n",
+	    "  data_req_pending=%d, tx_slot_map=0x%08lx,\n",
 	    state->tx_fsm_state,
-	    state->data_req_pending,
+	    state->data_req_pending, (unsigned long)state->tx_slot_map
+	);
+    dump_array(stderr, "  tx_queue[]= ", state->tx_queue,
+	       state->data_req_pending);
+    fprintf(stderr,
+	    "  tx_slot=%d,\n"
+	    "  tx_identifier=%u, tx_format=%d, tx_dlc=%d,\n",
+	    state->tx_slot,
 	    (unsigned int)state->tx_identifier, state->tx_format, state->tx_dlc
 	);
-    dump_array(stderr, "  tx_data[]= ", state->tx_data,
-	       state->tx_dlc <= 8 ? state->tx_dlc : 8);
+    if(state->tx_slot >= 0)
+	dump_array(stderr, "  tx_slots[tx_slot].data[]= ",
+		   state->tx_slots[state->tx_slot].data,
+		   data_length(state->tx_format, state->tx_dlc));
     fprintf(stderr,
-	    "  tx_byte_index=%d, tx_bit_count=%d, tx_shift_reg=0x%02x\n"
+	    "  tx_byte_index=%d, tx_bit_count=%d, tx_shift_reg=0x%02x,\n"
+	    "  tx_bitstream_bits=%d, tx_bit_index=%d,\n"
+	    "\n"
+	    "  tec=%d, rec=%d, error_tx=%d, tec_exception=%d,\n"
+	    "  suspend_bits=%d, bus_off_count=%d\n"
 	    "}\n",
 	    state->tx_byte_index, state->tx_bit_count,
-	    (unsigned int)state->tx_shift_reg);
+	    (unsigned int)state->tx_shift_reg,
+	    state->tx_bitstream_bits, state->tx_bit_index,
+	    state->tec, state->rec, state->error_tx, state->tec_exception,
+	    state->suspend_bits, state->bus_off_count);
 }
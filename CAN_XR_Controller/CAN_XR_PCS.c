@@ -28,6 +28,15 @@
    currently the same as the regular CAN PCS specified in ISO
    11898-1:2015(E) [1], Section 11.1.
 
+   In the data phase of FD frames with bit rate switching, it uses the
+   data phase bit time instead of the nominal one, [1] 11.3.1.2.  A
+   transmitter with transmitter delay compensation (TDC) also checks
+   the bits it sends at a secondary sample point (SSP), which follows
+   the start of each bit by the transmitter delay, measured before the
+   data phase, plus a fixed offset, [1] 11.3.3.  The data phase of XL
+   frames works the same way, with its own bit time and offset,
+   CiA 610-1 [2].
+
    This module is also responsible of keeping a timestamp counter
    based on nodeclock.  This is not specified in the standard.
 */
@@ -37,14 +46,143 @@
 #include "CAN_XR_PCS.h"
 #include "CAN_XR_Trace.h"
 
+/* Bit time parameters in use, nominal or data phase. */
+static const struct CAN_XR_PCS_Bit_Time_Parameters *bit_time(
+    const struct CAN_XR_PCS *pcs)
+{
+    switch(pcs->state.data_phase)
+    {
+    case CAN_XR_PCS_PHASE_FD_DATA:
+	return &pcs->data_parameters;
+    case CAN_XR_PCS_PHASE_XL_DATA:
+	return &pcs->xl_data_parameters;
+    default:
+	return &pcs->parameters;
+    }
+}
+
+/* Secondary sample point offset in the data phase in use. */
+static int ssp_offset(const struct CAN_XR_PCS *pcs)
+{
+    return (pcs->state.data_phase == CAN_XR_PCS_PHASE_XL_DATA)
+	? pcs->xl_ssp_offset : pcs->ssp_offset;
+}
+
+/* Return 1 if 'p' is the compile-time nominal bit time, see
+   CAN_XR_PCS_FIXED_PRESCALER_M, 0 if not or if there is none.
+*/
+static int fixed_bit_time(const struct CAN_XR_PCS_Bit_Time_Parameters *p)
+{
+#ifdef CAN_XR_PCS_FIXED_PRESCALER_M
+    return p->prescaler_m == CAN_XR_PCS_FIXED_PRESCALER_M
+	&& p->sync_seg == CAN_XR_PCS_FIXED_SYNC_SEG
+	&& p->prop_seg == CAN_XR_PCS_FIXED_PROP_SEG
+	&& p->phase_seg1 == CAN_XR_PCS_FIXED_PHASE_SEG1
+	&& p->phase_seg2 == CAN_XR_PCS_FIXED_PHASE_SEG2
+	&& p->sjw == CAN_XR_PCS_FIXED_SJW;
+#else
+    (void)p;
+    return 0;
+#endif
+}
+
+/* Derive the state information that depends on the bit time in use.
+   It must be invoked whenever it changes.
+*/
+static void derive_state(struct CAN_XR_PCS *pcs)
+{
+    const struct CAN_XR_PCS_Bit_Time_Parameters *p = bit_time(pcs);
+
+    pcs->state.sample_point = p->sync_seg + p->prop_seg + p->phase_seg1 - 1;
+    pcs->state.quanta_per_bit = pcs->state.sample_point + 1 + p->phase_seg2;
+    pcs->state.fixed = pcs->state.data_phase == CAN_XR_PCS_PHASE_NOMINAL
+	&& fixed_bit_time(p);
+}
+
+/* Bit time in use, as needed on each nodeclock tick or quantum.  When
+   it is the compile-time one, they are constants the compiler folds
+   into immediates, otherwise they come from the derived state or the
+   parameters.
+*/
+static inline int cur_prescaler_m(const struct CAN_XR_PCS *pcs)
+{
+#ifdef CAN_XR_PCS_FIXED_PRESCALER_M
+    if(pcs->state.fixed)
+	return CAN_XR_PCS_FIXED_PRESCALER_M;
+#endif
+    return bit_time(pcs)->prescaler_m;
+}
+
+static inline int cur_sample_point(const struct CAN_XR_PCS *pcs)
+{
+#ifdef CAN_XR_PCS_FIXED_PRESCALER_M
+    if(pcs->state.fixed)
+	return CAN_XR_PCS_FIXED_SAMPLE_POINT;
+#endif
+    return pcs->state.sample_point;
+}
+
+static inline int cur_quanta_per_bit(const struct CAN_XR_PCS *pcs)
+{
+#ifdef CAN_XR_PCS_FIXED_PRESCALER_M
+    if(pcs->state.fixed)
+	return CAN_XR_PCS_FIXED_QUANTA_PER_BIT;
+#endif
+    return pcs->state.quanta_per_bit;
+}
+
+static inline int cur_sjw(const struct CAN_XR_PCS *pcs)
+{
+#ifdef CAN_XR_PCS_FIXED_PRESCALER_M
+    if(pcs->state.fixed)
+	return CAN_XR_PCS_FIXED_SJW;
+#endif
+    return bit_time(pcs)->sjw;
+}
+
+/* Upcall to the MAC at the sample point, and downcall to the PMA at
+   the bit boundary.  The fast stack, see CAN_XR_Fast_Stack.h, makes
+   them direct calls that the compiler can inline.
+*/
+static void mac_data_ind(
+    struct CAN_XR_PCS *pcs, unsigned long ts, int bus_level)
+{
+#ifdef CAN_XR_FAST_STACK
+    CAN_XR_Fast_MAC_Data_Ind(pcs->mac, ts, bus_level);
+#else
+    if(pcs->primitives.data_ind)
+	pcs->primitives.data_ind(pcs->mac, ts, bus_level);
+#endif
+}
+
+/* Bulk upcall to the MAC, see CAN_XR_PCS_Advance.  Without a bulk
+   primitive, the MAC takes no sample point in bulk.
+*/
+static unsigned long mac_bulk_data_ind(
+    struct CAN_XR_PCS *pcs, unsigned long ts, int bus_level,
+    unsigned long n)
+{
+#ifdef CAN_XR_FAST_STACK
+    return CAN_XR_Fast_MAC_Bulk_Data_Ind(pcs->mac, ts, bus_level, n);
+#else
+    if(pcs->primitives.bulk_data_ind)
+	return pcs->primitives.bulk_data_ind(pcs->mac, ts, bus_level, n);
+    return 0;
+#endif
+}
+
+static void pma_data_req(struct CAN_XR_PCS *pcs, int bus_level)
+{
+#ifdef CAN_XR_FAST_STACK
+    CAN_XR_FAST_PMA_DATA_REQ(pcs->pma, bus_level);
+#else
+    CAN_XR_PMA_Data_Req(pcs->pma, bus_level);
+#endif
+}
+
 /* Initialize PCS state. */
 static void init_state(struct CAN_XR_PCS *pcs)
 {
-    /* State information derived from parameters */
-    pcs->state.quanta_per_bit =
-	pcs->parameters.sync_seg + pcs->parameters.prop_seg
-	+ pcs->parameters.phase_seg1 + pcs->parameters.phase_seg2;
-
     /* Fixed state information */
     pcs->state.nodeclock_ts = (unsigned long)0;
     pcs->state.prescaler_m_cnt = 0;
@@ -67,6 +205,24 @@ static void init_state(struct CAN_XR_PCS *pcs)
        to the quantum counter.
     */
     pcs->state.sending_level = 1;
+
+    /* Nominal bit time, no transmitter delay measured yet */
+    pcs->state.data_phase = 0;
+    pcs->state.tdc = 0;
+    pcs->state.tdc_pending = 0;
+    pcs->state.tdc_ts = (unsigned long)0;
+    pcs->state.tdc_delay = 0;
+    pcs->state.ssp_head = 0;
+    pcs->state.ssp_count = 0;
+    pcs->state.ssp_error = 0;
+
+    /* State information derived from parameters */
+    derive_state(pcs);
+
+#ifdef CAN_XR_PCS_FIXED_PRESCALER_M
+    if(!pcs->state.fixed)
+	TRACE(1, ">>> Nominal bit time is not the compile-time one");
+#endif
 }
 
 /* Implementation of data_req primitive.
@@ -95,8 +251,48 @@ static void data_req(struct CAN_XR_PCS *pcs, int output_unit)
     pcs->state.output_unit_buf = output_unit;
 }
 
+/* At the bit boundary, pass output_unit_buf to the PMA, see
+   quantumclock_m_ind.  'ts' is the time of the quantum clock edge.
+*/
+static void bit_boundary(struct CAN_XR_PCS *pcs, unsigned long ts)
+{
+    pma_data_req(pcs, pcs->state.output_unit_buf);
+
+    /* Transmitter delay compensation, [1] 11.3.3.  Before the data
+       phase, time the dominant edges we send until we see them, see
+       nodeclock_ind.  In the data phase, schedule the check of this
+       bit at its secondary sample point.  If the queue is full, the
+       delay is too long and the bit is not checked.
+    */
+    if(pcs->state.tdc)
+    {
+	if(pcs->state.ssp_count < CAN_XR_PCS_SSP_QUEUE)
+	{
+	    int i = (pcs->state.ssp_head + pcs->state.ssp_count)
+		& (CAN_XR_PCS_SSP_QUEUE - 1);
+
+	    pcs->state.ssp_ts[i] = ts + pcs->state.tdc_delay
+		+ (unsigned long)ssp_offset(pcs) * cur_prescaler_m(pcs);
+	    pcs->state.ssp_level[i] = pcs->state.output_unit_buf;
+	    pcs->state.ssp_count++;
+	}
+    }
+
+    else if(pcs->state.output_unit_buf == 0
+	    && pcs->state.sending_level == 1)
+    {
+	pcs->state.tdc_pending = 1;
+	pcs->state.tdc_ts = ts;
+    }
+
+    /* Update our internal notion of what is being sent on the bus,
+       for synchronization.
+    */
+    pcs->state.sending_level = pcs->state.output_unit_buf;
+}
+
 /* This internal primitive is invoked on the edges of the m quantum
-   clock (nominal bit time).
+   clock (nominal or data phase bit time).
 
    It implements
    - quantum m counting: [1] Section 11.3.1.1.
@@ -112,6 +308,7 @@ static void quantumclock_m_ind(
     int edge;
     int phase_error;
     int sync_amount;
+    int sjw;
 
     TRACE(1, "PCS @%lu quantumclock_m_ind(%d)", ts, bus_level);
 
@@ -142,21 +339,27 @@ static void quantumclock_m_ind(
 	    (pcs->state.quantum_m_cnt == 0)
 	    ? 0
 	    : ((pcs->state.quantum_m_cnt
-		<= (pcs->parameters.sync_seg + pcs->parameters.prop_seg
-		    + pcs->parameters.phase_seg1 - 1)
+		<= cur_sample_point(pcs)
 		/* Case 2, positive phase error (edge before s.p.) */
 		? pcs->state.quantum_m_cnt
 		/* Case 3, negative phase error (edge after s.p.) */
-		: (pcs->state.quantum_m_cnt - pcs->state.quanta_per_bit)));
+		: (pcs->state.quantum_m_cnt - cur_quanta_per_bit(pcs))));
 
 	/* [1] 11.3.2.1 b) 2), part 1) of the same clause was handled
 	   before computing the phase error.
 	*/
-	if(phase_error < 0
-	   || (phase_error > 0 && pcs->state.sending_level == 1))
+	if(pcs->state.tdc)
+	{
+	    /* [1] 11.3.2.1 d), a transmitter in the data phase with
+	       TDC does not synchronize on its own, delayed, edges.
+	    */
+	    TRACE(1, ">>> Edge ignored by transmitter with TDC");
+	}
+
+	else if(phase_error < 0
+		|| (phase_error > 0 && pcs->state.sending_level == 1))
 	{
-	    /* Edge good for synchronization.  [1] 11.3.2.1 d) is
-	       irrelevant for legacy CAN.
+	    /* Edge good for synchronization.
 
 	       Choose between hard and soft synchronization according to
 	       what the MAC tells us.  [1] 11.3.2.1 c) depends on MAC
@@ -185,11 +388,12 @@ static void quantumclock_m_ind(
 
 		   Clip phase_error with sjw on both ends.
 		*/
+		sjw = cur_sjw(pcs);
 		sync_amount =
-		    (phase_error > pcs->parameters.sjw)
-		    ? pcs->parameters.sjw
-		    : ((phase_error < - pcs->parameters.sjw)
-		       ? - pcs->parameters.sjw
+		    (phase_error > sjw)
+		    ? sjw
+		    : ((phase_error < - sjw)
+		       ? - sjw
 		       : phase_error);
 
 		/* Before the sampling point the phase error is always
@@ -254,12 +458,9 @@ static void quantumclock_m_ind(
        This may lead the MAC to call PCS back through
        PCS_Data.Request.
     */
-    if(pcs->state.quantum_m_cnt ==
-       (pcs->parameters.sync_seg + pcs->parameters.prop_seg
-	+ pcs->parameters.phase_seg1 - 1))
+    if(pcs->state.quantum_m_cnt == cur_sample_point(pcs))
     {
-	if(pcs->primitives.data_ind)
-	    pcs->primitives.data_ind(pcs->mac, ts, bus_level);
+	mac_data_ind(pcs, ts, bus_level);
 
 	/* Per [1] 11.3.2.1 a) reset sync_inhibit when the bus state
 	   detected at the sample point is recessive.
@@ -277,28 +478,56 @@ static void quantumclock_m_ind(
        instead of == below.  See the comments on data_req and
        above.
     */
-    if(pcs->state.quantum_m_cnt >= pcs->state.quanta_per_bit - 1)
+    if(pcs->state.quantum_m_cnt >= cur_quanta_per_bit(pcs) - 1)
     {
 	TRACE(1, ">>> Synchronized PMA_Data_Req%s",
-	      pcs->state.quantum_m_cnt == pcs->state.quanta_per_bit - 1
+	      pcs->state.quantum_m_cnt == cur_quanta_per_bit(pcs) - 1
 	      ? "" : " (after repositioned sync_seg)");
 
-	CAN_XR_PMA_Data_Req(pcs->pma, pcs->state.output_unit_buf);
-
-	/* Update our internal notion of what is being sent on the
-	   bus, for synchronization.
-	*/
-	pcs->state.sending_level = pcs->state.output_unit_buf;
+	bit_boundary(pcs, ts);
     }
 
-    /* Update quantum_m_cnt, wrap around at end of bit */
-    pcs->state.quantum_m_cnt =
-	(pcs->state.quantum_m_cnt + 1) % pcs->state.quanta_per_bit;
+    /* Update quantum_m_cnt, wrap around at end of bit.  It is at most
+       quanta_per_bit here, see above, so there is no need to divide.
+    */
+    if(++pcs->state.quantum_m_cnt >= cur_quanta_per_bit(pcs))
+	pcs->state.quantum_m_cnt -= cur_quanta_per_bit(pcs);
 
     /* Update prev_bus_level for the edge detector */
     pcs->state.prev_bus_level = bus_level;
 }
 
+/* Transmitter delay measurement and secondary sample points, see
+   quantumclock_m_ind, at nodeclock_ts, 'ticks' after the previous
+   invocation.  The delay is the shortest one consistent with seeing
+   the edge now, and a secondary sample point that falls between two
+   invocations is checked at the second one.
+*/
+static void tdc_ind(struct CAN_XR_PCS *pcs, int bus_level, int ticks)
+{
+    if(pcs->state.tdc_pending && bus_level == 0)
+    {
+	pcs->state.tdc_delay =
+	    pcs->state.nodeclock_ts - (ticks - 1) - pcs->state.tdc_ts;
+	pcs->state.tdc_pending = 0;
+    }
+
+    if(pcs->state.ssp_count > 0
+       && (long)(pcs->state.nodeclock_ts
+		 - pcs->state.ssp_ts[pcs->state.ssp_head]) >= 0)
+    {
+	if(bus_level != pcs->state.ssp_level[pcs->state.ssp_head])
+	{
+	    TRACE(1, ">>> Bit error at SSP");
+	    pcs->state.ssp_error = 1;
+	}
+
+	pcs->state.ssp_head =
+	    (pcs->state.ssp_head + 1) & (CAN_XR_PCS_SSP_QUEUE - 1);
+	pcs->state.ssp_count--;
+    }
+}
+
 /* Implementation of nodeclock_ind, invoked from PMA. */
 static void nodeclock_ind(struct CAN_XR_PCS *pcs, int bus_level)
 {
@@ -310,18 +539,249 @@ static void nodeclock_ind(struct CAN_XR_PCS *pcs, int bus_level)
     */
     pcs->state.nodeclock_ts++;
 
-    /* Prescaler, [1] Section 11.3.1.1. */
-    pcs->state.prescaler_m_cnt =
-	(pcs->state.prescaler_m_cnt + 1) % pcs->parameters.prescaler_m;
+    tdc_ind(pcs, bus_level, 1);
 
-    if(pcs->state.prescaler_m_cnt == 0)
+    /* Prescaler, [1] Section 11.3.1.1. */
+    if(++pcs->state.prescaler_m_cnt >= cur_prescaler_m(pcs))
     {
+	pcs->state.prescaler_m_cnt = 0;
+
 	/* At m quantum edge */
 	quantumclock_m_ind(pcs, pcs->state.nodeclock_ts, bus_level);
     }
 
 }
 
+/* Implementation of quantumclock_ind, invoked from a PMA that does
+   the prescaling itself, on each m quantum clock edge.  The timestamp
+   counter advances by a whole quantum, so the transmitter delay is
+   measured, and secondary sample points checked, with the resolution
+   of one quantum instead of one nodeclock tick.
+*/
+static int quantumclock_ind(struct CAN_XR_PCS *pcs, int bus_level)
+{
+    int prescaler_m = cur_prescaler_m(pcs);
+
+    TRACE(1, "PCS quantumclock_ind(%d)", bus_level);
+
+    /* Same as nodeclock_ind, prescaler_m_cnt stays at zero */
+    pcs->state.nodeclock_ts += prescaler_m;
+
+    tdc_ind(pcs, bus_level, prescaler_m);
+
+    quantumclock_m_ind(pcs, pcs->state.nodeclock_ts, bus_level);
+
+    /* The bit time may have changed at the sample point */
+    return cur_prescaler_m(pcs);
+}
+
+/* Bus level of sample 'i' of a batch. */
+static inline int batch_level(const uint8_t *buf, size_t i, int packed)
+{
+    return packed ? (buf[i >> 3] >> (i & 7)) & 1 : buf[i];
+}
+
+/* Block version of nodeclock_ind.  Transmitter delay compensation
+   looks at every sample, so it falls back on nodeclock_ind when a
+   delay measurement or a secondary sample point is pending.
+   Otherwise, it jumps from one quantum clock edge to the next, and
+   invokes quantumclock_m_ind only when the quantum needs it, see
+   there.  The compiler specializes it for 'packed'.
+*/
+static inline void nodeclock_batch(
+    struct CAN_XR_PCS *pcs, const uint8_t *buf, size_t n, int packed)
+{
+    size_t i = 0;
+    int ticks;
+    int bus_level;
+
+    TRACE(1, "PCS @%lu nodeclock_batch(%lu)",
+	  pcs->state.nodeclock_ts, (unsigned long)n);
+
+    while(i < n)
+    {
+	if(pcs->state.tdc_pending || pcs->state.ssp_count > 0)
+	{
+	    nodeclock_ind(pcs, batch_level(buf, i++, packed));
+	    continue;
+	}
+
+	/* Ticks up to the next quantum clock edge, included */
+	ticks = cur_prescaler_m(pcs) - pcs->state.prescaler_m_cnt;
+	if((size_t)ticks > n - i)
+	{
+	    pcs->state.nodeclock_ts += n - i;
+	    pcs->state.prescaler_m_cnt += n - i;
+	    return;
+	}
+
+	i += ticks;
+	pcs->state.nodeclock_ts += ticks;
+	pcs->state.prescaler_m_cnt = 0;
+	bus_level = batch_level(buf, i - 1, packed);
+
+	/* Without an edge, before the bit boundary and not at the
+	   sample point, quantumclock_m_ind would only count.
+	*/
+	if(bus_level == pcs->state.prev_bus_level
+	   && pcs->state.quantum_m_cnt != cur_sample_point(pcs)
+	   && pcs->state.quantum_m_cnt < cur_quanta_per_bit(pcs) - 1)
+	    pcs->state.quantum_m_cnt++;
+	else
+	    quantumclock_m_ind(pcs, pcs->state.nodeclock_ts, bus_level);
+    }
+}
+
+void CAN_XR_PCS_NodeClock_Batch(
+    struct CAN_XR_PCS *pcs, const uint8_t *levels, size_t n)
+{
+    nodeclock_batch(pcs, levels, n, 0);
+}
+
+void CAN_XR_PCS_NodeClock_Batch_Packed(
+    struct CAN_XR_PCS *pcs, const uint8_t *bits, size_t n)
+{
+    nodeclock_batch(pcs, bits, n, 1);
+}
+
+/* Advance over 'quanta' quantum clock edges, at least one, at a
+   constant 'bus_level' that is also the level at the previous edge.
+   Since there are no edges, no synchronization takes place and the
+   quantum counter just keeps running.  We only need to know whether
+   at least one sample point and one bit boundary fall within the
+   interval, to update the state they affect.  The MAC gets no
+   indication at the sample points, and the bit boundary passes the
+   same output_unit_buf to the PMA every time, so doing it once is
+   enough.
+*/
+static void advance_quanta(
+    struct CAN_XR_PCS *pcs, unsigned long quanta, int bus_level)
+{
+    unsigned long prescaler_m = cur_prescaler_m(pcs);
+    int sample_point = cur_sample_point(pcs);
+    int quanta_per_bit = cur_quanta_per_bit(pcs);
+    int quantum_m_cnt = pcs->state.quantum_m_cnt;
+    unsigned long first_ts =
+	pcs->state.nodeclock_ts + prescaler_m - pcs->state.prescaler_m_cnt;
+    unsigned long boundary;
+
+    /* The quanta that elapse are quantum_m_cnt, quantum_m_cnt+1, ...,
+       quantum_m_cnt+quanta-1, modulus quanta_per_bit.  At the sample
+       point, a recessive bus resets sync_inhibit.
+    */
+    if(quanta >= (unsigned long)quanta_per_bit
+       || ((sample_point - quantum_m_cnt + quanta_per_bit) % quanta_per_bit)
+       < quanta)
+    {
+	if(bus_level == 1)  pcs->state.sync_inhibit = 0;
+	pcs->state.prev_sample = bus_level;
+    }
+
+    boundary = (quanta_per_bit - 1 - quantum_m_cnt + quanta_per_bit)
+	% quanta_per_bit;
+    if(boundary < quanta)
+	bit_boundary(pcs, first_ts + boundary * prescaler_m);
+
+    pcs->state.quantum_m_cnt =
+	(quantum_m_cnt + quanta % quanta_per_bit) % quanta_per_bit;
+    pcs->state.nodeclock_ts = first_ts + (quanta - 1) * prescaler_m;
+    pcs->state.prescaler_m_cnt = 0;
+    pcs->state.prev_bus_level = bus_level;
+}
+
+/* Fast-forward over a recessive interval, see advance_quanta. */
+void CAN_XR_PCS_Skip(struct CAN_XR_PCS *pcs, unsigned long ticks)
+{
+    unsigned long prescaler_m = cur_prescaler_m(pcs);
+    unsigned long quanta;
+
+    TRACE(1, "PCS @%lu CAN_XR_PCS_Skip(%lu)", pcs->state.nodeclock_ts, ticks);
+
+    /* Number of quantum clock edges within the interval. */
+    quanta = ((unsigned long)pcs->state.prescaler_m_cnt + ticks) / prescaler_m;
+
+    if(quanta > 0)
+    {
+	ticks -= prescaler_m - pcs->state.prescaler_m_cnt
+	    + (quanta - 1) * prescaler_m;
+	advance_quanta(pcs, quanta, 1);
+    }
+
+    pcs->state.nodeclock_ts += ticks;
+    pcs->state.prescaler_m_cnt += ticks;
+}
+
+/* Fast-forward over an interval at a constant level, see
+   advance_quanta.  The first quantum clock edge at the new level may
+   see an edge, and transmitter delay compensation looks at every
+   tick, so they go through nodeclock_ind.  Then, the interval is
+   split at sample points.  At each of them, the MAC takes as many
+   sample points as it can with a bulk indication, and we advance
+   over them at once.  When it takes none, the sample point goes
+   through quantumclock_m_ind instead, so that the MAC can react.
+*/
+void CAN_XR_PCS_Advance(
+    struct CAN_XR_PCS *pcs, unsigned long ticks, int bus_level)
+{
+    unsigned long end = pcs->state.nodeclock_ts + ticks;
+    unsigned long prescaler_m, first, quanta, samples, n;
+    int quanta_per_bit, to_sample_point;
+
+    TRACE(1, "PCS @%lu CAN_XR_PCS_Advance(%lu, %d)",
+	  pcs->state.nodeclock_ts, ticks, bus_level);
+
+    while(pcs->state.nodeclock_ts != end
+	  && (pcs->state.prev_bus_level != bus_level
+	      || pcs->state.tdc || pcs->state.ssp_count > 0
+	      || (pcs->state.tdc_pending && bus_level == 0)))
+	nodeclock_ind(pcs, bus_level);
+
+    while(pcs->state.nodeclock_ts != end)
+    {
+	prescaler_m = cur_prescaler_m(pcs);
+	first = prescaler_m - pcs->state.prescaler_m_cnt;
+	ticks = end - pcs->state.nodeclock_ts;
+
+	/* No more quantum clock edges */
+	if(ticks < first)
+	{
+	    pcs->state.nodeclock_ts = end;
+	    pcs->state.prescaler_m_cnt += ticks;
+	    break;
+	}
+
+	quanta = (ticks - first) / prescaler_m + 1;
+	quanta_per_bit = cur_quanta_per_bit(pcs);
+	to_sample_point =
+	    (cur_sample_point(pcs) - pcs->state.quantum_m_cnt + quanta_per_bit)
+	    % quanta_per_bit;
+
+	/* Up to the next sample point, excluded */
+	if(to_sample_point > 0)
+	{
+	    advance_quanta(
+		pcs, quanta < (unsigned long)to_sample_point
+		? quanta : (unsigned long)to_sample_point, bus_level);
+	    continue;
+	}
+
+	/* At a sample point */
+	samples = (quanta - 1) / quanta_per_bit + 1;
+	n = mac_bulk_data_ind(
+	    pcs, pcs->state.nodeclock_ts + first, bus_level, samples);
+
+	if(n > 0)
+	    advance_quanta(pcs, (n - 1) * quanta_per_bit + 1, bus_level);
+
+	else
+	{
+	    pcs->state.nodeclock_ts += first;
+	    pcs->state.prescaler_m_cnt = 0;
+	    quantumclock_m_ind(pcs, pcs->state.nodeclock_ts, bus_level);
+	}
+    }
+}
+
 void CAN_XR_PCS_Init(
     struct CAN_XR_PCS *pcs,
     const struct CAN_XR_PCS_Bit_Time_Parameters *parameters,
@@ -334,16 +794,22 @@ void CAN_XR_PCS_Init(
     pcs->pma = pma;
 
     pcs->parameters = *parameters; /* Copy, just in case. */
+    pcs->data_parameters = *parameters;
+    pcs->ssp_offset = 0;
+    pcs->xl_data_parameters = *parameters;
+    pcs->xl_ssp_offset = 0;
 
     init_state(pcs); /* May use parameters */
 
     /* No data_ind for now, link static data_req */
     pcs->primitives.data_ind = NULL;
+    pcs->primitives.bulk_data_ind = NULL;
     pcs->primitives.data_req = data_req;
 
-    /* Link PMA to PCS, register nodeclock_ind */
+    /* Link PMA to PCS, register nodeclock_ind and quantumclock_ind */
     CAN_XR_PMA_Set_PCS(pma, pcs);
     CAN_XR_PMA_Set_NodeClock_Ind(pma, nodeclock_ind);
+    CAN_XR_PMA_Set_QuantumClock_Ind(pma, quantumclock_ind);
 }
 
 void CAN_XR_PCS_Set_MAC(struct CAN_XR_PCS *pcs, struct CAN_XR_MAC *mac)
@@ -357,6 +823,12 @@ void CAN_XR_PCS_Set_Data_Ind(
     pcs->primitives.data_ind = data_ind;
 }
 
+void CAN_XR_PCS_Set_Bulk_Data_Ind(
+    struct CAN_XR_PCS *pcs, CAN_XR_PCS_Bulk_Data_Ind_t bulk_data_ind)
+{
+    pcs->primitives.bulk_data_ind = bulk_data_ind;
+}
+
 void CAN_XR_PCS_Data_Req(struct CAN_XR_PCS *pcs, int output_unit)
 {
     if(pcs->primitives.data_req)
@@ -368,3 +840,56 @@ void CAN_XR_PCS_Hard_Sync_Allowed_Req(
 {
     pcs->state.hard_sync_allowed = hard_sync_allowed;
 }
+
+void CAN_XR_PCS_Set_Data_Bit_Time(
+    struct CAN_XR_PCS *pcs,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *data_parameters,
+    int ssp_offset)
+{
+    pcs->data_parameters = *data_parameters;
+    pcs->ssp_offset = ssp_offset;
+}
+
+void CAN_XR_PCS_Set_XL_Data_Bit_Time(
+    struct CAN_XR_PCS *pcs,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *xl_data_parameters,
+    int xl_ssp_offset)
+{
+    pcs->xl_data_parameters = *xl_data_parameters;
+    pcs->xl_ssp_offset = xl_ssp_offset;
+}
+
+/* We are at the sample point of the old bit time, so quantum_m_cnt
+   jumps to the sample point of the new one.  The prescaler count is
+   zero at a quantum edge anyway.  Pending secondary sample points
+   are dropped, see CAN_XR_PCS_Get_SSP_Error.
+*/
+void CAN_XR_PCS_Data_Phase_Req(
+    struct CAN_XR_PCS *pcs, int data_phase, int transmitter)
+{
+    if(data_phase == pcs->state.data_phase)
+	return;
+
+    TRACE(1, "PCS @%lu CAN_XR_PCS_Data_Phase_Req(%d, %d)",
+	  pcs->state.nodeclock_ts, data_phase, transmitter);
+
+    pcs->state.data_phase = data_phase;
+    derive_state(pcs);
+    pcs->state.quantum_m_cnt = pcs->state.sample_point;
+
+    pcs->state.tdc = data_phase && transmitter && ssp_offset(pcs) > 0;
+    pcs->state.tdc_pending = 0;
+    pcs->state.ssp_count = 0;
+    pcs->state.ssp_error = 0;
+}
+
+int CAN_XR_PCS_Get_SSP_Error(struct CAN_XR_PCS *pcs)
+{
+    int ssp_error = pcs->state.ssp_error;
+
+    if(!pcs->state.tdc)
+	return -1;
+
+    pcs->state.ssp_error = 0;
+    return ssp_error;
+}
@@ -44,6 +44,13 @@ void CAN_XR_PMA_Set_NodeClock_Ind(
     pma->primitives.nodeclock_ind = nodeclock_ind;
 }
 
+/* Set the quantumclock_ind callback of 'pma' to 'quantumclock_ind'. */
+void CAN_XR_PMA_Set_QuantumClock_Ind(
+    struct CAN_XR_PMA *pma, CAN_XR_PMA_QuantumClock_Ind_t quantumclock_ind)
+{
+    pma->primitives.quantumclock_ind = quantumclock_ind;
+}
+
 /* Invoke the data_req primitive of 'pma' to drive the bus to 'bus_level' */
 void CAN_XR_PMA_Data_Req(struct CAN_XR_PMA *pma, int bus_level)
 {
@@ -0,0 +1,125 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This file implements the frame pool.  See CAN_XR_Pool.h for more
+   information.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CAN_XR_Pool.h"
+
+void CAN_XR_Pool_Init(struct CAN_XR_Pool *pool)
+{
+    int i;
+
+    /* Lowest buffers on top of the stack, for no particular reason */
+    for(i=0; i<CAN_XR_POOL_FRAMES; i++)
+    {
+	pool->free[i] = CAN_XR_POOL_FRAMES - 1 - i;
+	pool->frames[i].refs = 0;
+    }
+
+    pool->n_free = CAN_XR_POOL_FRAMES;
+    pool->exhausted = 0;
+}
+
+int CAN_XR_Pool_Alloc(struct CAN_XR_Pool *pool)
+{
+    int frame;
+
+    if(pool->n_free == 0)
+    {
+	pool->exhausted++;
+	return -1;
+    }
+
+    frame = pool->free[--pool->n_free];
+    pool->frames[frame].refs = 1;
+    return frame;
+}
+
+void CAN_XR_Pool_Ref(struct CAN_XR_Pool *pool, int frame)
+{
+    pool->frames[frame].refs++;
+}
+
+void CAN_XR_Pool_Release(struct CAN_XR_Pool *pool, int frame)
+{
+    if(--pool->frames[frame].refs == 0)
+	pool->free[pool->n_free++] = frame;
+}
+
+uint8_t *CAN_XR_Pool_Data(struct CAN_XR_Pool *pool, int frame)
+{
+    return pool->frames[frame].data;
+}
+
+int CAN_XR_Pool_Handle(const struct CAN_XR_Pool *pool, const uint8_t *data)
+{
+    const uint8_t *base;
+    ptrdiff_t offset;
+    int frame;
+
+    if(pool == NULL)
+	return -1;
+
+    /* Comparing unrelated pointers is not portable C, but works on
+       all flat address spaces we run on.
+    */
+    base = (const uint8_t *)pool->frames
+	+ offsetof(struct CAN_XR_Pool_Frame, data);
+    if(data < base)
+	return -1;
+
+    offset = data - base;
+    frame = offset / sizeof(struct CAN_XR_Pool_Frame);
+    if(frame >= CAN_XR_POOL_FRAMES
+       || offset % sizeof(struct CAN_XR_Pool_Frame) != 0
+       || pool->frames[frame].refs == 0)
+	return -1;
+
+    return frame;
+}
+
+int CAN_XR_Pool_Hold(struct CAN_XR_Pool *pool, const uint8_t *data)
+{
+    int frame = CAN_XR_Pool_Handle(pool, data);
+
+    if(frame >= 0)
+	pool->frames[frame].refs++;
+    return frame;
+}
+
+int CAN_XR_Pool_Refs(const struct CAN_XR_Pool *pool, int frame)
+{
+    return pool->frames[frame].refs;
+}
+
+int CAN_XR_Pool_Free(const struct CAN_XR_Pool *pool)
+{
+    return pool->n_free;
+}
@@ -0,0 +1,118 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This file implements the RX FIFO.  See CAN_XR_RX_FIFO.h for more
+   information.
+
+   Records are published by a release store of the index that covers
+   them, and read after an acquire load of the same index, on both
+   sides.  On the boards, which have a single core, the builtins boil
+   down to plain loads and stores plus memory barriers.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include "CAN_XR_RX_FIFO.h"
+
+#define INDEX_MASK (CAN_XR_RX_FIFO_SIZE - 1)
+
+void CAN_XR_RX_FIFO_Init(struct CAN_XR_RX_FIFO *fifo)
+{
+    fifo->producer.head = 0;
+    fifo->producer.tail_copy = 0;
+    fifo->producer.lost = 0;
+    fifo->producer.frames = 0;
+    fifo->producer.overflows = 0;
+    fifo->consumer.tail = 0;
+    fifo->consumer.head_copy = 0;
+}
+
+int CAN_XR_RX_FIFO_Put(
+    struct CAN_XR_RX_FIFO *fifo, unsigned long ts,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc,
+    const uint8_t *data)
+{
+    uint32_t head = fifo->producer.head;
+    struct CAN_XR_RX_FIFO_Record *r;
+    int n_data;
+
+    /* Look at the real tail only if the FIFO looks full. */
+    if(head - fifo->producer.tail_copy == CAN_XR_RX_FIFO_SIZE)
+    {
+	fifo->producer.tail_copy =
+	    __atomic_load_n(&fifo->consumer.tail, __ATOMIC_ACQUIRE);
+
+	if(head - fifo->producer.tail_copy == CAN_XR_RX_FIFO_SIZE)
+	{
+	    fifo->producer.lost++;
+	    __atomic_store_n(&fifo->producer.overflows,
+			     fifo->producer.overflows + 1, __ATOMIC_RELAXED);
+	    return 0;
+	}
+    }
+
+    r = &fifo->records[head & INDEX_MASK];
+    r->ts = ts;
+    r->identifier = identifier;
+    r->format = format;
+    r->dlc = dlc;
+    n_data = CAN_XR_DATA_LENGTH(format, dlc);
+    if(n_data > CAN_XR_MAX_DATA)  n_data = CAN_XR_MAX_DATA;
+    memcpy(r->data, data, n_data);
+    r->lost = fifo->producer.lost;
+    fifo->producer.lost = 0;
+
+    __atomic_store_n(&fifo->producer.frames,
+		     fifo->producer.frames + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&fifo->producer.head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int CAN_XR_RX_FIFO_Get(
+    struct CAN_XR_RX_FIFO *fifo, struct CAN_XR_RX_FIFO_Record *record)
+{
+    uint32_t tail = fifo->consumer.tail;
+
+    /* Look at the real head only if the FIFO looks empty. */
+    if(tail == fifo->consumer.head_copy)
+    {
+	fifo->consumer.head_copy =
+	    __atomic_load_n(&fifo->producer.head, __ATOMIC_ACQUIRE);
+
+	if(tail == fifo->consumer.head_copy)
+	    return 0;
+    }
+
+    *record = fifo->records[tail & INDEX_MASK];
+
+    __atomic_store_n(&fifo->consumer.tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+unsigned long CAN_XR_RX_FIFO_Overflows(const struct CAN_XR_RX_FIFO *fifo)
+{
+    return __atomic_load_n(&fifo->producer.overflows, __ATOMIC_RELAXED);
+}
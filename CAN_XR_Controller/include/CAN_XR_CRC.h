@@ -0,0 +1,132 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations of the CRC-15 engines,
+   ISO 11898-1:2015(E) [1] 10.4.2.6.  They work on bit streams packed
+   MSb first into bytes: bit i of a stream is bit 7 - i%8 of byte
+   i/8.
+
+   The bit engine is the reference, the same as the MAC uses because
+   it gets one bit at a time anyway.  The others process a nibble, a
+   byte, or CAN_XR_CRC_SLICES bytes at a time with precomputed tables,
+   and fall back to the bit engine only for the bits before the first
+   nibble boundary and after the last one.  They are meant for code
+   that has whole fields or frames at hand, like the frame-level
+   simulator or the decoding of captured streams.
+
+   All engines return the same value as the bit engine.  The CRC of a
+   frame is computed from SOF to the end of the data field, starting
+   from zero, and the CRC of a stream that includes a correct CRC
+   field is zero.
+
+   FD frames use CRC-17 up to 16 data bytes and CRC-21 above, [1]
+   10.4.2.6, which only have a bit engine.  Their registers start
+   with the MSb set rather than from zero, and also cover the dynamic
+   stuff bits and the stuff count.
+
+   XL frames, CiA 610-1 [2], have a 13-bit preface CRC (PCRC) over the
+   header, and a 32-bit frame CRC (FCRC) over the whole frame.  Both
+   start with all bits set.  The FCRC also has a byte engine, because
+   it covers up to 2048 data bytes that are not interleaved with
+   stuff bits.
+*/
+
+#ifndef CAN_XR_CRC_H
+#define CAN_XR_CRC_H
+
+#include <stdint.h>
+
+#define CAN_XR_CRC_POLYNOMIAL 0x4599 /* It's monic, MSb omitted */
+#define CAN_XR_CRC17_POLYNOMIAL 0x1685B
+#define CAN_XR_CRC21_POLYNOMIAL 0x102899
+#define CAN_XR_CRC17_INIT 0x10000
+#define CAN_XR_CRC21_INIT 0x100000
+#define CAN_XR_PCRC_POLYNOMIAL 0x1C1F
+#define CAN_XR_FCRC_POLYNOMIAL 0xF1922815
+#define CAN_XR_PCRC_INIT 0x1FFF
+#define CAN_XR_FCRC_INIT 0xFFFFFFFF
+
+/* Number of bytes processed at a time by CAN_XR_CRC_Slice_Update,
+   [2, 8].
+*/
+#ifndef CAN_XR_CRC_SLICES
+#define CAN_XR_CRC_SLICES 8
+#endif
+
+/* Tables for CAN_XR_CRC_Slice_Update, 512 bytes each.  They are in a
+   caller-allocated data structure, and not const like the nibble and
+   byte tables, so that they do not take space on the board unless
+   they are actually used.
+*/
+struct CAN_XR_CRC_Slice_Tables
+{
+    uint16_t table[CAN_XR_CRC_SLICES][256];
+};
+
+/* Update 'crc' with the LSb of 'nxtbit'. */
+uint16_t CAN_XR_CRC_Bit(uint16_t crc, int nxtbit);
+
+/* Update the CRC-17 or CRC-21 'crc' with the LSb of 'nxtbit'. */
+uint32_t CAN_XR_CRC17_Bit(uint32_t crc, int nxtbit);
+uint32_t CAN_XR_CRC21_Bit(uint32_t crc, int nxtbit);
+
+/* Update the XL PCRC or FCRC 'crc' with the LSb of 'nxtbit'. */
+uint32_t CAN_XR_PCRC_Bit(uint32_t crc, int nxtbit);
+uint32_t CAN_XR_FCRC_Bit(uint32_t crc, int nxtbit);
+
+/* Update the XL FCRC 'crc' with 8 bits, MSb first. */
+uint32_t CAN_XR_FCRC_Byte(uint32_t crc, uint8_t byte);
+
+/* Update 'crc' with 4 bits, the LSbs of 'nibble', MSb first. */
+uint16_t CAN_XR_CRC_Nibble(uint16_t crc, int nibble);
+
+/* Update 'crc' with 8 bits, MSb first. */
+uint16_t CAN_XR_CRC_Byte(uint16_t crc, uint8_t byte);
+
+/* Update 'crc' with 'n_bits' bits of 'data', starting from bit
+   'first_bit', one bit at a time.
+*/
+uint16_t CAN_XR_CRC_Bits_Update(
+    uint16_t crc, const uint8_t *data,
+    unsigned long first_bit, unsigned long n_bits);
+
+/* Same as CAN_XR_CRC_Bits_Update, but a byte at a time. */
+uint16_t CAN_XR_CRC_Update(
+    uint16_t crc, const uint8_t *data,
+    unsigned long first_bit, unsigned long n_bits);
+
+/* Initialize 'tables' for CAN_XR_CRC_Slice_Update. */
+void CAN_XR_CRC_Slice_Init(struct CAN_XR_CRC_Slice_Tables *tables);
+
+/* Same as CAN_XR_CRC_Bits_Update, but CAN_XR_CRC_SLICES bytes at a
+   time.  Worth it only for long streams.
+*/
+uint16_t CAN_XR_CRC_Slice_Update(
+    const struct CAN_XR_CRC_Slice_Tables *tables,
+    uint16_t crc, const uint8_t *data,
+    unsigned long first_bit, unsigned long n_bits);
+
+#endif
@@ -0,0 +1,111 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations of the dispatch table, which
+   delivers each received frame to the subscriber of its identifier.
+   The table is indexed directly by the 11-bit identifier, so
+   dispatching a frame takes a single load and a single call, no
+   matter how many subscriptions there are.
+
+   Each identifier has at most one subscriber, the one of the last
+   subscription that covers it.  A subscriber is a callback and an
+   opaque context pointer passed back to it, so that callbacks do not
+   need to recover their context from the LLC pointer.  Subscribers
+   with the same callback and context share the same entry.
+
+   Frames reach the dispatch table only if they pass the acceptance
+   filter, in addition to data_ind and the RX FIFO.
+*/
+
+#ifndef CAN_XR_DISPATCH_H
+#define CAN_XR_DISPATCH_H
+
+#include <stdint.h>
+#include "CAN_XR_LLC.h" /* For enum CAN_XR_Format */
+
+/* Size of the identifier space covered by the table, CBFF. */
+#define CAN_XR_DISPATCH_IDS 2048
+
+/* Maximum number of distinct subscribers, [1, 65535].  Each one
+   costs 8 bytes on the boards.
+*/
+#ifndef CAN_XR_DISPATCH_SUBSCRIBERS
+#define CAN_XR_DISPATCH_SUBSCRIBERS 64
+#endif
+
+/* Subscriber callback, with the same arguments as MAC_Data.Indicate,
+   except for the context pointer in place of the LLC.
+*/
+typedef void (* CAN_XR_Dispatch_Callback_t)(
+    void *ctx, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data);
+
+struct CAN_XR_Dispatch_Subscriber
+{
+    CAN_XR_Dispatch_Callback_t callback;
+    void *ctx;
+};
+
+/* Dispatch table, 4 KiB plus the subscribers.  index[id] is the
+   subscriber of identifier 'id' plus one, zero if there is none.
+*/
+struct CAN_XR_Dispatch
+{
+    uint16_t index[CAN_XR_DISPATCH_IDS];
+    int n_subscribers;
+    struct CAN_XR_Dispatch_Subscriber subscribers[
+	CAN_XR_DISPATCH_SUBSCRIBERS];
+};
+
+/* Initialize 'dispatch', without subscriptions. */
+void CAN_XR_Dispatch_Init(struct CAN_XR_Dispatch *dispatch);
+
+/* Subscribe 'callback' and 'ctx' to identifiers 'first' to 'last',
+   included, replacing former subscriptions.  Return the number of
+   the subscriber, or -1 if the identifiers are out of range or there
+   are too many subscribers already.
+*/
+int CAN_XR_Dispatch_Subscribe(
+    struct CAN_XR_Dispatch *dispatch, uint32_t first, uint32_t last,
+    CAN_XR_Dispatch_Callback_t callback, void *ctx);
+
+/* Remove any subscription to identifiers 'first' to 'last',
+   included.  Subscriber entries are not reused until
+   CAN_XR_Dispatch_Init.
+*/
+void CAN_XR_Dispatch_Unsubscribe(
+    struct CAN_XR_Dispatch *dispatch, uint32_t first, uint32_t last);
+
+/* Invoke the subscriber of 'identifier', if any.  'identifier' must
+   be less than CAN_XR_DISPATCH_IDS.  Return non-zero if there was a
+   subscriber.
+*/
+int CAN_XR_Dispatch_Ind(
+    const struct CAN_XR_Dispatch *dispatch, unsigned long ts,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc,
+    uint8_t *data);
+
+#endif
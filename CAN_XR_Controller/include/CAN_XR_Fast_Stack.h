@@ -0,0 +1,123 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header composes the PCS and the MAC statically, for the
+   nodeclock loop of a PMA.  It is meant for the boards, where the
+   whole per-nodeclock path, from the PMA up to the MAC automata and
+   back, must fit in one nodeclock period.
+
+   With the function-pointer API, each nodeclock goes through
+   nodeclock_ind, then PCS data_ind at sample points, and each
+   CAN_XR_PCS_Data_Req and CAN_XR_PMA_Data_Req adds another indirect
+   call.  Here, the PCS and MAC sources are compiled in the
+   translation unit that includes this header, with those hops
+   replaced by direct calls to static functions, and
+   CAN_XR_Fast_NodeClock_Ind is the entry point of the stack.  The
+   compiler can then inline the whole path into the nodeclock loop.
+
+   Include this header in exactly one translation unit, the one with
+   the nodeclock loop.  It defines all the functions of CAN_XR_PCS.c
+   and CAN_XR_MAC_Common.c, so the corresponding library objects are
+   not linked.  The rest of the API is unchanged, and the PMA must
+   still be initialized and linked to the PCS as usual, but its
+   nodeclock_ind and the PCS data_ind primitives are bypassed.  The
+   PCS must be linked to a MAC.
+
+   Before including this header, the PMA may define
+   CAN_XR_FAST_PMA_DATA_REQ(pma, bus_level) to drive the bus
+   directly.  By default, it invokes the data_req primitive of the
+   PMA.
+*/
+
+#ifndef CAN_XR_FAST_STACK_H
+#define CAN_XR_FAST_STACK_H
+
+#ifndef CAN_XR_FAST_STACK
+#define CAN_XR_FAST_STACK
+#endif
+
+#include "CAN_XR_PMA.h"
+#include "CAN_XR_PCS.h"
+#include "CAN_XR_MAC.h"
+
+#ifndef CAN_XR_FAST_PMA_DATA_REQ
+#define CAN_XR_FAST_PMA_DATA_REQ(pma, bus_level) \
+    ((pma)->primitives.data_req((pma), (bus_level)))
+#endif
+
+/* PCS to MAC, defined below */
+static inline void CAN_XR_Fast_MAC_Data_Ind(
+    struct CAN_XR_MAC *mac, unsigned long ts, int bus_level);
+static inline unsigned long CAN_XR_Fast_MAC_Bulk_Data_Ind(
+    struct CAN_XR_MAC *mac, unsigned long ts, int bus_level,
+    unsigned long n);
+
+#include "../CAN_XR_PCS.c"
+
+/* MAC to PCS.  The data_req primitive of the PCS only buffers the
+   output unit until the next bit boundary.
+*/
+#define CAN_XR_PCS_Data_Req(pcs, output_unit) \
+    ((void)((pcs)->state.output_unit_buf = (output_unit)))
+
+#include "../CAN_XR_MAC_Common.c"
+
+static inline void CAN_XR_Fast_MAC_Data_Ind(
+    struct CAN_XR_MAC *mac, unsigned long ts, int bus_level)
+{
+    pcs_data_ind(mac, ts, bus_level);
+}
+
+static inline unsigned long CAN_XR_Fast_MAC_Bulk_Data_Ind(
+    struct CAN_XR_MAC *mac, unsigned long ts, int bus_level,
+    unsigned long n)
+{
+    return pcs_bulk_data_ind(mac, ts, bus_level, n);
+}
+
+/* Entry point of the stack, to be invoked by the PMA on every
+   nodeclock tick with the bus level it samples, in place of the
+   nodeclock_ind primitive.
+*/
+static inline void CAN_XR_Fast_NodeClock_Ind(
+    struct CAN_XR_PCS *pcs, int bus_level)
+{
+    nodeclock_ind(pcs, bus_level);
+}
+
+/* Same as CAN_XR_Fast_NodeClock_Ind, in place of the quantumclock_ind
+   primitive.  It returns the number of nodeclock ticks to the next
+   time quantum edge.
+*/
+static inline int CAN_XR_Fast_QuantumClock_Ind(
+    struct CAN_XR_PCS *pcs, int bus_level)
+{
+    return quantumclock_ind(pcs, bus_level);
+}
+
+#undef CAN_XR_PCS_Data_Req
+
+#endif
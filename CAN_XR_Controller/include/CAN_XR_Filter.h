@@ -0,0 +1,84 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations of the acceptance filter, a
+   bitmap with one bit per 11-bit identifier.  The MAC looks up the
+   identifier of a frame being received as soon as the identifier
+   field is complete, with a single load, no matter how many
+   identifiers the filter accepts.  Frames the filter rejects are
+   still acknowledged, as [1] 10.4.2.7 requires, but they do not
+   reach data_ind nor the RX FIFO.
+
+   Hardware-style code/mask pairs are expanded into the bitmap when
+   they are added, so they cost nothing at run time.  Changing the
+   filter while the MAC is receiving affects the next frame at the
+   earliest.
+*/
+
+#ifndef CAN_XR_FILTER_H
+#define CAN_XR_FILTER_H
+
+#include <stdint.h>
+
+/* Size of the identifier space covered by the filter, CBFF. */
+#define CAN_XR_FILTER_IDS 2048
+
+/* Acceptance filter, 256 bytes.  Bit id%32 of bitmap[id/32] is set if
+   the filter accepts identifier 'id'.
+*/
+struct CAN_XR_Filter
+{
+    uint32_t bitmap[CAN_XR_FILTER_IDS / 32];
+};
+
+/* Initialize 'filter' to reject all identifiers, or to accept all of
+   them if 'accept_all' is non-zero.
+*/
+void CAN_XR_Filter_Init(struct CAN_XR_Filter *filter, int accept_all);
+
+/* Accept, or reject, 'identifier'. */
+void CAN_XR_Filter_Add_Id(struct CAN_XR_Filter *filter, uint32_t identifier);
+void CAN_XR_Filter_Remove_Id(
+    struct CAN_XR_Filter *filter, uint32_t identifier);
+
+/* Accept all identifiers 'id' such that (id & mask) == (code & mask),
+   like a code/mask register pair of a hardware controller.  Bits
+   cleared in 'mask' are "don't care".
+*/
+void CAN_XR_Filter_Add_Mask(
+    struct CAN_XR_Filter *filter, uint32_t code, uint32_t mask);
+
+/* Return non-zero if 'filter' accepts 'identifier'. */
+int CAN_XR_Filter_Accepts(
+    const struct CAN_XR_Filter *filter, uint32_t identifier);
+
+/* Same as CAN_XR_Filter_Accepts, for the MAC receive path.
+   'identifier' must be less than CAN_XR_FILTER_IDS.
+*/
+#define CAN_XR_FILTER_ACCEPTS(filter, identifier) \
+    (((filter)->bitmap[(identifier) >> 5] >> ((identifier) & 0x1F)) & 0x1)
+
+#endif
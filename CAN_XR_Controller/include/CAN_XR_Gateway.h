@@ -0,0 +1,172 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations of the store-and-forward
+   gateway, which connects two MACs attached to different buses and
+   forwards frames between them according to a routing table.
+
+   The gateway is the LLC of both MACs.  Routes are compiled into the
+   dispatch table of their source MAC, so routing a frame takes a
+   single load and a single call, like dispatching it.  Since the
+   dispatch table is the last consumer of a received frame, the
+   payload transform of a route works in place on the receive buffer
+   of the MAC, and the frame is copied only once, by
+   CAN_XR_MAC_Data_Req into a TX slot of the other MAC.  The other
+   MAC transmits it right from the slot.
+
+   When the other MAC has no free TX slots, the frame is dropped,
+   unless the source MAC has a frame pool.  In that case the gateway
+   keeps the pool buffer of the frame in a backlog, and submits it
+   as soon as a slot is free, so that it is still copied only once.
+   Since the transform works in place, other holders of the buffer
+   see the transformed payload.
+
+   The gateway measures the latency of each route from the end of
+   frame on the source bus to its SOF on the destination bus.  The
+   timestamps of the two MACs must have the same time base, as when
+   they are driven by the same nodeclock.
+
+   XL frames are forwarded without their additional fields, like
+   CAN_XR_MAC_Data_Req does.
+*/
+
+#ifndef CAN_XR_GATEWAY_H
+#define CAN_XR_GATEWAY_H
+
+#include <stdint.h>
+#include "CAN_XR_MAC.h"
+#include "CAN_XR_Dispatch.h"
+
+/* Maximum number of routes, in both directions. */
+#ifndef CAN_XR_GATEWAY_ROUTES
+#define CAN_XR_GATEWAY_ROUTES 32
+#endif
+
+/* Maximum number of frames in the backlog of each side. */
+#ifndef CAN_XR_GATEWAY_BACKLOG
+#define CAN_XR_GATEWAY_BACKLOG 8
+#endif
+
+/* Payload transform of a route.  It is invoked with the translated
+   identifier and may modify the first CAN_XR_MAX_DATA bytes of
+   'data' in place.  It returns the DLC of the forwarded frame, or a
+   negative value to drop it.
+*/
+typedef int (* CAN_XR_Gateway_Transform_t)(
+    void *ctx, uint32_t identifier, enum CAN_XR_Format format, int dlc,
+    uint8_t *data);
+
+struct CAN_XR_Gateway;
+
+/* Route, with its statistics.  Latencies are in nodeclock ticks. */
+struct CAN_XR_Gateway_Route
+{
+    struct CAN_XR_Gateway *gw;
+    int from;			/* Source side, 0 or 1 */
+    uint32_t first, last;	/* Source identifiers */
+    uint32_t identifier;	/* Translation of 'first' */
+    CAN_XR_Gateway_Transform_t transform;
+    void *ctx;
+
+    unsigned long n_forwarded;	/* Queued on the other side */
+    unsigned long n_backlogged;	/* Waited for a TX slot */
+    unsigned long n_dropped;	/* By the transform or no room */
+    unsigned long n_failed;	/* Confirmed without success */
+    unsigned long n_measured;
+    unsigned long latency_min, latency_max, latency_sum;
+};
+
+/* Forwarded frame waiting for its SOF or confirmation */
+struct CAN_XR_Gateway_Pending
+{
+    uint32_t identifier;
+    int route;
+    int measured;
+    unsigned long rx_ts;
+};
+
+/* Frame in the backlog, in pool buffer 'frame' of 'pool' */
+struct CAN_XR_Gateway_Held
+{
+    struct CAN_XR_Pool *pool;
+    int frame;
+    uint32_t identifier;
+    enum CAN_XR_Format format;
+    int dlc;
+    int route;
+    unsigned long rx_ts;
+};
+
+/* One side of the gateway.  The LLC pointer of its MAC points here. */
+struct CAN_XR_Gateway_Side
+{
+    struct CAN_XR_Gateway *gw;
+    struct CAN_XR_MAC *mac;
+    struct CAN_XR_Dispatch dispatch;
+
+    /* Frames forwarded to this side, in order */
+    int n_pending;
+    struct CAN_XR_Gateway_Pending pending[CAN_XR_MAC_TX_SLOTS];
+
+    /* Frames waiting for a TX slot on this side, in order */
+    int n_held;
+    struct CAN_XR_Gateway_Held held[CAN_XR_GATEWAY_BACKLOG];
+};
+
+struct CAN_XR_Gateway
+{
+    struct CAN_XR_Gateway_Side side[2];
+    int n_routes;
+    struct CAN_XR_Gateway_Route routes[CAN_XR_GATEWAY_ROUTES];
+};
+
+/* Initialize 'gw' between 'mac0' (side 0) and 'mac1' (side 1),
+   without routes.  This sets the LLC, data_conf, tx_sof_ind and
+   dispatch table of both MACs.  Identifiers not routed can still be
+   subscribed to with CAN_XR_MAC_Subscribe, and an RX FIFO can still
+   be set.
+*/
+void CAN_XR_Gateway_Init(
+    struct CAN_XR_Gateway *gw, struct CAN_XR_MAC *mac0,
+    struct CAN_XR_MAC *mac1);
+
+/* Forward the frames received from side 'from' with identifiers
+   'first' to 'last', included, to the other side.  Identifier
+   'first' + i becomes 'identifier' + i there.  'transform', if not
+   NULL, is applied to the payload with 'ctx'.  Return the number of
+   the route, or -1 if the arguments are out of range or there are too
+   many routes already.  A route replaces former routes of the same
+   identifiers.
+*/
+int CAN_XR_Gateway_Add_Route(
+    struct CAN_XR_Gateway *gw, int from, uint32_t first, uint32_t last,
+    uint32_t identifier, CAN_XR_Gateway_Transform_t transform, void *ctx);
+
+/* Return route 'n' with its statistics, NULL if 'n' is out of range. */
+const struct CAN_XR_Gateway_Route *CAN_XR_Gateway_Get_Route(
+    const struct CAN_XR_Gateway *gw, int n);
+
+#endif
@@ -26,12 +26,16 @@
 
 /* This header contains the declarations and definitions needed by the
    CAN XR Link Layer Control.  Specified in ISO 11898-1:2015(E) [1],
-   Section 8.
+   Section 8, and in CiA 610-1 [2] for CAN XL frames.
 
    TBD: Incomplete.  Currently it only contains data type definitions
    shared between LLC and MAC.
 */
 
+#ifndef CAN_XR_LLC_H
+#define CAN_XR_LLC_H
+
+#include <stdint.h>
 
 /* LLC frame format, [1] Table 4, also used by MAC.  Generally, data
    types are defined in the header of the highest layer that uses them
@@ -41,6 +45,54 @@
 enum CAN_XR_Format {
     CAN_XR_FORMAT_CBFF, /* Classical Base (11b) */
     CAN_XR_FORMAT_CEFF, /* Classical Extended (29b), unsupported */
-    CAN_XR_FORMAT_FBFF, /* FD Base (11b), unsupported */
-    CAN_XR_FORMAT_FEFF  /* FD Extended (29b), unsupported */
+    CAN_XR_FORMAT_FBFF, /* FD Base (11b) */
+    CAN_XR_FORMAT_FEFF, /* FD Extended (29b), unsupported */
+    CAN_XR_FORMAT_XLFF  /* XL (11b), [2] */
+};
+
+/* Fields of XL frames that other formats do not have, [2]: the SDU
+   type, the simple extended content bit, the virtual CAN network
+   identifier, and the acceptance field.
+*/
+struct CAN_XR_XL_Control
+{
+    uint8_t sdt;
+    uint8_t sec;
+    uint8_t vcid;
+    uint32_t af;
 };
+
+/* Maximum length of the data field, in bytes, [1] 10.4.2.5: 8 in
+   classical frames, 64 in FD frames, 2048 in XL frames.  It sizes all
+   data buffers, and may be lowered to 8 to save memory on nodes that
+   do not need FD frames, or raised up to 2048 on nodes that transmit
+   or deliver long XL frames.  Nodes still receive and acknowledge
+   longer frames, but they neither transmit nor deliver them.
+*/
+#ifndef CAN_XR_MAX_DATA
+#define CAN_XR_MAX_DATA 64
+#endif
+
+/* Length of the data field, in bytes, of an FD frame with data length
+   code 'dlc', [1] 10.4.2.4.  Up to 8 it is the same as in classical
+   frames, above it grows by 4 bytes per code up to 24, then by 16.
+*/
+#define CAN_XR_FD_DATA_LENGTH(dlc)					\
+    ((dlc) <= 8 ? (dlc) : (dlc) <= 12 ? 4 * ((dlc) - 6) : 16 * ((dlc) - 11))
+
+/* Length of the data field, in bytes, of an XL frame with data
+   length code 'dlc', [2].  The code has 11 bits and is the length
+   minus one.
+*/
+#define CAN_XR_XL_DATA_LENGTH(dlc) (((dlc) & 0x7FF) + 1)
+
+/* Length of the data field, in bytes, of a frame with 'format' and
+   data length code 'dlc'.  In classical frames, codes above 8 still
+   mean 8 bytes.
+*/
+#define CAN_XR_DATA_LENGTH(format, dlc)					\
+    ((format) == CAN_XR_FORMAT_XLFF ? CAN_XR_XL_DATA_LENGTH(dlc)	\
+     : ((format) == CAN_XR_FORMAT_FBFF || (format) == CAN_XR_FORMAT_FEFF) \
+     ? CAN_XR_FD_DATA_LENGTH((dlc) & 0xF) : ((dlc) > 8 ? 8 : (dlc)))
+
+#endif
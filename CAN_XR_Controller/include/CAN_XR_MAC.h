@@ -26,7 +26,7 @@
 
 /* This header contains the declarations and definitions needed by the
    CAN XR Medium Access Control.  Specified in ISO 11898-1:2015(E)
-   [1], Section 10.
+   [1], Section 10, and in CiA 610-1 [2] for XL frames.
 */
 
 #ifndef CAN_XR_MAC_H
@@ -34,6 +34,10 @@
 
 #include <stdint.h>
 #include "CAN_XR_LLC.h" /* For enum CAN_XR_Format */
+#include "CAN_XR_RX_FIFO.h"
+#include "CAN_XR_Filter.h"
+#include "CAN_XR_Dispatch.h"
+#include "CAN_XR_Pool.h"
 
 /* Implementation-dependent part of the MAC state.  Currently we have
    only CAN_XR_MAC_Bare_Bones_State.
@@ -58,37 +62,166 @@ enum CAN_XR_MAC_RX_FSM_State
     CAN_XR_MAC_RX_FSM_RX_RTR,
     CAN_XR_MAC_RX_FSM_RX_IDE,
     CAN_XR_MAC_RX_FSM_RX_FDF,
+    CAN_XR_MAC_RX_FSM_RX_RES,          /* FD frames only, [1] 10.4.2.4 */
+    CAN_XR_MAC_RX_FSM_RX_BRS,
+    CAN_XR_MAC_RX_FSM_RX_ESI,
     CAN_XR_MAC_RX_FSM_RX_DLC,
     CAN_XR_MAC_RX_FSM_RX_DATA,
+    CAN_XR_MAC_RX_FSM_RX_STUFF_COUNT,  /* FD frames only */
     CAN_XR_MAC_RX_FSM_RX_CRC,
     CAN_XR_MAC_RX_FSM_RX_CDEL,
+    CAN_XR_MAC_RX_FSM_RX_RESXL,        /* XL frames only, [2] */
+    CAN_XR_MAC_RX_FSM_RX_ADS,
+    CAN_XR_MAC_RX_FSM_RX_SDT,
+    CAN_XR_MAC_RX_FSM_RX_SEC,
+    CAN_XR_MAC_RX_FSM_RX_XL_DLC,
+    CAN_XR_MAC_RX_FSM_RX_SBC,
+    CAN_XR_MAC_RX_FSM_RX_PCRC,
+    CAN_XR_MAC_RX_FSM_RX_VCID,
+    CAN_XR_MAC_RX_FSM_RX_AF,
+    CAN_XR_MAC_RX_FSM_RX_FCRC,
+    CAN_XR_MAC_RX_FSM_RX_FCP,
+    CAN_XR_MAC_RX_FSM_RX_DAS,
     CAN_XR_MAC_RX_FSM_RX_ACK,
     CAN_XR_MAC_RX_FSM_RX_ADEL,
     CAN_XR_MAC_RX_FSM_RX_EOF,
-    CAN_XR_MAC_RX_FSM_ERROR
+    CAN_XR_MAC_RX_FSM_INTERMISSION,    /* [1], 10.4.6.2 */
+    CAN_XR_MAC_RX_FSM_ERROR_FLAG,      /* [1], 10.4.4 */
+    CAN_XR_MAC_RX_FSM_ERROR_WAIT,
+    CAN_XR_MAC_RX_FSM_ERROR_DELIM,
+    CAN_XR_MAC_RX_FSM_OVERLOAD_FLAG,   /* [1], 10.4.5 */
+    CAN_XR_MAC_RX_FSM_OVERLOAD_WAIT,
+    CAN_XR_MAC_RX_FSM_OVERLOAD_DELIM,
+    CAN_XR_MAC_RX_FSM_BUS_OFF,         /* [1], 12.1.4 */
+    CAN_XR_MAC_RX_FSM_ERROR            /* Error detected */
 };
 
 enum CAN_XR_MAC_TX_FSM_State
 {
     CAN_XR_MAC_TX_FSM_IDLE,
-    CAN_XR_MAC_TX_FSM_TX_IDENTIFIER,    /* Mimic the RX_FSM ones */
-    CAN_XR_MAC_TX_FSM_TX_RTR,
-    CAN_XR_MAC_TX_FSM_TX_IDE,
-    CAN_XR_MAC_TX_FSM_TX_FDF,
-    CAN_XR_MAC_TX_FSM_TX_DLC,
-    CAN_XR_MAC_TX_FSM_TX_DATA,
-    CAN_XR_MAC_TX_FSM_TX_CRC_LATCH,
-    CAN_XR_MAC_TX_FSM_TX_CRC,
-    CAN_XR_MAC_TX_FSM_TX_CDEL,
-    CAN_XR_MAC_TX_FSM_TX_ACK,
-    CAN_XR_MAC_TX_FSM_TX_ADEL,
-    CAN_XR_MAC_TX_FSM_TX_EOF,
-    CAN_XR_MAC_TX_FSM_TX_EOF_TAIL,
+    CAN_XR_MAC_TX_FSM_TX_FRAME,         /* Pre-encoded slot bitstream */
     CAN_XR_MAC_TX_FSM_TX_EXT_DATA,      /* For ext_tx_data_ind */
     CAN_XR_MAC_TX_FSM_TX_EXT_TAIL,      /* After last ext_tx_data_ind */
     CAN_XR_MAC_TX_FSM_ERROR
 };
 
+/* Exceptions to the rule that a transmitter increments its transmit
+   error counter by 8 when it sends an error flag, [1] 12.1.4.2 c).
+*/
+enum CAN_XR_MAC_TEC_Exception
+{
+    CAN_XR_MAC_TEC_EXCEPTION_NONE = 0,
+    CAN_XR_MAC_TEC_EXCEPTION_ARBITRATION_STUFF, /* Recessive stuff bit
+						   monitored dominant in
+						   arbitration */
+    CAN_XR_MAC_TEC_EXCEPTION_PASSIVE_ACK        /* ACK error while error
+						   passive, unless the
+						   error flag meets a
+						   dominant bit */
+};
+
+/* Fault confinement state of a node, [1] 12.1.4.  It is not kept
+   anywhere, but derived from the error counters and the rx FSM
+   state, see CAN_XR_MAC_Get_Fault_State.
+*/
+enum CAN_XR_MAC_Fault_State
+{
+    CAN_XR_MAC_FAULT_ERROR_ACTIVE = 0,
+    CAN_XR_MAC_FAULT_ERROR_PASSIVE,
+    CAN_XR_MAC_FAULT_BUS_OFF
+};
+
+/* FD frame support, see CAN_XR_MAC_Set_FD_Mode. */
+enum CAN_XR_MAC_FD_Mode
+{
+    CAN_XR_MAC_FD_DISABLED = 0,
+    CAN_XR_MAC_FD_ENABLED,      /* FD frames at the nominal bit rate */
+    CAN_XR_MAC_FD_BRS           /* FD frames with bit rate switching */
+};
+
+/* Maximum length of the data field of FD frames, within the
+   buffers.
+*/
+#define CAN_XR_MAC_FD_MAX_DATA (CAN_XR_MAX_DATA < 64 ? CAN_XR_MAX_DATA : 64)
+
+/* Maximum length, in bits, of the bit stream of an FBFF or XL frame
+   with 'n_data' data bytes.  A CBFF frame has at most 98 bits from
+   SOF to CRC, 24 stuff bits among them, and 10 more bits from CDEL to
+   EOF, less than an FBFF frame with the same data.
+
+   An FBFF frame has 22 header bits and its data bytes, with at most
+   one stuff bit every 4 bits after the first 5, then at most 25 bits
+   of stuff count and CRC with 7 fixed stuff bits, and the same 10
+   bits from CDEL to EOF.
+
+   An XL frame has at most 22 bits from SOF to resXL, stuff bits
+   included, and the 4 bits of ADS.  Then 77 bits from SDT to AF, the
+   data bytes, and 32 bits of FCRC, with a fixed stuff bit every 10
+   bits.  Then 4 bits of FCP, 4 of DAS, and 9 from ACK to EOF, [2].
+*/
+#define CAN_XR_MAC_FD_MAX_BITS(n_data)				\
+    ((22 + 8 * (n_data)) * 5 / 4 + 32 + 10)
+
+#define CAN_XR_MAC_XL_MAX_BITS(n_data)				\
+    (22 + 4 + (77 + 8 * (n_data) + 32) * 11 / 10 + 4 + 4 + 9)
+
+/* Size of the bitstream of a TX slot, in 32-bit words, enough for
+   any frame.
+*/
+#define CAN_XR_MAC_TX_BITSTREAM_WORDS					\
+    ((((CAN_XR_MAC_FD_MAX_BITS(CAN_XR_MAC_FD_MAX_DATA)			\
+	> CAN_XR_MAC_XL_MAX_BITS(CAN_XR_MAX_DATA))			\
+       ? CAN_XR_MAC_FD_MAX_BITS(CAN_XR_MAC_FD_MAX_DATA)			\
+       : CAN_XR_MAC_XL_MAX_BITS(CAN_XR_MAX_DATA)) + 31) / 32)
+
+/* Number of entries of the stuffed header cache, a power of two.
+   Each entry costs 12 bytes.
+*/
+#ifndef CAN_XR_MAC_TX_HEADER_CACHE_SIZE
+#define CAN_XR_MAC_TX_HEADER_CACHE_SIZE 8
+#endif
+
+/* Stuffed header cache entry.  The header goes from SOF to DLC and
+   depends only on the identifier and DLC, so it can be reused as is
+   by requests with the same ones, together with the CRC and bit
+   stuffing state at its end.
+*/
+struct CAN_XR_MAC_TX_Header
+{
+    uint16_t key; /* identifier << 4 | dlc, CAN_XR_MAC_TX_HEADER_EMPTY */
+    uint16_t crc;
+    uint32_t bits; /* MSb first, from bit 31 */
+    uint8_t n_bits;
+    uint8_t nc_bits;
+    uint8_t nc_pol;
+};
+
+#define CAN_XR_MAC_TX_HEADER_EMPTY 0xFFFF
+
+/* Number of TX slots, that is, of frames MAC_Data.Request can
+   accept before they are transmitted, [1, 32].  Each slot costs 68
+   bytes with CAN_XR_MAX_DATA at 8, 184 at 64, and about 4.3 KiB at
+   2048.
+*/
+#ifndef CAN_XR_MAC_TX_SLOTS
+#define CAN_XR_MAC_TX_SLOTS 8
+#endif
+
+/* TX slot.  It holds a frame accepted by MAC_Data.Request, already
+   encoded, until it has been transmitted or aborted.
+*/
+struct CAN_XR_MAC_TX_Slot
+{
+    uint32_t identifier;
+    enum CAN_XR_Format format;
+    int dlc;
+    uint8_t data[CAN_XR_MAX_DATA];
+    uint32_t bitstream[CAN_XR_MAC_TX_BITSTREAM_WORDS];
+    int bitstream_bits;
+    int esi; /* ESI bit encoded in FD frames */
+    struct CAN_XR_XL_Control xl; /* XL frames only */
+};
+
 /* Overall MAC state.  Made up of an implementation-independent part
    (defined directly in this structure) and an
    implementation-dependent part (members of the id union).
@@ -102,29 +235,79 @@ struct CAN_XR_MAC_State
     int nc_bits; /* De-stuffing and CRC calculation */
     int nc_pol;
     uint16_t crc;
+    uint32_t crc17; /* FD CRCs, only if FD frames are enabled */
+    uint32_t crc21;
     int field_bits;
     int bus_bits;
     int de_stuffed_bits;
 
     uint32_t rx_identifier; /* Buffers for reassembled frame */
+    int rx_accept; /* Acceptance filter verdict on rx_identifier */
+    int rx_streaming; /* Header streamed, frame not delivered yet */
     int rx_rtr;
     int rx_ide;
     int rx_fdf;
+    int rx_fd; /* FDF recessive and FD frames enabled */
+    int rx_brs;
+    int rx_esi;
+    int rx_stuff_count; /* Expected, with parity, see rx_crc_start */
+    int rx_fixed_stuff; /* Bits between fixed stuff bits, 0 if none */
+    int rx_xl; /* FDF and XLF recessive and XL frames enabled */
+    struct CAN_XR_XL_Control rx_xl_control;
+    uint32_t pcrc; /* XL CRCs, only if XL frames are enabled */
+    uint32_t fcrc;
     int rx_dlc;
     uint8_t rx_byte;
     int rx_byte_index;
-    uint8_t rx_data[8];
+    uint8_t rx_data[CAN_XR_MAX_DATA];
+    int rx_frame; /* Pool buffer used instead of rx_data, -1 if none */
 
     enum CAN_XR_MAC_TX_FSM_State tx_fsm_state;
 
+    /* Frames accepted by MAC_Data.Request and not confirmed yet,
+       the one being transmitted included.  The first
+       data_req_pending items of tx_queue are the numbers of their
+       slots, sorted by identifier, that is, by priority.  Frames
+       with the same identifier keep the order in which they were
+       requested.
+    */
     int data_req_pending;
+    uint32_t tx_slot_map; /* Bit i set if tx_slots[i] is in use */
+    uint8_t tx_queue[CAN_XR_MAC_TX_SLOTS];
+    struct CAN_XR_MAC_TX_Slot tx_slots[CAN_XR_MAC_TX_SLOTS];
+
+    /* The frame being transmitted, in slot tx_slot, is sent right
+       from the data and bitstream of the slot.  Its identifier,
+       format, DLC and length are also kept here, because they are
+       still needed after the slot has been freed.  tx_slot is -1
+       when no transmission is in progress.
+    */
+    int tx_slot;
     uint32_t tx_identifier;
     enum CAN_XR_Format tx_format;
     int tx_dlc;
-    uint8_t tx_data[8];
-    int tx_byte_index;
+    int tx_byte_index; /* For ext_tx_data_ind */
     int tx_bit_count;
     uint32_t tx_shift_reg;
+    int tx_bitstream_bits;
+    int tx_bit_index; /* Next bit of the slot bitstream to transmit */
+
+    struct CAN_XR_MAC_TX_Header tx_header_cache[
+	CAN_XR_MAC_TX_HEADER_CACHE_SIZE];
+
+    /* Fault confinement, [1] 12.1.4.  error_tx is set if we are the
+       transmitter of the frame an error frame belongs to, until the
+       bus is idle again.  An error passive transmitter waits
+       suspend_bits more recessive bits after the frame before
+       starting a new transmission.  bus_off_count counts the
+       sequences of 11 recessive bits seen while bus off.
+    */
+    int tec;
+    int rec;
+    int error_tx;
+    enum CAN_XR_MAC_TEC_Exception tec_exception;
+    int suspend_bits;
+    int bus_off_count;
 
     union CAN_XR_MAC_ID_State id;
 };
@@ -154,11 +337,74 @@ typedef void (* CAN_XR_MAC_Data_Ind_t)(
     uint32_t identifier,
     enum CAN_XR_Format format, int dlc, uint8_t *data);
 
+/* Same as above, for XL frames, with their additional fields in
+   'xl'.  Not specified in the standard.
+*/
+typedef void (* CAN_XR_MAC_XL_Data_Req_t)(
+    struct CAN_XR_MAC *this,
+    uint32_t identifier,
+    const struct CAN_XR_XL_Control *xl, int dlc, uint8_t *data);
+
+typedef void (* CAN_XR_MAC_XL_Data_Ind_t)(
+    struct CAN_XR_LLC *this, unsigned long ts,
+    uint32_t identifier,
+    const struct CAN_XR_XL_Control *xl, int dlc, uint8_t *data);
+
 typedef void (* CAN_XR_MAC_Data_Conf_t)(
     struct CAN_XR_LLC *this, unsigned long ts,
     uint32_t identifier,
     enum CAN_XR_MAC_Tx_Status transmission_status);
 
+/* Additional MAC primitive to abort the transmission of all frames
+   with 'identifier' still waiting in a TX slot.  Each of them is
+   confirmed with CAN_XR_MAC_TX_STATUS_NO_SUCCESS.  A frame whose
+   transmission is already in progress is not aborted.
+*/
+typedef void (* CAN_XR_MAC_Abort_Req_t)(
+    struct CAN_XR_MAC *this,
+    uint32_t identifier);
+
+/* Additional MAC primitives for cut-through processing of the frame
+   being received, while it is still on the bus.  Not specified in the
+   standard.
+
+   - stream_header_ind: 'identifier', 'format' and 'dlc' are known, at
+     the end of the DLC field.  In XL frames, at the end of PCRC, so
+     that they have been checked.
+
+   - stream_byte_ind: data byte 'index' has been received.
+
+   - stream_crc_ind: the CRC (FCRC in XL frames) is correct.  The
+     frame is not valid yet, its data_ind follows.
+
+   - stream_abort_ind: the frame for which stream_header_ind has been
+     invoked has been discarded due to an error, and no data_ind
+     follows.
+
+   They are invoked only for frames that passed the acceptance filter
+   and fit into rx_data[], like data_ind, and also in the transmitter.
+*/
+typedef void (* CAN_XR_MAC_Stream_Header_Ind_t)(
+    struct CAN_XR_LLC *this, unsigned long ts,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc);
+
+typedef void (* CAN_XR_MAC_Stream_Byte_Ind_t)(
+    struct CAN_XR_LLC *this, unsigned long ts, int index, uint8_t byte);
+
+typedef void (* CAN_XR_MAC_Stream_CRC_Ind_t)(
+    struct CAN_XR_LLC *this, unsigned long ts);
+
+typedef void (* CAN_XR_MAC_Stream_Abort_Ind_t)(
+    struct CAN_XR_LLC *this, unsigned long ts);
+
+/* Additional MAC primitive invoked when the transmission of the frame
+   with 'identifier' starts, that is, at the sample point right before
+   its SOF.  It is invoked again if the frame is retransmitted.  Not
+   specified in the standard.
+*/
+typedef void (* CAN_XR_MAC_TX_SOF_Ind_t)(
+    struct CAN_XR_LLC *this, unsigned long ts, uint32_t identifier);
+
 /* MAC Remote_Req, Remote_Ind, Remote_Conf unsupported */
 /* MAC OVLD_Req, OVLD_Ind, OVLD_Conf unsupported */
 
@@ -182,6 +428,16 @@ struct CAN_XR_MAC_Primitives
     CAN_XR_MAC_Data_Ind_t data_ind;
     CAN_XR_MAC_Data_Conf_t data_conf;
 
+    /* Additional primitives */
+    CAN_XR_MAC_Abort_Req_t abort_req;
+    CAN_XR_MAC_XL_Data_Req_t xl_data_req;
+    CAN_XR_MAC_XL_Data_Ind_t xl_data_ind;
+    CAN_XR_MAC_Stream_Header_Ind_t stream_header_ind;
+    CAN_XR_MAC_Stream_Byte_Ind_t stream_byte_ind;
+    CAN_XR_MAC_Stream_CRC_Ind_t stream_crc_ind;
+    CAN_XR_MAC_Stream_Abort_Ind_t stream_abort_ind;
+    CAN_XR_MAC_TX_SOF_Ind_t tx_sof_ind;
+
     /* Additional primitives for internal use */
     CAN_XR_MAC_Ext_Tx_Data_Ind_t ext_tx_data_ind;
 };
@@ -190,6 +446,14 @@ struct CAN_XR_MAC
 {
     struct CAN_XR_LLC *llc; /* Link to the upper protocol layer. */
     struct CAN_XR_PCS *pcs; /* Link to the lower protocol layer. */
+    struct CAN_XR_RX_FIFO *rx_fifo; /* Received frames, may be NULL */
+    const struct CAN_XR_Filter *filter; /* NULL accepts all */
+    struct CAN_XR_Dispatch *dispatch; /* Subscriptions, may be NULL */
+    struct CAN_XR_Pool *pool; /* RX buffers, may be NULL */
+    int bus_monitoring; /* Receive only, see below */
+    enum CAN_XR_MAC_FD_Mode fd_mode;
+    int xl_mode;
+    int early_validation; /* Receivers, see CAN_XR_MAC_Set_Early_Validation */
 
     struct CAN_XR_MAC_State state;
     struct CAN_XR_MAC_Primitives primitives;
@@ -219,6 +483,116 @@ void CAN_XR_MAC_Set_Data_Ind(
 void CAN_XR_MAC_Set_Data_Conf(
     struct CAN_XR_MAC *mac, CAN_XR_MAC_Data_Conf_t data_conf);
 
+/* Set the RX FIFO of 'mac', or NULL for none.  The MAC puts every
+   frame it receives into 'fifo', besides invoking data_ind, without
+   ever waiting for the consumer.  'fifo' must have been initialized.
+*/
+void CAN_XR_MAC_Set_RX_FIFO(
+    struct CAN_XR_MAC *mac, struct CAN_XR_RX_FIFO *fifo);
+
+/* Set the acceptance filter of 'mac', or NULL to accept all frames.
+   Frames rejected by 'filter' are acknowledged, but neither data_ind
+   is invoked for them nor they are put into the RX FIFO.
+*/
+void CAN_XR_MAC_Set_Filter(
+    struct CAN_XR_MAC *mac, const struct CAN_XR_Filter *filter);
+
+/* Set the dispatch table of 'mac', or NULL for none.  'dispatch'
+   must have been initialized, and may already hold subscriptions.
+*/
+void CAN_XR_MAC_Set_Dispatch(
+    struct CAN_XR_MAC *mac, struct CAN_XR_Dispatch *dispatch);
+
+/* Subscribe 'callback' and 'ctx' to the frames received by 'mac' with
+   identifiers 'first' to 'last', included, see
+   CAN_XR_Dispatch_Subscribe.  Return -1 if 'mac' has no dispatch
+   table.
+*/
+int CAN_XR_MAC_Subscribe(
+    struct CAN_XR_MAC *mac, uint32_t first, uint32_t last,
+    CAN_XR_Dispatch_Callback_t callback, void *ctx);
+
+/* Set the frame pool of 'mac', or NULL for none, before starting it.
+   'pool' must have been initialized, and may be shared with other
+   MACs in the same context.  With a pool, 'mac' receives data into a
+   pool buffer, so the data pointer passed to data_ind, xl_data_ind
+   and the dispatch subscribers can be kept with CAN_XR_Pool_Hold.
+   If the pool runs out of buffers, 'mac' falls back to rx_data[],
+   and CAN_XR_Pool_Hold fails.
+*/
+void CAN_XR_MAC_Set_Pool(struct CAN_XR_MAC *mac, struct CAN_XR_Pool *pool);
+
+/* Enable (non-zero 'bus_monitoring') or disable (the default) bus
+   monitoring mode in 'mac', [1] 10.14.  In this mode, 'mac' receives
+   frames but does not honor transmit requests, and it neither signals
+   nor counts the errors and overload conditions it detects.  It waits
+   for bus integration instead, like CAN_XR_Decoder does.  It still
+   requests a dominant ACK bit, which the PMA is expected to loop back
+   internally without driving the bus.
+*/
+void CAN_XR_MAC_Set_Bus_Monitoring(
+    struct CAN_XR_MAC *mac, int bus_monitoring);
+
+/* Set the FD mode of 'mac', CAN_XR_MAC_FD_DISABLED by default.  When
+   FD frames are enabled, 'mac' accepts FBFF requests and receives
+   FD frames, [1] 10.4.2.  With CAN_XR_MAC_FD_BRS, it transmits them
+   with bit rate switching, in the data phase bit time of its PCS, see
+   CAN_XR_PCS_Set_Data_Bit_Time.  It receives FD frames with or
+   without bit rate switching in both modes.
+
+   When FD frames are disabled, an FBFF request is confirmed with
+   CAN_XR_MAC_TX_STATUS_NO_SUCCESS, and 'mac' takes the FDF bit as
+   the reserved bit of classical frames.
+*/
+void CAN_XR_MAC_Set_FD_Mode(
+    struct CAN_XR_MAC *mac, enum CAN_XR_MAC_FD_Mode fd_mode);
+
+/* Enable (non-zero 'xl_mode') or disable (the default) XL frames in
+   'mac', [2].  When XL frames are enabled, 'mac' accepts XLFF
+   requests and receives XL frames, independently of its FD mode.  It
+   always transmits them with bit rate switching, in the XL data phase
+   bit time of its PCS, see CAN_XR_PCS_Set_XL_Data_Bit_Time.
+
+   The additional fields of XL frames are taken from the xl_data_req
+   primitive, and are all zero in XLFF requests made through
+   data_req.  A received XL frame is indicated through xl_data_ind,
+   if registered, instead of data_ind.  The RX FIFO and the dispatch
+   table get its data only.
+
+   When XL frames are disabled, an XLFF request is confirmed with
+   CAN_XR_MAC_TX_STATUS_NO_SUCCESS, and an XL frame is a protocol
+   exception, like with an FD frame when FD frames are disabled.
+*/
+void CAN_XR_MAC_Set_XL_Mode(struct CAN_XR_MAC *mac, int xl_mode);
+
+/* Register the xl_data_ind upcall primitive in 'mac'. */
+void CAN_XR_MAC_Set_XL_Data_Ind(
+    struct CAN_XR_MAC *mac, CAN_XR_MAC_XL_Data_Ind_t xl_data_ind);
+
+/* Register the cut-through upcall primitives in 'mac'.  Any of them
+   may be NULL.
+*/
+void CAN_XR_MAC_Set_Stream_Ind(
+    struct CAN_XR_MAC *mac,
+    CAN_XR_MAC_Stream_Header_Ind_t stream_header_ind,
+    CAN_XR_MAC_Stream_Byte_Ind_t stream_byte_ind,
+    CAN_XR_MAC_Stream_CRC_Ind_t stream_crc_ind,
+    CAN_XR_MAC_Stream_Abort_Ind_t stream_abort_ind);
+
+/* Register the tx_sof_ind upcall primitive in 'mac'. */
+void CAN_XR_MAC_Set_TX_SOF_Ind(
+    struct CAN_XR_MAC *mac, CAN_XR_MAC_TX_SOF_Ind_t tx_sof_ind);
+
+/* Enable (non-zero 'early_validation') or disable (the default) frame
+   validation at the last but one bit of EOF in 'mac' when it is a
+   receiver, as permitted by [1] 10.7.  Received frames are then
+   delivered one bit earlier, even if the last bit of EOF is dominant
+   and starts an overload frame.  The transmitter always validates
+   its frames at the last bit of EOF.
+*/
+void CAN_XR_MAC_Set_Early_Validation(
+    struct CAN_XR_MAC *mac, int early_validation);
+
 /* Register the ext_tx_data_ind primitive in 'mac'. */
 void CAN_XR_MAC_Set_Ext_Tx_Data_Ind(
     struct CAN_XR_MAC *mac, CAN_XR_MAC_Ext_Tx_Data_Ind_t ext_tx_data_ind);
@@ -228,6 +602,50 @@ void CAN_XR_MAC_Data_Req(
     struct CAN_XR_MAC *mac,
     uint32_t identifier, enum CAN_XR_Format format, int dlc, uint8_t *data);
 
+/* Invoke the xl_data_req primitive in 'mac'. */
+void CAN_XR_MAC_XL_Data_Req(
+    struct CAN_XR_MAC *mac, uint32_t identifier,
+    const struct CAN_XR_XL_Control *xl, int dlc, uint8_t *data);
+
+/* Frame description for CAN_XR_MAC_Data_Req_Burst, with the same
+   arguments as MAC_Data.Request.
+*/
+struct CAN_XR_MAC_Frame
+{
+    uint32_t identifier;
+    enum CAN_XR_Format format;
+    int dlc;
+    uint8_t *data;
+};
+
+/* Invoke the data_req primitive in 'mac' for the 'n' frames of
+   'frames', in order.  Frames that do not fit in the TX slots left
+   are confirmed with CAN_XR_MAC_TX_STATUS_NO_SUCCESS, as usual.  Since
+   the TX slots are sorted by priority, the order of 'frames' matters
+   only among frames with the same identifier.
+*/
+void CAN_XR_MAC_Data_Req_Burst(
+    struct CAN_XR_MAC *mac, const struct CAN_XR_MAC_Frame *frames, int n);
+
+/* Invoke the abort_req primitive in 'mac'. */
+void CAN_XR_MAC_Abort_Req(struct CAN_XR_MAC *mac, uint32_t identifier);
+
+/* Return non-zero if 'mac' is idle, that is, both its automata are
+   idle and it has nothing to transmit.  An idle MAC ignores any
+   recessive bit it receives, see CAN_XR_PCS_Skip.
+*/
+int CAN_XR_MAC_Is_Idle(const struct CAN_XR_MAC *mac);
+
+/* Return the fault confinement state of 'mac'.  A node is error
+   passive when either error counter exceeds 127, and bus off when
+   its transmit error counter exceeds 255.  A bus off node recovers
+   by itself, with both counters reset, after it has seen 128
+   sequences of 11 recessive bits.  Frames waiting in its TX slots
+   are transmitted afterwards.
+*/
+enum CAN_XR_MAC_Fault_State CAN_XR_MAC_Get_Fault_State(
+    const struct CAN_XR_MAC *mac);
+
 /* Dump the MAC state on stderr. */
 void CAN_XR_MAC_Dump(
     const char *desc, const struct CAN_XR_MAC *mac);
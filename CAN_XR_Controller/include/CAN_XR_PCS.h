@@ -26,13 +26,21 @@
 
 /* This header contains the data structures needed by the CAN XR
    Physical Coding Sub-layer.  It is currently the same as the regular
-   CAN PCS specified in ISO 11898-1:2015(E) [1], Section 11.1.
+   CAN PCS specified in ISO 11898-1:2015(E) [1], Section 11.1, with
+   the data phase bit time and transmitter delay compensation of FD
+   frames, [1] 11.3.1.2 and 11.3.3, and the data phase bit time of XL
+   frames, CiA 610-1 [2].
 */
 
 #ifndef CAN_XR_PCS_H
 #define CAN_XR_PCS_H
 
-/* [1], Table 8. */
+#include <stddef.h>
+#include <stdint.h>
+
+/* [1], Table 8.  The same structure holds the data phase bit time,
+   whose segments may be shorter, [1] Table 9.
+*/
 struct CAN_XR_PCS_Bit_Time_Parameters
 {
     int prescaler_m; /* [ 1, 32] -- [1], Table 8. */
@@ -43,6 +51,72 @@ struct CAN_XR_PCS_Bit_Time_Parameters
     int sjw;         /* [ 1,  4] */
 };
 
+/* Bit time in use, see CAN_XR_PCS_Data_Phase_Req. */
+enum CAN_XR_PCS_Phase
+{
+    CAN_XR_PCS_PHASE_NOMINAL = 0,
+    CAN_XR_PCS_PHASE_FD_DATA,
+    CAN_XR_PCS_PHASE_XL_DATA
+};
+
+/* Number of secondary sample points that may be pending at the same
+   time, a power of two.  The transmitter delay must be shorter than
+   this number of data phase bits.
+*/
+#ifndef CAN_XR_PCS_SSP_QUEUE
+#define CAN_XR_PCS_SSP_QUEUE 4
+#endif
+
+/* Compile-time nominal bit time.  If CAN_XR_PCS_FIXED_PRESCALER_M is
+   defined when CAN_XR_PCS.c is compiled, together with the other
+   CAN_XR_PCS_FIXED_* parameters below, the PCS is specialized for
+   that nominal bit time: the prescaler modulus, sample point, bit
+   length and sjw clipping become constants.  It falls back on the
+   parameters passed to CAN_XR_PCS_Init if they are different, and
+   the data phase bit time is never specialized.  Invalid parameter
+   sets, see [1] Table 8, do not compile.
+
+   Use CAN_XR_PCS_FIXED_PARAMETERS to initialize the parameters passed
+   to CAN_XR_PCS_Init, so that they match.
+*/
+#ifdef CAN_XR_PCS_FIXED_PRESCALER_M
+
+#ifndef CAN_XR_PCS_FIXED_SYNC_SEG
+#define CAN_XR_PCS_FIXED_SYNC_SEG 1
+#endif
+
+#define CAN_XR_PCS_FIXED_PARAMETERS			\
+    {							\
+	.prescaler_m = CAN_XR_PCS_FIXED_PRESCALER_M,	\
+	.sync_seg = CAN_XR_PCS_FIXED_SYNC_SEG,		\
+	.prop_seg = CAN_XR_PCS_FIXED_PROP_SEG,		\
+	.phase_seg1 = CAN_XR_PCS_FIXED_PHASE_SEG1,	\
+	.phase_seg2 = CAN_XR_PCS_FIXED_PHASE_SEG2,	\
+	.sjw = CAN_XR_PCS_FIXED_SJW			\
+    }
+
+#define CAN_XR_PCS_FIXED_SAMPLE_POINT					\
+    (CAN_XR_PCS_FIXED_SYNC_SEG + CAN_XR_PCS_FIXED_PROP_SEG		\
+     + CAN_XR_PCS_FIXED_PHASE_SEG1 - 1)
+
+#define CAN_XR_PCS_FIXED_QUANTA_PER_BIT					\
+    (CAN_XR_PCS_FIXED_SAMPLE_POINT + 1 + CAN_XR_PCS_FIXED_PHASE_SEG2)
+
+/* C99 has no static assertions, an invalid set makes the array size
+   negative.  The sjw must not exceed either phase segment.
+*/
+typedef char CAN_XR_PCS_Fixed_Bit_Time_Check[
+    (CAN_XR_PCS_FIXED_PRESCALER_M >= 1 && CAN_XR_PCS_FIXED_PRESCALER_M <= 32
+     && CAN_XR_PCS_FIXED_SYNC_SEG == 1
+     && CAN_XR_PCS_FIXED_PROP_SEG >= 1 && CAN_XR_PCS_FIXED_PROP_SEG <= 8
+     && CAN_XR_PCS_FIXED_PHASE_SEG1 >= 1 && CAN_XR_PCS_FIXED_PHASE_SEG1 <= 8
+     && CAN_XR_PCS_FIXED_PHASE_SEG2 >= 2 && CAN_XR_PCS_FIXED_PHASE_SEG2 <= 8
+     && CAN_XR_PCS_FIXED_SJW >= 1 && CAN_XR_PCS_FIXED_SJW <= 4
+     && CAN_XR_PCS_FIXED_SJW <= CAN_XR_PCS_FIXED_PHASE_SEG1
+     && CAN_XR_PCS_FIXED_SJW <= CAN_XR_PCS_FIXED_PHASE_SEG2) ? 1 : -1];
+
+#endif
+
 /* PCS state information. */
 struct CAN_XR_PCS_State
 {
@@ -50,12 +124,32 @@ struct CAN_XR_PCS_State
     int prescaler_m_cnt; /* Prescaler m, count */
     int quantum_m_cnt; /* Quantum m counter, within a bit */
     int quanta_per_bit; /* Derived from parameters */
+    int sample_point; /* Same as above, quantum_m_cnt at sample point */
+    int fixed; /* Nominal bit time, same as CAN_XR_PCS_FIXED_* */
     int prev_bus_level; /* Previous bus level for edge detection */
     int prev_sample; /* Bus @ previous sample point for edge detection */
     int sync_inhibit; /* Sync inhibit per [1] 11.3.2.1 a) */
     int hard_sync_allowed; /* Set by MAC to allow/forbid hard sync */
     int output_unit_buf; /* Buffer for output_unit to be / being sent */
     int sending_level; /* Level being sent, resync'd @ bit boundary */
+
+    /* Bit rate switching and transmitter delay compensation.  The
+       delay is measured, in nodeclock ticks, on the last dominant
+       edge we transmit before the data phase.  In the data phase, a
+       transmitter with TDC checks each bit it sends at its secondary
+       sample point, ssp_ts[], and accumulates mismatches in
+       ssp_error.
+    */
+    int data_phase; /* enum CAN_XR_PCS_Phase */
+    int tdc; /* Transmitter in the data phase, with TDC */
+    int tdc_pending; /* Dominant edge sent, not seen yet */
+    unsigned long tdc_ts; /* When the edge was sent */
+    int tdc_delay;
+    int ssp_head; /* Oldest pending secondary sample point */
+    int ssp_count;
+    unsigned long ssp_ts[CAN_XR_PCS_SSP_QUEUE];
+    int ssp_level[CAN_XR_PCS_SSP_QUEUE]; /* Level sent */
+    int ssp_error;
 };
 
 struct CAN_XR_PCS;
@@ -67,6 +161,16 @@ struct CAN_XR_MAC;
 typedef void (* CAN_XR_PCS_Data_Ind_t)(
     struct CAN_XR_MAC *this, unsigned long ts, int input_unit);
 
+/* Bulk version of data_ind, for 'n' consecutive sample points at the
+   same bus level, the first one at 'ts', see CAN_XR_PCS_Advance.  It
+   returns how many of them, from the first, the MAC took as if it
+   got them one by one, possibly none.  For those, the MAC must not
+   invoke the PCS.
+*/
+typedef unsigned long (* CAN_XR_PCS_Bulk_Data_Ind_t)(
+    struct CAN_XR_MAC *this, unsigned long ts, int input_unit,
+    unsigned long n);
+
 typedef void (* CAN_XR_PCS_Data_Req_t)(
     struct CAN_XR_PCS *this, int output_unit);
 
@@ -74,6 +178,7 @@ typedef void (* CAN_XR_PCS_Data_Req_t)(
 struct CAN_XR_PCS_Primitives
 {
     CAN_XR_PCS_Data_Ind_t data_ind;
+    CAN_XR_PCS_Bulk_Data_Ind_t bulk_data_ind;
     CAN_XR_PCS_Data_Req_t data_req;
 };
 
@@ -83,6 +188,10 @@ struct CAN_XR_PCS
     struct CAN_XR_PMA *pma; /* Link to the lower protocol layer. */
 
     struct CAN_XR_PCS_Bit_Time_Parameters parameters;
+    struct CAN_XR_PCS_Bit_Time_Parameters data_parameters;
+    int ssp_offset; /* Data phase quanta, 0 disables TDC */
+    struct CAN_XR_PCS_Bit_Time_Parameters xl_data_parameters;
+    int xl_ssp_offset; /* Same as above, for XL frames */
     struct CAN_XR_PCS_State state;
     struct CAN_XR_PCS_Primitives primitives;
 };
@@ -103,6 +212,12 @@ void CAN_XR_PCS_Set_MAC(struct CAN_XR_PCS *pcs, struct CAN_XR_MAC *mac);
 void CAN_XR_PCS_Set_Data_Ind(
     struct CAN_XR_PCS *pcs, CAN_XR_PCS_Data_Ind_t data_ind);
 
+/* Register the bulk_data_ind upcall primitive in 'pcs'.  Whoever
+   replaces data_ind must also replace or clear it.
+*/
+void CAN_XR_PCS_Set_Bulk_Data_Ind(
+    struct CAN_XR_PCS *pcs, CAN_XR_PCS_Bulk_Data_Ind_t bulk_data_ind);
+
 /* Invoke the data_req primitive in 'pcs'. */
 void CAN_XR_PCS_Data_Req(struct CAN_XR_PCS *pcs, int output_unit);
 
@@ -118,4 +233,88 @@ void CAN_XR_PCS_Data_Req(struct CAN_XR_PCS *pcs, int output_unit);
 void CAN_XR_PCS_Hard_Sync_Allowed_Req(
     struct CAN_XR_PCS *pcs, int hard_sync_allowed);
 
+/* Set the data phase bit time of 'pcs', used in FD frames with bit
+   rate switching, and the offset of the secondary sample point from
+   the measured transmitter delay, in data phase time quanta.  A zero
+   'ssp_offset' disables transmitter delay compensation, [1] 11.3.3.
+   The default data phase bit time is the same as the nominal one.
+*/
+void CAN_XR_PCS_Set_Data_Bit_Time(
+    struct CAN_XR_PCS *pcs,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *data_parameters,
+    int ssp_offset);
+
+/* Same as CAN_XR_PCS_Set_Data_Bit_Time, for the data phase of XL
+   frames, [2].  The default is the nominal bit time, too.
+*/
+void CAN_XR_PCS_Set_XL_Data_Bit_Time(
+    struct CAN_XR_PCS *pcs,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *xl_data_parameters,
+    int xl_ssp_offset);
+
+/* Switch 'pcs' to the bit time 'data_phase', an enum CAN_XR_PCS_Phase.
+   The MAC invokes it at the sample point of the BRS bit of FD frames
+   and of the ADH bit of XL frames, then at the sample point of the
+   CRC delimiter or of the DAH bit, or when it detects an error, to
+   switch back to the nominal bit time, [1] 11.3.1.2 and [2].  The
+   rest of the bit follows the new bit time.  Transmitter delay
+   compensation applies only if 'transmitter' is non-zero.
+
+   TBD: Like CAN_XR_PCS_Hard_Sync_Allowed_Req, this is not in the
+   primitives vector.
+*/
+void CAN_XR_PCS_Data_Phase_Req(
+    struct CAN_XR_PCS *pcs, int data_phase, int transmitter);
+
+/* Return 1 if a bit sent in the data phase did not match the bus level
+   at its secondary sample point since the last invocation, 0 if
+   not, and -1 if transmitter delay compensation is not active, so
+   that the MAC must monitor bits at the sample point as usual.
+*/
+int CAN_XR_PCS_Get_SSP_Error(struct CAN_XR_PCS *pcs);
+
+/* Feed 'pcs' with 'n' consecutive bus levels, one per nodeclock
+   tick, from 'levels'.  The result is the same as invoking
+   nodeclock_ind on each of them, but only the samples taken at time
+   quantum edges are looked at, and quanta without an edge, a sample
+   point or a bit boundary only advance the quantum counter.  The
+   levels are those of the bus, unaffected by what the PCS sends in
+   the meantime, as in replay from a file or a DMA buffer.  A PMA
+   that combines them with its own transmission, like
+   CAN_XR_PMA_Sim, must keep going one tick at a time instead.
+*/
+void CAN_XR_PCS_NodeClock_Batch(
+    struct CAN_XR_PCS *pcs, const uint8_t *levels, size_t n);
+
+/* Same as CAN_XR_PCS_NodeClock_Batch, with the bus levels packed
+   eight per byte, least significant bit first.
+*/
+void CAN_XR_PCS_NodeClock_Batch_Packed(
+    struct CAN_XR_PCS *pcs, const uint8_t *bits, size_t n);
+
+/* Advance 'pcs' by 'ticks' nodeclock ticks in which the bus stays
+   recessive, in constant time.  The result is the same as invoking
+   nodeclock_ind 'ticks' times with a recessive bus level, except
+   that the MAC receives no PCS_Data.Indicate for the sample points
+   that fall within the interval.
+
+   This is meant for simulation drivers, and it is correct only if
+   the bus was already recessive at the previous tick and the MAC
+   would ignore those indications anyway, see CAN_XR_MAC_Is_Idle.
+   An idle MAC always uses the nominal bit time.
+*/
+void CAN_XR_PCS_Skip(struct CAN_XR_PCS *pcs, unsigned long ticks);
+
+/* Advance 'pcs' by 'ticks' nodeclock ticks in which the bus stays at
+   'bus_level'.  The result is the same as invoking nodeclock_ind
+   'ticks' times with that level, but the sample points in which the
+   MAC would only count bits, like bus integration, idle, bus off
+   recovery and error or overload delimiters, are passed to it with
+   bulk_data_ind, and the PCS advances over them in constant time.
+   Unlike CAN_XR_PCS_Skip, it works with any MAC state and both
+   levels.
+*/
+void CAN_XR_PCS_Advance(
+    struct CAN_XR_PCS *pcs, unsigned long ticks, int bus_level);
+
 #endif
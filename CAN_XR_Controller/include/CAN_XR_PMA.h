@@ -41,6 +41,16 @@ struct CAN_XR_PCS;
 typedef void (* CAN_XR_PMA_NodeClock_Ind_t)(
     struct CAN_XR_PCS *pcs, int bus_level);
 
+/* PMA primitive invoked upon each time quantum edge, by a PMA that
+   does the prescaling itself, in hardware or by simulation, instead
+   of invoking nodeclock_ind on each node clock edge.  Same arguments
+   as nodeclock_ind.  It returns the number of node clock ticks to the
+   next time quantum edge, which may change at any quantum because of
+   bit rate switching.
+*/
+typedef int (* CAN_XR_PMA_QuantumClock_Ind_t)(
+    struct CAN_XR_PCS *pcs, int bus_level);
+
 /* PMA primitive invoked to drive the transceiver.  Arguments are the
    target PMA data structure and the requested bus level.
 */
@@ -63,6 +73,8 @@ struct CAN_XR_PMA_GPIO_State
        rather than primitives.
     */
     CAN_XR_PMA_NodeClock_Ind_t app_nodeclock_ind;
+
+    int port; /* GPIO port, see CAN_XR_PMA_GPIO_Init_Port */
 };
 
 union CAN_XR_PMA_State
@@ -75,6 +87,7 @@ union CAN_XR_PMA_State
 struct CAN_XR_PMA_Primitives
 {
     CAN_XR_PMA_NodeClock_Ind_t nodeclock_ind;
+    CAN_XR_PMA_QuantumClock_Ind_t quantumclock_ind;
     CAN_XR_PMA_Data_Req_t data_req;
 };
 
@@ -94,6 +107,10 @@ void CAN_XR_PMA_Set_PCS(struct CAN_XR_PMA *pma, struct CAN_XR_PCS *pcs);
 void CAN_XR_PMA_Set_NodeClock_Ind(
     struct CAN_XR_PMA *pma, CAN_XR_PMA_NodeClock_Ind_t nodeclock_ind);
 
+/* Register the quantumclock_ind upcall primitive in 'pma' */
+void CAN_XR_PMA_Set_QuantumClock_Ind(
+    struct CAN_XR_PMA *pma, CAN_XR_PMA_QuantumClock_Ind_t quantumclock_ind);
+
 /* Invoke the data_req primitive in 'pma' */
 void CAN_XR_PMA_Data_Req(struct CAN_XR_PMA *pma, int bus_level);
 
@@ -0,0 +1,108 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations of the frame pool, a fixed
+   set of frame buffers with reference counts, for zero-copy fan-out
+   of received frames.
+
+   A MAC with a pool receives data directly into a pool buffer.  All
+   consumers of the frame, data_ind, the dispatch subscribers and the
+   gateway, get a pointer into that buffer, and may keep it beyond
+   their callback by taking a reference with CAN_XR_Pool_Hold.  The
+   MAC then switches to a fresh buffer for the next frame, and the
+   buffer returns to the pool when the last reference is released.
+   If nobody keeps it, the MAC reuses the same buffer.
+
+   Handles are buffer numbers.  There is no dynamic allocation, and
+   all operations take constant time.  The pool must only be used
+   from the context of the MAC, that is, the sampling context on the
+   boards.
+*/
+
+#ifndef CAN_XR_POOL_H
+#define CAN_XR_POOL_H
+
+#include <stdint.h>
+
+/* Number of buffers, [1, 65535].  Each one costs 4 bytes plus
+   CAN_XR_MAX_DATA on the boards.
+*/
+#ifndef CAN_XR_POOL_FRAMES
+#define CAN_XR_POOL_FRAMES 16
+#endif
+
+struct CAN_XR_Pool_Frame
+{
+    int refs; /* Zero if free */
+    uint8_t data[CAN_XR_MAX_DATA];
+};
+
+struct CAN_XR_Pool
+{
+    int n_free;
+    uint16_t free[CAN_XR_POOL_FRAMES]; /* Stack of free buffers */
+    unsigned long exhausted; /* CAN_XR_Pool_Alloc failures */
+    struct CAN_XR_Pool_Frame frames[CAN_XR_POOL_FRAMES];
+};
+
+/* Initialize 'pool', with all buffers free. */
+void CAN_XR_Pool_Init(struct CAN_XR_Pool *pool);
+
+/* Take a free buffer from 'pool', with one reference.  Return its
+   handle, or -1 if there are no free buffers.
+*/
+int CAN_XR_Pool_Alloc(struct CAN_XR_Pool *pool);
+
+/* Take one more reference to buffer 'frame', which must be in use. */
+void CAN_XR_Pool_Ref(struct CAN_XR_Pool *pool, int frame);
+
+/* Release one reference to buffer 'frame'.  The buffer returns to
+   the pool with its last reference.
+*/
+void CAN_XR_Pool_Release(struct CAN_XR_Pool *pool, int frame);
+
+/* Return the data of buffer 'frame'. */
+uint8_t *CAN_XR_Pool_Data(struct CAN_XR_Pool *pool, int frame);
+
+/* Return the handle of the buffer in use 'data' points to the
+   beginning of, or -1 if there is none, for instance because 'data'
+   is not in 'pool' or 'pool' is NULL.
+*/
+int CAN_XR_Pool_Handle(const struct CAN_XR_Pool *pool, const uint8_t *data);
+
+/* Same as CAN_XR_Pool_Handle, and take one more reference to the
+   buffer if there is one.  Consumers that get 'data' from the MAC
+   call this to keep it, and copy it if it returns -1.
+*/
+int CAN_XR_Pool_Hold(struct CAN_XR_Pool *pool, const uint8_t *data);
+
+/* Return the number of references to buffer 'frame'. */
+int CAN_XR_Pool_Refs(const struct CAN_XR_Pool *pool, int frame);
+
+/* Return the number of free buffers in 'pool'. */
+int CAN_XR_Pool_Free(const struct CAN_XR_Pool *pool);
+
+#endif
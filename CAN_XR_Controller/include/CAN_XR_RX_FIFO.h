@@ -0,0 +1,124 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations of the RX FIFO, a
+   single-producer, single-consumer ring of received frames.  The MAC
+   puts every frame it receives into its FIFO, if it has one, from the
+   sampling context, which must never wait.  The application gets
+   them from a background context, at its own pace.
+
+   The producer and the consumer synchronize only through the GCC
+   __atomic builtins, without locks, so the FIFO also works between
+   two threads on the host.  Each side owns its index and only reads
+   the other one, and keeps a copy of it to avoid reading it at every
+   operation.
+
+   When the FIFO is full, the producer drops the frame and counts it.
+   The next frame it manages to put into the FIFO carries the number
+   of frames lost right before it, so the consumer knows where the
+   gaps are.
+*/
+
+#ifndef CAN_XR_RX_FIFO_H
+#define CAN_XR_RX_FIFO_H
+
+#include <stdint.h>
+#include "CAN_XR_LLC.h" /* For enum CAN_XR_Format */
+
+/* Number of records of the FIFO, a power of two.  Each record costs
+   20 bytes plus CAN_XR_MAX_DATA on the boards.
+*/
+#ifndef CAN_XR_RX_FIFO_SIZE
+#define CAN_XR_RX_FIFO_SIZE 16
+#endif
+
+/* Alignment of the producer and consumer parts of the FIFO, at least
+   a cache line, so that the two sides do not bounce a line to each
+   other at every operation.
+*/
+#ifndef CAN_XR_RX_FIFO_ALIGN
+#define CAN_XR_RX_FIFO_ALIGN 64
+#endif
+
+/* A received frame, with the arguments of MAC_Data.Indicate. */
+struct CAN_XR_RX_FIFO_Record
+{
+    unsigned long ts;
+    uint32_t identifier;
+    enum CAN_XR_Format format;
+    int dlc;
+    uint8_t data[CAN_XR_MAX_DATA];
+    unsigned long lost; /* Frames lost right before this one */
+};
+
+struct CAN_XR_RX_FIFO
+{
+    /* Producer side.  frames and overflows may be read by the
+       consumer, too.
+    */
+    struct
+    {
+	uint32_t head; /* Next record to write, free running */
+	uint32_t tail_copy;
+	unsigned long lost; /* For the next record */
+	unsigned long frames; /* Frames put into the FIFO */
+	unsigned long overflows; /* Frames lost */
+    } producer __attribute__((aligned(CAN_XR_RX_FIFO_ALIGN)));
+
+    /* Consumer side */
+    struct
+    {
+	uint32_t tail; /* Next record to read, free running */
+	uint32_t head_copy;
+    } consumer __attribute__((aligned(CAN_XR_RX_FIFO_ALIGN)));
+
+    struct CAN_XR_RX_FIFO_Record records[CAN_XR_RX_FIFO_SIZE]
+    __attribute__((aligned(CAN_XR_RX_FIFO_ALIGN)));
+};
+
+/* Initialize 'fifo', which must not be in use by either side. */
+void CAN_XR_RX_FIFO_Init(struct CAN_XR_RX_FIFO *fifo);
+
+/* Producer side.  Put a frame into 'fifo'.  Return non-zero on
+   success, zero if the FIFO is full and the frame has been lost.
+*/
+int CAN_XR_RX_FIFO_Put(
+    struct CAN_XR_RX_FIFO *fifo, unsigned long ts,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc,
+    const uint8_t *data);
+
+/* Consumer side.  Get the oldest frame from 'fifo' into 'record'.
+   Return non-zero on success, zero if the FIFO is empty.
+*/
+int CAN_XR_RX_FIFO_Get(
+    struct CAN_XR_RX_FIFO *fifo, struct CAN_XR_RX_FIFO_Record *record);
+
+/* Consumer side.  Return the number of frames lost so far because
+   'fifo' was full.
+*/
+unsigned long CAN_XR_RX_FIFO_Overflows(const struct CAN_XR_RX_FIFO *fifo);
+
+#endif
@@ -37,13 +37,20 @@
    See CAN_XR_CAN_Driver.c for details about how to set the LPC1768
    pin configuration properly.
 
+   Port 1, for gateways, works on GPIO Port P0.1 (transmit) and P0.0
+   (receive).  On the same boards, these bits are connected to the
+   second CAN transceiver because they share the same pins as TD1 and
+   RD1 (coming from the CAN1 hardware controller), respectively.
+
    On the LPC4357 boards:
 
    This PMA works on GPIO Port P5_9 (transmit, connected to Pin P3_2)
    and GPIO Port P5_8 (receive, connected to Pin P3_1).  On the
    LPC4357 board PE2036A0-V3, these bits are connected to the CAN
    transceiver because they share the same pins as CAN0_TX and CAN0_RX
-   (coming from the CAN0 hardware controller), respectively.
+   (coming from the CAN0 hardware controller), respectively.  This is
+   the only port on these boards, so programs that need two of them,
+   like gateways, run on the LPC1768 boards only.
 
    Hardware-based timings and synchronization code taken from
      exp_swtx.c 1.42 (CVS Papers/supercan/Software, Super CAN)
@@ -73,6 +80,8 @@
 #define FIO0SET		REG32(0x2009C018)
 #define FIO0CLR		REG32(0x2009C01C)
 
+#define PORT_0_0_MASK   (1 << 0)
+#define PORT_0_1_MASK   (1 << 1)
 #define PORT_0_4_MASK   (1 << 4)
 #define PORT_0_5_MASK	(1 << 5)
 
@@ -186,11 +195,19 @@ static void setup_ts(int prescaler)
 
 /* --- Access to GPIO port exp_swtx.c 1.42 --- */
 
+/* Number of ports and their TX and RX pins, all on GPIO Port 0 */
+#define GPIO_PORTS 2
+static const uint32_t tx_mask[GPIO_PORTS] = { PORT_0_5_MASK, PORT_0_1_MASK };
+static const uint32_t rx_mask[GPIO_PORTS] = { PORT_0_4_MASK, PORT_0_0_MASK };
+
+/* Read all pins at once */
+#define gpio_read()  (FIO0PIN)
+
 /* Set to HIGH --- recessive for the SN65HVD232 */
-#define gpio_tx_rec()  (FIO0SET = PORT_0_5_MASK)
+#define gpio_tx_rec(p)  (FIO0SET = tx_mask[p])
 
 /* Set to LOW --- dominant for the SN65HVD232 */
-#define gpio_tx_dom()  (FIO0CLR = PORT_0_5_MASK)
+#define gpio_tx_dom(p)  (FIO0CLR = tx_mask[p])
 
 /* The difference between gpio_tx_pin() and gpio_rx_pin() is that:
 
@@ -199,13 +216,47 @@ static void setup_ts(int prescaler)
 */
 
 /* Read back value of tx pin --- 0: dominant, 1: recessive */
-#define gpio_tx_pin()  ((FIO0PIN & PORT_0_5_MASK) ? 1 : 0)
+#define gpio_tx_pin(p)  ((FIO0PIN & tx_mask[p]) ? 1 : 0)
 
 /* Read bus value --- 0: dominant, 1: recessive */
-#define gpio_rx_pin()  ((FIO0PIN & PORT_0_4_MASK) ? 1 : 0)
+#define gpio_rx_pin(p)  ((FIO0PIN & rx_mask[p]) ? 1 : 0)
 
-static void init_gpio(void)
+/* Same, from the value 'pins' of gpio_read() */
+#define gpio_rx_bit(pins, p)  (((pins) & rx_mask[p]) ? 1 : 0)
+
+static void init_gpio(int p)
 {
+    if(p == 1)
+    {
+	/* Set FIO0DIR<1> = 1, FIO0DIR<0> = 0,
+	     GPIO Port 0.1 must be an output, 0.0 an input.
+
+	   Set PINMODE0<1:0> = 10,
+	     GPIO Port 0.0 must have neither pull-up nor pull-down.
+	     PINMODE0 is unused for outputs.
+
+	   Set PINMODE_OD0<1> = 0,
+	     GPIO Port 0.1 must not be open-drain.
+	     PINMODE_OD0 is unused for inputs.
+
+	   Set output to recessive to not perturb the bus.
+
+	   Set PINSEL0<3:2> = 00, PINSEL0<1:0> = 00, this configures
+	     P0.1 and P0.0 as GPIO pins instead of TD1 and RD1.  This is
+	     the last action to avoid connecting to the physical pins
+	     GPIO signals not configured in the right way.
+	*/
+	FIO0DIR     = (FIO0DIR     & ~0x00000003) | 0x00000002;
+	PINMODE0    = (PINMODE0    & ~0x00000003) | 0x00000002;
+	PINMODE_OD0 = (PINMODE_OD0 & ~0x00000002) | 0x00000000;
+	gpio_tx_rec(p);
+	PINSEL0     = (PINSEL0     & ~0x0000000F) | 0x00000000;
+
+	TRACE(0, ">>> gpio_tx_pin/rx_pin(1) after init: %d/%d",
+	      gpio_tx_pin(p), gpio_rx_pin(p));
+	return;
+    }
+
     /* Set FIO0DIR<5> = 1, FIO0DIR<4> = 0,
          GPIO Port 0.5 must be an output, 0.4 an input.
 
@@ -227,11 +278,11 @@ static void init_gpio(void)
     FIO0DIR     = (FIO0DIR     & ~0x00000030) | 0x00000020;
     PINMODE0    = (PINMODE0    & ~0x00000300) | 0x00000200;
     PINMODE_OD0 = (PINMODE_OD0 & ~0x00000020) | 0x00000000;
-    gpio_tx_rec();
+    gpio_tx_rec(p);
     PINSEL0     = (PINSEL0     & ~0x00000F00) | 0x00000000;
 
     TRACE(0, ">>> gpio_tx_pin/rx_pin after init: %d/%d",
-	  gpio_tx_pin(), gpio_rx_pin());
+	  gpio_tx_pin(p), gpio_rx_pin(p));
 }
 
 
@@ -291,11 +342,19 @@ static void setup_ts(int prescaler)
 
 /* --- Access to GPIO port --- */
 
+/* Number of ports and their TX and RX pins, all on GPIO Port 5 */
+#define GPIO_PORTS 1
+static const uint32_t tx_mask[GPIO_PORTS] = { PORT_5_9_MASK };
+static const uint32_t rx_mask[GPIO_PORTS] = { PORT_5_8_MASK };
+
+/* Read all pins at once */
+#define gpio_read()  (GPIO_PIN5)
+
 /* Set to HIGH --- recessive for the SN65HVD232 */
-#define gpio_tx_rec()  (GPIO_SET5 = PORT_5_9_MASK)
+#define gpio_tx_rec(p)  (GPIO_SET5 = tx_mask[p])
 
 /* Set to LOW --- dominant for the SN65HVD232 */
-#define gpio_tx_dom()  (GPIO_CLR5 = PORT_5_9_MASK)
+#define gpio_tx_dom(p)  (GPIO_CLR5 = tx_mask[p])
 
 /* The difference between gpio_tx_pin() and gpio_rx_pin() is that:
 
@@ -304,19 +363,22 @@ static void setup_ts(int prescaler)
 */
 
 /* Read back value of tx pin --- 0: dominant, 1: recessive */
-#define gpio_tx_pin()  ((GPIO_PIN5 & PORT_5_9_MASK) ? 1 : 0)
+#define gpio_tx_pin(p)  ((GPIO_PIN5 & tx_mask[p]) ? 1 : 0)
 
 /* Read bus value --- 0: dominant, 1: recessive */
-#define gpio_rx_pin()  ((GPIO_PIN5 & PORT_5_8_MASK) ? 1 : 0)
+#define gpio_rx_pin(p)  ((GPIO_PIN5 & rx_mask[p]) ? 1 : 0)
 
-static void init_gpio(void)
+/* Same, from the value 'pins' of gpio_read() */
+#define gpio_rx_bit(pins, p)  (((pins) & rx_mask[p]) ? 1 : 0)
+
+static void init_gpio(int p)
 {
     /* Set GPIO5[8] as input and GPIO5[9] as output */
     GPIO_DIR5 &= ~PORT_5_8_MASK;
     GPIO_DIR5 |= PORT_5_9_MASK;
 
     /* Set TX to recessive */
-    gpio_tx_rec();
+    gpio_tx_rec(p);
 
     /* Set P3_1 (UM10503, Table 189) as:
        - GPIO5[8] (MODE=4)
@@ -339,7 +401,7 @@ static void init_gpio(void)
     SFSP3_2 = 0x00000014;
 
     TRACE(0, ">>> gpio_tx_pin/rx_pin after init: %d/%d",
-	  gpio_tx_pin(), gpio_rx_pin());
+	  gpio_tx_pin(p), gpio_rx_pin(p));
 }
 
 /* Delay before start of the nodeclock stream, in periods of TIMER0 */
@@ -359,7 +421,7 @@ static void init_gpio(void)
 #endif
 
 
-static void data_req(struct CAN_XR_PMA *pma, int bus_level)
+static void gpio_data_req(struct CAN_XR_PMA *pma, int bus_level)
 {
     TRACE(0, "CAN_XR_PMA_GPIO_Data_Req(%d)", bus_level);
 
@@ -368,27 +430,73 @@ static void data_req(struct CAN_XR_PMA *pma, int bus_level)
        least, it should).
     */
     if(bus_level)
-	gpio_tx_rec();
+	gpio_tx_rec(pma->state.gpio.port);
     else
-	gpio_tx_dom();
+	gpio_tx_dom(pma->state.gpio.port);
 }
 
-void CAN_XR_PMA_GPIO_Init(struct CAN_XR_PMA *pma, int prescaler)
+/* Nodeclock indication to the upper layer.  When this file is
+   compiled with CAN_XR_FAST_STACK, for instance by including it in
+   the main program, the whole stack is compiled with it, see
+   CAN_XR_Fast_Stack.h.
+*/
+#ifdef CAN_XR_FAST_STACK
+#define CAN_XR_FAST_PMA_DATA_REQ(pma, bus_level) \
+    gpio_data_req((pma), (bus_level))
+#include "CAN_XR_Fast_Stack.h"
+#define upper_nodeclock_ind(pma, bus_level) \
+    CAN_XR_Fast_NodeClock_Ind((pma)->pcs, (bus_level))
+#define upper_quantumclock_ind(pma, bus_level) \
+    CAN_XR_Fast_QuantumClock_Ind((pma)->pcs, (bus_level))
+#else
+#define upper_nodeclock_ind(pma, bus_level)				\
+    do {								\
+	if((pma)->primitives.nodeclock_ind)				\
+	    (pma)->primitives.nodeclock_ind((pma)->pcs, (bus_level));	\
+    } while(0)
+
+/* Without a quantumclock_ind upcall, fall back to nodeclock_ind and
+   keep going at the nodeclock rate.
+*/
+static inline int upper_quantumclock_ind(
+    struct CAN_XR_PMA *pma, int bus_level)
 {
-    TRACE(0, "CAN_XR_PMA_GPIO_Init");
+    if(pma->primitives.quantumclock_ind)
+	return pma->primitives.quantumclock_ind(pma->pcs, bus_level);
+
+    upper_nodeclock_ind(pma, bus_level);
+    return 1;
+}
+#endif
+
+int CAN_XR_PMA_GPIO_Init_Port(
+    struct CAN_XR_PMA *pma, int prescaler, int port)
+{
+    TRACE(0, "CAN_XR_PMA_GPIO_Init_Port(%d)", port);
+
+    if(port < 0 || port >= GPIO_PORTS)
+	return -1;
 
     pma->pcs = NULL;
+    pma->state.gpio.port = port;
 
     /* Connect GPIO pins to the CAN transceiver. */
-    init_gpio();
+    init_gpio(port);
 
-    /* Set up nodeclock for use. */
+    /* Set up nodeclock for use.  All ports share it. */
     setup_ts(prescaler);
 
     pma->primitives.nodeclock_ind = NULL; /* Set by upper layer. */
-    pma->primitives.data_req = data_req;
+    pma->primitives.quantumclock_ind = NULL; /* Same */
+    pma->primitives.data_req = gpio_data_req;
 
     pma->state.gpio.app_nodeclock_ind = NULL;
+    return 0;
+}
+
+void CAN_XR_PMA_GPIO_Init(struct CAN_XR_PMA *pma, int prescaler)
+{
+    CAN_XR_PMA_GPIO_Init_Port(pma, prescaler, 0);
 }
 
 void CAN_XR_PMA_GPIO_Set_App_NodeClock_Ind(
@@ -417,12 +525,12 @@ void CAN_XR_PMA_GPIO_NodeClock_Ind(struct CAN_XR_PMA *pma)
 	   the upper layer.  We assume that the whole chain of
 	   indication callbacks takes less than one nodeclock period.
 	*/
-	if(pma->primitives.nodeclock_ind)
-	    pma->primitives.nodeclock_ind(pma->pcs, gpio_rx_pin());
+	upper_nodeclock_ind(pma, gpio_rx_pin(pma->state.gpio.port));
 
 	/* Call GPIO-specific app_nodeclock_ind if registered */
 	if(pma->state.gpio.app_nodeclock_ind)
-	    pma->state.gpio.app_nodeclock_ind(pma->pcs, gpio_rx_pin());
+	    pma->state.gpio.app_nodeclock_ind(
+		pma->pcs, gpio_rx_pin(pma->state.gpio.port));
 
 	x++;
 
@@ -435,3 +543,92 @@ void CAN_XR_PMA_GPIO_NodeClock_Ind(struct CAN_XR_PMA *pma)
 	    LED_OFF(GREEN);
     }
 }
+
+void CAN_XR_PMA_GPIO_Dual_NodeClock_Ind(
+    struct CAN_XR_PMA *pma0, struct CAN_XR_PMA *pma1)
+{
+    uint32_t x, pins;
+
+    TRACE(0, "CAN_XR_PMA_GPIO_Dual_NodeClock_Ind");
+
+    x = read_ts() + INITIAL_NODECLOCK_DELAY;
+    while(x != read_ts());
+
+    TRACE(0, ">>> Initial delay/sync ok");
+
+    while(1)
+    {
+	/* Synchronize with TIMER0, which is the source of nodeclock */
+	while(x == read_ts());
+
+	/* Sample both buses at the same time, then generate the
+	   nodeclock indications.  Both chains of indication callbacks
+	   together must take less than one nodeclock period.
+	*/
+	pins = gpio_read();
+
+	upper_nodeclock_ind(pma0, gpio_rx_bit(pins, pma0->state.gpio.port));
+	upper_nodeclock_ind(pma1, gpio_rx_bit(pins, pma1->state.gpio.port));
+
+	/* Call GPIO-specific app_nodeclock_ind if registered */
+	if(pma0->state.gpio.app_nodeclock_ind)
+	    pma0->state.gpio.app_nodeclock_ind(
+		pma0->pcs, gpio_rx_bit(pins, pma0->state.gpio.port));
+	if(pma1->state.gpio.app_nodeclock_ind)
+	    pma1->state.gpio.app_nodeclock_ind(
+		pma1->pcs, gpio_rx_bit(pins, pma1->state.gpio.port));
+
+	x++;
+
+	/* Simple cycle overflow check.
+	   Turn off the green led if we are late.
+	*/
+	if(x == read_ts())
+	    LED_ON(GREEN);
+	else
+	    LED_OFF(GREEN);
+    }
+}
+
+void CAN_XR_PMA_GPIO_QuantumClock_Ind(struct CAN_XR_PMA *pma)
+{
+    uint32_t x;
+    int m = 1;
+
+    TRACE(0, "CAN_XR_PMA_GPIO_QuantumClock_Ind");
+
+    x = read_ts() + INITIAL_NODECLOCK_DELAY;
+    while(x != read_ts());
+
+    TRACE(0, ">>> Initial delay/sync ok");
+
+    while(1)
+    {
+	/* Synchronize with TIMER0, 'm' nodeclock periods after the
+	   previous quantum edge.  The first one is one period after
+	   the initial delay.
+	*/
+	x += m;
+	while((int32_t)(read_ts() - x) < 0);
+
+	/* Sample bus level and generate a quantumclock indication for
+	   the upper layer.  The whole chain of indication callbacks
+	   must take less than one time quantum, which is as long as
+	   the upper layer says.
+	*/
+	m = upper_quantumclock_ind(pma, gpio_rx_pin(pma->state.gpio.port));
+
+	/* Call GPIO-specific app_nodeclock_ind if registered */
+	if(pma->state.gpio.app_nodeclock_ind)
+	    pma->state.gpio.app_nodeclock_ind(
+		pma->pcs, gpio_rx_pin(pma->state.gpio.port));
+
+	/* Simple cycle overflow check.
+	   Turn off the green led if we are late.
+	*/
+	if((int32_t)(read_ts() - (x + m)) >= 0)
+	    LED_ON(GREEN);
+	else
+	    LED_OFF(GREEN);
+    }
+}
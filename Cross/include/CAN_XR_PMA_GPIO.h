@@ -39,8 +39,16 @@
 */
 void CAN_XR_PMA_GPIO_Init(struct CAN_XR_PMA *pma, int prescaler);
 
+/* Same as CAN_XR_PMA_GPIO_Init, on GPIO port 'port' of the board.
+   Port 0 is the default one.  Return -1 if the board does not have
+   'port'.  All ports share the same nodeclock.
+*/
+int CAN_XR_PMA_GPIO_Init_Port(
+    struct CAN_XR_PMA *pma, int prescaler, int port);
+
 /* Register the app_nodeclock_ind upcall primitive in 'pma'.  It is
-   invoked on every nodeclock cycle.
+   invoked on every nodeclock cycle, or on every time quantum with
+   CAN_XR_PMA_GPIO_QuantumClock_Ind.
 */
 void CAN_XR_PMA_GPIO_Set_App_NodeClock_Ind(
     struct CAN_XR_PMA *pma, CAN_XR_PMA_NodeClock_Ind_t app_nodeclock_ind);
@@ -52,4 +60,22 @@ void CAN_XR_PMA_GPIO_Set_App_NodeClock_Ind(
 */
 void CAN_XR_PMA_GPIO_NodeClock_Ind(struct CAN_XR_PMA *pma);
 
+/* Same as CAN_XR_PMA_GPIO_NodeClock_Ind, for two PMAs on different
+   ports, for instance the two sides of a gateway.  Both buses are
+   sampled at the same time on every nodeclock cycle, and both PMAs
+   get their indications from the same loop, so their upper layers
+   share the same time base.
+*/
+void CAN_XR_PMA_GPIO_Dual_NodeClock_Ind(
+    struct CAN_XR_PMA *pma0, struct CAN_XR_PMA *pma1);
+
+/* Same as CAN_XR_PMA_GPIO_NodeClock_Ind, but the bus is sampled only
+   on time quantum edges, as many nodeclock cycles apart as the
+   prescaler of the bit time in use, and the PCS gets quantumclock
+   indications.  The upper layers have a whole time quantum, rather
+   than a nodeclock cycle, to handle each indication, so a faster
+   nodeclock can be used for the same bit time.
+*/
+void CAN_XR_PMA_GPIO_QuantumClock_Ind(struct CAN_XR_PMA *pma);
+
 #endif
@@ -58,27 +58,50 @@ const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
 #define GPIO_NODECLOCK_PER_BIT 8
 #define GPIO_PRESCALER configCPU_CLOCK_HZ/(GPIO_BIT_RATE*GPIO_NODECLOCK_PER_BIT)
 
-/* This takes plenty of time and very disrupts the reception of the
-   next frame if it's too close.
+struct CAN_XR_MAC mac;
+struct CAN_XR_PCS pcs;
+struct CAN_XR_PMA pma;
+
+/* Printing a frame takes plenty of time and very disrupts the
+   reception of the next frame if it's too close.  For this reason,
+   the MAC only puts received frames into rx_fifo, and they are
+   printed by print_rx_fifo.
 */
-void dummy_data_ind(
-    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
-    enum CAN_XR_Format format, int dlc, uint8_t *data)
+struct CAN_XR_RX_FIFO rx_fifo;
+
+/* The GPIO PMA busy-waits for the next nodeclock forever, so there is
+   no background context on the board.  Print at most one frame per
+   nodeclock, and only when the MAC is idle, to stay as far as
+   possible from the next sampling point that matters.  Frames
+   received in the meantime wait in rx_fifo.
+*/
+void print_rx_fifo(void)
 {
+    struct CAN_XR_RX_FIFO_Record r;
     int j;
 
-    printf("> @%lu: id=%lu, format=%d, dlc=%d, data[] = { ",
-	   ts, (unsigned long)identifier, format, dlc);
-    for(j=0; j<dlc; j++) printf("0x%02x ", data[j]);
-    printf("}\n");
+    if(CAN_XR_MAC_Is_Idle(&mac) && CAN_XR_RX_FIFO_Get(&rx_fifo, &r))
+    {
+	if(r.lost)
+	    printf("! %lu frames lost\n", r.lost);
+	printf("> @%lu: id=%lu, format=%d, dlc=%d, data[] = { ",
+	       r.ts, (unsigned long)r.identifier, r.format, r.dlc);
+	for(j=0; j<r.dlc; j++) printf("0x%02x ", r.data[j]);
+	printf("}\n");
+    }
 }
 
-int main(int argc, char *argv[])
+/* This indication is generated by the GPIO PMA on every nodeclock
+   cycle.  It is time-critical, see print_rx_fifo.
+*/
+void app_nodeclock_ind(
+    struct CAN_XR_PCS *pcs, int bus_level)
 {
-    struct CAN_XR_MAC mac;
-    struct CAN_XR_PCS pcs;
-    struct CAN_XR_PMA pma;
+    print_rx_fifo();
+}
 
+int main(int argc, char *argv[])
+{
     CAN_XR_PMA_GPIO_Init(&pma, GPIO_PRESCALER);
     CAN_XR_PCS_Init(&pcs, &pcs_parameters, &pma);
 
@@ -86,8 +109,12 @@ int main(int argc, char *argv[])
        function when there's one. */
     CAN_XR_MAC_Common_Init(&mac, &pcs);
 
-    /* Register a dummy data_ind primitive in 'mac'. */
-    CAN_XR_MAC_Set_Data_Ind(&mac, dummy_data_ind);
+    /* Register app_nodeclock_ind to print received frames */
+    CAN_XR_PMA_GPIO_Set_App_NodeClock_Ind(&pma, app_nodeclock_ind);
+
+    /* Received frames go into rx_fifo */
+    CAN_XR_RX_FIFO_Init(&rx_fifo);
+    CAN_XR_MAC_Set_RX_FIFO(&mac, &rx_fifo);
 
     /* Start the controller, feeding it with nodeclock indications. */
     SET_TRACE_TRESHOLD(3);
@@ -0,0 +1,112 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <CAN_XR_Config.h>
+#include <CAN_XR_PMA_GPIO.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Pool.h>
+#include <CAN_XR_Gateway.h>
+#include <CAN_XR_Trace.h>
+
+/* Only the LPC1768 boards have a second GPIO port, see
+   CAN_XR_PMA_GPIO.c.  The Makefile does not build this program for
+   the other boards.
+*/
+#ifndef GCC_ARM_CM3_UN_LPC1768
+#error "03_can_sw_gateway needs two GPIO ports, only the LPC1768 has them"
+#endif
+
+#define configCPU_CLOCK_HZ 100000000
+
+/* Same bit timing as 01_can_sw_receiver.c, on both buses. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 2,
+    .phase_seg2 = 2,
+    .sjw = 1
+};
+
+#define GPIO_BIT_RATE CAN_XR_BIT_RATE
+#define GPIO_NODECLOCK_PER_BIT 8
+#define GPIO_PRESCALER configCPU_CLOCK_HZ/(GPIO_BIT_RATE*GPIO_NODECLOCK_PER_BIT)
+
+/* Side 0 of the gateway is on GPIO port 0, side 1 on port 1.  A
+   single loop drives both, see CAN_XR_PMA_GPIO_Dual_NodeClock_Ind.
+*/
+struct CAN_XR_MAC mac[2];
+struct CAN_XR_PCS pcs[2];
+struct CAN_XR_PMA pma[2];
+
+/* Both MACs receive into the same pool, so that the gateway can hold
+   the frames that do not fit into the TX slots of the other side
+   until they do.  They run in the same loop, so they can share it.
+*/
+struct CAN_XR_Pool pool;
+
+struct CAN_XR_Gateway gw;
+
+/* Forward 0x100-0x1FF from bus 0 to 0x200-0x2FF on bus 1, and
+   0x300-0x3FF back from bus 1 to bus 0 as they are.
+*/
+int main(int argc, char *argv[])
+{
+    int i;
+
+    CAN_XR_Pool_Init(&pool);
+
+    for(i=0; i<2; i++)
+    {
+	if(CAN_XR_PMA_GPIO_Init_Port(&pma[i], GPIO_PRESCALER, i) < 0)
+	{
+	    printf("! GPIO port %d not available\n", i);
+	    return EXIT_FAILURE;
+	}
+
+	CAN_XR_PCS_Init(&pcs[i], &pcs_parameters, &pma[i]);
+
+	/* TBD: To be replaced by implementation-specific
+	   initialization function when there's one. */
+	CAN_XR_MAC_Common_Init(&mac[i], &pcs[i]);
+	CAN_XR_MAC_Set_Pool(&mac[i], &pool);
+    }
+
+    CAN_XR_Gateway_Init(&gw, &mac[0], &mac[1]);
+    CAN_XR_Gateway_Add_Route(&gw, 0, 0x100, 0x1FF, 0x200, NULL, NULL);
+    CAN_XR_Gateway_Add_Route(&gw, 1, 0x300, 0x3FF, 0x300, NULL, NULL);
+
+    /* Start the gateway, feeding both sides with nodeclock
+       indications. */
+    SET_TRACE_TRESHOLD(3);
+    CAN_XR_PMA_GPIO_Dual_NodeClock_Ind(&pma[0], &pma[1]);
+
+    return EXIT_SUCCESS;
+}
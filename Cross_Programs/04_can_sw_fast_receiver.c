@@ -0,0 +1,132 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* Same as 01_can_sw_receiver.c, with the fast stack.  The GPIO PMA,
+   and with it the PCS and the MAC, are compiled here, so that the
+   compiler can inline the whole per-nodeclock path into the nodeclock
+   loop, see CAN_XR_Fast_Stack.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include <CAN_XR_Config.h>
+
+/* Before the GPIO PMA, which uses it */
+#define configCPU_CLOCK_HZ 100000000
+
+#define CAN_XR_FAST_STACK
+#include "../Cross/CAN_XR_PMA_GPIO.c"
+
+#include <CAN_XR_Trace.h>
+
+/* 8 quanta per bit, sampling point between quantum 5 and 6, (assuming
+   the first quantum is quantum 0).  This matches the configuration of
+   the hardware CAN controller performed by CAN_XR_CAN_Driver.c.
+*/
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 2,
+    .phase_seg2 = 2,
+    .sjw = 1
+};
+
+/* The GPIO PMA takes its timing reference from Timer 0, clocked at
+   the CCLK frequency, configCPU_CLOCK_HZ.  The prescaler value must
+   be calculated in the same way as a normal CAN controller, starting
+   from that frequency.
+*/
+#define GPIO_BIT_RATE CAN_XR_BIT_RATE
+#define GPIO_NODECLOCK_PER_BIT 8
+#define GPIO_PRESCALER configCPU_CLOCK_HZ/(GPIO_BIT_RATE*GPIO_NODECLOCK_PER_BIT)
+
+struct CAN_XR_MAC mac;
+struct CAN_XR_PCS pcs;
+struct CAN_XR_PMA pma;
+
+/* Printing a frame takes plenty of time and very disrupts the
+   reception of the next frame if it's too close.  For this reason,
+   the MAC only puts received frames into rx_fifo, and they are
+   printed by print_rx_fifo.
+*/
+struct CAN_XR_RX_FIFO rx_fifo;
+
+/* The GPIO PMA busy-waits for the next nodeclock forever, so there is
+   no background context on the board.  Print at most one frame per
+   nodeclock, and only when the MAC is idle, to stay as far as
+   possible from the next sampling point that matters.  Frames
+   received in the meantime wait in rx_fifo.
+*/
+void print_rx_fifo(void)
+{
+    struct CAN_XR_RX_FIFO_Record r;
+    int j;
+
+    if(CAN_XR_MAC_Is_Idle(&mac) && CAN_XR_RX_FIFO_Get(&rx_fifo, &r))
+    {
+	if(r.lost)
+	    printf("! %lu frames lost\n", r.lost);
+	printf("> @%lu: id=%lu, format=%d, dlc=%d, data[] = { ",
+	       r.ts, (unsigned long)r.identifier, r.format, r.dlc);
+	for(j=0; j<r.dlc; j++) printf("0x%02x ", r.data[j]);
+	printf("}\n");
+    }
+}
+
+/* This indication is generated by the GPIO PMA on every nodeclock
+   cycle.  It is time-critical, see print_rx_fifo.
+*/
+void app_nodeclock_ind(
+    struct CAN_XR_PCS *pcs, int bus_level)
+{
+    print_rx_fifo();
+}
+
+int main(int argc, char *argv[])
+{
+    CAN_XR_PMA_GPIO_Init(&pma, GPIO_PRESCALER);
+    CAN_XR_PCS_Init(&pcs, &pcs_parameters, &pma);
+
+    /* TBD: To be replaced by implementation-specific initialization
+       function when there's one. */
+    CAN_XR_MAC_Common_Init(&mac, &pcs);
+
+    /* Register app_nodeclock_ind to print received frames */
+    CAN_XR_PMA_GPIO_Set_App_NodeClock_Ind(&pma, app_nodeclock_ind);
+
+    /* Received frames go into rx_fifo */
+    CAN_XR_RX_FIFO_Init(&rx_fifo);
+    CAN_XR_MAC_Set_RX_FIFO(&mac, &rx_fifo);
+
+    /* Start the controller, feeding it with nodeclock indications. */
+    SET_TRACE_TRESHOLD(3);
+    CAN_XR_PMA_GPIO_NodeClock_Ind(&pma);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* Implementation of a simulated, multi-node CAN bus on the host.
+
+   Each node is a full protocol stack, and its PMA is an instance of
+   CAN_XR_PMA_Sim.  On every nodeclock tick, the bus first computes
+   the wired AND of the tx_bus_level of all PMAs, that is, of what all
+   nodes are transmitting, and then propagates the result to all nodes
+   as rx_bus_level.
+
+   Computing the bus level beforehand makes the simulation independent
+   of the order in which nodes are visited.  Any PMA_Data_Req issued
+   by a node during the tick only becomes visible on the bus at the
+   next tick, as it would be for a real transceiver.
+*/
+
+/* The simulation is event-driven to some extent.  When the bus is
+   idle, nothing can change until an external event happens, so the
+   bus skips directly to it by means of CAN_XR_PCS_Skip on all nodes.
+   External events are scheduled MAC_Data.Requests and edges of the
+   external stimulus.  Requests issued by upcalls only happen when the
+   bus is busy, and hence, they are handled tick by tick.
+
+   Bus integration is not considered idle and is always simulated
+   tick by tick, it lasts only 11 bits anyway.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "CAN_XR_PMA_Sim.h"
+#include "CAN_XR_Bus.h"
+#include "CAN_XR_Trace.h"
+
+void CAN_XR_Bus_Init(
+    struct CAN_XR_Bus *bus,
+    struct CAN_XR_Bus_Node *nodes, int n_nodes,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters)
+{
+    int n;
+
+    TRACE(0, "CAN_XR_Bus_Init(%d)", n_nodes);
+
+    bus->nodes = nodes;
+    bus->n_nodes = n_nodes;
+
+    /* The bus is initially recessive and no time has elapsed yet. */
+    bus->nodeclock_ts = (unsigned long)0;
+    bus->bus_level = 1;
+
+    /* No schedule, no stimulus, idle skipping enabled. */
+    bus->schedule = NULL;
+    bus->n_schedule = 0;
+    bus->next_schedule = 0;
+    bus->stimulus = NULL;
+    bus->n_stimulus = 0;
+    bus->next_stimulus = 0;
+    bus->ext_level = 1;
+    bus->idle_skip = 1;
+
+    for(n=0; n<n_nodes; n++)
+    {
+	CAN_XR_PMA_Sim_Init(&nodes[n].pma);
+	CAN_XR_PCS_Init(&nodes[n].pcs, parameters, &nodes[n].pma);
+	CAN_XR_MAC_Common_Init(&nodes[n].mac, &nodes[n].pcs);
+    }
+}
+
+struct CAN_XR_MAC *CAN_XR_Bus_MAC(struct CAN_XR_Bus *bus, int node)
+{
+    return &(bus->nodes[node].mac);
+}
+
+void CAN_XR_Bus_Set_Schedule(
+    struct CAN_XR_Bus *bus,
+    const struct CAN_XR_Bus_Data_Req *schedule, int n)
+{
+    bus->schedule = schedule;
+    bus->n_schedule = n;
+    bus->next_schedule = 0;
+}
+
+void CAN_XR_Bus_Set_Stimulus(
+    struct CAN_XR_Bus *bus,
+    const struct CAN_XR_Bus_Edge *stimulus, int n)
+{
+    bus->stimulus = stimulus;
+    bus->n_stimulus = n;
+    bus->next_stimulus = 0;
+    bus->ext_level = 1;
+}
+
+void CAN_XR_Bus_Set_Idle_Skip(struct CAN_XR_Bus *bus, int idle_skip)
+{
+    bus->idle_skip = idle_skip;
+}
+
+/* Issue scheduled requests and apply stimulus edges due at or before
+   tick 'ts'.
+*/
+static void external_events(struct CAN_XR_Bus *bus, unsigned long ts)
+{
+    const struct CAN_XR_Bus_Data_Req *r;
+
+    while(bus->next_schedule < bus->n_schedule
+	  && bus->schedule[bus->next_schedule].ts <= ts)
+    {
+	r = &(bus->schedule[bus->next_schedule++]);
+
+	TRACE(0, "CAN_XR_Bus @%lu scheduled Data_Req node %d id %lu",
+	      ts, r->node, (unsigned long)r->identifier);
+
+	CAN_XR_MAC_Data_Req(&(bus->nodes[r->node].mac),
+			    r->identifier, r->format, r->dlc, r->data);
+    }
+
+    while(bus->next_stimulus < bus->n_stimulus
+	  && bus->stimulus[bus->next_stimulus].ts <= ts)
+	bus->ext_level = bus->stimulus[bus->next_stimulus++].level;
+}
+
+/* Return non-zero if 'bus' is idle.  This requires the bus to be
+   recessive now and all nodes to be idle and willing to stay
+   recessive at the next bit boundary, too.
+*/
+static int bus_idle(const struct CAN_XR_Bus *bus)
+{
+    const struct CAN_XR_Bus_Node *node;
+    int n;
+
+    if(bus->bus_level == 0 || bus->ext_level == 0)
+	return 0;
+
+    for(n=0; n<bus->n_nodes; n++)
+    {
+	node = &(bus->nodes[n]);
+
+	if(!CAN_XR_MAC_Is_Idle(&node->mac)
+	   || node->pma.state.sim.tx_bus_level == 0
+	   || node->pcs.state.output_unit_buf == 0)
+	    return 0;
+    }
+
+    return 1;
+}
+
+void CAN_XR_Bus_Run(struct CAN_XR_Bus *bus, unsigned long ticks)
+{
+    struct CAN_XR_Bus_Node *nodes = bus->nodes;
+    int n_nodes = bus->n_nodes;
+    unsigned long end = bus->nodeclock_ts + ticks;
+    unsigned long skip_end;
+    int bus_level;
+    int n;
+
+    TRACE(0, "CAN_XR_Bus_Run(%lu) @%lu", ticks, bus->nodeclock_ts);
+
+    while(bus->nodeclock_ts < end)
+    {
+	external_events(bus, bus->nodeclock_ts + 1);
+
+	if(bus->idle_skip && bus_idle(bus))
+	{
+	    /* Skip up to the tick before the next external event, or
+	       up to the end of the run.
+	    */
+	    skip_end = end;
+
+	    if(bus->next_schedule < bus->n_schedule
+	       && bus->schedule[bus->next_schedule].ts - 1 < skip_end)
+		skip_end = bus->schedule[bus->next_schedule].ts - 1;
+
+	    if(bus->next_stimulus < bus->n_stimulus
+	       && bus->stimulus[bus->next_stimulus].ts - 1 < skip_end)
+		skip_end = bus->stimulus[bus->next_stimulus].ts - 1;
+
+	    if(skip_end > bus->nodeclock_ts)
+	    {
+		TRACE(0, "CAN_XR_Bus @%lu skipping to %lu",
+		      bus->nodeclock_ts, skip_end);
+
+		for(n=0; n<n_nodes; n++)
+		    CAN_XR_PCS_Skip(&nodes[n].pcs,
+				    skip_end - bus->nodeclock_ts);
+
+		bus->nodeclock_ts = skip_end;
+		continue;
+	    }
+	}
+
+	/* Wired AND of what all nodes and the stimulus are
+	   transmitting.
+	*/
+	bus_level = bus->ext_level;
+	for(n=0; n<n_nodes; n++)
+	    bus_level &= nodes[n].pma.state.sim.tx_bus_level;
+
+	bus->nodeclock_ts++;
+	bus->bus_level = bus_level;
+
+	/* All nodes see the same bus level at the same time. */
+	for(n=0; n<n_nodes; n++)
+	    CAN_XR_PMA_Sim_NodeClock_Ind(&nodes[n].pma, bus_level);
+    }
+}
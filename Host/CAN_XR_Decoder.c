@@ -0,0 +1,953 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* Implementation of the offline frame decoder, see CAN_XR_Decoder.h.
+
+   Full TRACE at level 2.
+   Frame errors, which are part of normal operation for a decoder,
+   are traced at level 3.
+*/
+
+#include <string.h>
+#include <pthread.h>
+#include "CAN_XR_CRC.h"
+#include "CAN_XR_Decoder.h"
+#include "CAN_XR_Trace.h"
+
+/* De-stuffed bit counts, from SOF included, at which the IDE bit,
+   the FDF bit, and the DLC field have been received.
+*/
+#define IDE_END (1 + 11 + 2)
+#define FDF_END (1 + 11 + 3)
+#define DLC_END (1 + 11 + 3 + 4)
+
+/* Return bit i of the capture in 'samples'. */
+#define sample(samples, i) ((int)((samples)[(i) >> 6] >> ((i) & 0x3F)) & 0x1)
+
+/* Return the index of the first bus level different from 'level' in
+   'samples', starting from 'first' (< 'n_samples') and up to
+   'n_samples' excluded, or 'n_samples' if there is none.
+
+   Words are compared four at a time while looking for a change, the
+   compiler is free to use vector instructions for that.  A change
+   within a word is then located with ctz.
+*/
+static unsigned long find_change(
+    const uint64_t *samples, unsigned long first, unsigned long n_samples,
+    int level)
+{
+    const uint64_t flip = level ? ~(uint64_t)0 : (uint64_t)0;
+    unsigned long n_words = (n_samples + 63) >> 6;
+    unsigned long i = first >> 6;
+    uint64_t w = (samples[i] ^ flip) & (~(uint64_t)0 << (first & 0x3F));
+
+    while(w == 0)
+    {
+	i++;
+	while(i + 4 <= n_words
+	      && ((samples[i] ^ flip) | (samples[i+1] ^ flip)
+		  | (samples[i+2] ^ flip) | (samples[i+3] ^ flip)) == 0)
+	    i += 4;
+
+	if(i >= n_words)
+	    return n_samples;
+
+	w = samples[i] ^ flip;
+    }
+
+    i = (i << 6) + __builtin_ctzll(w);
+    return (i < n_samples) ? i : n_samples;
+}
+
+/* Set 'n' (<= 8) bits of 'frame', MSb first, starting from bit
+   'first'.  Only ones need to be set, because the frame is cleared at
+   SOF.
+*/
+static void put_ones(uint8_t *frame, int first, int n)
+{
+    unsigned int w = ((0xFFFF0000U >> n) & 0xFFFF) >> (first & 0x7);
+
+    frame[first >> 3] |= w >> 8;
+    frame[(first >> 3) + 1] |= w & 0xFF;
+}
+
+/* Return 'n' (<= 16) bits of 'frame', MSb first, starting from bit
+   'first'.
+*/
+static unsigned int get_bits(const uint8_t *frame, int first, int n)
+{
+    const uint8_t *p = &frame[first >> 3];
+    uint32_t w = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+
+    return (w >> (24 - (first & 0x7) - n)) & ((1U << n) - 1);
+}
+
+/* Enter the error state, the error is handled at the next sample
+   point.
+*/
+static void rx_error(
+    struct CAN_XR_Decoder *dec, unsigned long ts, const char *what)
+{
+    TRACE(3, ">>> Decoder @%lu %s error", ts, what);
+
+    dec->state.errors++;
+    dec->state.rx_fsm_state = CAN_XR_DECODER_RX_FSM_ERROR;
+}
+
+/* Check the frame when the de-stuffed bit count reaches a field
+   boundary, at the sample point of the last bit of the field, 'ts'.
+   The checks are the same of de_stuffed_data_ind in
+   CAN_XR_MAC_Common.c, but done once per field.
+*/
+static void rx_field_end(struct CAN_XR_Decoder *dec, unsigned long ts)
+{
+    struct CAN_XR_Decoder_State *s = &dec->state;
+    int n_data, i;
+
+    if(s->de_stuffed_bits == IDE_END)
+    {
+	/* TBD: Like the MAC, only CBFF, it must be IDE=0.  Not an
+	   error, wait for the bus to be idle right away.
+	*/
+	if(get_bits(s->rx_frame, IDE_END - 1, 1))
+	{
+	    TRACE(3, ">>> Decoder @%lu xEFF format unsupported", ts);
+	    s->hard_sync_allowed = 1;
+	    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_BUS_INTEGRATION;
+	}
+    }
+
+    else if(s->de_stuffed_bits == FDF_END)
+    {
+	/* Same for FDF=1, like the MAC with FD frames disabled */
+	if(get_bits(s->rx_frame, FDF_END - 1, 1))
+	{
+	    TRACE(3, ">>> Decoder @%lu FDF recessive", ts);
+	    s->hard_sync_allowed = 1;
+	    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_BUS_INTEGRATION;
+	}
+    }
+
+    else if(s->de_stuffed_bits == DLC_END)
+    {
+	s->rx_identifier = get_bits(s->rx_frame, 1, 11);
+	s->rx_dlc = get_bits(s->rx_frame, DLC_END - 4, 4);
+	n_data = (s->rx_dlc > 8) ? 8 : s->rx_dlc;
+	s->frame_bits = DLC_END + 8 * n_data + 15;
+
+	/* The MAC clears rx_data only when the data field is not
+	   empty, but we always do, so that the frames do not depend
+	   on the previous ones.
+	*/
+	memset(s->rx_data, 0, sizeof(s->rx_data));
+    }
+
+    else
+    {
+	/* End of CRC, the CRC of the whole frame must be zero */
+	if(CAN_XR_CRC_Update(0x0000, s->rx_frame, 0, s->frame_bits) != 0)
+	    rx_error(dec, ts, "CRC");
+
+	else
+	{
+	    n_data = (s->rx_dlc > 8) ? 8 : s->rx_dlc;
+	    for(i=0; i<n_data; i++)
+		s->rx_data[i] = get_bits(s->rx_frame, DLC_END + 8*i, 8);
+
+	    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_RX_CDEL;
+	}
+    }
+}
+
+/* Deliver 'n' sampled bits, all at 'level', to the receive automaton.
+   The first one was sampled at 'ts', the others follow every
+   'ts_step' ticks.  This is the counterpart of pcs_data_ind in
+   CAN_XR_MAC_Common.c, for the MAC of a node that does not transmit
+   anything but the ACK bit, except that it consumes as many bits as
+   possible at each step.
+*/
+static void rx_bits(
+    struct CAN_XR_Decoder *dec, int level,
+    unsigned long n, unsigned long ts, unsigned long ts_step)
+{
+    struct CAN_XR_Decoder_State *s = &dec->state;
+    unsigned long m;
+    int field_end;
+
+    while(n > 0)
+    {
+	switch(s->rx_fsm_state)
+	{
+	case CAN_XR_DECODER_RX_FSM_BUS_INTEGRATION:
+	    /* Transition to idle after 11 recessive bits */
+	    if(level == 0)
+	    {
+		s->bus_integration_counter = 0;
+		return;
+	    }
+
+	    m = 11 - s->bus_integration_counter;
+	    if(n < m)
+	    {
+		s->bus_integration_counter += n;
+		return;
+	    }
+
+	    s->bus_integration_counter = 0;
+	    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_IDLE;
+	    n -= m;
+	    ts += m * ts_step;
+	    break;
+
+	case CAN_XR_DECODER_RX_FSM_IDLE:
+	    if(level == 1)
+		return;
+
+	    /* SOF received, disable hard synchronization, initialize
+	       bit de-stuffing state, and start a new frame.
+	    */
+	    s->hard_sync_allowed = 0;
+	    s->nc_bits = 1;
+	    s->nc_pol = 0;
+	    memset(s->rx_frame, 0, sizeof(s->rx_frame));
+	    s->de_stuffed_bits = 1;
+	    s->frame_bits = CAN_XR_DECODER_MAX_FRAME_BITS;
+	    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_RX_FRAME;
+	    n--;
+	    ts += ts_step;
+	    break;
+
+	case CAN_XR_DECODER_RX_FSM_RX_FRAME:
+	case CAN_XR_DECODER_RX_FSM_RX_CDEL:
+	    /* Bit de-stuffing, [1] 10.5, up to CDEL included like in
+	       the MAC.
+	    */
+	    if(s->nc_bits == 5)
+	    {
+		/* Expecting a stuff bit, must be the opposite of nc_pol */
+		if(level == s->nc_pol)
+		    rx_error(dec, ts, "stuff");
+
+		else
+		{
+		    s->nc_bits = 1;
+		    s->nc_pol = level;
+		}
+
+		n--;
+		ts += ts_step;
+		break;
+	    }
+
+	    if(level != s->nc_pol)
+	    {
+		s->nc_bits = 0;
+		s->nc_pol = level;
+	    }
+
+	    if(s->rx_fsm_state == CAN_XR_DECODER_RX_FSM_RX_CDEL)
+	    {
+		s->nc_bits++;
+		if(level != 1)
+		    rx_error(dec, ts, "CDEL form");
+
+		else
+		{
+		    /* Acknowledge the frame at the next bit boundary */
+		    s->output_unit_buf = 0;
+		    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_RX_ACK;
+		}
+
+		n--;
+		ts += ts_step;
+		break;
+	    }
+
+	    /* Take as many bits as possible, up to the next stuff bit
+	       or the end of the next field to be checked.
+	    */
+	    field_end =
+		(s->de_stuffed_bits < IDE_END) ? IDE_END
+		: (s->de_stuffed_bits < FDF_END) ? FDF_END
+		: (s->de_stuffed_bits < DLC_END) ? DLC_END : s->frame_bits;
+
+	    m = 5 - s->nc_bits;
+	    if(m > (unsigned long)(field_end - s->de_stuffed_bits))
+		m = field_end - s->de_stuffed_bits;
+	    if(m > n)
+		m = n;
+
+	    if(level)
+		put_ones(s->rx_frame, s->de_stuffed_bits, m);
+
+	    s->de_stuffed_bits += m;
+	    s->nc_bits += m;
+	    n -= m;
+	    ts += m * ts_step;
+
+	    if(s->de_stuffed_bits == field_end)
+		rx_field_end(dec, ts - ts_step);
+	    break;
+
+	case CAN_XR_DECODER_RX_FSM_RX_ACK:
+	    if(level != 0)
+		rx_error(dec, ts, "ACK bit");
+
+	    else
+	    {
+		/* Stop transmitting the dominant ACK bit */
+		s->output_unit_buf = 1;
+		s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_RX_ADEL;
+	    }
+
+	    n--;
+	    ts += ts_step;
+	    break;
+
+	case CAN_XR_DECODER_RX_FSM_RX_ADEL:
+	    if(level != 1)
+		rx_error(dec, ts, "ADEL form");
+
+	    else
+	    {
+		s->field_bits = 6;
+		s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_RX_EOF;
+	    }
+
+	    n--;
+	    ts += ts_step;
+	    break;
+
+	case CAN_XR_DECODER_RX_FSM_RX_EOF:
+	    /* Like the MAC, the frame is valid regardless of the 7th
+	       bit of EOF, see de_stuffed_data_ind.
+	    */
+	    if(level == 1 && s->field_bits > 0)
+	    {
+		m = ((unsigned long)s->field_bits < n) ? s->field_bits : n;
+		s->field_bits -= m;
+		n -= m;
+		ts += m * ts_step;
+	    }
+
+	    else if(s->field_bits > 0)
+	    {
+		rx_error(dec, ts, "EOF form");
+		n--;
+		ts += ts_step;
+	    }
+
+	    else
+	    {
+		TRACE(2, "Decoder @%lu Frame OK id=%lu dlc=%d", ts,
+		      (unsigned long)s->rx_identifier, s->rx_dlc);
+
+		s->frames++;
+		if(dec->data_ind)
+		    dec->data_ind(
+			dec->llc, ts, s->rx_identifier,
+			CAN_XR_FORMAT_CBFF, s->rx_dlc, s->rx_data);
+
+		if(level == 0)
+		    rx_error(dec, ts, "overload");
+
+		else
+		{
+		    s->field_bits = 2;
+		    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_INTERMISSION;
+		}
+
+		n--;
+		ts += ts_step;
+	    }
+	    break;
+
+	case CAN_XR_DECODER_RX_FSM_INTERMISSION:
+	    /* Intermission, the MAC in bus monitoring mode handles an
+	       overload condition like an error.  Hard synchronization
+	       is allowed again after the first bit, and a dominant
+	       third bit is a SOF.
+	    */
+	    if(level == 1)
+	    {
+		m = ((unsigned long)s->field_bits + 1 < n)
+		    ? (unsigned long)s->field_bits + 1 : n;
+		s->hard_sync_allowed = 1;
+		s->field_bits -= m;
+		if(s->field_bits < 0)
+		    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_IDLE;
+		n -= m;
+		ts += m * ts_step;
+	    }
+
+	    else if(s->field_bits > 0)
+	    {
+		rx_error(dec, ts, "overload");
+		n--;
+		ts += ts_step;
+	    }
+
+	    else
+		s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_IDLE;
+	    break;
+
+	default:
+	    /* Same error recovery as the MAC in bus monitoring mode:
+	       transmit recessive at the next bit boundary, enable hard
+	       synchronization, and go to bus integration.
+	    */
+	    s->output_unit_buf = 1;
+	    s->hard_sync_allowed = 1;
+	    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_BUS_INTEGRATION;
+	    n--;
+	    ts += ts_step;
+	    break;
+	}
+    }
+}
+
+/* Advance by 'n' quanta without edges, so the bus level stays at
+   prev_bus_level and the quantum counter just keeps running.  Deliver
+   the bits sampled in the meantime to the receive automaton, in at
+   most two chunks.  The first chunk ends before the last bit boundary
+   within the interval, if any, because sending_level takes the value
+   output_unit_buf has there.
+*/
+static void advance(struct CAN_XR_Decoder *dec, unsigned long n)
+{
+    struct CAN_XR_Decoder_State *s = &dec->state;
+    unsigned long quanta_per_bit = dec->quanta_per_bit;
+    unsigned long ts_step = quanta_per_bit * dec->parameters.prescaler_m;
+    unsigned long first_sample, n_samples;
+    unsigned long first_boundary, n_boundaries, n_before;
+    unsigned long ts;
+    int level = s->prev_bus_level;
+
+    if(n == 0)  return;
+
+    /* The quanta that elapse are quantum_m_cnt, quantum_m_cnt+1, ...,
+       modulus quanta_per_bit, and quantum_m_cnt is in range here.
+    */
+    first_sample =
+	(dec->sample_point >= s->quantum_m_cnt)
+	? dec->sample_point - s->quantum_m_cnt
+	: dec->sample_point - s->quantum_m_cnt + quanta_per_bit;
+    n_samples =
+	(first_sample < n) ? (n - 1 - first_sample) / quanta_per_bit + 1 : 0;
+    first_boundary = quanta_per_bit - 1 - s->quantum_m_cnt;
+    ts = s->quantum_ts + first_sample * dec->parameters.prescaler_m;
+
+    if(first_boundary < n)
+    {
+	/* Sample points and bit boundaries alternate, so the samples
+	   before the last boundary are as many as the boundaries, or
+	   one less if the first boundary comes first.
+	*/
+	n_boundaries = (n - 1 - first_boundary) / quanta_per_bit + 1;
+	n_before = n_boundaries - (first_boundary < first_sample);
+
+	rx_bits(dec, level, n_before, ts, ts_step);
+	s->sending_level = s->output_unit_buf;
+	rx_bits(dec, level, n_samples - n_before,
+		ts + n_before * ts_step, ts_step);
+    }
+
+    else
+	rx_bits(dec, level, n_samples, ts, ts_step);
+
+    if(n_samples > 0)
+    {
+	if(level == 1)  s->sync_inhibit = 0;
+	s->prev_sample = level;
+    }
+
+    s->quantum_m_cnt = (s->quantum_m_cnt + n) % quanta_per_bit;
+    s->quantum_ts += n * dec->parameters.prescaler_m;
+}
+
+/* Process a quantum at which the bus level changes to 'level'.  This
+   is the same as quantumclock_m_ind in CAN_XR_PCS.c, with an edge.
+*/
+static void edge(struct CAN_XR_Decoder *dec, int level)
+{
+    struct CAN_XR_Decoder_State *s = &dec->state;
+    int quanta_per_bit = dec->quanta_per_bit;
+    int sjw = dec->parameters.sjw;
+    int q = s->quantum_m_cnt;
+    int phase_error;
+
+    s->edges++;
+
+    /* Synchronization, [1] 11.3.2 */
+    if(!s->sync_inhibit && s->prev_sample == 1)
+    {
+	phase_error =
+	    (q == 0) ? 0 : ((q <= dec->sample_point) ? q : q - quanta_per_bit);
+
+	if(phase_error < 0 || (phase_error > 0 && s->sending_level == 1))
+	{
+	    if(s->hard_sync_allowed)
+		q = 0;
+	    else
+		q -= (phase_error > sjw)
+		    ? sjw : ((phase_error < -sjw) ? -sjw : phase_error);
+	}
+    }
+
+    s->sync_inhibit = 1;
+
+    /* Sampling, then bit boundary */
+    if(q == dec->sample_point)
+    {
+	rx_bits(dec, level, 1, s->quantum_ts, 0);
+	if(level == 1)  s->sync_inhibit = 0;
+	s->prev_sample = level;
+    }
+
+    if(q >= quanta_per_bit - 1)
+	s->sending_level = s->output_unit_buf;
+
+    s->quantum_m_cnt = (q + 1) % quanta_per_bit;
+    s->prev_bus_level = level;
+    s->quantum_ts += dec->parameters.prescaler_m;
+}
+
+void CAN_XR_Decoder_Init(
+    struct CAN_XR_Decoder *dec,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters)
+{
+    struct CAN_XR_Decoder_State *s = &dec->state;
+
+    TRACE(2, "CAN_XR_Decoder_Init");
+
+    dec->llc = NULL;
+    dec->data_ind = NULL;
+
+    dec->parameters = *parameters;
+    dec->quanta_per_bit =
+	parameters->sync_seg + parameters->prop_seg
+	+ parameters->phase_seg1 + parameters->phase_seg2;
+    dec->sample_point =
+	parameters->sync_seg + parameters->prop_seg
+	+ parameters->phase_seg1 - 1;
+
+    /* Same initial state as CAN_XR_PCS_Init and
+       CAN_XR_MAC_Common_Init.
+    */
+    s->nodeclock_ts = 0;
+    s->quantum_ts = parameters->prescaler_m;
+    s->quantum_m_cnt = 0;
+    s->prev_bus_level = 1;
+    s->prev_sample = 1;
+    s->sync_inhibit = 0;
+    s->hard_sync_allowed = 1;
+    s->output_unit_buf = 1;
+    s->sending_level = 1;
+
+    s->rx_fsm_state = CAN_XR_DECODER_RX_FSM_BUS_INTEGRATION;
+    s->bus_integration_counter = 0;
+    s->nc_bits = 0;
+    s->nc_pol = 1;
+    s->de_stuffed_bits = 0;
+    s->frame_bits = CAN_XR_DECODER_MAX_FRAME_BITS;
+    s->field_bits = 0;
+    memset(s->rx_frame, 0, sizeof(s->rx_frame));
+    s->rx_identifier = 0;
+    s->rx_dlc = 0;
+    memset(s->rx_data, 0, sizeof(s->rx_data));
+
+    s->edges = 0;
+    s->frames = 0;
+    s->errors = 0;
+}
+
+void CAN_XR_Decoder_Set_LLC(struct CAN_XR_Decoder *dec, struct CAN_XR_LLC *llc)
+{
+    dec->llc = llc;
+}
+
+void CAN_XR_Decoder_Set_Data_Ind(
+    struct CAN_XR_Decoder *dec, CAN_XR_MAC_Data_Ind_t data_ind)
+{
+    dec->data_ind = data_ind;
+}
+
+/* Decode the capture in 'samples', in which samples[0] is at tick
+   base+1, from where the decoder left off up to sample 'end'
+   excluded.
+*/
+static void run(
+    struct CAN_XR_Decoder *dec,
+    const uint64_t *samples, unsigned long base, unsigned long end)
+{
+    struct CAN_XR_Decoder_State *s = &dec->state;
+    unsigned long m = dec->parameters.prescaler_m;
+    unsigned long first, change, next;
+    int level;
+
+    /* 'first' is the index of the bus level seen at the next quantum
+       clock edge, which is the only one that matters when prescaler_m
+       > 1.
+    */
+    while((first = s->quantum_ts - base - 1) < end)
+    {
+	change = find_change(samples, first, end, s->prev_bus_level);
+
+	/* First quantum clock edge at or after the change */
+	next = (m == 1) ? change : first + (change - first + m - 1) / m * m;
+	advance(dec, (m == 1) ? next - first : (next - first) / m);
+
+	if(next >= end)
+	    break;
+
+	/* The level may have changed back before the quantum clock
+	   edge, in this case there is no edge.
+	*/
+	level = sample(samples, next);
+	if(level != s->prev_bus_level)
+	    edge(dec, level);
+	else
+	    advance(dec, 1);
+    }
+
+    s->nodeclock_ts = base + end;
+}
+
+void CAN_XR_Decoder_Run(
+    struct CAN_XR_Decoder *dec,
+    const uint64_t *samples, unsigned long n_samples)
+{
+    TRACE(2, "Decoder @%lu CAN_XR_Decoder_Run(%lu)",
+	  dec->state.nodeclock_ts, n_samples);
+
+    run(dec, samples, dec->state.nodeclock_ts, n_samples);
+}
+
+/* No chunk boundary found by a task */
+#define NO_CUT (~0UL)
+
+/* Look for a chunk boundary in 'samples', from sample 'first' to
+   sample 'end' excluded, in a capture of 'n_samples' samples.  Return
+   the index of the first quantum clock edge at which the bus is
+   dominant after at least CAN_XR_DECODER_SPLIT_BITS bits and one
+   quantum of recessive bus, or NO_CUT.
+
+   The receive automaton is idle there, hard synchronization is
+   allowed and the automaton is not sending the ACK bit, whatever
+   happened before.  So, at the edge, the decoder hard synchronizes
+   and gets back to the same state it would have if it had decoded
+   the whole capture.
+
+   The recessive interval is only searched from 'first', so a
+   boundary that follows an interval that starts before 'first' may
+   be missed.  This affects only the load balance.
+*/
+static unsigned long find_cut(
+    const struct CAN_XR_Decoder *dec,
+    const uint64_t *samples, unsigned long base,
+    unsigned long first, unsigned long end, unsigned long n_samples)
+{
+    unsigned long m = dec->parameters.prescaler_m;
+    unsigned long min_ticks =
+	CAN_XR_DECODER_SPLIT_BITS * dec->quanta_per_bit * m + m;
+    unsigned long recessive = first, dominant, cut;
+
+    while(recessive < end)
+    {
+	dominant = find_change(samples, recessive, n_samples, 1);
+	if(dominant >= end)
+	    break;
+
+	if(dominant - recessive >= min_ticks)
+	{
+	    /* First quantum clock edge at or after the dominant
+	       level, it is an edge if the bus is still dominant.
+	    */
+	    cut = dominant + (m - (base + dominant + 1) % m) % m;
+	    if(cut < end && sample(samples, cut) == 0)
+		return cut;
+	}
+
+	recessive = find_change(samples, dominant, n_samples, 0);
+    }
+
+    return NO_CUT;
+}
+
+/* Collect the frames decoded by a task, the llc of its decoder. */
+static void collect_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct CAN_XR_Decoder_Task *task = (struct CAN_XR_Decoder_Task *)llc;
+    struct CAN_XR_Decoder_Frame *frame;
+
+    /* CAN_XR_DECODER_MAX_FRAMES makes sure that this never happens */
+    if(task->n_frames == task->max_frames)
+    {
+	TRACE(9, ">>> Decoder @%lu frame lost", ts);
+	return;
+    }
+
+    frame = &task->frames[task->n_frames++];
+    frame->ts = ts;
+    frame->identifier = identifier;
+    frame->dlc = dlc;
+    memcpy(frame->data, data, sizeof(frame->data));
+}
+
+/* Carry out task 'i' of 'pool' in the current phase. */
+static void do_task(struct CAN_XR_Decoder_Pool *pool, unsigned long i)
+{
+    struct CAN_XR_Decoder_Task *task = &pool->tasks[i];
+    struct CAN_XR_Decoder dec;
+    unsigned long end;
+
+    if(pool->phase == 1)
+    {
+	/* Task 0 always starts at the beginning */
+	task->cut =
+	    (i == 0) ? 0
+	    : find_cut(pool->dec, pool->samples, pool->base,
+		       i * pool->n_samples / pool->n_tasks,
+		       (i + 1) * pool->n_samples / pool->n_tasks,
+		       pool->n_samples);
+	return;
+    }
+
+    end = pool->tasks[i+1].cut;
+    if(task->cut >= end)
+	return;
+
+    /* The first chunk continues from the state of the decoder, the
+       others start from a decoder idle at their first sample, that
+       is, a quantum clock edge.
+    */
+    dec = *pool->dec;
+    if(i > 0)
+    {
+	CAN_XR_Decoder_Init(&dec, &pool->dec->parameters);
+	dec.state.nodeclock_ts = pool->base + task->cut;
+	dec.state.quantum_ts = pool->base + task->cut + 1;
+	dec.state.rx_fsm_state = CAN_XR_DECODER_RX_FSM_IDLE;
+    }
+
+    CAN_XR_Decoder_Set_LLC(&dec, (struct CAN_XR_LLC *)task);
+    CAN_XR_Decoder_Set_Data_Ind(&dec, collect_data_ind);
+    run(&dec, pool->samples, pool->base, end);
+
+    task->edges = dec.state.edges;
+    task->frames_ok = dec.state.frames;
+    task->errors = dec.state.errors;
+    if(end == pool->n_samples)
+	pool->last_state = dec.state;
+}
+
+/* Take the next task of worker 'w', or steal one from the other
+   workers, starting from the next one.  Return the task number, or
+   n_tasks if there are no tasks left.
+*/
+static unsigned long take_task(struct CAN_XR_Decoder_Pool *pool, int w)
+{
+    struct CAN_XR_Decoder_Worker *worker = &pool->workers[w];
+    unsigned long task = pool->n_tasks;
+    int i;
+
+    pthread_mutex_lock(&worker->lock);
+    if(worker->next_task < worker->end_task)
+	task = worker->next_task++;
+    pthread_mutex_unlock(&worker->lock);
+
+    for(i=1; i<pool->n_workers && task == pool->n_tasks; i++)
+    {
+	worker = &pool->workers[(w + i) % pool->n_workers];
+
+	pthread_mutex_lock(&worker->lock);
+	if(worker->next_task < worker->end_task)
+	    task = --worker->end_task;
+	pthread_mutex_unlock(&worker->lock);
+    }
+
+    return task;
+}
+
+/* Body of a worker thread, and of the calling thread as worker 0. */
+static void *worker_main(void *arg)
+{
+    struct CAN_XR_Decoder_Worker *worker = arg;
+    struct CAN_XR_Decoder_Pool *pool = worker->pool;
+    int w = worker - pool->workers;
+    unsigned long task;
+
+    while((task = take_task(pool, w)) < pool->n_tasks)
+	do_task(pool, task);
+
+    return NULL;
+}
+
+/* Run all tasks of 'pool' in the current phase.  Each worker gets a
+   contiguous range of tasks at the beginning, because neighboring
+   chunks take a similar time to decode.
+*/
+static void run_phase(struct CAN_XR_Decoder_Pool *pool, int phase)
+{
+    int w;
+
+    pool->phase = phase;
+
+    for(w=0; w<pool->n_workers; w++)
+    {
+	pool->workers[w].next_task = w * pool->n_tasks / pool->n_workers;
+	pool->workers[w].end_task = (w + 1) * pool->n_tasks / pool->n_workers;
+    }
+
+    for(w=1; w<pool->n_workers; w++)
+	if(pthread_create(&pool->workers[w].thread, NULL,
+			  worker_main, &pool->workers[w]) != 0)
+	{
+	    /* The other workers will steal its tasks */
+	    TRACE(9, ">>> Decoder worker %d not started", w);
+	    pool->workers[w].thread = pthread_self();
+	}
+
+    worker_main(&pool->workers[0]);
+
+    for(w=1; w<pool->n_workers; w++)
+	if(!pthread_equal(pool->workers[w].thread, pthread_self()))
+	    pthread_join(pool->workers[w].thread, NULL);
+}
+
+void CAN_XR_Decoder_Pool_Init(
+    struct CAN_XR_Decoder_Pool *pool,
+    struct CAN_XR_Decoder_Worker *workers, int n_workers,
+    struct CAN_XR_Decoder_Task *tasks, unsigned long n_tasks,
+    struct CAN_XR_Decoder_Frame *frames, unsigned long max_frames)
+{
+    int w;
+
+    TRACE(2, "CAN_XR_Decoder_Pool_Init(%d, %lu, %lu)",
+	  n_workers, n_tasks, max_frames);
+
+    pool->workers = workers;
+    pool->n_workers = n_workers;
+    pool->tasks = tasks;
+    pool->n_tasks = n_tasks;
+    pool->frames = frames;
+    pool->max_frames = max_frames;
+
+    for(w=0; w<n_workers; w++)
+    {
+	workers[w].pool = pool;
+	pthread_mutex_init(&workers[w].lock, NULL);
+    }
+}
+
+void CAN_XR_Decoder_Run_Parallel(
+    struct CAN_XR_Decoder *dec, struct CAN_XR_Decoder_Pool *pool,
+    const uint64_t *samples, unsigned long n_samples)
+{
+    struct CAN_XR_Decoder_Task *task;
+    unsigned long bit_ticks = dec->quanta_per_bit * dec->parameters.prescaler_m;
+    unsigned long min_ticks =
+	43 * (dec->quanta_per_bit - dec->parameters.sjw)
+	* dec->parameters.prescaler_m;
+    unsigned long i, j, n_frames;
+
+    TRACE(2, "Decoder @%lu CAN_XR_Decoder_Run_Parallel(%lu)",
+	  dec->state.nodeclock_ts, n_samples);
+
+    /* Not worth it if no task can have a boundary */
+    if(n_samples / pool->n_tasks <= CAN_XR_DECODER_SPLIT_BITS * bit_ticks)
+    {
+	CAN_XR_Decoder_Run(dec, samples, n_samples);
+	return;
+    }
+
+    pool->dec = dec;
+    pool->samples = samples;
+    pool->base = dec->state.nodeclock_ts;
+    pool->n_samples = n_samples;
+
+    /* Phase 1, look for chunk boundaries.  When a task finds none,
+       its chunk is empty and the previous one extends further.
+    */
+    pool->tasks[pool->n_tasks].cut = n_samples;
+    run_phase(pool, 1);
+
+    for(i=pool->n_tasks; i-- > 0; )
+	if(pool->tasks[i].cut == NO_CUT)
+	    pool->tasks[i].cut = pool->tasks[i+1].cut;
+
+    /* Share the frame buffer out among tasks, according to the
+       longest chunk they may have.
+    */
+    for(i=0, n_frames=0; i<pool->n_tasks; i++)
+    {
+	task = &pool->tasks[i];
+	task->frames = pool->frames + n_frames;
+	task->max_frames =
+	    (pool->tasks[i+1].cut - task->cut) / min_ticks + 2;
+	task->n_frames = 0;
+	n_frames += task->max_frames;
+    }
+
+    if(n_frames > pool->max_frames)
+    {
+	TRACE(2, "Decoder needs %lu frames, has %lu",
+	      n_frames, pool->max_frames);
+	CAN_XR_Decoder_Run(dec, samples, n_samples);
+	return;
+    }
+
+    /* Phase 2, decode the chunks, then deliver the frames in order.
+       The chunks are in order, and so are the frames within them.
+    */
+    run_phase(pool, 2);
+
+    pool->last_state.edges = 0;
+    pool->last_state.frames = 0;
+    pool->last_state.errors = 0;
+
+    for(i=0; i<pool->n_tasks; i++)
+    {
+	task = &pool->tasks[i];
+	if(task->cut == pool->tasks[i+1].cut)
+	    continue;
+
+	pool->last_state.edges += task->edges;
+	pool->last_state.frames += task->frames_ok;
+	pool->last_state.errors += task->errors;
+
+	if(dec->data_ind)
+	    for(j=0; j<task->n_frames; j++)
+		dec->data_ind(
+		    dec->llc, task->frames[j].ts, task->frames[j].identifier,
+		    CAN_XR_FORMAT_CBFF, task->frames[j].dlc,
+		    task->frames[j].data);
+    }
+
+    dec->state = pool->last_state;
+}
@@ -0,0 +1,116 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This file contains the event log of host programs, see
+   CAN_XR_Event_Log.h.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "CAN_XR_Event_Log.h"
+
+struct CAN_XR_Event_Log *CAN_XR_Event_Log_Current = NULL;
+
+void CAN_XR_Event_Log_Init(
+    struct CAN_XR_Event_Log *log,
+    struct CAN_XR_Event *events, int max_events)
+{
+    log->events = events;
+    log->max_events = max_events;
+    log->n_events = 0;
+}
+
+struct CAN_XR_Event *CAN_XR_Event_Log_Add(
+    struct CAN_XR_Event_Log *log, int node, enum CAN_XR_Event_Kind kind,
+    unsigned long ts, uint32_t identifier, int dlc_or_status,
+    const uint8_t *data)
+{
+    struct CAN_XR_Event *e;
+
+    if(log->n_events >= log->max_events)  return NULL;
+    e = &(log->events[log->n_events++]);
+
+    memset(e, 0, sizeof(*e));
+    e->node = node;
+    e->kind = kind;
+    e->ts = ts;
+    e->identifier = identifier;
+    e->dlc_or_status = dlc_or_status;
+    if(kind == CAN_XR_EVENT_DATA_IND)
+	memcpy(e->data, data, dlc_or_status > 8 ? 8 : dlc_or_status);
+    return e;
+}
+
+int CAN_XR_Event_Log_Compare(
+    const char *what,
+    const struct CAN_XR_Event_Log *ref, const struct CAN_XR_Event_Log *log)
+{
+    const struct CAN_XR_Event *r, *l;
+    int errors = 0;
+    int i;
+
+    if(ref->n_events != log->n_events)
+    {
+	printf("! %s: %d events vs. %d\n", what, log->n_events, ref->n_events);
+	errors++;
+    }
+
+    for(i=0; i<ref->n_events && i<log->n_events && errors < 10; i++)
+    {
+	r = &(ref->events[i]);
+	l = &(log->events[i]);
+	if(memcmp(r, l, sizeof(*r)) != 0)
+	{
+	    printf("! %s: event #%d: node %d kind %d @%lu id=%lu %d "
+		   "vs. node %d kind %d @%lu id=%lu %d\n",
+		   what, i,
+		   l->node, l->kind, l->ts, (unsigned long)l->identifier,
+		   l->dlc_or_status,
+		   r->node, r->kind, r->ts, (unsigned long)r->identifier,
+		   r->dlc_or_status);
+	    errors++;
+	}
+    }
+
+    return errors;
+}
+
+void CAN_XR_Event_Log_Data_Ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    CAN_XR_Event_Log_Add(CAN_XR_Event_Log_Current, *(int *)llc,
+			 CAN_XR_EVENT_DATA_IND, ts, identifier, dlc, data);
+}
+
+void CAN_XR_Event_Log_Data_Conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    CAN_XR_Event_Log_Add(CAN_XR_Event_Log_Current, *(int *)llc,
+			 CAN_XR_EVENT_DATA_CONF, ts, identifier,
+			 transmission_status, NULL);
+}
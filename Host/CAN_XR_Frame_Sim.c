@@ -0,0 +1,789 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* Implementation of a frame-level (transaction-level) bus simulator
+   on the host.
+
+   The simulator keeps track of time in nodeclock units, like the
+   bit-level one, but advances one frame at a time.  All nodes share
+   the same bit time parameters and are perfectly synchronized, so
+   bits lie on a common grid and the sample point of bit i, counted
+   from the epoch, is at
+
+     ts = prescaler_m * (i * quanta_per_bit + sync_seg + prop_seg
+			 + phase_seg1)
+
+   with the same conventions as CAN_XR_PCS.  The simulator mimics
+   what the bit-level MAC in CAN_XR_MAC_Common.c does:
+
+   - bus integration takes 11 bits, so the first SOF can be sent in
+     bit 11;
+
+   - a pending request is honored at the first sample point at which
+     both automata of the MAC are idle, and the SOF is transmitted in
+     the next bit.  After a frame, this is the sample point of the
+     third bit of intermission, so the next SOF comes 3 bits after
+     the last EOF bit;
+
+   - a node with several pending requests transmits the one with the
+     highest priority among those visible at that sample point, and
+     after a frame of its own it is busy until the next one;
+
+   - the frame is delivered to all nodes, the transmitter included,
+     at the sample point of its last EOF bit, which is also when the
+     transmitter gets its confirmation;
+
+   - the MACs are visited in order at each sample point, so a request
+     issued from an upcall is honored at the same sample point if the
+     target MAC has not been visited yet, at the next one otherwise.
+
+   When more than one node wants to start a frame in the same bit,
+   arbitration is resolved in favor of the lowest identifier.  The
+   losers keep their request pending and retry at the next
+   opportunity.
+
+   This mode covers only part of what the bit-level MAC does.  It
+   supports CBFF data frames only, and confirms FBFF and XLFF requests
+   with NO_SUCCESS right away.  Errors, error frames, fault
+   confinement and overload frames are not simulated either.
+   Scenarios that need them must run on CAN_XR_Bus.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CAN_XR_Bus.h"
+#include "CAN_XR_Frame_Sim.h"
+#include "CAN_XR_CRC.h"
+#include "CAN_XR_Trace.h"
+
+/* Append the 'n_bits' LSbs of 'v', 1 to 64, to the bit string 'w',
+   MSb first, starting at position 'pos'.  Bit 0 of the string is the
+   MSb of w[0].  Return the updated position.
+*/
+static int put_bits(uint64_t *w, int pos, uint64_t v, int n_bits)
+{
+    int i = pos >> 6, o = pos & 63;
+
+    if(n_bits < 64)
+	v &= ((uint64_t)1 << n_bits) - 1;
+
+    if(o + n_bits <= 64)
+	w[i] |= v << (64 - o - n_bits);
+    else
+    {
+	w[i] |= v >> (o + n_bits - 64);
+	w[i+1] |= v << (128 - o - n_bits);
+    }
+
+    return pos + n_bits;
+}
+
+/* Return the length of the run of bits at level 'pol' that starts at
+   position 'pos' of the bit string 'w' and ends at 'end' at most.
+   The string must have a spare word after 'end'.
+*/
+static int run_length(const uint64_t *w, int pos, int end, int pol)
+{
+    int start = pos;
+    int i, o, k;
+    uint64_t x;
+
+    while(pos < end)
+    {
+	i = pos >> 6;
+	o = pos & 63;
+	x = o ? (w[i] << o) | (w[i+1] >> (64 - o)) : w[i];
+	if(pol)
+	    x = ~x;
+
+	k = x ? __builtin_clzll(x) : 64;
+	pos += k;
+	if(k < 64)
+	    break;
+    }
+
+    return ((pos < end) ? pos : end) - start;
+}
+
+/* Return the length, in bits, of a CBFF data frame from SOF to the
+   last EOF bit, stuff bits included.
+
+   Stuff bits are counted one run of equal bits at a time.  A run of
+   'len' bits, preceded by 'carry' bits at the same level, gets
+   (carry + len) / 5 stuff bits, and the stuff bit that may end it
+   counts as the first bit of the next run, which has the opposite
+   level.
+*/
+static int frame_bits(uint32_t identifier, int dlc, const uint8_t *data)
+{
+    uint64_t w[3] = { 0, 0, 0 };
+    int n_data = (dlc > 8) ? 8 : dlc;
+    uint16_t crc = 0x0000;
+    uint32_t header;
+    uint64_t payload = 0;
+    int n_bits = 0;
+    int n_stuff = 0;
+    int carry = 0;
+    int pol = 0;
+    int pos, len;
+    int i;
+
+    /* SOF, identifier, RTR, IDE, FDF/r0 and DLC */
+    header = ((identifier & 0x7FF) << 7) | (dlc & 0xF);
+    n_bits = put_bits(w, n_bits, header, 19);
+
+    for(i=0; i<n_data; i++)
+	payload = (payload << 8) | data[i];
+    if(n_data > 0)
+	n_bits = put_bits(w, n_bits, payload, 8 * n_data);
+
+    /* CRC, the 19 bits that precede the data field make it
+       unaligned, so 3 bits go one at a time.
+    */
+    for(i=18; i>=16; i--)
+	crc = CAN_XR_CRC_Bit(crc, header >> i);
+    for(i=12; i>=0; i-=4)
+	crc = CAN_XR_CRC_Nibble(crc, header >> i);
+    for(i=0; i<n_data; i++)
+	crc = CAN_XR_CRC_Byte(crc, data[i]);
+    n_bits = put_bits(w, n_bits, crc, 15);
+
+    /* Count stuff bits, including the one that may follow the last
+       bit of CRC.  SOF is dominant.
+    */
+    for(pos=0; pos<n_bits; pos+=len)
+    {
+	len = run_length(w, pos, n_bits, pol);
+	n_stuff += (carry + len) / 5;
+	carry = ((carry + len) % 5 == 0) ? 1 : 0;
+	pol = 1 - pol;
+    }
+
+    /* CDEL, ACK, ADEL and 7 EOF bits follow */
+    return n_bits + n_stuff + 10;
+}
+
+/* Return the timestamp of the sample point of bit 'bit'. */
+static unsigned long sample_ts(
+    const struct CAN_XR_Frame_Sim *sim, unsigned long bit)
+{
+    return (unsigned long)sim->parameters.prescaler_m
+	* (bit * sim->quanta_per_bit
+	   + sim->parameters.sync_seg + sim->parameters.prop_seg
+	   + sim->parameters.phase_seg1);
+}
+
+/* Return the first bit in which a node can start transmitting a
+   request issued at 'req_ts'.
+*/
+static unsigned long start_bit(
+    const struct CAN_XR_Frame_Sim *sim, unsigned long req_ts)
+{
+    unsigned long bit_ticks =
+	(unsigned long)sim->parameters.prescaler_m * sim->quanta_per_bit;
+    unsigned long first_sample = sample_ts(sim, 0);
+    unsigned long bit = 0;
+
+    /* The request must be visible at the sample point of the bit
+       before, that is, sample_ts(bit - 1) >= req_ts.
+    */
+    if(req_ts > first_sample)
+	bit = (req_ts - first_sample + bit_ticks - 1) / bit_ticks;
+    bit++;
+
+    return (bit > sim->free_bit) ? bit : sim->free_bit;
+}
+
+/* Return the slot of the frame 'node' transmits next, or -1 if it
+   has nothing to transmit.  Store in 'bit' the bit in which it
+   starts.  Like the bit-level MAC, the node picks the frame with the
+   highest priority among those visible when it decides to transmit
+   the SOF, at the sample point of the bit before.
+*/
+static int next_slot(
+    const struct CAN_XR_Frame_Sim *sim,
+    const struct CAN_XR_Frame_Sim_Node *node, unsigned long *bit)
+{
+    const struct CAN_XR_MAC_State *s = &(node->mac.state);
+    unsigned long req_ts, ts;
+    int i;
+
+    if(s->data_req_pending == 0)
+	return -1;
+
+    req_ts = node->req_ts[s->tx_queue[0]];
+    for(i=1; i<s->data_req_pending; i++)
+	if(node->req_ts[s->tx_queue[i]] < req_ts)
+	    req_ts = node->req_ts[s->tx_queue[i]];
+
+    *bit = start_bit(sim, req_ts);
+    if(node->req_ts[s->tx_queue[0]] == req_ts)
+	return s->tx_queue[0];
+
+    ts = sample_ts(sim, *bit - 1);
+    for(i=0; node->req_ts[s->tx_queue[i]] > ts; i++)
+	;
+
+    return s->tx_queue[i];
+}
+
+/* Remove tx_queue[i] of 'mac' from the queue and free its slot, as
+   the bit-level MAC does.
+*/
+static void tx_queue_remove(struct CAN_XR_MAC_State *s, int i)
+{
+    s->tx_slot_map &= ~((uint32_t)1 << s->tx_queue[i]);
+    s->data_req_pending--;
+    for(; i<s->data_req_pending; i++)
+	s->tx_queue[i] = s->tx_queue[i+1];
+}
+
+/* MAC_Data.Request primitive of the frame-level simulator.  It keeps
+   the same TX slots and tx_queue as mac_data_req in
+   CAN_XR_MAC_Common.c, but does not encode the frame, and records in
+   the node when the request was issued.
+*/
+static void frame_sim_data_req(
+    struct CAN_XR_MAC *mac,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct CAN_XR_Frame_Sim_Node *node = (struct CAN_XR_Frame_Sim_Node *)mac;
+    struct CAN_XR_Frame_Sim *sim = node->sim;
+    struct CAN_XR_MAC_State *s = &(mac->state);
+    struct CAN_XR_MAC_TX_Slot *slot;
+    int n = node - sim->nodes;
+    int i, k;
+
+    TRACE(2, "Frame_Sim @%lu data_req node %d (%lu, ...)",
+	  sim->nodeclock_ts, n, (unsigned long)identifier);
+
+    if(s->data_req_pending == CAN_XR_MAC_TX_SLOTS
+       || format != CAN_XR_FORMAT_CBFF)
+    {
+	/* Same as the bit-level MAC when the slots are full, ts not in
+	   scope.  Unlike the bit-level MAC, FD and XL frames are not
+	   supported.
+	*/
+	if(mac->primitives.data_conf)
+	    mac->primitives.data_conf(
+		mac->llc, 0, identifier, CAN_XR_MAC_TX_STATUS_NO_SUCCESS);
+	return;
+    }
+
+    k = __builtin_ctz(~s->tx_slot_map);
+    slot = &(s->tx_slots[k]);
+    slot->identifier = identifier;
+    slot->format = format;
+    slot->dlc = dlc;
+    memset(slot->data, 0, sizeof(slot->data));
+    memcpy(slot->data, data, (dlc > 8) ? 8 : dlc);
+
+    for(i=s->data_req_pending;
+	i > 0 && s->tx_slots[s->tx_queue[i-1]].identifier > identifier; i--)
+	s->tx_queue[i] = s->tx_queue[i-1];
+    s->tx_queue[i] = k;
+    s->tx_slot_map |= (uint32_t)1 << k;
+    s->data_req_pending++;
+
+    /* A request issued while delivering a frame can still be honored
+       at the current sample point if the target MAC has not been
+       visited yet.
+    */
+    if(sim->delivering
+       && (n > sim->visit_node
+	   || (n == sim->visit_node && !sim->visit_tx_done)))
+	node->req_ts[k] = sim->nodeclock_ts;
+    else
+	node->req_ts[k] = sim->nodeclock_ts + 1;
+}
+
+/* Abort primitive of the frame-level simulator.  The frame 'node'
+   transmits next is already in progress if the node has decided to
+   send its SOF, and is not aborted in that case.
+
+   TBD: The node may still lose arbitration to a frame that starts in
+   the same bit, and then its frame could have been aborted.
+*/
+static void frame_sim_abort_req(struct CAN_XR_MAC *mac, uint32_t identifier)
+{
+    struct CAN_XR_Frame_Sim_Node *node = (struct CAN_XR_Frame_Sim_Node *)mac;
+    struct CAN_XR_Frame_Sim *sim = node->sim;
+    struct CAN_XR_MAC_State *s = &(mac->state);
+    unsigned long bit;
+    int active = next_slot(sim, node, &bit);
+    int n_aborted = 0;
+    int i = 0;
+
+    if(active >= 0 && sample_ts(sim, bit - 1) > sim->nodeclock_ts)
+	active = -1;
+
+    while(i < s->data_req_pending)
+    {
+	if(s->tx_slots[s->tx_queue[i]].identifier == identifier
+	   && s->tx_queue[i] != active)
+	{
+	    tx_queue_remove(s, i);
+	    n_aborted++;
+	}
+	else
+	    i++;
+    }
+
+    while(n_aborted-- > 0)
+	if(mac->primitives.data_conf)
+	    mac->primitives.data_conf(
+		mac->llc, 0, identifier, CAN_XR_MAC_TX_STATUS_NO_SUCCESS);
+}
+
+void CAN_XR_Frame_Sim_Init(
+    struct CAN_XR_Frame_Sim *sim,
+    struct CAN_XR_Frame_Sim_Node *nodes, int n_nodes,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters)
+{
+    struct CAN_XR_MAC *mac;
+    int n;
+
+    TRACE(0, "CAN_XR_Frame_Sim_Init(%d)", n_nodes);
+
+    sim->nodes = nodes;
+    sim->n_nodes = n_nodes;
+    sim->parameters = *parameters;
+    sim->quanta_per_bit =
+	parameters->sync_seg + parameters->prop_seg
+	+ parameters->phase_seg1 + parameters->phase_seg2;
+
+    /* Bus integration is over at the sample point of bit 10 */
+    sim->nodeclock_ts = (unsigned long)0;
+    sim->free_bit = 11;
+    sim->frames = 0;
+    sim->delivering = 0;
+
+    sim->schedule = NULL;
+    sim->n_schedule = 0;
+    sim->next_schedule = 0;
+
+    sim->verify_every = 0;
+    sim->replay_nodes = NULL;
+    sim->verified_frames = 0;
+    sim->divergences = 0;
+
+    /* Set up the MACs by hand, they have no PCS. */
+    for(n=0; n<n_nodes; n++)
+    {
+	nodes[n].sim = sim;
+
+	mac = &(nodes[n].mac);
+	memset(mac, 0, sizeof(*mac));
+	mac->llc = NULL;
+	mac->pcs = NULL;
+	mac->rx_fifo = NULL;
+	mac->filter = NULL;
+	mac->dispatch = NULL;
+	mac->state.rx_fsm_state = CAN_XR_MAC_RX_FSM_IDLE;
+	mac->state.tx_fsm_state = CAN_XR_MAC_TX_FSM_IDLE;
+	mac->state.data_req_pending = 0;
+	mac->state.tx_slot_map = 0;
+	mac->state.tx_slot = -1;
+	mac->primitives.data_req = frame_sim_data_req;
+	mac->primitives.abort_req = frame_sim_abort_req;
+	mac->primitives.data_ind = NULL;
+	mac->primitives.data_conf = NULL;
+	mac->primitives.ext_tx_data_ind = NULL;
+    }
+}
+
+struct CAN_XR_MAC *CAN_XR_Frame_Sim_MAC(
+    struct CAN_XR_Frame_Sim *sim, int node)
+{
+    return &(sim->nodes[node].mac);
+}
+
+void CAN_XR_Frame_Sim_Set_Schedule(
+    struct CAN_XR_Frame_Sim *sim,
+    const struct CAN_XR_Bus_Data_Req *schedule, int n)
+{
+    sim->schedule = schedule;
+    sim->n_schedule = n;
+    sim->next_schedule = 0;
+}
+
+void CAN_XR_Frame_Sim_Set_Verification(
+    struct CAN_XR_Frame_Sim *sim, int verify_every,
+    struct CAN_XR_Bus_Node *replay_nodes)
+{
+    sim->verify_every = verify_every;
+    sim->replay_nodes = replay_nodes;
+}
+
+/* Issue the next scheduled request, advancing time up to the tick
+   before its ts if needed.
+*/
+static void issue_scheduled(struct CAN_XR_Frame_Sim *sim)
+{
+    const struct CAN_XR_Bus_Data_Req *r =
+	&(sim->schedule[sim->next_schedule++]);
+
+    if(r->ts > 0 && r->ts - 1 > sim->nodeclock_ts)
+	sim->nodeclock_ts = r->ts - 1;
+
+    CAN_XR_MAC_Data_Req(&(sim->nodes[r->node].mac),
+			r->identifier, r->format, r->dlc, r->data);
+}
+
+/* Outcome of a bit-level replay for one node, filled by the upcalls
+   below through the LLC pointer.
+*/
+struct replay
+{
+    int n_ind;
+    unsigned long ind_ts;
+    uint32_t identifier;
+    int dlc;
+    uint8_t data[8];
+
+    int n_conf;
+    unsigned long conf_ts;
+    uint32_t conf_identifier;
+    enum CAN_XR_MAC_Tx_Status transmission_status;
+};
+
+static void replay_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct replay *r = (struct replay *)llc;
+
+    r->n_ind++;
+    r->ind_ts = ts;
+    r->identifier = identifier;
+    r->dlc = dlc;
+    memcpy(r->data, data, (dlc > 8) ? 8 : dlc);
+}
+
+static void replay_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    struct replay *r = (struct replay *)llc;
+
+    r->n_conf++;
+    r->conf_ts = ts;
+    r->conf_identifier = identifier;
+    r->transmission_status = transmission_status;
+}
+
+/* Replay the frame that starts in 'sof_bit' through a bit-level
+   bus, and check that it agrees with the frame-level model, which
+   chose node 'tx' as the winner of arbitration and says that the
+   frame is 'n_bits' long.
+
+   The replay bus starts from scratch, so it is idle and can take a
+   SOF in bit 11, right after bus integration.  This is aligned to
+   'sof_bit' of the real bus, where all nodes are idle, too.  Each
+   node that contends for the bus in 'sof_bit' gets the requests
+   that are visible to it at the sample point of the bit before, in
+   queue order, so that it picks the same frame from them.  Requests
+   that become visible later do not take part in arbitration and are
+   left out.
+
+   Then, every node must get the same indications and confirmations,
+   at the same time relative to the start of the frame, and the
+   winner of arbitration must be the same.  The losers must get
+   nothing but the indication of the winning frame before they retry.
+*/
+static void verify(
+    struct CAN_XR_Frame_Sim *sim, const struct CAN_XR_Frame_Sim_Node *tx,
+    unsigned long sof_bit, int n_bits)
+{
+    struct CAN_XR_Bus bus;
+    struct replay r[sim->n_nodes];
+    const struct CAN_XR_Frame_Sim_Node *node;
+    const struct CAN_XR_MAC_State *s;
+    const struct CAN_XR_MAC_TX_Slot *slot;
+    struct CAN_XR_MAC *mac;
+    unsigned long start_ts = sample_ts(sim, sof_bit - 1);
+    unsigned long end_ts = sample_ts(sim, sof_bit + n_bits - 1);
+    unsigned long replay_start_ts = sample_ts(sim, 10);
+    uint32_t identifier = tx->mac.state.tx_identifier;
+    int dlc = tx->mac.state.tx_dlc;
+    int n_data = (dlc > 8) ? 8 : dlc;
+    int winner = -1;
+    int diverges = 0;
+    unsigned long bit;
+    int n, i, k;
+
+    memset(r, 0, sizeof(r));
+
+    CAN_XR_Bus_Init(&bus, sim->replay_nodes, sim->n_nodes, &sim->parameters);
+    for(n=0; n<sim->n_nodes; n++)
+    {
+	mac = CAN_XR_Bus_MAC(&bus, n);
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&r[n]);
+	CAN_XR_MAC_Set_Data_Ind(mac, replay_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, replay_data_conf);
+	if(sim->nodes[n].mac.filter)
+	    CAN_XR_MAC_Set_Filter(mac, sim->nodes[n].mac.filter);
+
+	node = &(sim->nodes[n]);
+	s = &(node->mac.state);
+	if(next_slot(sim, node, &bit) < 0 || bit != sof_bit)
+	    continue;
+
+	for(i=0; i<s->data_req_pending; i++)
+	{
+	    k = s->tx_queue[i];
+	    if(node->req_ts[k] > start_ts)
+		continue;
+
+	    slot = &(s->tx_slots[k]);
+	    CAN_XR_MAC_Data_Req(mac, slot->identifier, slot->format,
+				slot->dlc, (uint8_t *)slot->data);
+	}
+    }
+
+    /* Stop a couple of bits after the end of the frame, to catch late
+       indications, too, but before the losers can start again after
+       intermission.
+    */
+    CAN_XR_Bus_Run(&bus, sample_ts(sim, 11 + n_bits + 1));
+
+    sim->verified_frames++;
+
+    /* The winner is the node that got a successful confirmation. */
+    for(n=0; n<sim->n_nodes && winner < 0; n++)
+	if(r[n].n_conf > 0
+	   && r[n].transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+	    winner = n;
+
+    if(winner != tx - sim->nodes)
+    {
+	TRACE(9, ">>> Frame_Sim @%lu id=%lu winner diverges: "
+	      "expected node %d, got %d",
+	      sim->nodeclock_ts, (unsigned long)identifier,
+	      (int)(tx - sim->nodes), winner);
+	diverges = 1;
+    }
+
+    for(n=0; n<sim->n_nodes && !diverges; n++)
+    {
+	mac = &(sim->nodes[n].mac);
+
+	if(!mac->filter || CAN_XR_Filter_Accepts(mac->filter, identifier))
+	{
+	    if(r[n].n_ind != 1
+	       || r[n].ind_ts - replay_start_ts != end_ts - start_ts
+	       || r[n].identifier != identifier || r[n].dlc != dlc
+	       || memcmp(r[n].data,
+			 tx->mac.state.tx_slots[tx->mac.state.tx_slot].data,
+			 n_data) != 0)
+		diverges = 1;
+	}
+	else if(r[n].n_ind != 0)
+	    diverges = 1;
+
+	if(n == winner)
+	{
+	    if(r[n].n_conf != 1
+	       || r[n].conf_ts - replay_start_ts != end_ts - start_ts
+	       || r[n].conf_identifier != identifier)
+		diverges = 1;
+	}
+	else if(r[n].n_conf != 0)
+	    diverges = 1;
+
+	if(diverges)
+	    TRACE(9, ">>> Frame_Sim @%lu id=%lu dlc=%d node %d diverges: "
+		  "expected +%lu, data_ind %d +%lu, data_conf %d +%lu "
+		  "status %d",
+		  sim->nodeclock_ts, (unsigned long)identifier, dlc, n,
+		  end_ts - start_ts,
+		  r[n].n_ind, r[n].ind_ts - replay_start_ts,
+		  r[n].n_conf, r[n].conf_ts - replay_start_ts,
+		  r[n].transmission_status);
+    }
+
+    if(diverges)
+	sim->divergences++;
+}
+
+void CAN_XR_Frame_Sim_Run(struct CAN_XR_Frame_Sim *sim, unsigned long ticks)
+{
+    unsigned long end = sim->nodeclock_ts + ticks;
+    struct CAN_XR_Frame_Sim_Node *tx;
+    struct CAN_XR_MAC *mac;
+    const struct CAN_XR_MAC_TX_Slot *slot;
+    unsigned long best_bit, bit, start_ts, end_bit, end_ts;
+    uint32_t identifier, best_identifier;
+    int dlc;
+    uint8_t data[8];
+    int n_bits;
+    int best_slot, k;
+    int n, i;
+
+    TRACE(0, "CAN_XR_Frame_Sim_Run(%lu) @%lu", ticks, sim->nodeclock_ts);
+
+    while(1)
+    {
+	/* Look for the next frame to be sent, resolving arbitration
+	   in favor of the lowest identifier.
+	*/
+	tx = NULL;
+	best_bit = 0;
+	best_slot = -1;
+	best_identifier = 0;
+	for(n=0; n<sim->n_nodes; n++)
+	{
+	    mac = &(sim->nodes[n].mac);
+	    if((k = next_slot(sim, &(sim->nodes[n]), &bit)) < 0)
+		continue;
+
+	    identifier = mac->state.tx_slots[k].identifier;
+	    if(tx == NULL || bit < best_bit
+	       || (bit == best_bit && identifier < best_identifier))
+	    {
+		tx = &(sim->nodes[n]);
+		best_bit = bit;
+		best_slot = k;
+		best_identifier = identifier;
+	    }
+	}
+
+	/* Scheduled requests that come before the sample point at
+	   which the frame starts may take part in arbitration.
+	*/
+	start_ts = tx ? sample_ts(sim, best_bit - 1) : end;
+	if(sim->next_schedule < sim->n_schedule
+	   && sim->schedule[sim->next_schedule].ts <= start_ts
+	   && sim->schedule[sim->next_schedule].ts <= end)
+	{
+	    issue_scheduled(sim);
+	    continue;
+	}
+
+	if(tx == NULL)
+	    break;
+
+	/* Load the frame as the bit-level MAC does when it transmits
+	   the SOF.
+	*/
+	slot = &(tx->mac.state.tx_slots[best_slot]);
+	tx->mac.state.tx_slot = best_slot;
+	tx->mac.state.tx_identifier = slot->identifier;
+	tx->mac.state.tx_format = slot->format;
+	tx->mac.state.tx_dlc = slot->dlc;
+
+	n_bits = frame_bits(slot->identifier, slot->dlc, slot->data);
+	end_bit = best_bit + n_bits - 1;
+	end_ts = sample_ts(sim, end_bit);
+
+	if(end_ts > end)
+	{
+	    tx->mac.state.tx_slot = -1;
+	    break;
+	}
+
+	if(sim->verify_every > 0
+	   && (sim->frames + 1) % sim->verify_every == 0)
+	    verify(sim, tx, best_bit, n_bits);
+
+	/* Requests issued while the frame is on the bus. */
+	while(sim->next_schedule < sim->n_schedule
+	      && sim->schedule[sim->next_schedule].ts <= end_ts)
+	    issue_scheduled(sim);
+
+	sim->nodeclock_ts = end_ts;
+	sim->free_bit = end_bit + 1 + 3; /* Intermission */
+	sim->frames++;
+
+	TRACE(2, "Frame_Sim @%lu frame id=%lu from node %d, bits %lu-%lu",
+	      end_ts, (unsigned long)tx->mac.state.tx_identifier,
+	      (int)(tx - sim->nodes), best_bit, end_bit);
+
+	/* Deliver the frame, visiting the nodes in order like the
+	   bit-level simulator does.  Work on a copy of the frame,
+	   because upcalls may issue further requests.
+	*/
+	identifier = tx->mac.state.tx_identifier;
+	dlc = tx->mac.state.tx_dlc;
+	memcpy(data, slot->data, sizeof(data));
+
+	sim->delivering = 1;
+	for(n=0; n<sim->n_nodes; n++)
+	{
+	    mac = &(sim->nodes[n].mac);
+	    sim->visit_node = n;
+	    sim->visit_tx_done = 0;
+
+	    if(!mac->filter || CAN_XR_Filter_Accepts(mac->filter, identifier))
+	    {
+		if(mac->primitives.data_ind)
+		    mac->primitives.data_ind(
+			mac->llc, end_ts, identifier, CAN_XR_FORMAT_CBFF,
+			dlc, data);
+
+		if(mac->rx_fifo)
+		    CAN_XR_RX_FIFO_Put(
+			mac->rx_fifo, end_ts, identifier, CAN_XR_FORMAT_CBFF,
+			dlc, data);
+
+		if(mac->dispatch && identifier < CAN_XR_DISPATCH_IDS)
+		    CAN_XR_Dispatch_Ind(
+			mac->dispatch, end_ts, identifier, CAN_XR_FORMAT_CBFF,
+			dlc, data);
+	    }
+
+	    if(&(sim->nodes[n]) == tx)
+	    {
+		sim->visit_tx_done = 1;
+
+		/* Free the slot.  The other frames of the transmitter
+		   become visible at the next sample point at the
+		   earliest, because its transmit automaton is busy at
+		   this one.
+		*/
+		for(i=0; mac->state.tx_queue[i] != mac->state.tx_slot; i++)
+		    ;
+		tx_queue_remove(&(mac->state), i);
+		mac->state.tx_slot = -1;
+		for(i=0; i<mac->state.data_req_pending; i++)
+		{
+		    k = mac->state.tx_queue[i];
+		    if(tx->req_ts[k] <= end_ts)
+			tx->req_ts[k] = end_ts + 1;
+		}
+
+		if(mac->primitives.data_conf)
+		    mac->primitives.data_conf(
+			mac->llc, end_ts, identifier,
+			CAN_XR_MAC_TX_STATUS_SUCCESS);
+	    }
+	}
+	sim->delivering = 0;
+    }
+
+    sim->nodeclock_ts = end;
+}
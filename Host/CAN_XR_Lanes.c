@@ -0,0 +1,1476 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* Implementation of the bit-sliced, multi-lane CAN XR controller on
+   the host.  The code mirrors quantumclock_m_ind in CAN_XR_PCS.c and
+   pcs_data_ind in CAN_XR_MAC_Common.c closely, see there for the
+   rationale of each step.  Here, each step is carried out on all the
+   lanes it applies to at once, as selected by a lane mask.
+
+   Errors are emitted at TRACE level 9, like in the MAC.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "CAN_XR_Lanes.h"
+#include "CAN_XR_Trace.h"
+
+/* Shorthands for all-zeros and all-ones words. */
+#define ZERO ((CAN_XR_Lanes_Word){0})
+#define ONES (~ZERO)
+
+/* Bit planes of CRC_POLYNOMIAL 0x4599 in CAN_XR_MAC_Common.c. */
+static const int crc_polynomial[15] = {
+    1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 0, 1
+};
+
+/* Return 'a' in the lanes of 'm', 'b' elsewhere. */
+static inline CAN_XR_Lanes_Word sel(
+    CAN_XR_Lanes_Word m, CAN_XR_Lanes_Word a, CAN_XR_Lanes_Word b)
+{
+    return b ^ ((a ^ b) & m);
+}
+
+/* Return the lanes in which the n-bit counter 'p' is equal to 'v'. */
+static inline CAN_XR_Lanes_Word eq_const(
+    const CAN_XR_Lanes_Word *p, int n, unsigned int v)
+{
+    CAN_XR_Lanes_Word r = ONES;
+    int i;
+
+    for(i=0; i<n; i++)
+	r &= ((v >> i) & 0x1) ? p[i] : ~p[i];
+    return r;
+}
+
+/* Return the lanes in which the n-bit counters 'p' and 'q' are equal. */
+static inline CAN_XR_Lanes_Word eq(
+    const CAN_XR_Lanes_Word *p, const CAN_XR_Lanes_Word *q, int n)
+{
+    CAN_XR_Lanes_Word r = ZERO;
+    int i;
+
+    for(i=0; i<n; i++)
+	r |= p[i] ^ q[i];
+    return ~r;
+}
+
+/* Return the lanes in which the n-bit counter 'p' is zero. */
+static inline CAN_XR_Lanes_Word is_zero(const CAN_XR_Lanes_Word *p, int n)
+{
+    CAN_XR_Lanes_Word r = ZERO;
+    int i;
+
+    for(i=0; i<n; i++)
+	r |= p[i];
+    return ~r;
+}
+
+/* Return the lanes in which 'p' <= 'q', unsigned. */
+static inline CAN_XR_Lanes_Word le(
+    const CAN_XR_Lanes_Word *p, const CAN_XR_Lanes_Word *q, int n)
+{
+    CAN_XR_Lanes_Word borrow = ZERO;
+    int i;
+
+    /* Borrow out of q - p */
+    for(i=0; i<n; i++)
+	borrow = (~q[i] & p[i]) | (~(q[i] ^ p[i]) & borrow);
+    return ~borrow;
+}
+
+/* Set the n-bit counter 'p' to 'v' in the lanes of 'm'. */
+static inline void set_const(
+    CAN_XR_Lanes_Word *p, int n, unsigned int v, CAN_XR_Lanes_Word m)
+{
+    int i;
+
+    for(i=0; i<n; i++)
+	p[i] = ((v >> i) & 0x1) ? (p[i] | m) : (p[i] & ~m);
+}
+
+/* Copy the n-bit counter 'q' into 'p' in the lanes of 'm'. */
+static inline void copy(
+    CAN_XR_Lanes_Word *p, const CAN_XR_Lanes_Word *q, int n,
+    CAN_XR_Lanes_Word m)
+{
+    int i;
+
+    for(i=0; i<n; i++)
+	p[i] = sel(m, q[i], p[i]);
+}
+
+/* Increment and decrement the n-bit counter 'p' in the lanes of 'm',
+   with wrap-around.
+*/
+static inline void inc(CAN_XR_Lanes_Word *p, int n, CAN_XR_Lanes_Word m)
+{
+    CAN_XR_Lanes_Word carry = m, t;
+    int i;
+
+    for(i=0; i<n; i++)
+    {
+	t = p[i] & carry;
+	p[i] ^= carry;
+	carry = t;
+    }
+}
+
+static inline void dec(CAN_XR_Lanes_Word *p, int n, CAN_XR_Lanes_Word m)
+{
+    CAN_XR_Lanes_Word borrow = m, t;
+    int i;
+
+    for(i=0; i<n; i++)
+    {
+	t = ~p[i] & borrow;
+	p[i] ^= borrow;
+	borrow = t;
+    }
+}
+
+/* Add 'v' to the n-bit counter 'p' in the lanes of 'm', with
+   wrap-around.
+*/
+static inline void add_const(
+    CAN_XR_Lanes_Word *p, int n, unsigned int v, CAN_XR_Lanes_Word m)
+{
+    CAN_XR_Lanes_Word carry = ZERO, b, t;
+    int i;
+
+    for(i=0; i<n; i++)
+    {
+	b = ((v >> i) & 0x1) ? m : ZERO;
+	t = p[i] ^ b ^ carry;
+	carry = (p[i] & b) | ((p[i] ^ b) & carry);
+	p[i] = t;
+    }
+}
+
+/* Shift 'b' into the n-bit register 'p' from the LSb, like shift_in
+   in CAN_XR_MAC_Common.c, in the lanes of 'm'.
+*/
+static inline void shift_in(
+    CAN_XR_Lanes_Word *p, int n, CAN_XR_Lanes_Word b, CAN_XR_Lanes_Word m)
+{
+    int i;
+
+    for(i=n-1; i>0; i--)
+	p[i] = sel(m, p[i-1], p[i]);
+    p[0] = sel(m, b, p[0]);
+}
+
+/* Return the value of the n-bit counter 'p' in 'lane'.  If 'sign' is
+   non-zero the counter is two's complement.
+*/
+static int get_value(
+    const CAN_XR_Lanes_Word *p, int n, int lane, int sign)
+{
+    int v = 0;
+    int i;
+
+    for(i=0; i<n; i++)
+	v |= CAN_XR_LANES_GET(p[i], lane) << i;
+
+    if(sign && (v & (1 << (n - 1))))
+	v -= 1 << n;
+    return v;
+}
+
+/* Set the n-bit counter 'p' to 'v' in 'lane'. */
+static void set_value(CAN_XR_Lanes_Word *p, int n, int lane, unsigned int v)
+{
+    int i;
+
+    for(i=0; i<n; i++)
+	CAN_XR_LANES_SET(p[i], lane, (v >> i) & 0x1);
+}
+
+/* Transitions of the one-hot FSMs, from 'from' to 'to' in the lanes of
+   'm'.  Going to the error state is possible from any state.
+*/
+static inline void rx_move(
+    struct CAN_XR_Lanes_MAC_State *mac,
+    enum CAN_XR_MAC_RX_FSM_State from, enum CAN_XR_MAC_RX_FSM_State to,
+    CAN_XR_Lanes_Word m)
+{
+    mac->rx_fsm_state[from] &= ~m;
+    mac->rx_fsm_state[to] |= m;
+}
+
+/* Move the lanes of 'm' to rx state 'to', whatever their state. */
+static inline void rx_goto(
+    struct CAN_XR_Lanes_MAC_State *mac,
+    enum CAN_XR_MAC_RX_FSM_State to, CAN_XR_Lanes_Word m)
+{
+    int i;
+
+    for(i=0; i<=CAN_XR_MAC_RX_FSM_ERROR; i++)
+	mac->rx_fsm_state[i] &= ~m;
+    mac->rx_fsm_state[to] |= m;
+}
+
+static inline void tx_move(
+    struct CAN_XR_Lanes_MAC_State *mac,
+    enum CAN_XR_Lanes_TX_FSM_State from, enum CAN_XR_Lanes_TX_FSM_State to,
+    CAN_XR_Lanes_Word m)
+{
+    mac->tx_fsm_state[from] &= ~m;
+    mac->tx_fsm_state[to] |= m;
+}
+
+/* Update the CRC with bit 'b' in the lanes of 'm', like crc_nxtbit. */
+static inline void crc_nxtbit(
+    struct CAN_XR_Lanes_MAC_State *mac,
+    CAN_XR_Lanes_Word b, CAN_XR_Lanes_Word m)
+{
+    CAN_XR_Lanes_Word crcnxt = (mac->crc[14] ^ b) & m;
+    int i;
+
+    for(i=14; i>0; i--)
+	mac->crc[i] = sel(m, mac->crc[i-1], mac->crc[i]);
+    mac->crc[0] &= ~m;
+
+    for(i=0; i<15; i++)
+	if(crc_polynomial[i])  mac->crc[i] ^= crcnxt;
+}
+
+/* Store into the 'n'-bit counter 'p' the length of the data field
+   minus one, 8 * min(dlc, 8) - 1, in the lanes of 'm' with a
+   non-empty data field.  Return the lanes of 'm' with an empty data
+   field.
+*/
+static CAN_XR_Lanes_Word data_field_bits(
+    CAN_XR_Lanes_Word *p, const CAN_XR_Lanes_Word *dlc, CAN_XR_Lanes_Word m)
+{
+    CAN_XR_Lanes_Word empty = m & is_zero(dlc, 4);
+    CAN_XR_Lanes_Word full = m & dlc[3];
+    CAN_XR_Lanes_Word bytes[3];
+
+    /* min(dlc, 8) - 1 fits in 3 bits, it is 7 when dlc >= 8. */
+    m &= ~empty;
+    memcpy(bytes, dlc, sizeof(bytes));
+    dec(bytes, 3, m & ~full);
+    set_const(bytes, 3, 7, full);
+
+    set_const(p, 3, 7, m);
+    copy(p + 3, bytes, 3, m);
+    set_const(p + 3 + 3, CAN_XR_LANES_FIELD_BITS - 6, 0, m);
+
+    return empty;
+}
+
+/* Load the n-bit value 'v' into tx_shift_reg like shift_prepare, in
+   the lanes of 'm'.
+*/
+static inline void tx_load(
+    struct CAN_XR_Lanes_MAC_State *mac,
+    const CAN_XR_Lanes_Word *v, int n, CAN_XR_Lanes_Word m)
+{
+    copy(mac->tx_shift_reg + 15 - n, v, n, m);
+    set_const(mac->tx_shift_reg, 15 - n, 0, m);
+}
+
+/* Shift out the next bit of tx_shift_reg like shift_out, in the
+   lanes of 'm'.  Return the bit.
+*/
+static inline CAN_XR_Lanes_Word tx_shift_out(
+    struct CAN_XR_Lanes_MAC_State *mac, CAN_XR_Lanes_Word m)
+{
+    CAN_XR_Lanes_Word b = mac->tx_shift_reg[14];
+    int i;
+
+    for(i=14; i>0; i--)
+	mac->tx_shift_reg[i] = sel(m, mac->tx_shift_reg[i-1],
+				   mac->tx_shift_reg[i]);
+    mac->tx_shift_reg[0] &= ~m;
+
+    return b;
+}
+
+/* Return the error passive lanes, see error_passive in
+   CAN_XR_MAC_Common.c.  rec never exceeds 255.
+*/
+static inline CAN_XR_Lanes_Word error_passive(
+    const struct CAN_XR_Lanes_MAC_State *mac)
+{
+    return mac->tec[7] | mac->tec[8] | mac->rec[7];
+}
+
+/* Error counting for the lanes of 'm', like error_count.  Return the
+   lanes that went bus off.
+*/
+static CAN_XR_Lanes_Word error_count(
+    struct CAN_XR_Lanes *lanes, unsigned long ts,
+    int tec_n, int rec_n, CAN_XR_Lanes_Word m)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    struct CAN_XR_Lanes_MAC_State *mac = &(lanes->mac);
+    CAN_XR_Lanes_Word r = m & ~mac->error_tx, t = m & mac->error_tx;
+    CAN_XR_Lanes_Word off;
+
+    add_const(mac->rec, 9, rec_n, r);
+    set_const(mac->rec, 9, 255, r & mac->rec[8]);
+
+    add_const(mac->tec, 9, tec_n, t);
+    off = t & mac->tec[8];
+    if(CAN_XR_LANES_ANY(off))
+    {
+	TRACE(9, ">>> Lanes @%lu bus off", ts);
+	pcs->output_unit_buf |= off;
+	pcs->hard_sync_allowed |= off;
+	set_const(mac->bus_integration_counter, 4, 0, off);
+	set_const(mac->bus_off_count, 8, 0, off);
+	rx_goto(mac, CAN_XR_MAC_RX_FSM_BUS_OFF, off);
+    }
+
+    return off;
+}
+
+/* End of a frame in the lanes of 'm', like frame_end.  The lanes of
+   'transmitter' have been the transmitter.
+*/
+static void frame_end(
+    struct CAN_XR_Lanes *lanes,
+    CAN_XR_Lanes_Word m, CAN_XR_Lanes_Word transmitter)
+{
+    struct CAN_XR_Lanes_MAC_State *mac = &(lanes->mac);
+    CAN_XR_Lanes_Word suspend = m & transmitter & error_passive(mac);
+
+    set_const(mac->suspend_bits, 4, 8, suspend);
+    set_const(mac->suspend_bits, 4, 0, m & ~suspend);
+    mac->error_tx &= ~m;
+    mac->tec_exception_arbitration_stuff &= ~m;
+    mac->tec_exception_passive_ack &= ~m;
+}
+
+/* Start intermission in the lanes of 'm', like intermission. */
+static void intermission(
+    struct CAN_XR_Lanes *lanes, CAN_XR_Lanes_Word m)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    struct CAN_XR_Lanes_MAC_State *mac = &(lanes->mac);
+
+    pcs->hard_sync_allowed &= ~m;
+    set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 2, m);
+    rx_goto(mac, CAN_XR_MAC_RX_FSM_INTERMISSION, m);
+}
+
+/* Start the overload flag in the lanes of 'm', like
+   overload_detected.
+*/
+static void overload_detected(
+    struct CAN_XR_Lanes *lanes, unsigned long ts, CAN_XR_Lanes_Word m)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    struct CAN_XR_Lanes_MAC_State *mac = &(lanes->mac);
+
+    if(!CAN_XR_LANES_ANY(m))
+	return;
+
+    TRACE(2, ">>> Lanes @%lu overload flag", ts);
+    pcs->output_unit_buf &= ~m;
+    pcs->hard_sync_allowed &= ~m;
+    set_const(mac->nc_bits, 3, 0, m);
+    rx_goto(mac, CAN_XR_MAC_RX_FSM_OVERLOAD_FLAG, m);
+}
+
+/* Invoke the data_ind upcall for all lanes of 'm'. */
+static void data_ind(
+    struct CAN_XR_Lanes *lanes, unsigned long ts, CAN_XR_Lanes_Word m)
+{
+    struct CAN_XR_MAC_State mac_state;
+    int lane;
+
+    for(lane=0; lane<CAN_XR_LANES; lane++)
+	if(CAN_XR_LANES_GET(m, lane))
+	{
+	    CAN_XR_Lanes_Get_State(lanes, lane, NULL, &mac_state);
+
+	    TRACE(2, "Lanes @%lu lane %d Frame OK id=%lu dlc=%d", ts, lane,
+		  (unsigned long)mac_state.rx_identifier, mac_state.rx_dlc);
+
+	    if(lanes->data_ind)
+		lanes->data_ind(
+		    lanes, lane, ts, mac_state.rx_identifier,
+		    CAN_XR_FORMAT_CBFF, mac_state.rx_dlc, mac_state.rx_data);
+	}
+}
+
+/* Invoke the data_conf upcall for all lanes of 'm'. */
+static void data_conf(
+    struct CAN_XR_Lanes *lanes, unsigned long ts, CAN_XR_Lanes_Word m,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    int lane;
+
+    for(lane=0; lane<CAN_XR_LANES; lane++)
+	if(CAN_XR_LANES_GET(m, lane) && lanes->data_conf)
+	    lanes->data_conf(
+		lanes, lane, ts, lanes->mac.tx_identifier_value[lane],
+		transmission_status);
+}
+
+/* Receive automaton, the first half of pcs_data_ind, for the lanes of
+   's' that are at the sample point and sample 'in'.  Return the lanes
+   that may start transmitting along with the SOF they sampled at the
+   third bit of intermission, see early_sof in pcs_data_ind.
+*/
+static CAN_XR_Lanes_Word rx_data_ind(
+    struct CAN_XR_Lanes *lanes, unsigned long ts,
+    CAN_XR_Lanes_Word s, CAN_XR_Lanes_Word in)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    struct CAN_XR_Lanes_MAC_State *mac = &(lanes->mac);
+    CAN_XR_Lanes_Word m[CAN_XR_MAC_RX_FSM_ERROR + 1];
+    CAN_XR_Lanes_Word stuffing, five, stuff, err, chg, d, fz, end, ok, x;
+    CAN_XR_Lanes_Word arb, lost, dom, first, done, t, early_sof = ZERO;
+    int i;
+
+    /* Bit monitoring, see bit_monitoring in CAN_XR_MAC_Common.c.  The
+       level a lane drove in this bit is its sending_level.
+    */
+    x = s & ~mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_IDLE]
+	& ~mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_ERROR]
+	& ~mac->rx_fsm_state[CAN_XR_MAC_RX_FSM_RX_ACK]
+	& ~(mac->rx_fsm_state[CAN_XR_MAC_RX_FSM_RX_EOF]
+	    & is_zero(mac->field_bits, CAN_XR_LANES_FIELD_BITS))
+	& (in ^ pcs->sending_level);
+    if(CAN_XR_LANES_ANY(x))
+    {
+	arb = x & pcs->sending_level
+	    & (mac->rx_fsm_state[CAN_XR_MAC_RX_FSM_RX_IDENTIFIER]
+	       | mac->rx_fsm_state[CAN_XR_MAC_RX_FSM_RX_RTR]);
+	stuff = arb & eq_const(mac->nc_bits, 3, 5);
+	mac->tec_exception_arbitration_stuff |= stuff;
+
+	lost = arb & ~stuff;
+	if(CAN_XR_LANES_ANY(lost))
+	{
+	    TRACE(2, ">>> Lanes @%lu arbitration lost", ts);
+	    pcs->output_unit_buf |= lost;
+	    for(i=0; i<=CAN_XR_LANES_TX_FSM_ERROR; i++)
+		mac->tx_fsm_state[i] &= ~lost;
+	    mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_IDLE] |= lost;
+	}
+
+	err = x & ~lost;
+	if(CAN_XR_LANES_ANY(err))
+	{
+	    TRACE(9, ">>> Lanes @%lu bit error", ts);
+	    rx_goto(mac, CAN_XR_MAC_RX_FSM_ERROR, err);
+	}
+    }
+
+    /* Lanes in each state, before any transition takes place. */
+    for(i=0; i<=CAN_XR_MAC_RX_FSM_ERROR; i++)
+	m[i] = mac->rx_fsm_state[i] & s;
+
+    /* Bus integration */
+    if(CAN_XR_LANES_ANY(m[CAN_XR_MAC_RX_FSM_BUS_INTEGRATION]))
+    {
+	x = m[CAN_XR_MAC_RX_FSM_BUS_INTEGRATION];
+	set_const(mac->bus_integration_counter, 4, 0, x & ~in);
+	inc(mac->bus_integration_counter, 4, x & in);
+
+	end = x & in & eq_const(mac->bus_integration_counter, 4, 11);
+	set_const(mac->bus_integration_counter, 4, 0, end);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_BUS_INTEGRATION,
+		CAN_XR_MAC_RX_FSM_IDLE, end);
+    }
+
+    /* Intermission.  A dominant bit is an overload condition in the
+       first two bits, and a SOF in the third one.
+    */
+    x = m[CAN_XR_MAC_RX_FSM_INTERMISSION];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	fz = is_zero(mac->field_bits, CAN_XR_LANES_FIELD_BITS);
+	overload_detected(lanes, ts, x & ~in & ~fz);
+
+	pcs->hard_sync_allowed |= x & in;
+	dec(mac->field_bits, CAN_XR_LANES_FIELD_BITS, x & in);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_INTERMISSION,
+		CAN_XR_MAC_RX_FSM_IDLE, x & fz);
+
+	t = x & ~in & fz;
+	early_sof = t & is_zero(mac->suspend_bits, 4);
+	m[CAN_XR_MAC_RX_FSM_IDLE] |= t;
+    }
+
+    /* SOF, including the IDLE case of de_stuffed_data_ind.  The CRC
+       of a single dominant bit is zero.
+    */
+    x = m[CAN_XR_MAC_RX_FSM_IDLE] & ~in;
+    if(CAN_XR_LANES_ANY(x))
+    {
+	set_const(mac->nc_bits, 3, 1, x);
+	mac->nc_pol &= ~x;
+	pcs->hard_sync_allowed &= ~x;
+	set_const(mac->crc, 15, 0, x);
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 10, x);
+	set_const(mac->rx_identifier, 11, 0, x);
+	set_const(mac->suspend_bits, 4, 0, x);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_IDLE, CAN_XR_MAC_RX_FSM_RX_IDENTIFIER, x);
+    }
+
+    x = m[CAN_XR_MAC_RX_FSM_IDLE] & in;
+    if(CAN_XR_LANES_ANY(x))
+	dec(mac->suspend_bits, 4, x & ~is_zero(mac->suspend_bits, 4));
+
+    /* De-stuffing.  Afterwards, the lanes of m[] in which a
+       de-stuffed bit is available for de_stuffed_data_ind are
+       restricted to those in 'd'.
+    */
+    stuffing =
+	m[CAN_XR_MAC_RX_FSM_RX_IDENTIFIER] | m[CAN_XR_MAC_RX_FSM_RX_RTR]
+	| m[CAN_XR_MAC_RX_FSM_RX_IDE] | m[CAN_XR_MAC_RX_FSM_RX_FDF]
+	| m[CAN_XR_MAC_RX_FSM_RX_DLC] | m[CAN_XR_MAC_RX_FSM_RX_DATA]
+	| m[CAN_XR_MAC_RX_FSM_RX_CRC] | m[CAN_XR_MAC_RX_FSM_RX_CDEL];
+
+    if(CAN_XR_LANES_ANY(stuffing))
+    {
+	five = eq_const(mac->nc_bits, 3, 5);
+
+	stuff = stuffing & five;
+	err = stuff & ~(in ^ mac->nc_pol);
+	if(CAN_XR_LANES_ANY(err))
+	{
+	    TRACE(9, ">>> Lanes @%lu stuff error", ts);
+	    for(i=CAN_XR_MAC_RX_FSM_RX_IDENTIFIER;
+		i<=CAN_XR_MAC_RX_FSM_RX_CDEL; i++)
+		rx_move(mac, i, CAN_XR_MAC_RX_FSM_ERROR, err);
+	}
+
+	d = stuffing & ~five;
+	chg = (stuff & ~err) | (d & (in ^ mac->nc_pol));
+	inc(mac->nc_bits, 3, d & ~chg);
+	set_const(mac->nc_bits, 3, 1, chg);
+	mac->nc_pol = sel(chg, in, mac->nc_pol);
+
+	for(i=CAN_XR_MAC_RX_FSM_RX_IDENTIFIER;
+	    i<=CAN_XR_MAC_RX_FSM_RX_CDEL; i++)
+	    m[i] &= d;
+    }
+
+    /* De-stuffed bits from now on, see de_stuffed_data_ind.  All
+       fields up to the CRC go into the CRC calculation, and many
+       states count bits down to zero in field_bits.
+    */
+    x = m[CAN_XR_MAC_RX_FSM_RX_IDENTIFIER] | m[CAN_XR_MAC_RX_FSM_RX_RTR]
+	| m[CAN_XR_MAC_RX_FSM_RX_IDE] | m[CAN_XR_MAC_RX_FSM_RX_FDF]
+	| m[CAN_XR_MAC_RX_FSM_RX_DLC] | m[CAN_XR_MAC_RX_FSM_RX_DATA]
+	| m[CAN_XR_MAC_RX_FSM_RX_CRC];
+    if(CAN_XR_LANES_ANY(x))
+	crc_nxtbit(mac, in, x);
+
+    fz = is_zero(mac->field_bits, CAN_XR_LANES_FIELD_BITS);
+
+    /* Identifier */
+    x = m[CAN_XR_MAC_RX_FSM_RX_IDENTIFIER];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	shift_in(mac->rx_identifier, 11, in, x);
+	dec(mac->field_bits, CAN_XR_LANES_FIELD_BITS, x & ~fz);
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 1, x & fz);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_IDENTIFIER,
+		CAN_XR_MAC_RX_FSM_RX_RTR, x & fz);
+    }
+
+    /* RTR, IDE, FDF.  The FDF check looks at rx_ide, like the MAC.
+       Unsupported formats go to bus integration.
+    */
+    x = m[CAN_XR_MAC_RX_FSM_RX_RTR];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	mac->rx_rtr = sel(x, in, mac->rx_rtr);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_RTR, CAN_XR_MAC_RX_FSM_RX_IDE, x);
+    }
+
+    x = m[CAN_XR_MAC_RX_FSM_RX_IDE];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	mac->rx_ide = sel(x, in, mac->rx_ide);
+	pcs->hard_sync_allowed |= x & in;
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_IDE,
+		CAN_XR_MAC_RX_FSM_BUS_INTEGRATION, x & in);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_IDE, CAN_XR_MAC_RX_FSM_RX_FDF, x & ~in);
+    }
+
+    x = m[CAN_XR_MAC_RX_FSM_RX_FDF];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	/* Lanes only support CBFF, FDF recessive is ignored like
+	   IDE recessive.
+	*/
+	mac->rx_fdf = sel(x, in, mac->rx_fdf);
+	err = x & in;
+	pcs->hard_sync_allowed |= err;
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_FDF,
+		CAN_XR_MAC_RX_FSM_BUS_INTEGRATION, err);
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 3, x & ~err);
+	set_const(mac->rx_dlc, 4, 0, x & ~err);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_FDF, CAN_XR_MAC_RX_FSM_RX_DLC, x & ~err);
+    }
+
+    /* DLC */
+    x = m[CAN_XR_MAC_RX_FSM_RX_DLC];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	shift_in(mac->rx_dlc, 4, in, x);
+	dec(mac->field_bits, CAN_XR_LANES_FIELD_BITS, x & ~fz);
+
+	end = x & fz;
+	if(CAN_XR_LANES_ANY(end))
+	{
+	    CAN_XR_Lanes_Word empty =
+		data_field_bits(mac->field_bits, mac->rx_dlc, end);
+
+	    set_const(mac->rx_byte, 8, 0, end & ~empty);
+	    rx_move(mac, CAN_XR_MAC_RX_FSM_RX_DLC,
+		    CAN_XR_MAC_RX_FSM_RX_DATA, end & ~empty);
+
+	    set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 14, empty);
+	    rx_move(mac, CAN_XR_MAC_RX_FSM_RX_DLC,
+		    CAN_XR_MAC_RX_FSM_RX_CRC, empty);
+	}
+    }
+
+    /* Data, one byte at a time into rx_data. */
+    x = m[CAN_XR_MAC_RX_FSM_RX_DATA];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	shift_in(mac->rx_byte, 8, in, x);
+
+	end = x & is_zero(mac->field_bits, 3); /* Byte boundary */
+	if(CAN_XR_LANES_ANY(end))
+	{
+	    for(i=63; i>=8; i--)
+		mac->rx_data[i] = sel(end, mac->rx_data[i-8], mac->rx_data[i]);
+	    copy(mac->rx_data, mac->rx_byte, 8, end);
+	    set_const(mac->rx_byte, 8, 0, end);
+	}
+
+	dec(mac->field_bits, CAN_XR_LANES_FIELD_BITS, x & ~fz);
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 14, x & fz);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_DATA, CAN_XR_MAC_RX_FSM_RX_CRC, x & fz);
+    }
+
+    /* CRC, it must be zero at the end. */
+    x = m[CAN_XR_MAC_RX_FSM_RX_CRC];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	dec(mac->field_bits, CAN_XR_LANES_FIELD_BITS, x);
+
+	end = x & fz;
+	err = end & ~is_zero(mac->crc, 15);
+	if(CAN_XR_LANES_ANY(err))
+	    TRACE(9, ">>> Lanes @%lu CRC error", ts);
+
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_CRC, CAN_XR_MAC_RX_FSM_ERROR, err);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_CRC, CAN_XR_MAC_RX_FSM_RX_CDEL,
+		end & ~err);
+    }
+
+    /* CDEL, acknowledge good frames. */
+    x = m[CAN_XR_MAC_RX_FSM_RX_CDEL];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	ok = x & in;
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_CDEL, CAN_XR_MAC_RX_FSM_ERROR, x & ~in);
+	pcs->output_unit_buf &= ~ok;
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_CDEL, CAN_XR_MAC_RX_FSM_RX_ACK, ok);
+    }
+
+    /* ACK, stop acknowledging.  An error passive transmitter may be
+       alone on the bus.
+    */
+    x = m[CAN_XR_MAC_RX_FSM_RX_ACK];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	mac->tec_exception_passive_ack |= x & in
+	    & ~mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_IDLE]
+	    & ~mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_ERROR]
+	    & error_passive(mac);
+
+	ok = x & ~in;
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_ACK, CAN_XR_MAC_RX_FSM_ERROR, x & in);
+	pcs->output_unit_buf |= ok;
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_ACK, CAN_XR_MAC_RX_FSM_RX_ADEL, ok);
+    }
+
+    /* ADEL */
+    x = m[CAN_XR_MAC_RX_FSM_RX_ADEL];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	ok = x & in;
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_ADEL, CAN_XR_MAC_RX_FSM_ERROR, x & ~in);
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 6, ok);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_ADEL, CAN_XR_MAC_RX_FSM_RX_EOF, ok);
+    }
+
+    /* EOF, the last bit is not checked. */
+    x = m[CAN_XR_MAC_RX_FSM_RX_EOF];
+    end = ZERO;
+    if(CAN_XR_LANES_ANY(x))
+    {
+	err = x & ~in & ~fz;
+	if(CAN_XR_LANES_ANY(err))
+	    TRACE(9, ">>> Lanes @%lu EOF form error", ts);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_RX_EOF, CAN_XR_MAC_RX_FSM_ERROR, err);
+
+	end = x & ~err & fz;
+	dec(mac->field_bits, CAN_XR_LANES_FIELD_BITS, x & ~err);
+
+	/* Successful transmission or reception */
+	t = end & ~mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_IDLE]
+	    & ~mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_ERROR];
+	dec(mac->tec, 9, t & ~is_zero(mac->tec, 9));
+
+	ok = end & ~t & mac->rec[7];
+	set_const(mac->rec, 9, 119, ok);
+	dec(mac->rec, 9, end & ~t & ~ok & ~is_zero(mac->rec, 9));
+
+	frame_end(lanes, end, t);
+	overload_detected(lanes, ts, end & ~in);
+	intermission(lanes, end & in);
+    }
+
+    /* Error flag.  Lanes with a TEC exception for an ACK error count
+       the first dominant bit, active lanes count bit errors and start
+       a new error flag.  The others count bits of equal polarity.
+    */
+    x = m[CAN_XR_MAC_RX_FSM_ERROR_FLAG];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	t = x & ~in & mac->tec_exception_passive_ack;
+	if(CAN_XR_LANES_ANY(t))
+	{
+	    mac->tec_exception_passive_ack &= ~t;
+	    x &= ~error_count(lanes, ts, 8, 0, t);
+	}
+
+	err = x & in & ~error_passive(mac);
+	if(CAN_XR_LANES_ANY(err))
+	{
+	    TRACE(9, ">>> Lanes @%lu bit error in error flag", ts);
+	    x &= ~err;
+	    err &= ~error_count(lanes, ts, 8, 8, err);
+	    pcs->output_unit_buf =
+		sel(err, error_passive(mac), pcs->output_unit_buf);
+	    set_const(mac->nc_bits, 3, 0, err);
+	}
+
+	chg = x & (is_zero(mac->nc_bits, 3) | (in ^ mac->nc_pol));
+	inc(mac->nc_bits, 3, x & ~chg);
+	set_const(mac->nc_bits, 3, 1, chg);
+	mac->nc_pol = sel(chg, in, mac->nc_pol);
+
+	done = x & eq_const(mac->nc_bits, 3, 6);
+	pcs->output_unit_buf |= done;
+	mac->tec_exception_arbitration_stuff &= ~done;
+	mac->tec_exception_passive_ack &= ~done;
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, -1, done);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_ERROR_FLAG,
+		CAN_XR_MAC_RX_FSM_ERROR_WAIT, done);
+    }
+
+    /* Wait for the bus to be recessive, counting dominant bits. */
+    x = m[CAN_XR_MAC_RX_FSM_ERROR_WAIT];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 6, x & in);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_ERROR_WAIT,
+		CAN_XR_MAC_RX_FSM_ERROR_DELIM, x & in);
+
+	dom = x & ~in;
+	first = dom & eq_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, -1);
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 1, first);
+	error_count(lanes, ts, 0, 8, first);
+
+	dom &= ~first;
+	inc(mac->field_bits, CAN_XR_LANES_FIELD_BITS, dom);
+	done = dom & eq_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 8);
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 0, done);
+	error_count(lanes, ts, 8, 8, done);
+    }
+
+    /* Overload flag, a recessive bit is a bit error. */
+    x = m[CAN_XR_MAC_RX_FSM_OVERLOAD_FLAG];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	err = x & in;
+	if(CAN_XR_LANES_ANY(err))
+	{
+	    TRACE(9, ">>> Lanes @%lu bit error in overload flag", ts);
+	    err &= ~error_count(lanes, ts, 8, 8, err);
+	    set_const(mac->nc_bits, 3, 0, err);
+	}
+
+	dom = x & ~in;
+	inc(mac->nc_bits, 3, dom);
+	done = dom & eq_const(mac->nc_bits, 3, 6);
+	pcs->output_unit_buf |= done;
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 0, done);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_OVERLOAD_FLAG,
+		CAN_XR_MAC_RX_FSM_OVERLOAD_WAIT, done);
+    }
+
+    /* Wait for the bus to be recessive, counting dominant bits. */
+    x = m[CAN_XR_MAC_RX_FSM_OVERLOAD_WAIT];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 6, x & in);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_OVERLOAD_WAIT,
+		CAN_XR_MAC_RX_FSM_OVERLOAD_DELIM, x & in);
+
+	dom = x & ~in;
+	inc(mac->field_bits, CAN_XR_LANES_FIELD_BITS, dom);
+	done = dom & eq_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 8);
+	set_const(mac->field_bits, CAN_XR_LANES_FIELD_BITS, 0, done);
+	error_count(lanes, ts, 8, 8, done);
+    }
+
+    /* Error and overload delimiters, a dominant last bit is an
+       overload condition.
+    */
+    x = m[CAN_XR_MAC_RX_FSM_ERROR_DELIM] | m[CAN_XR_MAC_RX_FSM_OVERLOAD_DELIM];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	err = x & ~in & ~fz;
+	if(CAN_XR_LANES_ANY(err))
+	    TRACE(9, ">>> Lanes @%lu delimiter form error", ts);
+	rx_goto(mac, CAN_XR_MAC_RX_FSM_ERROR, err);
+
+	dec(mac->field_bits, CAN_XR_LANES_FIELD_BITS, x & ~err);
+	done = x & ~err & fz;
+	frame_end(lanes, done & m[CAN_XR_MAC_RX_FSM_ERROR_DELIM],
+		  mac->error_tx);
+	overload_detected(lanes, ts, done & ~in);
+	intermission(lanes, done & in);
+    }
+
+    /* Bus off recovery */
+    x = m[CAN_XR_MAC_RX_FSM_BUS_OFF];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	set_const(mac->bus_integration_counter, 4, 0, x & ~in);
+	inc(mac->bus_integration_counter, 4, x & in);
+
+	t = x & in & eq_const(mac->bus_integration_counter, 4, 11);
+	set_const(mac->bus_integration_counter, 4, 0, t);
+
+	ok = t & eq_const(mac->bus_off_count, 8, 127);
+	inc(mac->bus_off_count, 8, t & ~ok);
+	set_const(mac->bus_off_count, 8, 0, ok);
+	set_const(mac->tec, 9, 0, ok);
+	set_const(mac->rec, 9, 0, ok);
+	frame_end(lanes, ok, ZERO);
+	pcs->hard_sync_allowed |= ok;
+	rx_goto(mac, CAN_XR_MAC_RX_FSM_IDLE, ok);
+    }
+
+    /* Errors detected at this sample point, see error_detected.  The
+       transmit error counter is not incremented in lanes with a TEC
+       exception.
+    */
+    x = mac->rx_fsm_state[CAN_XR_MAC_RX_FSM_ERROR] & s;
+    if(CAN_XR_LANES_ANY(x))
+    {
+	mac->error_tx |= x & ~mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_IDLE]
+	    & ~mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_ERROR];
+	for(i=0; i<=CAN_XR_LANES_TX_FSM_ERROR; i++)
+	    mac->tx_fsm_state[i] &= ~x;
+	mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_IDLE] |= x;
+
+	t = mac->tec_exception_arbitration_stuff
+	    | mac->tec_exception_passive_ack;
+	x &= ~error_count(lanes, ts, 8, 1, x & ~t);
+	x &= ~error_count(lanes, ts, 0, 1, x & t);
+
+	pcs->output_unit_buf =
+	    sel(x, error_passive(mac), pcs->output_unit_buf);
+	set_const(mac->nc_bits, 3, 0, x);
+	rx_move(mac, CAN_XR_MAC_RX_FSM_ERROR, CAN_XR_MAC_RX_FSM_ERROR_FLAG, x);
+    }
+
+    /* Upcalls last, they may issue further requests. */
+    if(CAN_XR_LANES_ANY(end))
+	data_ind(lanes, ts, end);
+
+    return early_sof;
+}
+
+/* Transmit automaton, the second half of pcs_data_ind, for the lanes
+   of 's' that are at the sample point.  The lanes of 'early_sof' have
+   just sampled a SOF at the third bit of intermission.
+*/
+static void tx_data_ind(
+    struct CAN_XR_Lanes *lanes, unsigned long ts, CAN_XR_Lanes_Word s,
+    CAN_XR_Lanes_Word early_sof)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    struct CAN_XR_Lanes_MAC_State *mac = &(lanes->mac);
+    CAN_XR_Lanes_Word t[CAN_XR_LANES_TX_FSM_ERROR + 1];
+    CAN_XR_Lanes_Word stuffing, five, tz, x, end, b;
+    int i;
+
+    for(i=0; i<=CAN_XR_LANES_TX_FSM_ERROR; i++)
+	t[i] = mac->tx_fsm_state[i] & s;
+
+    /* Honor pending requests if the receiver is idle and the
+       transmission is not suspended, send SOF.  The lanes of
+       'early_sof' skip it, and send the first bit of the identifier
+       right away.
+    */
+    x = t[CAN_XR_LANES_TX_FSM_IDLE] & mac->data_req_pending
+	& (mac->rx_fsm_state[CAN_XR_MAC_RX_FSM_IDLE] | early_sof)
+	& is_zero(mac->suspend_bits, 4);
+    if(CAN_XR_LANES_ANY(x))
+    {
+	pcs->output_unit_buf &= ~x;
+	tx_load(mac, mac->tx_identifier, 11, x);
+	set_const(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, 10, x);
+	set_const(mac->tx_bit_index, CAN_XR_LANES_TX_INDEX_BITS, 1, x);
+	copy(mac->tx_data_reg, mac->tx_data, 64, x);
+	tx_move(mac, CAN_XR_LANES_TX_FSM_IDLE, CAN_XR_LANES_TX_FSM_TX_IDENTIFIER, x);
+	t[CAN_XR_LANES_TX_FSM_TX_IDENTIFIER] |= x & early_sof;
+    }
+
+    /* Stuff bit insertion, using the de-stuffing state of the rx
+       automaton.  Afterwards, restrict t[] to the lanes that go on
+       with tx_processing_ind.
+    */
+    stuffing =
+	t[CAN_XR_LANES_TX_FSM_TX_IDENTIFIER] | t[CAN_XR_LANES_TX_FSM_TX_RTR]
+	| t[CAN_XR_LANES_TX_FSM_TX_IDE] | t[CAN_XR_LANES_TX_FSM_TX_FDF]
+	| t[CAN_XR_LANES_TX_FSM_TX_DLC] | t[CAN_XR_LANES_TX_FSM_TX_DATA]
+	| t[CAN_XR_LANES_TX_FSM_TX_CRC_LATCH] | t[CAN_XR_LANES_TX_FSM_TX_CRC]
+	| t[CAN_XR_LANES_TX_FSM_TX_CDEL];
+
+    if(!CAN_XR_LANES_ANY(stuffing
+			 | t[CAN_XR_LANES_TX_FSM_TX_ACK]
+			 | t[CAN_XR_LANES_TX_FSM_TX_ADEL]
+			 | t[CAN_XR_LANES_TX_FSM_TX_EOF]
+			 | t[CAN_XR_LANES_TX_FSM_TX_EOF_TAIL]))
+	return;
+
+    /* All of them but EOF_TAIL transmit a bit */
+    inc(mac->tx_bit_index, CAN_XR_LANES_TX_INDEX_BITS,
+	stuffing | t[CAN_XR_LANES_TX_FSM_TX_ACK]
+	| t[CAN_XR_LANES_TX_FSM_TX_ADEL] | t[CAN_XR_LANES_TX_FSM_TX_EOF]);
+
+    five = stuffing & eq_const(mac->nc_bits, 3, 5);
+    pcs->output_unit_buf = sel(five, ~mac->nc_pol, pcs->output_unit_buf);
+    for(i=CAN_XR_LANES_TX_FSM_TX_IDENTIFIER; i<=CAN_XR_LANES_TX_FSM_TX_CDEL; i++)
+	t[i] &= ~five;
+
+    tz = is_zero(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS);
+
+    /* Identifier */
+    x = t[CAN_XR_LANES_TX_FSM_TX_IDENTIFIER];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	b = tx_shift_out(mac, x);
+	pcs->output_unit_buf = sel(x, b, pcs->output_unit_buf);
+	dec(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, x);
+	tx_move(mac, CAN_XR_LANES_TX_FSM_TX_IDENTIFIER,
+		CAN_XR_LANES_TX_FSM_TX_RTR, x & tz);
+    }
+
+    /* RTR, IDE and FDF are dominant. */
+    x = t[CAN_XR_LANES_TX_FSM_TX_RTR];
+    pcs->output_unit_buf &= ~x;
+    tx_move(mac, CAN_XR_LANES_TX_FSM_TX_RTR, CAN_XR_LANES_TX_FSM_TX_IDE, x);
+
+    x = t[CAN_XR_LANES_TX_FSM_TX_IDE];
+    pcs->output_unit_buf &= ~x;
+    tx_move(mac, CAN_XR_LANES_TX_FSM_TX_IDE, CAN_XR_LANES_TX_FSM_TX_FDF, x);
+
+    x = t[CAN_XR_LANES_TX_FSM_TX_FDF];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	pcs->output_unit_buf &= ~x;
+	tx_load(mac, mac->tx_dlc, 4, x);
+	set_const(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, 3, x);
+	tx_move(mac, CAN_XR_LANES_TX_FSM_TX_FDF, CAN_XR_LANES_TX_FSM_TX_DLC, x);
+    }
+
+    /* DLC */
+    x = t[CAN_XR_LANES_TX_FSM_TX_DLC];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	b = tx_shift_out(mac, x);
+	pcs->output_unit_buf = sel(x, b, pcs->output_unit_buf);
+	dec(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, x);
+
+	end = x & tz;
+	if(CAN_XR_LANES_ANY(end))
+	{
+	    CAN_XR_Lanes_Word empty =
+		data_field_bits(mac->tx_bit_count, mac->tx_dlc, end);
+
+	    tx_load(mac, mac->tx_data_reg, 8, end & ~empty);
+	    tx_move(mac, CAN_XR_LANES_TX_FSM_TX_DLC,
+		    CAN_XR_LANES_TX_FSM_TX_DATA, end & ~empty);
+	    tx_move(mac, CAN_XR_LANES_TX_FSM_TX_DLC,
+		    CAN_XR_LANES_TX_FSM_TX_CRC_LATCH, empty);
+	}
+    }
+
+    /* Data, switch to the next byte of tx_data_reg at byte boundary. */
+    x = t[CAN_XR_LANES_TX_FSM_TX_DATA];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	b = tx_shift_out(mac, x);
+	pcs->output_unit_buf = sel(x, b, pcs->output_unit_buf);
+	tx_move(mac, CAN_XR_LANES_TX_FSM_TX_DATA,
+		CAN_XR_LANES_TX_FSM_TX_CRC_LATCH, x & tz);
+
+	end = x & ~tz & is_zero(mac->tx_bit_count, 3);
+	if(CAN_XR_LANES_ANY(end))
+	{
+	    for(i=0; i<64-8; i++)
+		mac->tx_data_reg[i] =
+		    sel(end, mac->tx_data_reg[i+8], mac->tx_data_reg[i]);
+	    tx_load(mac, mac->tx_data_reg, 8, end);
+	}
+
+	dec(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, x & ~tz);
+    }
+
+    /* Latch the CRC calculated by the rx automaton and send its first
+       bit.
+    */
+    x = t[CAN_XR_LANES_TX_FSM_TX_CRC_LATCH];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	tx_load(mac, mac->crc, 15, x);
+	b = tx_shift_out(mac, x);
+	pcs->output_unit_buf = sel(x, b, pcs->output_unit_buf);
+	set_const(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, 13, x);
+	tx_move(mac, CAN_XR_LANES_TX_FSM_TX_CRC_LATCH, CAN_XR_LANES_TX_FSM_TX_CRC, x);
+    }
+
+    /* CRC */
+    x = t[CAN_XR_LANES_TX_FSM_TX_CRC];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	b = tx_shift_out(mac, x);
+	pcs->output_unit_buf = sel(x, b, pcs->output_unit_buf);
+	dec(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, x);
+	tx_move(mac, CAN_XR_LANES_TX_FSM_TX_CRC, CAN_XR_LANES_TX_FSM_TX_CDEL, x & tz);
+    }
+
+    /* Frame trailer, all recessive. */
+    x = t[CAN_XR_LANES_TX_FSM_TX_CDEL];
+    pcs->output_unit_buf |= x;
+    tx_move(mac, CAN_XR_LANES_TX_FSM_TX_CDEL, CAN_XR_LANES_TX_FSM_TX_ACK, x);
+
+    x = t[CAN_XR_LANES_TX_FSM_TX_ACK];
+    pcs->output_unit_buf |= x;
+    tx_move(mac, CAN_XR_LANES_TX_FSM_TX_ACK, CAN_XR_LANES_TX_FSM_TX_ADEL, x);
+
+    x = t[CAN_XR_LANES_TX_FSM_TX_ADEL];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	pcs->output_unit_buf |= x;
+	set_const(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, 6, x);
+	tx_move(mac, CAN_XR_LANES_TX_FSM_TX_ADEL, CAN_XR_LANES_TX_FSM_TX_EOF, x);
+    }
+
+    x = t[CAN_XR_LANES_TX_FSM_TX_EOF];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	pcs->output_unit_buf |= x;
+	dec(mac->tx_bit_count, CAN_XR_LANES_FIELD_BITS, x);
+	tx_move(mac, CAN_XR_LANES_TX_FSM_TX_EOF,
+		CAN_XR_LANES_TX_FSM_TX_EOF_TAIL, x & tz);
+    }
+
+    /* Back to idle and confirm, without intermission like the MAC. */
+    x = t[CAN_XR_LANES_TX_FSM_TX_EOF_TAIL];
+    if(CAN_XR_LANES_ANY(x))
+    {
+	mac->data_req_pending &= ~x;
+	tx_move(mac, CAN_XR_LANES_TX_FSM_TX_EOF_TAIL, CAN_XR_LANES_TX_FSM_IDLE, x);
+	data_conf(lanes, ts, x, CAN_XR_MAC_TX_STATUS_SUCCESS);
+    }
+}
+
+/* Bit-sliced quantumclock_m_ind, for the lanes of 'e' that are at a
+   quantum clock edge and see bus level 'in'.
+*/
+static void quantumclock_m_ind(
+    struct CAN_XR_Lanes *lanes, CAN_XR_Lanes_Word e, CAN_XR_Lanes_Word in)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    CAN_XR_Lanes_Word *q = pcs->quantum_m_cnt;
+    CAN_XR_Lanes_Word edge, cand, before, use, soft_neg, s, wrap0, wrap1;
+    CAN_XR_Lanes_Word t[CAN_XR_LANES_Q_BITS];
+    CAN_XR_Lanes_Word borrow, carry, x;
+    int i;
+
+    /* Edge detection */
+    edge = e & (pcs->prev_bus_level ^ in);
+    cand = edge & ~pcs->sync_inhibit & pcs->prev_sample;
+    soft_neg = ZERO;
+
+    if(CAN_XR_LANES_ANY(cand))
+    {
+	/* Phase error sign, then hard or soft synchronization.  An
+	   edge in quantum 0 has no phase error, and positive phase
+	   errors count only if sending recessive.
+	*/
+	before = le(q, pcs->sample_point, CAN_XR_LANES_Q_BITS);
+	use = cand & ~is_zero(q, CAN_XR_LANES_Q_BITS)
+	    & (~before | pcs->sending_level);
+
+	set_const(q, CAN_XR_LANES_Q_BITS, 0, use & pcs->hard_sync_allowed);
+	use &= ~pcs->hard_sync_allowed;
+
+	/* Positive phase error e = q, q -= min(e, sjw), that is,
+	   q = max(q - sjw, 0).
+	*/
+	x = use & before;
+	if(CAN_XR_LANES_ANY(x))
+	{
+	    borrow = ZERO;
+	    for(i=0; i<CAN_XR_LANES_Q_BITS; i++)
+	    {
+		t[i] = q[i] ^ pcs->sjw[i] ^ borrow;
+		borrow = (~q[i] & pcs->sjw[i]) | (~(q[i] ^ pcs->sjw[i]) & borrow);
+	    }
+	    copy(q, t, CAN_XR_LANES_Q_BITS, x & ~borrow);
+	    set_const(q, CAN_XR_LANES_Q_BITS, 0, x & borrow);
+	}
+
+	/* Negative phase error e = q - quanta_per_bit, q -= max(e,
+	   -sjw), that is, q = min(q + sjw, quanta_per_bit).
+	*/
+	soft_neg = use & ~before;
+	if(CAN_XR_LANES_ANY(soft_neg))
+	{
+	    carry = ZERO;
+	    for(i=0; i<CAN_XR_LANES_Q_BITS; i++)
+	    {
+		t[i] = q[i] ^ pcs->sjw[i] ^ carry;
+		carry = (q[i] & pcs->sjw[i]) | ((q[i] ^ pcs->sjw[i]) & carry);
+	    }
+	    x = le(t, pcs->quanta_per_bit, CAN_XR_LANES_Q_BITS);
+	    copy(q, t, CAN_XR_LANES_Q_BITS, soft_neg & x);
+	    copy(q, pcs->quanta_per_bit, CAN_XR_LANES_Q_BITS, soft_neg & ~x);
+	}
+    }
+
+    pcs->sync_inhibit |= edge;
+
+    /* Sampling, then the MAC. */
+    s = e & eq(q, pcs->sample_point, CAN_XR_LANES_Q_BITS);
+    if(CAN_XR_LANES_ANY(s))
+    {
+	x = rx_data_ind(lanes, lanes->nodeclock_ts, s, in);
+	tx_data_ind(lanes, lanes->nodeclock_ts, s, x);
+
+	pcs->sync_inhibit &= ~(s & in);
+	pcs->prev_sample = sel(s, in, pcs->prev_sample);
+    }
+
+    /* Bit boundary and quantum counter update.  quantum_m_cnt may be
+       equal to quanta_per_bit only after a soft synchronization.
+    */
+    wrap0 = e & eq(q, pcs->last_quantum, CAN_XR_LANES_Q_BITS);
+    wrap1 = CAN_XR_LANES_ANY(soft_neg)
+	? e & eq(q, pcs->quanta_per_bit, CAN_XR_LANES_Q_BITS) : ZERO;
+
+    pcs->sending_level =
+	sel(wrap0 | wrap1, pcs->output_unit_buf, pcs->sending_level);
+
+    inc(q, CAN_XR_LANES_Q_BITS, e & ~wrap0 & ~wrap1);
+    set_const(q, CAN_XR_LANES_Q_BITS, 0, wrap0);
+    set_const(q, CAN_XR_LANES_Q_BITS, 1, wrap1);
+
+    pcs->prev_bus_level = sel(e, in, pcs->prev_bus_level);
+}
+
+void CAN_XR_Lanes_NodeClock_Ind(
+    struct CAN_XR_Lanes *lanes, const CAN_XR_Lanes_Word *rx_bus_level)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    CAN_XR_Lanes_Word e = ZERO;
+    int g;
+
+    lanes->nodeclock_ts++;
+
+    /* Prescalers, compare and reset rather than modulus */
+    for(g=0; g<pcs->n_prescalers; g++)
+    {
+	if(++pcs->prescaler_m_cnt[g] == pcs->prescaler_m[g])
+	    pcs->prescaler_m_cnt[g] = 0;
+
+	if(pcs->prescaler_m_cnt[g] == 0)
+	    e |= pcs->prescaler_lanes[g];
+    }
+
+    /* Wired AND in the simulated PMA */
+    if(CAN_XR_LANES_ANY(e))
+	quantumclock_m_ind(lanes, e, *rx_bus_level & pcs->sending_level);
+}
+
+void CAN_XR_Lanes_Tx_Bus_Level(
+    const struct CAN_XR_Lanes *lanes, CAN_XR_Lanes_Word *tx_bus_level)
+{
+    *tx_bus_level = lanes->pcs.sending_level;
+}
+
+/* Rebuild the prescaler groups from the lane parameters. */
+static void set_prescalers(struct CAN_XR_Lanes *lanes)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    int lane, g;
+
+    pcs->n_prescalers = 0;
+    for(lane=0; lane<CAN_XR_LANES; lane++)
+    {
+	for(g=0; g<pcs->n_prescalers; g++)
+	    if(pcs->prescaler_m[g] == lanes->parameters[lane].prescaler_m)
+		break;
+
+	if(g == pcs->n_prescalers)
+	{
+	    pcs->prescaler_m[g] = lanes->parameters[lane].prescaler_m;
+	    pcs->prescaler_m_cnt[g] = 0;
+	    pcs->prescaler_lanes[g] = ZERO;
+	    pcs->n_prescalers++;
+	}
+
+	CAN_XR_LANES_SET(pcs->prescaler_lanes[g], lane, 1);
+    }
+}
+
+void CAN_XR_Lanes_Set_Parameters(
+    struct CAN_XR_Lanes *lanes, int lane,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters)
+{
+    struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    int sample_point =
+	parameters->sync_seg + parameters->prop_seg + parameters->phase_seg1 - 1;
+    int quanta_per_bit = sample_point + 1 + parameters->phase_seg2;
+
+    TRACE(1, "CAN_XR_Lanes_Set_Parameters(%d)", lane);
+
+    lanes->parameters[lane] = *parameters;
+
+    set_value(pcs->sample_point, CAN_XR_LANES_Q_BITS, lane, sample_point);
+    set_value(pcs->last_quantum, CAN_XR_LANES_Q_BITS, lane,
+	      quanta_per_bit - 1);
+    set_value(pcs->quanta_per_bit, CAN_XR_LANES_Q_BITS, lane, quanta_per_bit);
+    set_value(pcs->sjw, CAN_XR_LANES_Q_BITS, lane, parameters->sjw);
+
+    set_prescalers(lanes);
+}
+
+void CAN_XR_Lanes_Init(
+    struct CAN_XR_Lanes *lanes,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters)
+{
+    int lane;
+
+    TRACE(1, "CAN_XR_Lanes_Init");
+
+    memset(lanes, 0, sizeof(*lanes));
+    lanes->nodeclock_ts = (unsigned long)0;
+
+    for(lane=0; lane<CAN_XR_LANES; lane++)
+	CAN_XR_Lanes_Set_Parameters(lanes, lane, parameters);
+
+    /* Same as init_state in CAN_XR_PCS.c and PMA_Sim */
+    lanes->pcs.prev_bus_level = ONES;
+    lanes->pcs.prev_sample = ONES;
+    lanes->pcs.sync_inhibit = ZERO;
+    lanes->pcs.hard_sync_allowed = ONES;
+    lanes->pcs.output_unit_buf = ONES;
+    lanes->pcs.sending_level = ONES;
+
+    /* Same as CAN_XR_MAC_Common_Init */
+    lanes->mac.rx_fsm_state[CAN_XR_MAC_RX_FSM_BUS_INTEGRATION] = ONES;
+    lanes->mac.tx_fsm_state[CAN_XR_LANES_TX_FSM_IDLE] = ONES;
+    lanes->mac.data_req_pending = ZERO;
+
+    lanes->data_ind = NULL;
+    lanes->data_conf = NULL;
+    lanes->user = NULL;
+}
+
+void CAN_XR_Lanes_Set_Data_Ind(
+    struct CAN_XR_Lanes *lanes, CAN_XR_Lanes_Data_Ind_t data_ind)
+{
+    lanes->data_ind = data_ind;
+}
+
+void CAN_XR_Lanes_Set_Data_Conf(
+    struct CAN_XR_Lanes *lanes, CAN_XR_Lanes_Data_Conf_t data_conf)
+{
+    lanes->data_conf = data_conf;
+}
+
+void CAN_XR_Lanes_Data_Req(
+    struct CAN_XR_Lanes *lanes, int lane,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct CAN_XR_Lanes_MAC_State *mac = &(lanes->mac);
+    int n_data = (dlc > 8) ? 8 : dlc;
+    int i;
+
+    TRACE(2, "Lanes lane %d data_req(%lu, ...)",
+	  lane, (unsigned long)identifier);
+
+    /* Same checks as mac_data_req, ts not in scope. */
+    if(CAN_XR_LANES_GET(mac->data_req_pending, lane)
+       || format != CAN_XR_FORMAT_CBFF)
+    {
+	if(lanes->data_conf)
+	    lanes->data_conf(
+		lanes, lane, 0, identifier, CAN_XR_MAC_TX_STATUS_NO_SUCCESS);
+	return;
+    }
+
+    mac->tx_identifier_value[lane] = identifier;
+    set_value(mac->tx_identifier, 11, lane, identifier);
+    set_value(mac->tx_dlc, 4, lane, dlc);
+    for(i=0; i<8; i++)
+	set_value(mac->tx_data + 8*i, 8, lane, (i < n_data) ? data[i] : 0);
+    CAN_XR_LANES_SET(mac->data_req_pending, lane, 1);
+}
+
+/* Return the index of the state 'lane' is in. */
+static int get_state(const CAN_XR_Lanes_Word *states, int n, int lane)
+{
+    int i;
+
+    for(i=0; i<n; i++)
+	if(CAN_XR_LANES_GET(states[i], lane))
+	    return i;
+    return -1;
+}
+
+void CAN_XR_Lanes_Get_State(
+    const struct CAN_XR_Lanes *lanes, int lane,
+    struct CAN_XR_PCS_State *pcs_state, struct CAN_XR_MAC_State *mac_state)
+{
+    const struct CAN_XR_Lanes_PCS_State *pcs = &(lanes->pcs);
+    const struct CAN_XR_Lanes_MAC_State *mac = &(lanes->mac);
+    struct CAN_XR_MAC_TX_Slot *slot;
+    int n_data, g, i;
+
+    if(pcs_state)
+    {
+	memset(pcs_state, 0, sizeof(*pcs_state));
+
+	pcs_state->nodeclock_ts = lanes->nodeclock_ts;
+	for(g=0; g<pcs->n_prescalers; g++)
+	    if(CAN_XR_LANES_GET(pcs->prescaler_lanes[g], lane))
+		pcs_state->prescaler_m_cnt = pcs->prescaler_m_cnt[g];
+
+	pcs_state->quantum_m_cnt =
+	    get_value(pcs->quantum_m_cnt, CAN_XR_LANES_Q_BITS, lane, 0);
+	pcs_state->quanta_per_bit =
+	    get_value(pcs->quanta_per_bit, CAN_XR_LANES_Q_BITS, lane, 0);
+	pcs_state->prev_bus_level = CAN_XR_LANES_GET(pcs->prev_bus_level, lane);
+	pcs_state->prev_sample = CAN_XR_LANES_GET(pcs->prev_sample, lane);
+	pcs_state->sync_inhibit = CAN_XR_LANES_GET(pcs->sync_inhibit, lane);
+	pcs_state->hard_sync_allowed =
+	    CAN_XR_LANES_GET(pcs->hard_sync_allowed, lane);
+	pcs_state->output_unit_buf =
+	    CAN_XR_LANES_GET(pcs->output_unit_buf, lane);
+	pcs_state->sending_level = CAN_XR_LANES_GET(pcs->sending_level, lane);
+    }
+
+    if(mac_state)
+    {
+	memset(mac_state, 0, sizeof(*mac_state));
+
+	mac_state->rx_fsm_state =
+	    get_state(mac->rx_fsm_state, CAN_XR_MAC_RX_FSM_ERROR + 1, lane);
+	mac_state->bus_integration_counter =
+	    get_value(mac->bus_integration_counter, 4, lane, 0);
+	mac_state->nc_bits = get_value(mac->nc_bits, 3, lane, 0);
+	mac_state->nc_pol = CAN_XR_LANES_GET(mac->nc_pol, lane);
+	mac_state->crc = get_value(mac->crc, 15, lane, 0);
+	mac_state->field_bits =
+	    get_value(mac->field_bits, CAN_XR_LANES_FIELD_BITS, lane, 1);
+
+	mac_state->rx_identifier = get_value(mac->rx_identifier, 11, lane, 0);
+	mac_state->rx_accept = 1; /* Lanes have no acceptance filter */
+	mac_state->rx_rtr = CAN_XR_LANES_GET(mac->rx_rtr, lane);
+	mac_state->rx_ide = CAN_XR_LANES_GET(mac->rx_ide, lane);
+	mac_state->rx_fdf = CAN_XR_LANES_GET(mac->rx_fdf, lane);
+	mac_state->rx_dlc = get_value(mac->rx_dlc, 4, lane, 0);
+	mac_state->rx_byte = get_value(mac->rx_byte, 8, lane, 0);
+
+	/* The last byte received is in planes 0-7. */
+	n_data = (mac_state->rx_dlc > 8) ? 8 : mac_state->rx_dlc;
+	for(i=0; i<n_data; i++)
+	    mac_state->rx_data[i] =
+		get_value(mac->rx_data + 8*(n_data - 1 - i), 8, lane, 0);
+
+	mac_state->tx_fsm_state =
+	    CAN_XR_LANES_GET(mac->tx_fsm_state[CAN_XR_LANES_TX_FSM_IDLE], lane)
+	    ? CAN_XR_MAC_TX_FSM_IDLE : CAN_XR_MAC_TX_FSM_TX_FRAME;
+	/* Lanes have a single TX slot, slot 0. */
+	mac_state->data_req_pending =
+	    CAN_XR_LANES_GET(mac->data_req_pending, lane);
+	mac_state->tx_slot_map = mac_state->data_req_pending;
+	mac_state->tx_slot =
+	    (mac_state->tx_fsm_state == CAN_XR_MAC_TX_FSM_IDLE) ? -1 : 0;
+	mac_state->tx_identifier = mac->tx_identifier_value[lane];
+	mac_state->tx_format = CAN_XR_FORMAT_CBFF;
+	mac_state->tx_dlc = get_value(mac->tx_dlc, 4, lane, 0);
+	if(mac_state->data_req_pending)
+	{
+	    slot = &(mac_state->tx_slots[0]);
+	    slot->identifier = mac_state->tx_identifier;
+	    slot->format = mac_state->tx_format;
+	    slot->dlc = mac_state->tx_dlc;
+	    for(i=0; i<8; i++)
+		slot->data[i] = get_value(mac->tx_data + 8*i, 8, lane, 0);
+	}
+	mac_state->tx_bit_index =
+	    get_value(mac->tx_bit_index, CAN_XR_LANES_TX_INDEX_BITS, lane, 0);
+
+	mac_state->tec = get_value(mac->tec, 9, lane, 0);
+	mac_state->rec = get_value(mac->rec, 9, lane, 0);
+	mac_state->error_tx = CAN_XR_LANES_GET(mac->error_tx, lane);
+	mac_state->tec_exception =
+	    CAN_XR_LANES_GET(mac->tec_exception_arbitration_stuff, lane)
+	    ? CAN_XR_MAC_TEC_EXCEPTION_ARBITRATION_STUFF
+	    : CAN_XR_LANES_GET(mac->tec_exception_passive_ack, lane)
+	    ? CAN_XR_MAC_TEC_EXCEPTION_PASSIVE_ACK
+	    : CAN_XR_MAC_TEC_EXCEPTION_NONE;
+	mac_state->suspend_bits = get_value(mac->suspend_bits, 4, lane, 0);
+	mac_state->bus_off_count = get_value(mac->bus_off_count, 8, lane, 0);
+    }
+}
@@ -29,7 +29,8 @@
    nodeclock_ind is triggered, it combines with a wired AND the
    rx_bus_level passed as argument to nodeclock_ind itself with the
    stored tx_bus_level from the last call to data_req.  The result is
-   propagated to the upper layer as a nodeclock_ind.
+   propagated to the upper layer as a nodeclock_ind.  The same holds
+   for quantumclock_ind, when the simulation does the prescaling.
 */
 
 #include <stdio.h>
@@ -55,6 +56,7 @@ void CAN_XR_PMA_Sim_Init(struct CAN_XR_PMA *pma)
 
     pma->primitives.nodeclock_ind = NULL; /* To be set by upper
 					     layer. */
+    pma->primitives.quantumclock_ind = NULL;
     pma->primitives.data_req = data_req;
 }
 
@@ -70,3 +72,25 @@ void CAN_XR_PMA_Sim_NodeClock_Ind(struct CAN_XR_PMA *pma, int rx_bus_level)
 	    pma->pcs,
 	    pma->state.sim.rx_bus_level & pma->state.sim.tx_bus_level);
 }
+
+int CAN_XR_PMA_Sim_QuantumClock_Ind(struct CAN_XR_PMA *pma, int rx_bus_level)
+{
+    TRACE(0, "CAN_XR_PMA_Sim_QuantumClock_Ind(%d)", rx_bus_level);
+
+    pma->state.sim.rx_bus_level = rx_bus_level;
+
+    /* Propagate indication to the upper layer.  Without one, fall
+       back to nodeclock_ind and keep going at the nodeclock rate.
+    */
+    if(pma->primitives.quantumclock_ind)
+	return pma->primitives.quantumclock_ind(
+	    pma->pcs,
+	    pma->state.sim.rx_bus_level & pma->state.sim.tx_bus_level);
+
+    if(pma->primitives.nodeclock_ind)
+	pma->primitives.nodeclock_ind(
+	    pma->pcs,
+	    pma->state.sim.rx_bus_level & pma->state.sim.tx_bus_level);
+
+    return 1;
+}
@@ -0,0 +1,78 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This file contains the reference frame encoder, see
+   CAN_XR_Ref_Encoder.h.
+*/
+
+#include <CAN_XR_CRC.h>
+#include "CAN_XR_Ref_Encoder.h"
+
+int CAN_XR_Ref_Encode(
+    uint32_t identifier, int dlc, const uint8_t *data, int ack,
+    uint8_t *bits)
+{
+    uint8_t raw[1 + 11 + 3 + 4 + 8*8 + 15]; /* SOF to CRC, unstuffed */
+    int n_raw = 0, n = 0;
+    uint16_t crc = 0;
+    int nc_bits = 0, nc_pol = -1;
+    int i, j;
+
+    raw[n_raw++] = 0;
+    for(i=10; i>=0; i--)  raw[n_raw++] = (identifier >> i) & 0x1;
+    for(i=0; i<3; i++)  raw[n_raw++] = 0; /* RTR, IDE, FDF */
+    for(i=3; i>=0; i--)  raw[n_raw++] = (dlc >> i) & 0x1;
+    for(j=0; j<dlc && j<8; j++)
+	for(i=7; i>=0; i--)  raw[n_raw++] = (data[j] >> i) & 0x1;
+
+    for(i=0; i<n_raw; i++)
+	crc = CAN_XR_CRC_Bit(crc, raw[i]);
+    for(i=14; i>=0; i--)  raw[n_raw++] = (crc >> i) & 0x1;
+
+    for(i=0; i<n_raw; i++)
+    {
+	bits[n++] = raw[i];
+	if(raw[i] == nc_pol)
+	    nc_bits++;
+	else
+	{
+	    nc_pol = raw[i];
+	    nc_bits = 1;
+	}
+
+	if(nc_bits == 5)
+	{
+	    nc_pol = 1 - nc_pol;
+	    nc_bits = 1;
+	    bits[n++] = nc_pol;
+	}
+    }
+
+    bits[n++] = 1; /* CDEL */
+    bits[n++] = ack;
+    for(i=0; i<8; i++)  bits[n++] = 1; /* ADEL, EOF */
+    return n;
+}
@@ -0,0 +1,146 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations and definitions needed by the
+   simulated multi-node CAN bus that runs on the host.  The bus owns N
+   complete PMA/PCS/MAC stacks, each one built upon CAN_XR_PMA_Sim,
+   and connects them with a wired AND.
+*/
+
+#ifndef CAN_XR_BUS_H
+#define CAN_XR_BUS_H
+
+#include <CAN_XR_PMA.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+
+/* A node attached to the simulated bus, that is, a full protocol
+   stack.  The node is the owner of its layers, which are linked
+   together by CAN_XR_Bus_Init.
+*/
+struct CAN_XR_Bus_Node
+{
+    struct CAN_XR_PMA pma;
+    struct CAN_XR_PCS pcs;
+    struct CAN_XR_MAC mac;
+};
+
+/* A MAC_Data.Request scheduled on the bus.  It is issued to the MAC
+   of node 'node' right before the nodes process nodeclock tick 'ts'.
+   'data' must stay valid until then.
+*/
+struct CAN_XR_Bus_Data_Req
+{
+    unsigned long ts;
+    int node;
+    uint32_t identifier;
+    enum CAN_XR_Format format;
+    int dlc;
+    uint8_t *data;
+};
+
+/* An edge of the external stimulus.  Starting from nodeclock tick
+   'ts' included, an external device drives the bus to 'level'.  Its
+   contribution is wired-AND'ed with the nodes' one.
+*/
+struct CAN_XR_Bus_Edge
+{
+    unsigned long ts;
+    int level;
+};
+
+struct CAN_XR_Bus
+{
+    struct CAN_XR_Bus_Node *nodes; /* Array of n_nodes nodes */
+    int n_nodes;
+
+    unsigned long nodeclock_ts; /* Simulated time, nodeclock units */
+    int bus_level; /* Bus level seen by all nodes at nodeclock_ts */
+
+    const struct CAN_XR_Bus_Data_Req *schedule; /* Sorted by ts */
+    int n_schedule;
+    int next_schedule; /* Index of the next request to issue */
+
+    const struct CAN_XR_Bus_Edge *stimulus; /* Sorted by ts */
+    int n_stimulus;
+    int next_stimulus; /* Index of the next edge to apply */
+    int ext_level; /* Level driven by the external stimulus */
+
+    int idle_skip; /* Skip idle intervals, see CAN_XR_Bus_Run */
+};
+
+/* Initialize 'bus' with the 'n_nodes' nodes in the 'nodes' array,
+   provided by the caller.  All nodes share the same bit time
+   'parameters'.  Each node gets a CAN_XR_PMA_Sim, a PCS and a MAC,
+   all linked together.  The MACs have no upcall primitives and no
+   LLC at this time, the caller shall set them through the MAC setters
+   as usual before running the bus.
+*/
+void CAN_XR_Bus_Init(
+    struct CAN_XR_Bus *bus,
+    struct CAN_XR_Bus_Node *nodes, int n_nodes,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters);
+
+/* Return the MAC of node number 'node' of 'bus'. */
+struct CAN_XR_MAC *CAN_XR_Bus_MAC(struct CAN_XR_Bus *bus, int node);
+
+/* Set the MAC_Data.Request schedule of 'bus' to the 'n' requests in
+   'schedule', which must be sorted by nondecreasing ts and stay valid
+   while the bus runs.  Requests whose ts has already elapsed are
+   issued at the next tick.
+*/
+void CAN_XR_Bus_Set_Schedule(
+    struct CAN_XR_Bus *bus,
+    const struct CAN_XR_Bus_Data_Req *schedule, int n);
+
+/* Set the external stimulus of 'bus' to the 'n' edges in 'stimulus',
+   which must be sorted by nondecreasing ts and stay valid while the
+   bus runs.  Before the first edge, the stimulus is recessive.
+*/
+void CAN_XR_Bus_Set_Stimulus(
+    struct CAN_XR_Bus *bus,
+    const struct CAN_XR_Bus_Edge *stimulus, int n);
+
+/* Enable (non-zero 'idle_skip', the default) or disable idle
+   skipping in 'bus'.
+*/
+void CAN_XR_Bus_Set_Idle_Skip(struct CAN_XR_Bus *bus, int idle_skip);
+
+/* Advance all nodes of 'bus' by 'ticks' nodeclock ticks.  On each
+   tick, the bus level is the wired AND of the levels all nodes and
+   the external stimulus are transmitting, and all nodes see it at the
+   same time.
+
+   When idle skipping is enabled and the bus is idle, that is, all
+   MACs are idle and nobody is driving the bus dominant, the bus jumps
+   directly to the next tick at which anything can change: the next
+   scheduled request, the next edge of the stimulus, or the end of the
+   run.  The outcome is the same as simulating every tick, but much
+   faster on lightly loaded buses.
+*/
+void CAN_XR_Bus_Run(struct CAN_XR_Bus *bus, unsigned long ticks);
+
+#endif
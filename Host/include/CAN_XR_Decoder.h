@@ -0,0 +1,270 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations and definitions needed by the
+   offline frame decoder that runs on the host.
+
+   The decoder takes a raw bus capture, one bit per nodeclock tick, and
+   gives the same MAC_Data.Indicate, with the same timestamps, as a
+   PMA/PCS/MAC stack fed with the capture one tick at a time, as long
+   as the MAC does not transmit anything but the ACK bit.  However, it
+   does not run the PCS and MAC automata tick by tick:
+
+   - it looks for edges of the bus level a 64-bit word at a time;
+
+   - between two edges, no synchronization takes place, so the number
+     and the timestamps of the sample points that fall within the
+     interval are calculated directly from the quantum counter;
+
+   - the sampled bits come in runs of the same level, which are
+     de-stuffed and appended to the frame a run at a time, and the
+     frame fields and CRC are extracted and checked only when the
+     whole field is available.
+
+   The state of the PCS and MAC automata is kept only as far as it
+   affects the outcome, and is updated with the same rules of
+   CAN_XR_PCS.c and CAN_XR_MAC_Common.c.
+
+   Long captures can also be decoded by several threads.  The capture
+   is cut into chunks at the SOF that follows a long enough recessive
+   interval, because the receive automaton is certainly idle there
+   and its state no longer depends on what came before.  The chunks
+   are decoded independently, and the frames are delivered in order
+   at the end.
+*/
+
+#ifndef CAN_XR_DECODER_H
+#define CAN_XR_DECODER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+
+/* Receive automaton states.  RX_FRAME covers all the fields from SOF
+   to CRC, that are handled together because all of them are
+   stuffed.
+*/
+enum CAN_XR_Decoder_RX_FSM_State
+{
+    CAN_XR_DECODER_RX_FSM_BUS_INTEGRATION,
+    CAN_XR_DECODER_RX_FSM_IDLE,
+    CAN_XR_DECODER_RX_FSM_RX_FRAME,
+    CAN_XR_DECODER_RX_FSM_RX_CDEL,
+    CAN_XR_DECODER_RX_FSM_RX_ACK,
+    CAN_XR_DECODER_RX_FSM_RX_ADEL,
+    CAN_XR_DECODER_RX_FSM_RX_EOF,
+    CAN_XR_DECODER_RX_FSM_INTERMISSION,
+    CAN_XR_DECODER_RX_FSM_ERROR
+};
+
+/* Longest de-stuffed CBFF frame, from SOF to the end of CRC, bits */
+#define CAN_XR_DECODER_MAX_FRAME_BITS (1 + 11 + 3 + 4 + 64 + 15)
+
+struct CAN_XR_Decoder_State
+{
+    /* PCS state, same meaning as in struct CAN_XR_PCS_State.
+       nodeclock_ts counts the ticks consumed so far, whereas
+       quantum_ts is the tick of the next quantum clock edge.
+    */
+    unsigned long nodeclock_ts;
+    unsigned long quantum_ts;
+    int quantum_m_cnt;
+    int prev_bus_level;
+    int prev_sample;
+    int sync_inhibit;
+    int hard_sync_allowed;
+    int output_unit_buf;
+    int sending_level;
+
+    /* MAC receive automaton state */
+    enum CAN_XR_Decoder_RX_FSM_State rx_fsm_state;
+    int bus_integration_counter;
+    int nc_bits; /* Bit de-stuffing state */
+    int nc_pol;
+    int de_stuffed_bits; /* From SOF, within rx_frame[] */
+    int frame_bits; /* SOF to the end of CRC, known after DLC */
+    int field_bits; /* Bits left in EOF or intermission */
+    /* De-stuffed frame, MSb first, plus two bytes of slack so that
+       fields can be read and written through a window of 3 bytes.
+    */
+    uint8_t rx_frame[(CAN_XR_DECODER_MAX_FRAME_BITS + 7) / 8 + 2];
+    uint32_t rx_identifier;
+    int rx_dlc;
+    uint8_t rx_data[8];
+
+    /* Statistics */
+    unsigned long edges; /* Edges of the quantum-rate bus level */
+    unsigned long frames; /* Frames delivered */
+    unsigned long errors; /* Transitions to the error state */
+};
+
+struct CAN_XR_Decoder
+{
+    struct CAN_XR_LLC *llc; /* Link to the upper protocol layer. */
+
+    struct CAN_XR_PCS_Bit_Time_Parameters parameters;
+    int quanta_per_bit; /* Derived from parameters */
+    int sample_point; /* Quantum number of the sample point */
+    struct CAN_XR_Decoder_State state;
+
+    CAN_XR_MAC_Data_Ind_t data_ind;
+};
+
+/* Initialize 'dec' with the bit time 'parameters'.  The decoder starts
+   like a PCS/MAC stack that has just been initialized, that is,
+   at tick zero and in bus integration.  There is no LLC and no
+   data_ind primitive at this time, the caller shall set them through
+   the setters below.
+*/
+void CAN_XR_Decoder_Init(
+    struct CAN_XR_Decoder *dec,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters);
+
+/* Set the pointer to the upper layer in 'dec'. */
+void CAN_XR_Decoder_Set_LLC(struct CAN_XR_Decoder *dec, struct CAN_XR_LLC *llc);
+
+/* Register the data_ind upcall primitive in 'dec'.  It is invoked
+   upon each valid frame, exactly like the MAC_Data.Indicate of the
+   MAC.  'data' is valid only for the duration of the upcall.  Unlike
+   in the MAC, the bytes of 'data' past the DLC are always zero.
+*/
+void CAN_XR_Decoder_Set_Data_Ind(
+    struct CAN_XR_Decoder *dec, CAN_XR_MAC_Data_Ind_t data_ind);
+
+/* Decode the next 'n_samples' ticks of the capture.  Bus level i is
+   bit i % 64 of samples[i / 64], that is, the layout of a buffer of
+   bytes filled LSb first on a little-endian host.  Successive calls
+   continue the capture where the previous one left off, and
+   buffer boundaries are not required to be word-aligned with
+   respect to the capture.  Bits past 'n_samples' in the last word
+   are ignored.
+*/
+void CAN_XR_Decoder_Run(
+    struct CAN_XR_Decoder *dec,
+    const uint64_t *samples, unsigned long n_samples);
+
+/* Minimum length of the recessive interval before a chunk boundary,
+   in bits.  Bus integration needs 11 recessive bits, but a receiver
+   caught in the middle of a frame may need 6 more to detect a stuff
+   error, and 1 to recover from it, before it even starts.  The last
+   2 bits are a margin for synchronization at the beginning of the
+   interval and for the position of the sample points.
+*/
+#define CAN_XR_DECODER_SPLIT_BITS (6 + 1 + 11 + 2)
+
+/* A frame decoded by a worker, waiting to be delivered. */
+struct CAN_XR_Decoder_Frame
+{
+    unsigned long ts;
+    uint32_t identifier;
+    int dlc;
+    uint8_t data[8];
+};
+
+/* A unit of work.  In the first phase, task i looks for the first
+   chunk boundary within the i-th n_tasks-th of the capture.  In the
+   second phase, it decodes the chunk between its boundary and the
+   next one into its share of the frame buffer.
+*/
+struct CAN_XR_Decoder_Task
+{
+    unsigned long cut; /* First sample of the chunk */
+    struct CAN_XR_Decoder_Frame *frames; /* Share of the frame buffer */
+    unsigned long max_frames;
+    unsigned long n_frames;
+    unsigned long edges, frames_ok, errors; /* Statistics */
+};
+
+/* A worker thread.  It owns a range of tasks, and takes them from the
+   bottom.  When it has no tasks left, it steals them from the top of
+   the other workers' ranges.
+*/
+struct CAN_XR_Decoder_Worker
+{
+    struct CAN_XR_Decoder_Pool *pool;
+    pthread_t thread;
+    pthread_mutex_t lock; /* Protects next_task, end_task */
+    unsigned long next_task;
+    unsigned long end_task;
+};
+
+struct CAN_XR_Decoder_Pool
+{
+    struct CAN_XR_Decoder_Worker *workers; /* Array of n_workers */
+    int n_workers;
+    struct CAN_XR_Decoder_Task *tasks; /* Array of n_tasks + 1 */
+    unsigned long n_tasks;
+    struct CAN_XR_Decoder_Frame *frames; /* Array of max_frames */
+    unsigned long max_frames;
+
+    /* Work being done */
+    int phase;
+    struct CAN_XR_Decoder *dec;
+    const uint64_t *samples;
+    unsigned long base; /* samples[0] is at base+1 */
+    unsigned long n_samples;
+    struct CAN_XR_Decoder_State last_state; /* From the last chunk */
+};
+
+/* Upper bound of the number of frames in 'n_samples' ticks decoded
+   with 'parameters' by a pool with 'n_tasks' tasks.  The shortest
+   frame has 44 bits, and the bit time can be shortened by sjw quanta
+   at most.
+*/
+#define CAN_XR_DECODER_MAX_FRAMES(parameters, n_samples, n_tasks)	\
+    ((n_samples)							\
+     / (43UL * (parameters)->prescaler_m				\
+	* ((parameters)->sync_seg + (parameters)->prop_seg		\
+	   + (parameters)->phase_seg1 + (parameters)->phase_seg2	\
+	   - (parameters)->sjw))					\
+     + 2 * (n_tasks))
+
+/* Initialize 'pool' with the 'n_workers' workers in 'workers', the
+   'n_tasks' + 1 tasks in 'tasks' and the 'max_frames' frames in
+   'frames', all provided by the caller.  The more tasks, the better
+   the load balance, but each task scans its part of the capture for
+   a chunk boundary, and a chunk boundary is needed in every part for
+   all tasks to be useful.
+*/
+void CAN_XR_Decoder_Pool_Init(
+    struct CAN_XR_Decoder_Pool *pool,
+    struct CAN_XR_Decoder_Worker *workers, int n_workers,
+    struct CAN_XR_Decoder_Task *tasks, unsigned long n_tasks,
+    struct CAN_XR_Decoder_Frame *frames, unsigned long max_frames);
+
+/* Same as CAN_XR_Decoder_Run, but using the workers of 'pool'.  The
+   upcalls are the same, with the same arguments and in the same
+   order, but they take place at the end, from the calling thread.
+   The state of 'dec' at the end is also the same.  If 'pool' does
+   not have enough room for the frames, the capture is decoded by the
+   calling thread alone.
+*/
+void CAN_XR_Decoder_Run_Parallel(
+    struct CAN_XR_Decoder *dec, struct CAN_XR_Decoder_Pool *pool,
+    const uint64_t *samples, unsigned long n_samples);
+
+#endif
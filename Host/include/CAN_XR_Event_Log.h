@@ -0,0 +1,108 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations of the event log that host
+   programs use to record the MAC upcalls of a run, and to compare
+   them with another run of the same scenario, for instance on a
+   different simulator.
+
+   The log is an array provided by the caller.  Events past its end
+   are dropped, and then the comparison fails anyway because the
+   number of events no longer matches.
+*/
+
+#ifndef CAN_XR_EVENT_LOG_H
+#define CAN_XR_EVENT_LOG_H
+
+#include <stdint.h>
+#include <CAN_XR_MAC.h>
+
+enum CAN_XR_Event_Kind
+{
+    CAN_XR_EVENT_DATA_IND,
+    CAN_XR_EVENT_DATA_CONF
+};
+
+/* Events are cleared before being filled in, so that two of them can
+   be compared with memcmp.
+*/
+struct CAN_XR_Event
+{
+    int node;
+    int kind; /* enum CAN_XR_Event_Kind */
+    unsigned long ts;
+    uint32_t identifier;
+    int dlc_or_status; /* DLC, or enum CAN_XR_MAC_Tx_Status */
+    uint8_t data[8]; /* First 8 data bytes, data_ind only */
+};
+
+struct CAN_XR_Event_Log
+{
+    struct CAN_XR_Event *events; /* max_events, provided by the caller */
+    int max_events;
+    int n_events;
+};
+
+/* Log the upcalls go to, see CAN_XR_Event_Log_Data_Ind and
+   CAN_XR_Event_Log_Data_Conf.
+*/
+extern struct CAN_XR_Event_Log *CAN_XR_Event_Log_Current;
+
+/* Initialize 'log', with room for 'max_events' in 'events'. */
+void CAN_XR_Event_Log_Init(
+    struct CAN_XR_Event_Log *log,
+    struct CAN_XR_Event *events, int max_events);
+
+/* Append an event to 'log', and return it, or NULL if the log is
+   full.  'data' is only looked at by data_ind events, and may be
+   NULL otherwise.
+*/
+struct CAN_XR_Event *CAN_XR_Event_Log_Add(
+    struct CAN_XR_Event_Log *log, int node, enum CAN_XR_Event_Kind kind,
+    unsigned long ts, uint32_t identifier, int dlc_or_status,
+    const uint8_t *data);
+
+/* Compare 'log' with 'ref', print the differences, up to 10 of them,
+   prefixed by 'what', and return their number.
+*/
+int CAN_XR_Event_Log_Compare(
+    const char *what,
+    const struct CAN_XR_Event_Log *ref, const struct CAN_XR_Event_Log *log);
+
+/* MAC_Data.Indicate and MAC_Data.Confirm upcalls that log to
+   CAN_XR_Event_Log_Current.  The LLC pointer of the MAC must point
+   to the node number, an int.  Programs that need to do more in
+   their upcalls can call them from their own.
+*/
+void CAN_XR_Event_Log_Data_Ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data);
+
+void CAN_XR_Event_Log_Data_Conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status);
+
+#endif
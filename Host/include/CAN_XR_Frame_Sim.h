@@ -0,0 +1,140 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations and definitions needed by the
+   frame-level (transaction-level) bus simulator that runs on the
+   host.
+
+   Unlike CAN_XR_Bus, this simulator does not step the PCS/MAC
+   automata bit by bit.  Each node exposes the usual MAC primitives,
+   and the simulator resolves arbitration, frame length and
+   timestamps analytically, one frame at a time.
+
+   Only CBFF data frames on an error-free bus are simulated, see
+   CAN_XR_Frame_Sim.c.  FBFF and XLFF requests are confirmed with
+   CAN_XR_MAC_TX_STATUS_NO_SUCCESS.
+*/
+
+#ifndef CAN_XR_FRAME_SIM_H
+#define CAN_XR_FRAME_SIM_H
+
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Bus.h> /* For CAN_XR_Bus_Data_Req and CAN_XR_Bus_Node */
+
+struct CAN_XR_Frame_Sim;
+
+/* A node attached to the frame-level simulator.  Only its MAC is
+   meaningful: its primitives and LLC link are used as usual, and its
+   TX slots hold the pending transmission requests, if any.  The MAC
+   must be the first member, because data_req gets back to the node
+   from it.
+*/
+struct CAN_XR_Frame_Sim_Node
+{
+    struct CAN_XR_MAC mac;
+    struct CAN_XR_Frame_Sim *sim;
+
+    /* Tick from which the request in each TX slot is visible */
+    unsigned long req_ts[CAN_XR_MAC_TX_SLOTS];
+};
+
+struct CAN_XR_Frame_Sim
+{
+    struct CAN_XR_Frame_Sim_Node *nodes; /* Array of n_nodes nodes */
+    int n_nodes;
+
+    struct CAN_XR_PCS_Bit_Time_Parameters parameters;
+    int quanta_per_bit; /* Derived from parameters */
+
+    unsigned long nodeclock_ts; /* Simulated time, nodeclock units */
+    unsigned long free_bit; /* First bit in which a SOF can be sent */
+    unsigned long frames; /* Frames transmitted so far */
+
+    /* Visiting state while delivering a frame, to decide when
+       requests issued from upcalls are honored.
+    */
+    int delivering;
+    int visit_node;
+    int visit_tx_done;
+
+    const struct CAN_XR_Bus_Data_Req *schedule; /* Sorted by ts */
+    int n_schedule;
+    int next_schedule; /* Index of the next request to issue */
+
+    int verify_every; /* Verify 1 frame out of verify_every, if > 0 */
+    struct CAN_XR_Bus_Node *replay_nodes; /* n_nodes, for verification */
+    unsigned long verified_frames;
+    unsigned long divergences; /* Verified frames that diverged */
+};
+
+/* Initialize 'sim' with the 'n_nodes' nodes in the 'nodes' array,
+   provided by the caller.  All nodes share the same bit time
+   'parameters', and the timestamps they see are the same the
+   bit-level simulator would produce with the same parameters.  There
+   must be at least two nodes, otherwise nobody would acknowledge the
+   frames.  The MACs have no upcall primitives and no LLC at this
+   time, the caller shall set them through the MAC setters as usual.
+*/
+void CAN_XR_Frame_Sim_Init(
+    struct CAN_XR_Frame_Sim *sim,
+    struct CAN_XR_Frame_Sim_Node *nodes, int n_nodes,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters);
+
+/* Return the MAC of node number 'node' of 'sim'. */
+struct CAN_XR_MAC *CAN_XR_Frame_Sim_MAC(
+    struct CAN_XR_Frame_Sim *sim, int node);
+
+/* Set the MAC_Data.Request schedule of 'sim', with the same rules as
+   CAN_XR_Bus_Set_Schedule.
+*/
+void CAN_XR_Frame_Sim_Set_Schedule(
+    struct CAN_XR_Frame_Sim *sim,
+    const struct CAN_XR_Bus_Data_Req *schedule, int n);
+
+/* Enable the verification mode of 'sim' if 'verify_every' is
+   positive, disable it otherwise.  In verification mode, one frame
+   out of 'verify_every' is also replayed through a bit-level
+   CAN_XR_Bus built on 'replay_nodes', an array of n_nodes nodes
+   provided by the caller.  The replay starts from an idle bus, with
+   the same requests pending in the nodes that contend for the bus
+   when the frame starts, and with the same acceptance filters.  The
+   winner of arbitration, and the timestamps of all indications and
+   confirmations relative to the start of the frame, must be the same
+   in both simulations.  Any divergence is traced at level 9 and
+   counted in sim->divergences.
+*/
+void CAN_XR_Frame_Sim_Set_Verification(
+    struct CAN_XR_Frame_Sim *sim, int verify_every,
+    struct CAN_XR_Bus_Node *replay_nodes);
+
+/* Advance 'sim' by 'ticks' nodeclock ticks.  Frames are delivered
+   (MAC_Data.Indicate to all nodes, MAC_Data.Confirm to the
+   transmitter) when the simulated time reaches their last EOF bit.
+*/
+void CAN_XR_Frame_Sim_Run(struct CAN_XR_Frame_Sim *sim, unsigned long ticks);
+
+#endif
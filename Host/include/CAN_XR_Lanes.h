@@ -0,0 +1,294 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations and definitions needed by the
+   bit-sliced, multi-lane CAN XR controller that runs on the host.
+
+   CAN_XR_Lanes simulates CAN_XR_LANES independent controllers, each
+   made of a simulated PMA, the PCS in CAN_XR_PCS.c and the common MAC
+   in CAN_XR_MAC_Common.c, and advances all of them by one nodeclock
+   tick per call.  Each controller is a lane, and every state item of
+   the PCS and MAC is kept as a set of bit planes, one bit per lane.
+   For instance, quantum_m_cnt is kept as CAN_XR_LANES_Q_BITS words,
+   the i-th word holding bit i of the counter of all lanes, whereas the
+   FSM states are kept one-hot, one word per state.  FSM transitions
+   and counter updates are then carried out for all lanes at once with
+   bitwise operations, masked by the lanes they apply to.
+
+   Lanes may have different bit time parameters and see different bus
+   levels, so that a parameter sweep with CAN_XR_LANES scenarios runs
+   in a single simulation.  As long as the parameters are within the
+   ranges of [1] Table 8, every lane goes through exactly the same
+   state transitions as the scalar controller.
+
+   By default, there are 64 lanes, one per bit of a 64-bit word.
+   Compiling with -DCAN_XR_LANES=256 -mavx2 uses GCC vector extensions
+   to get 256 lanes, one per bit of an AVX2 register.
+
+   TBD:
+
+   - The ext_tx_data_ind extension of the MAC is not supported.
+   - Each lane has a single TX slot, and rejects further requests
+     while it has a frame pending, like a MAC with CAN_XR_MAC_TX_SLOTS
+     set to 1.  CAN_XR_Lanes_Get_State puts that frame into slot 0,
+     without its bitstream, and there is no abort.
+   - The diagnostic items bus_bits, de_stuffed_bits, rx_byte_index
+     and tx_byte_index of the MAC state are not kept, nor is the
+     stuffed header cache.
+*/
+
+#ifndef CAN_XR_LANES_H
+#define CAN_XR_LANES_H
+
+#include <stdint.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+
+#ifndef CAN_XR_LANES
+#define CAN_XR_LANES 64
+#endif
+
+/* CAN_XR_Lanes_Word holds one bit per lane.  CAN_XR_LANES_ELEMENT
+   gives the 64-bit element of a word that holds 'lane'.
+*/
+#if CAN_XR_LANES == 64
+typedef uint64_t CAN_XR_Lanes_Word;
+
+#define CAN_XR_LANES_ELEMENT(w, lane) (w)
+#define CAN_XR_LANES_ANY(w) ((w) != 0)
+
+#elif CAN_XR_LANES == 256
+typedef uint64_t CAN_XR_Lanes_Word __attribute__ ((vector_size (32)));
+
+#define CAN_XR_LANES_ELEMENT(w, lane) ((w)[(lane) >> 6])
+#define CAN_XR_LANES_ANY(w) (((w)[0] | (w)[1] | (w)[2] | (w)[3]) != 0)
+
+#else
+#error "CAN_XR_LANES must be either 64 or 256"
+#endif
+
+/* Get and set the bit of 'lane' in word 'w'. */
+#define CAN_XR_LANES_GET(w, lane)				\
+    ((int)((CAN_XR_LANES_ELEMENT(w, lane) >> ((lane) & 63)) & 0x1))
+
+#define CAN_XR_LANES_SET(w, lane, v)					\
+    do {								\
+	CAN_XR_LANES_ELEMENT(w, lane) =					\
+	    (CAN_XR_LANES_ELEMENT(w, lane) & ~((uint64_t)1 << ((lane) & 63))) \
+	    | ((uint64_t)((v) & 0x1) << ((lane) & 63));			\
+    } while(0)
+
+/* Width of the bit-sliced counters.  Quanta per bit are at most 25
+   per [1] Table 8, and quantum_m_cnt may temporarily reach
+   quanta_per_bit.
+*/
+#define CAN_XR_LANES_Q_BITS 5
+#define CAN_XR_LANES_FIELD_BITS 7 /* Two's complement, like an int */
+
+struct CAN_XR_Lanes;
+
+/* Upcall primitives, like the MAC ones, plus the lane number. */
+typedef void (* CAN_XR_Lanes_Data_Ind_t)(
+    struct CAN_XR_Lanes *this, int lane, unsigned long ts,
+    uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data);
+
+typedef void (* CAN_XR_Lanes_Data_Conf_t)(
+    struct CAN_XR_Lanes *this, int lane, unsigned long ts,
+    uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status);
+
+/* Bit-sliced PCS state, see struct CAN_XR_PCS_State.  The prescaler
+   does not depend on the bus, so lanes with the same prescaler_m share
+   a scalar prescaler counter.  Per-lane parameters are kept as bit
+   planes, too.
+*/
+struct CAN_XR_Lanes_PCS_State
+{
+    int n_prescalers;
+    int prescaler_m[32];
+    int prescaler_m_cnt[32];
+    CAN_XR_Lanes_Word prescaler_lanes[32];
+
+    CAN_XR_Lanes_Word sample_point[CAN_XR_LANES_Q_BITS];
+    CAN_XR_Lanes_Word last_quantum[CAN_XR_LANES_Q_BITS];
+    CAN_XR_Lanes_Word quanta_per_bit[CAN_XR_LANES_Q_BITS];
+    CAN_XR_Lanes_Word sjw[CAN_XR_LANES_Q_BITS];
+
+    CAN_XR_Lanes_Word quantum_m_cnt[CAN_XR_LANES_Q_BITS];
+    CAN_XR_Lanes_Word prev_bus_level;
+    CAN_XR_Lanes_Word prev_sample;
+    CAN_XR_Lanes_Word sync_inhibit;
+    CAN_XR_Lanes_Word hard_sync_allowed;
+    CAN_XR_Lanes_Word output_unit_buf;
+    CAN_XR_Lanes_Word sending_level; /* Also the PMA tx_bus_level */
+};
+
+/* States of the transmit automaton of the lanes.  The scalar MAC
+   shifts out a bit stream pre-encoded by MAC_Data.Request, which
+   would take CAN_XR_MAC_TX_BITSTREAM_WORDS * 32 planes here.  The
+   lanes instead build the frame field by field, and count the bits
+   they transmit, stuff bits included, in tx_bit_index.  The bus sees
+   the same bits.  CAN_XR_Lanes_Get_State reports all states but the
+   idle one as CAN_XR_MAC_TX_FSM_TX_FRAME.
+*/
+enum CAN_XR_Lanes_TX_FSM_State
+{
+    CAN_XR_LANES_TX_FSM_IDLE,
+    CAN_XR_LANES_TX_FSM_TX_IDENTIFIER,
+    CAN_XR_LANES_TX_FSM_TX_RTR,
+    CAN_XR_LANES_TX_FSM_TX_IDE,
+    CAN_XR_LANES_TX_FSM_TX_FDF,
+    CAN_XR_LANES_TX_FSM_TX_DLC,
+    CAN_XR_LANES_TX_FSM_TX_DATA,
+    CAN_XR_LANES_TX_FSM_TX_CRC_LATCH,
+    CAN_XR_LANES_TX_FSM_TX_CRC,
+    CAN_XR_LANES_TX_FSM_TX_CDEL,
+    CAN_XR_LANES_TX_FSM_TX_ACK,
+    CAN_XR_LANES_TX_FSM_TX_ADEL,
+    CAN_XR_LANES_TX_FSM_TX_EOF,
+    CAN_XR_LANES_TX_FSM_TX_EOF_TAIL,
+    CAN_XR_LANES_TX_FSM_ERROR
+};
+
+/* Bits of tx_bit_index */
+#define CAN_XR_LANES_TX_INDEX_BITS 8
+
+/* Bit-sliced MAC state, see struct CAN_XR_MAC_State.  FSM states are
+   one-hot, indexed by the scalar rx enum and by enum
+   CAN_XR_Lanes_TX_FSM_State.  Multi-byte fields are kept
+   in shift registers, rx_data holds the last byte received in planes
+   0-7, the one before in planes 8-15 and so on.  tx_data holds byte
+   0 in planes 0-7, and so on, and tx_data_reg is its working copy
+   during transmission.
+*/
+struct CAN_XR_Lanes_MAC_State
+{
+    CAN_XR_Lanes_Word rx_fsm_state[CAN_XR_MAC_RX_FSM_ERROR + 1];
+
+    CAN_XR_Lanes_Word bus_integration_counter[4];
+
+    CAN_XR_Lanes_Word nc_bits[3];
+    CAN_XR_Lanes_Word nc_pol;
+    CAN_XR_Lanes_Word crc[15];
+    CAN_XR_Lanes_Word field_bits[CAN_XR_LANES_FIELD_BITS];
+
+    CAN_XR_Lanes_Word rx_identifier[11];
+    CAN_XR_Lanes_Word rx_rtr;
+    CAN_XR_Lanes_Word rx_ide;
+    CAN_XR_Lanes_Word rx_fdf;
+    CAN_XR_Lanes_Word rx_dlc[4];
+    CAN_XR_Lanes_Word rx_byte[8];
+    CAN_XR_Lanes_Word rx_data[64];
+
+    CAN_XR_Lanes_Word tx_fsm_state[CAN_XR_LANES_TX_FSM_ERROR + 1];
+
+    CAN_XR_Lanes_Word data_req_pending;
+    uint32_t tx_identifier_value[CAN_XR_LANES]; /* For data_conf */
+    CAN_XR_Lanes_Word tx_identifier[11];
+    CAN_XR_Lanes_Word tx_dlc[4];
+    CAN_XR_Lanes_Word tx_data[64];
+    CAN_XR_Lanes_Word tx_data_reg[64];
+    CAN_XR_Lanes_Word tx_bit_count[CAN_XR_LANES_FIELD_BITS];
+    CAN_XR_Lanes_Word tx_shift_reg[15]; /* MSb in plane 14 */
+    CAN_XR_Lanes_Word tx_bit_index[CAN_XR_LANES_TX_INDEX_BITS];
+
+    /* Fault confinement.  The receive error counter saturates at
+       255, the transmit one goes up to 263 before the lane goes bus
+       off.  Each TEC exception has its own plane.
+    */
+    CAN_XR_Lanes_Word tec[9];
+    CAN_XR_Lanes_Word rec[9];
+    CAN_XR_Lanes_Word error_tx;
+    CAN_XR_Lanes_Word tec_exception_arbitration_stuff;
+    CAN_XR_Lanes_Word tec_exception_passive_ack;
+    CAN_XR_Lanes_Word suspend_bits[4];
+    CAN_XR_Lanes_Word bus_off_count[8];
+};
+
+struct CAN_XR_Lanes
+{
+    unsigned long nodeclock_ts; /* The same for all lanes */
+
+    struct CAN_XR_PCS_Bit_Time_Parameters parameters[CAN_XR_LANES];
+    struct CAN_XR_Lanes_PCS_State pcs;
+    struct CAN_XR_Lanes_MAC_State mac;
+
+    CAN_XR_Lanes_Data_Ind_t data_ind;
+    CAN_XR_Lanes_Data_Conf_t data_conf;
+    void *user; /* For the upcalls, unused by CAN_XR_Lanes */
+};
+
+/* Initialize 'lanes', all with the same bit time 'parameters'.  The
+   state of each lane is the same as a freshly initialized PMA_Sim,
+   PCS and MAC, with no upcall primitives.
+*/
+void CAN_XR_Lanes_Init(
+    struct CAN_XR_Lanes *lanes,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters);
+
+/* Set the bit time 'parameters' of 'lane' in 'lanes'.  Only before
+   the first tick.
+*/
+void CAN_XR_Lanes_Set_Parameters(
+    struct CAN_XR_Lanes *lanes, int lane,
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters);
+
+/* Register the data_ind and data_conf upcall primitives in 'lanes'. */
+void CAN_XR_Lanes_Set_Data_Ind(
+    struct CAN_XR_Lanes *lanes, CAN_XR_Lanes_Data_Ind_t data_ind);
+
+void CAN_XR_Lanes_Set_Data_Conf(
+    struct CAN_XR_Lanes *lanes, CAN_XR_Lanes_Data_Conf_t data_conf);
+
+/* MAC_Data.Request for 'lane', with the same semantics as
+   CAN_XR_MAC_Data_Req.
+*/
+void CAN_XR_Lanes_Data_Req(
+    struct CAN_XR_Lanes *lanes, int lane,
+    uint32_t identifier, enum CAN_XR_Format format, int dlc, uint8_t *data);
+
+/* Advance all lanes by one nodeclock tick.  'rx_bus_level' holds the
+   bus level each lane sees, before the wired AND with what the lane
+   itself is transmitting, like CAN_XR_PMA_Sim_NodeClock_Ind.
+*/
+void CAN_XR_Lanes_NodeClock_Ind(
+    struct CAN_XR_Lanes *lanes, const CAN_XR_Lanes_Word *rx_bus_level);
+
+/* Store into 'tx_bus_level' the level each lane is transmitting. */
+void CAN_XR_Lanes_Tx_Bus_Level(
+    const struct CAN_XR_Lanes *lanes, CAN_XR_Lanes_Word *tx_bus_level);
+
+/* Rebuild the scalar PCS and MAC state of 'lane', for comparison with
+   the scalar controller and debugging.  Items that CAN_XR_Lanes does
+   not keep are set to zero, rx_data holds meaningful data only after
+   the whole data field has been received.
+*/
+void CAN_XR_Lanes_Get_State(
+    const struct CAN_XR_Lanes *lanes, int lane,
+    struct CAN_XR_PCS_State *pcs_state, struct CAN_XR_MAC_State *mac_state);
+
+#endif
@@ -39,4 +39,11 @@ void CAN_XR_PMA_Sim_Init(struct CAN_XR_PMA *pma);
 /* Trigger a NodeClock indication in CAN_XR_PMA_Sim. */
 void CAN_XR_PMA_Sim_NodeClock_Ind(struct CAN_XR_PMA *pma, int rx_bus_level);
 
+/* Trigger a QuantumClock indication in CAN_XR_PMA_Sim, in place of
+   the nodeclock indications of a whole time quantum.  Return the
+   number of nodeclock ticks to the next one.  A simulation must use
+   either this or CAN_XR_PMA_Sim_NodeClock_Ind from the start.
+*/
+int CAN_XR_PMA_Sim_QuantumClock_Ind(struct CAN_XR_PMA *pma, int rx_bus_level);
+
 #endif
@@ -0,0 +1,58 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This header contains the declarations of the reference frame
+   encoder that host programs use to check the bitstreams the MAC
+   sends, or to build the bitstreams of remote transmitters.
+
+   It encodes frames the simplest possible way, one bit at a time,
+   with the CAN_XR_CRC_Bit engine and stuffing as described in
+   ISO 11898-1:2015(E) [1] 10.5, and does not share any code with the
+   MAC transmit path.  Only CBFF data frames are supported.
+*/
+
+#ifndef CAN_XR_REF_ENCODER_H
+#define CAN_XR_REF_ENCODER_H
+
+#include <stdint.h>
+
+/* Longest stuffed CBFF data frame, from SOF to the last EOF bit.  The
+   98 bits from SOF to the CRC field may contain up to 24 stuff bits,
+   and are followed by CDEL, ACK, ADEL, and 7 EOF bits.
+*/
+#define CAN_XR_REF_ENCODER_MAX_BITS (98 + 24 + 10)
+
+/* Encode a CBFF data frame into bits[], one bit per byte, from SOF to
+   EOF, stuff bits included, and return the number of bits.  The ACK
+   slot is at 'ack', that is, 0 for a frame as seen by the receivers
+   and 1 for a frame as sent by the transmitter.  At most 8 bytes of
+   data are encoded, whatever the DLC.
+*/
+int CAN_XR_Ref_Encode(
+    uint32_t identifier, int dlc, const uint8_t *data, int ack,
+    uint8_t *bits);
+
+#endif
@@ -31,6 +31,21 @@
 
 #include <stdio.h> /* For fputc, fprintf. */
 
+/* Trace threshold, TRACE() messages with a lower level are
+   suppressed.  Unlike on the board, where tracing must be enabled
+   explicitly, the threshold is zero by default and everything is
+   traced.  Simulations with many nodes, or long ones, will likely
+   want to raise it with SET_TRACE_TRESHOLD().
+
+   It is defined in CAN_XR_Trace.c and not here because, unlike the
+   cross-compiler, the host compiler does not necessarily put
+   uninitialized globals into a common block.
+*/
+extern int CAN_XR_TRACE_Threshold;
+
+#define SET_TRACE_TRESHOLD(x)	\
+    CAN_XR_TRACE_Threshold = x;	\
+
 /* Yes, if you are wondering, this is a variadic macro, and is
    perfectly standard.  Note the implicit literal concatenation and
    the use of ## to suppress the preceding comma when varargs are
@@ -38,16 +53,22 @@
    with cpp.  :)
 */
 
-#define TRACE(level, format, ...)			\
-    do {						\
-	int i;						\
-	for(i=0; i<level*4; i++) fputc(' ', stderr);	\
-	fprintf(stderr, format "\n", ##__VA_ARGS__);	\
+#define TRACE(level, format, ...)				\
+    do {							\
+	if(level >= CAN_XR_TRACE_Threshold)			\
+	{							\
+	    int i;						\
+	    for(i=0; i<level*4; i++) fputc(' ', stderr);	\
+	    fprintf(stderr, format "\n", ##__VA_ARGS__);	\
+	}							\
     } while(0)
 
-#define TRACE_FUNCTION(level, function, ...)		\
-    do {						\
-	function(__VA_ARGS__);				\
+#define TRACE_FUNCTION(level, function, ...)			\
+    do {							\
+	if(level >= CAN_XR_TRACE_Threshold)			\
+	{							\
+	    function(__VA_ARGS__);				\
+	}							\
     } while(0)
 
 #endif
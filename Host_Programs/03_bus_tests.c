@@ -0,0 +1,166 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* 10 quanta per bit, sampling point between quantum #6 and #7, like
+   02_transmitter_tests.
+*/
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define MAX_NODES 64
+
+/* Upper bound of the frame duration, in nodeclock ticks.  It covers
+   bus integration, too.
+*/
+#define MAX_FRAME_TICKS 4000
+
+/* Per-node bookkeeping.  The MAC upcalls identify the node by means
+   of the LLC pointer, which points to one of these.
+*/
+struct node_log
+{
+    int n_data_ind;
+    int n_data_conf;
+    unsigned long ts;
+    uint32_t identifier;
+    int dlc;
+    uint8_t data[8];
+    enum CAN_XR_MAC_Tx_Status transmission_status;
+};
+
+struct node_log node_log[MAX_NODES];
+
+void log_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct node_log *l = (struct node_log *)llc;
+
+    l->n_data_ind++;
+    l->ts = ts;
+    l->identifier = identifier;
+    l->dlc = dlc;
+    memcpy(l->data, data, dlc);
+}
+
+void log_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    struct node_log *l = (struct node_log *)llc;
+
+    l->n_data_conf++;
+    l->transmission_status = transmission_status;
+}
+
+/* Transmit one frame from node 'tx' on a bus with 'n_nodes' nodes and
+   check that all nodes receive it.  Return the number of errors.
+*/
+int single_frame_test(int n_nodes, int tx)
+{
+    struct CAN_XR_Bus_Node nodes[MAX_NODES];
+    struct CAN_XR_Bus bus;
+    uint8_t data[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0x3E, 0x3E, 0x3E };
+    unsigned long ticks;
+    int errors = 0;
+    int n;
+
+    memset(node_log, 0, sizeof(node_log));
+
+    CAN_XR_Bus_Init(&bus, nodes, n_nodes, &pcs_parameters);
+    for(n=0; n<n_nodes; n++)
+    {
+	CAN_XR_MAC_Set_LLC(
+	    CAN_XR_Bus_MAC(&bus, n), (struct CAN_XR_LLC *)&node_log[n]);
+	CAN_XR_MAC_Set_Data_Ind(CAN_XR_Bus_MAC(&bus, n), log_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(CAN_XR_Bus_MAC(&bus, n), log_data_conf);
+    }
+
+    CAN_XR_MAC_Data_Req(CAN_XR_Bus_MAC(&bus, tx),
+			0x345, CAN_XR_FORMAT_CBFF, 8, data);
+
+    /* Run until the transmitter confirms, one bit at a time. */
+    for(ticks=0;
+	node_log[tx].n_data_conf == 0 && ticks < MAX_FRAME_TICKS;
+	ticks += 10)
+	CAN_XR_Bus_Run(&bus, 10);
+
+    if(node_log[tx].n_data_conf != 1
+       || node_log[tx].transmission_status != CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	printf("! %d nodes, tx %d: no successful data_conf\n", n_nodes, tx);
+	errors++;
+    }
+
+    for(n=0; n<n_nodes; n++)
+    {
+	if(node_log[n].n_data_ind != 1
+	   || node_log[n].identifier != 0x345
+	   || node_log[n].dlc != 8
+	   || memcmp(node_log[n].data, data, 8) != 0
+	   || node_log[n].ts != node_log[tx].ts)
+	{
+	    printf("! %d nodes, tx %d: node %d did not receive the frame\n",
+		   n_nodes, tx, n);
+	    errors++;
+	}
+    }
+
+    printf("# %d nodes, tx %d: frame received @%lu, %d errors\n",
+	   n_nodes, tx, node_log[tx].ts, errors);
+
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors only */
+    SET_TRACE_TRESHOLD(9);
+
+    errors += single_frame_test(2, 0);
+    errors += single_frame_test(16, 5);
+    errors += single_frame_test(64, 63);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,198 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Event_Log.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program runs the same lightly-loaded bus scenario twice, with
+   and without idle skipping in CAN_XR_Bus, checks that the outcome
+   is the same, and reports the elapsed time of both runs.
+*/
+
+/* 10 quanta per bit, with prescaler to have some idle nodeclock
+   ticks between quanta, too.
+*/
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 2,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define N_NODES 8
+#define N_FRAMES 100
+#define N_EDGES 4
+#define MAX_EVENTS (N_NODES * N_FRAMES * 2)
+
+/* Simulated time, in nodeclock ticks.  It ends well after the last
+   frame.
+*/
+unsigned long sim_ticks;
+
+/* Log of all MAC upcalls, to compare the runs. */
+struct CAN_XR_Event events[2][MAX_EVENTS];
+struct CAN_XR_Event_Log logs[2];
+
+/* The LLC pointer of each MAC points to the node number. */
+int node_numbers[N_NODES];
+
+struct CAN_XR_Bus_Data_Req schedule[N_FRAMES];
+uint8_t payloads[N_FRAMES][8];
+
+/* An external glitch in the middle of the idle time between two
+   frames.  Nodes see a SOF, then a stuff error, and recover by means
+   of bus integration.
+*/
+struct CAN_XR_Bus_Edge stimulus[N_EDGES];
+
+/* Sparse traffic with pseudo-random inter-arrival times. */
+void build_scenario(void)
+{
+    unsigned long seed = 12345;
+    unsigned long ts = 1000;
+    int f, j;
+
+    for(f=0; f<N_FRAMES; f++)
+    {
+	seed = seed * 1103515245UL + 12345UL;
+	ts += 20000 + (seed >> 8) % 100000;
+
+	for(j=0; j<8; j++)
+	    payloads[f][j] = (uint8_t)((seed >> (j + 4)) ^ f);
+
+	schedule[f].ts = ts;
+	schedule[f].node = f % N_NODES;
+	schedule[f].identifier = (seed >> 12) % 0x800;
+	schedule[f].format = CAN_XR_FORMAT_CBFF;
+	schedule[f].dlc = f % 9;
+	schedule[f].data = payloads[f];
+    }
+
+    sim_ticks = ts + 100000;
+
+    stimulus[0].ts = schedule[10].ts + 10000;
+    stimulus[0].level = 0;
+    stimulus[1].ts = stimulus[0].ts + 27;
+    stimulus[1].level = 1;
+    stimulus[2].ts = schedule[20].ts + 15001;
+    stimulus[2].level = 0;
+    stimulus[3].ts = stimulus[2].ts + 333;
+    stimulus[3].level = 1;
+}
+
+struct CAN_XR_Bus_Node nodes[2][N_NODES];
+struct CAN_XR_Bus bus[2];
+
+double run(int b, int idle_skip)
+{
+    struct CAN_XR_MAC *mac;
+    clock_t start;
+    int n;
+
+    CAN_XR_Event_Log_Init(&logs[b], events[b], MAX_EVENTS);
+    CAN_XR_Event_Log_Current = &logs[b];
+
+    memset(nodes[b], 0, sizeof(nodes[b]));
+    CAN_XR_Bus_Init(&bus[b], nodes[b], N_NODES, &pcs_parameters);
+    CAN_XR_Bus_Set_Idle_Skip(&bus[b], idle_skip);
+    CAN_XR_Bus_Set_Schedule(&bus[b], schedule, N_FRAMES);
+    CAN_XR_Bus_Set_Stimulus(&bus[b], stimulus, N_EDGES);
+
+    for(n=0; n<N_NODES; n++)
+    {
+	mac = CAN_XR_Bus_MAC(&bus[b], n);
+	node_numbers[n] = n;
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(mac, CAN_XR_Event_Log_Data_Ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, CAN_XR_Event_Log_Data_Conf);
+    }
+
+    start = clock();
+    CAN_XR_Bus_Run(&bus[b], sim_ticks);
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[])
+{
+    double t_full, t_skip;
+    int errors = 0;
+    int n;
+
+    /* No trace at all, the stimulus provokes errors on purpose. */
+    SET_TRACE_TRESHOLD(10);
+
+    build_scenario();
+
+    t_full = run(0, 0);
+    t_skip = run(1, 1);
+
+    errors += CAN_XR_Event_Log_Compare("idle skipping", &logs[0], &logs[1]);
+
+    /* The final state of all PCSs must be the same, too. */
+    for(n=0; n<N_NODES; n++)
+    {
+	struct CAN_XR_PCS_State *s0 = &(nodes[0][n].pcs.state);
+	struct CAN_XR_PCS_State *s1 = &(nodes[1][n].pcs.state);
+
+	if(s0->nodeclock_ts != s1->nodeclock_ts
+	   || s0->prescaler_m_cnt != s1->prescaler_m_cnt
+	   || s0->quantum_m_cnt != s1->quantum_m_cnt
+	   || s0->prev_bus_level != s1->prev_bus_level
+	   || s0->prev_sample != s1->prev_sample
+	   || s0->sync_inhibit != s1->sync_inhibit
+	   || s0->sending_level != s1->sending_level)
+	{
+	    printf("! node %d PCS state differs\n", n);
+	    errors++;
+	}
+    }
+
+    /* Every frame is received by all nodes and confirmed. */
+    if(logs[1].n_events != N_FRAMES * (N_NODES + 1))
+    {
+	printf("! %d events, expected %d\n",
+	       logs[1].n_events, N_FRAMES * (N_NODES + 1));
+	errors++;
+    }
+
+    printf("# %lu ticks, %d nodes, %d events\n",
+	   sim_ticks, N_NODES, logs[1].n_events);
+    printf("# tick by tick: %.3fs, idle skipping: %.3fs, speedup %.1fx\n",
+	   t_full, t_skip, t_skip > 0.0 ? t_full / t_skip : 0.0);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
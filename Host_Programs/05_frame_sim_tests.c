@@ -0,0 +1,374 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_Frame_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Event_Log.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the frame-level simulator against the
+   bit-level one on an uncontended scenario, in which the outcome
+   must be exactly the same, then runs a saturated, contended
+   scenario on the frame-level simulator only, checking arbitration
+   and verification mode, and reports the simulation speed of both.
+*/
+
+/* 10 quanta per bit, with prescaler, like 04_idle_skip_tests. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 2,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define N_NODES 8
+#define N_FRAMES 200
+#define MAX_EVENTS (N_NODES * N_FRAMES * 4)
+
+/* Identifiers from FOLLOW_UP_ID on are reserved to follow-up
+   requests, issued from upcalls.
+*/
+#define FOLLOW_UP_ID 0x7F0
+
+/* Contended scenario */
+#define N_CONTENDED_NODES 32
+#define N_CONTENDED_FRAMES 200000
+#define VERIFY_EVERY 1000
+
+unsigned long sim_ticks;
+
+/* Log of all MAC upcalls, to compare the runs. */
+struct CAN_XR_Event events[2][MAX_EVENTS];
+struct CAN_XR_Event_Log logs[2];
+
+/* The MACs of the current run, for follow-up requests. */
+struct CAN_XR_MAC *macs[N_NODES];
+
+/* The LLC pointer of each MAC points to the node number. */
+int node_numbers[N_CONTENDED_NODES];
+
+uint8_t follow_up_data[8] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77 };
+
+/* Some receivers issue a follow-up request from data_ind, and some
+   transmitters from data_conf.  They exercise the rules about when
+   requests issued from upcalls are honored.  There is at most one
+   follow-up per frame.
+*/
+void log_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int node = *(int *)llc;
+
+    CAN_XR_Event_Log_Data_Ind(llc, ts, identifier, format, dlc, data);
+
+    if(identifier < FOLLOW_UP_ID && identifier % 5 == 0
+       && node == identifier % N_NODES)
+	CAN_XR_MAC_Data_Req(macs[node], FOLLOW_UP_ID | node,
+			    CAN_XR_FORMAT_CBFF, 4, follow_up_data);
+}
+
+void log_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    int node = *(int *)llc;
+
+    CAN_XR_Event_Log_Data_Conf(llc, ts, identifier, transmission_status);
+
+    if(identifier < FOLLOW_UP_ID && identifier % 5 != 0
+       && identifier % 7 == 0
+       && transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+	CAN_XR_MAC_Data_Req(macs[node], FOLLOW_UP_ID | 8 | node,
+			    CAN_XR_FORMAT_CBFF, 8, follow_up_data);
+}
+
+struct CAN_XR_Bus_Data_Req schedule[N_FRAMES];
+uint8_t payloads[N_FRAMES][8];
+
+/* Uncontended traffic: requests are far enough apart that each frame,
+   and its follow-up if any, is over before the next request.
+*/
+void build_scenario(void)
+{
+    unsigned long seed = 54321;
+    unsigned long ts = 1000;
+    int f, j;
+
+    for(f=0; f<N_FRAMES; f++)
+    {
+	seed = seed * 1103515245UL + 12345UL;
+	ts += 6000 + (seed >> 8) % 4000;
+
+	for(j=0; j<8; j++)
+	    payloads[f][j] = (uint8_t)((seed >> (j + 4)) ^ (f * 0x1F));
+
+	schedule[f].ts = ts;
+	schedule[f].node = f % N_NODES;
+	schedule[f].identifier = (seed >> 12) % FOLLOW_UP_ID;
+	schedule[f].format = CAN_XR_FORMAT_CBFF;
+	schedule[f].dlc = f % 9;
+	schedule[f].data = payloads[f];
+    }
+
+    sim_ticks = ts + 10000;
+}
+
+struct CAN_XR_Bus_Node bus_nodes[N_NODES];
+struct CAN_XR_Bus bus;
+
+double run_bus(void)
+{
+    clock_t start;
+    int n;
+
+    CAN_XR_Event_Log_Init(&logs[0], events[0], MAX_EVENTS);
+    CAN_XR_Event_Log_Current = &logs[0];
+
+    CAN_XR_Bus_Init(&bus, bus_nodes, N_NODES, &pcs_parameters);
+    CAN_XR_Bus_Set_Schedule(&bus, schedule, N_FRAMES);
+
+    for(n=0; n<N_NODES; n++)
+    {
+	node_numbers[n] = n;
+	macs[n] = CAN_XR_Bus_MAC(&bus, n);
+	CAN_XR_MAC_Set_LLC(macs[n], (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(macs[n], log_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(macs[n], log_data_conf);
+    }
+
+    start = clock();
+    CAN_XR_Bus_Run(&bus, sim_ticks);
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+struct CAN_XR_Frame_Sim_Node sim_nodes[N_CONTENDED_NODES];
+struct CAN_XR_Bus_Node replay_nodes[N_CONTENDED_NODES];
+struct CAN_XR_Frame_Sim sim;
+
+double run_frame_sim(void)
+{
+    clock_t start;
+    int n;
+
+    CAN_XR_Event_Log_Init(&logs[1], events[1], MAX_EVENTS);
+    CAN_XR_Event_Log_Current = &logs[1];
+
+    CAN_XR_Frame_Sim_Init(&sim, sim_nodes, N_NODES, &pcs_parameters);
+    CAN_XR_Frame_Sim_Set_Schedule(&sim, schedule, N_FRAMES);
+    CAN_XR_Frame_Sim_Set_Verification(&sim, 1, replay_nodes);
+
+    for(n=0; n<N_NODES; n++)
+    {
+	node_numbers[n] = n;
+	macs[n] = CAN_XR_Frame_Sim_MAC(&sim, n);
+	CAN_XR_MAC_Set_LLC(macs[n], (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(macs[n], log_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(macs[n], log_data_conf);
+    }
+
+    start = clock();
+    CAN_XR_Frame_Sim_Run(&sim, sim_ticks);
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Uncontended scenario, the frame-level simulator must produce the
+   same upcalls, with the same timestamps, as the bit-level one.
+   Return the number of errors.
+*/
+int uncontended_test(void)
+{
+    double t_bus, t_sim;
+    int errors = 0;
+
+    build_scenario();
+
+    t_bus = run_bus();
+    t_sim = run_frame_sim();
+
+    errors += CAN_XR_Event_Log_Compare("frame level", &logs[0], &logs[1]);
+
+    if(sim.divergences != 0)
+    {
+	printf("! %lu divergences out of %lu verified frames\n",
+	       sim.divergences, sim.verified_frames);
+	errors++;
+    }
+
+    printf("# uncontended: %lu ticks, %lu frames, %d events, "
+	   "%d errors\n",
+	   sim_ticks, sim.frames, logs[1].n_events, errors);
+    printf("# bit level: %.3fs, frame level (verifying all): %.3fs\n",
+	   t_bus, t_sim);
+
+    return errors;
+}
+
+/* Contended scenario, all nodes always have a pending request.  Each
+   node re-requests from data_conf, with identifiers unique to the
+   node.
+*/
+unsigned long seed;
+unsigned long contended_frames;
+int prev_winner;
+int arbitration_errors;
+
+uint32_t next_identifier(int node)
+{
+    seed = seed * 1103515245UL + 12345UL;
+    return ((seed >> 12) % (0x800 / N_CONTENDED_NODES))
+	* N_CONTENDED_NODES + node;
+}
+
+void contended_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+}
+
+void contended_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    int node = *(int *)llc;
+    uint8_t data[8];
+    int n;
+
+    contended_frames++;
+
+    /* The winner must have the lowest identifier among contenders.
+       The previous winner did not contend, because it re-requested
+       from data_conf.  Nodes stop re-requesting at the end, so not
+       all nodes are necessarily pending.
+    */
+    for(n=0; n<N_CONTENDED_NODES; n++)
+    {
+	struct CAN_XR_MAC *mac = CAN_XR_Frame_Sim_MAC(&sim, n);
+
+	if(n == node || n == prev_winner)
+	    continue;
+
+	if(mac->state.data_req_pending
+	   && mac->state.tx_slots[mac->state.tx_queue[0]].identifier
+	   < identifier)
+	{
+	    if(arbitration_errors++ == 0)
+		printf("! @%lu node %d (%lu) won over node %d (%lu)\n",
+		       ts, node, (unsigned long)identifier, n,
+		       (unsigned long)
+		       mac->state.tx_slots[mac->state.tx_queue[0]].identifier);
+	}
+    }
+    prev_winner = node;
+
+    if(contended_frames < N_CONTENDED_FRAMES)
+    {
+	memset(data, node, sizeof(data));
+	data[0] = (uint8_t)contended_frames;
+	CAN_XR_MAC_Data_Req(CAN_XR_Frame_Sim_MAC(&sim, node),
+			    next_identifier(node), CAN_XR_FORMAT_CBFF,
+			    contended_frames % 9, data);
+    }
+}
+
+int contended_test(void)
+{
+    uint8_t data[8] = { 0 };
+    clock_t start;
+    double t;
+    int errors = 0;
+    int n;
+
+    seed = 999;
+    contended_frames = 0;
+    prev_winner = -1;
+    arbitration_errors = 0;
+
+    CAN_XR_Frame_Sim_Init(&sim, sim_nodes, N_CONTENDED_NODES,
+			  &pcs_parameters);
+    CAN_XR_Frame_Sim_Set_Verification(&sim, VERIFY_EVERY, replay_nodes);
+
+    for(n=0; n<N_CONTENDED_NODES; n++)
+    {
+	struct CAN_XR_MAC *mac = CAN_XR_Frame_Sim_MAC(&sim, n);
+
+	node_numbers[n] = n;
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(mac, contended_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, contended_data_conf);
+	CAN_XR_MAC_Data_Req(mac, next_identifier(n), CAN_XR_FORMAT_CBFF,
+			    n % 9, data);
+    }
+
+    /* Run until all frames have been sent. */
+    start = clock();
+    while(contended_frames < N_CONTENDED_FRAMES)
+	CAN_XR_Frame_Sim_Run(&sim, 1000000);
+    t = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if(arbitration_errors)
+    {
+	printf("! %d arbitration errors\n", arbitration_errors);
+	errors++;
+    }
+
+    if(sim.divergences != 0 || sim.verified_frames == 0)
+    {
+	printf("! %lu divergences out of %lu verified frames\n",
+	       sim.divergences, sim.verified_frames);
+	errors++;
+    }
+
+    printf("# contended: %d nodes, %lu frames, %lu verified, %d errors\n",
+	   N_CONTENDED_NODES, sim.frames, sim.verified_frames, errors);
+    printf("# frame level: %.3fs, %.0f frames/s\n",
+	   t, t > 0.0 ? sim.frames / t : 0.0);
+
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors only */
+    SET_TRACE_TRESHOLD(9);
+
+    errors += uncontended_test();
+    errors += contended_test();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,567 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CAN_XR_PMA_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Bus.h> /* For struct CAN_XR_Bus_Node */
+#include <CAN_XR_Lanes.h>
+#include <CAN_XR_Ref_Encoder.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program runs CAN_XR_LANES scalar controllers and a
+   CAN_XR_Lanes with the same parameters and inputs, checks that the
+   state of each lane is the same as the state of the corresponding
+   scalar controller, and compares their speed.
+
+   Most lanes see a stream of frames coming from a remote
+   transmitter, some of them with glitches.  The remote transmitter
+   does not always wait for the end of intermission, which makes the
+   lanes send overload frames, or receive a SOF at its third bit.
+   The others transmit, and a remote receiver acknowledges their
+   frames.  Some of them see dominant bits that make them lose
+   arbitration or detect bit errors, or one on a recessive stuff bit
+   in the arbitration field or on the last EOF bit of their first
+   frame.  Lanes send error
+   flags and go through all fault confinement states.
+*/
+
+#define N_TICKS 200000
+#define CHECK_TICKS 50000 /* Full state comparison at every tick */
+#define CHECK_EVERY 11 /* Afterwards */
+
+/* Stuffed frame, from SOF to the last EOF bit. */
+#define MAX_FRAME_BITS CAN_XR_REF_ENCODER_MAX_BITS
+
+/* Overload flag and delimiter */
+#define OVERLOAD_BITS (6 + 8)
+
+/* Stimulus, one word per tick */
+CAN_XR_Lanes_Word *stimulus;
+
+struct CAN_XR_PCS_Bit_Time_Parameters parameters[CAN_XR_LANES];
+
+/* Scalar controllers */
+struct CAN_XR_Bus_Node nodes[CAN_XR_LANES];
+struct CAN_XR_Lanes lanes;
+
+/* Per-lane event summary, [0] scalar, [1] lanes. */
+struct event_log
+{
+    int n_data_ind;
+    int n_data_conf;
+    unsigned long hash;
+};
+
+struct event_log logs[2][CAN_XR_LANES];
+
+/* The LLC pointer of each scalar MAC points to the lane number. */
+int lane_numbers[CAN_XR_LANES];
+
+uint8_t tx_payload[8] = { 0xDE, 0xAD, 0xBE, 0xEF, 0x00, 0xFF, 0x0F, 0xF0 };
+
+#define TRANSMITS(lane) ((lane) % 4 == 3)
+
+static unsigned long hash_step(unsigned long h, unsigned long v)
+{
+    return (h ^ v) * 1099511628211UL;
+}
+
+void log_data_ind(struct event_log *l, unsigned long ts, uint32_t identifier,
+		  int dlc, uint8_t *data)
+{
+    int i;
+
+    l->n_data_ind++;
+    l->hash = hash_step(l->hash, ts);
+    l->hash = hash_step(l->hash, identifier);
+    l->hash = hash_step(l->hash, dlc);
+    for(i=0; i<dlc && i<8; i++)
+	l->hash = hash_step(l->hash, data[i]);
+}
+
+void log_data_conf(struct event_log *l, unsigned long ts, uint32_t identifier,
+		   enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    l->n_data_conf++;
+    l->hash = hash_step(l->hash, ts);
+    l->hash = hash_step(l->hash, identifier);
+    l->hash = hash_step(l->hash, transmission_status);
+}
+
+void scalar_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    log_data_ind(&logs[0][*(int *)llc], ts, identifier, dlc, data);
+}
+
+void scalar_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    int lane = *(int *)llc;
+
+    log_data_conf(&logs[0][lane], ts, identifier, transmission_status);
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+	CAN_XR_MAC_Data_Req(&nodes[lane].mac, identifier, CAN_XR_FORMAT_CBFF,
+			    lane % 9, tx_payload);
+}
+
+void lanes_data_ind(
+    struct CAN_XR_Lanes *l, int lane, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    log_data_ind(&logs[1][lane], ts, identifier, dlc, data);
+}
+
+void lanes_data_conf(
+    struct CAN_XR_Lanes *l, int lane, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    log_data_conf(&logs[1][lane], ts, identifier, transmission_status);
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+	CAN_XR_Lanes_Data_Req(l, lane, identifier, CAN_XR_FORMAT_CBFF,
+			      lane % 9, tx_payload);
+}
+
+/* Remote transmitter of each lane.  Lanes that transmit only see a
+   remote receiver, which acknowledges their frames.
+*/
+struct remote
+{
+    uint8_t bits[MAX_FRAME_BITS];
+    int n_bits;
+    int bit;
+    int bit_ticks;
+    int tick;
+    int gap; /* Idle bits before the next frame */
+    int stuff_bit; /* First recessive stuff bit in arbitration, or -1 */
+    unsigned long seed;
+    unsigned long glitch_seed;
+};
+
+struct remote remotes[CAN_XR_LANES];
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+/* Return the index of the first recessive stuff bit among the first
+   'n_bits' of 'bits', starting from SOF, or -1.
+*/
+int find_stuff_bit(const uint8_t *bits, int n_bits)
+{
+    int nc_bits = 0, nc_pol = -1;
+    int i;
+
+    for(i=0; i<n_bits; i++)
+    {
+	if(nc_bits == 5)
+	{
+	    if(bits[i] == 1)
+		return i;
+	    nc_bits = 0;
+	}
+
+	if(bits[i] == nc_pol)
+	    nc_bits++;
+	else
+	{
+	    nc_pol = bits[i];
+	    nc_bits = 1;
+	}
+    }
+
+    return -1;
+}
+
+/* Scenarios:
+
+   - MIXED, all lanes have different bit time parameters, prescaler
+     included, and their remote transmitter has a slightly different
+     bit time.
+
+   - SWEEP, all lanes have the same nominal bit time and see the same
+     frames, but the sample point and sjw vary, as in a parameter
+     sweep.
+*/
+enum scenario { MIXED, SWEEP };
+const char *scenario_names[] = { "mixed", "sweep" };
+
+void set_parameters(enum scenario scenario, int lane)
+{
+    struct CAN_XR_PCS_Bit_Time_Parameters *p = &parameters[lane];
+
+    p->sync_seg = 1;
+    if(scenario == MIXED)
+    {
+	p->prescaler_m = 1 + lane % 3;
+	p->prop_seg = 1 + (lane * 5) % 8;
+	p->phase_seg1 = 1 + (lane * 3) % 8;
+	p->phase_seg2 = 2 + (lane * 7) % 7;
+	p->sjw = 1 + lane % 4;
+    }
+    else
+    {
+	p->prescaler_m = 2;
+	p->prop_seg = 1 + lane % 4;
+	p->phase_seg1 = 1 + (lane / 4) % 4;
+	p->phase_seg2 = 16 - 1 - p->prop_seg - p->phase_seg1;
+	p->sjw = 1 + (lane / 16) % 4;
+    }
+}
+
+void build_scenario(enum scenario scenario)
+{
+    struct CAN_XR_PCS_Bit_Time_Parameters *p;
+    struct remote *r;
+    uint8_t data[8];
+    unsigned long t;
+    int lane, level, i, b;
+
+    memset(stimulus, 0, N_TICKS * sizeof(CAN_XR_Lanes_Word));
+
+    for(lane=0; lane<CAN_XR_LANES; lane++)
+    {
+	set_parameters(scenario, lane);
+	p = &parameters[lane];
+
+	r = &remotes[lane];
+	memset(r, 0, sizeof(*r));
+	r->seed = (scenario == MIXED) ? 1000 + lane : 1000;
+	r->glitch_seed = 2000 + lane;
+	r->bit_ticks =
+	    p->prescaler_m
+	    * (p->sync_seg + p->prop_seg + p->phase_seg1 + p->phase_seg2);
+	if(scenario == MIXED && !TRANSMITS(lane))
+	    r->bit_ticks += (lane % 3) - 1;
+	r->gap = 20;
+
+	/* The remote receiver of a transmitting lane only needs to know
+	   the length of its frames.  The first one starts after bus
+	   integration, at bit 11, and each of the others after the 3
+	   bits of intermission that follow the previous one.
+	*/
+	if(TRANSMITS(lane))
+	{
+	    r->n_bits = CAN_XR_Ref_Encode(
+		0x100 + lane, lane % 9, tx_payload, 1, r->bits);
+	    r->stuff_bit = find_stuff_bit(r->bits, 1 + 11 + 2);
+	}
+    }
+
+    for(t=0; t<N_TICKS; t++)
+	for(lane=0; lane<CAN_XR_LANES; lane++)
+	{
+	    r = &remotes[lane];
+
+	    if(TRANSMITS(lane))
+	    {
+		/* Some transmitting lanes see a dominant last EOF bit in
+		   their first frame.  The overload frame they send
+		   delays all the others by OVERLOAD_BITS.
+		*/
+		b = t / r->bit_ticks;
+		level = 1;
+		if(lane % 16 == 11 && b >= 11 + r->n_bits - 1)
+		{
+		    if(b == 11 + r->n_bits - 1)
+			level = 0;
+		    b = (b < 11 + r->n_bits + 3 + OVERLOAD_BITS)
+			? 0 : b - OVERLOAD_BITS;
+		}
+
+		/* Dominant ACK */
+		if(b >= 11 && (b - 11) % (r->n_bits + 3) == r->n_bits - 9)
+		    level = 0;
+
+		/* Some transmitting lanes see whole dominant bits now
+		   and then, which make them lose arbitration or detect
+		   a bit error.
+		*/
+		if(lane % 8 == 7)
+		{
+		    if(t % r->bit_ticks == 0)
+			r->gap = (rnd(&r->glitch_seed) % 300 == 0);
+		    if(r->gap)
+			level = 0;
+		}
+
+		if(lane % 16 == 3 && r->stuff_bit >= 0
+		   && b == 11 + r->stuff_bit)
+		    level = 0;
+
+		if(level)
+		    CAN_XR_LANES_SET(stimulus[t], lane, 1);
+		continue;
+	    }
+
+	    if(r->gap > 0)
+		level = 1;
+	    else
+	    {
+		if(r->n_bits == 0)
+		{
+		    for(i=0; i<8; i++)
+			data[i] = rnd(&r->seed);
+		    r->n_bits = CAN_XR_Ref_Encode(
+			rnd(&r->seed) % 0x800, rnd(&r->seed) % 9, data, 1,
+			r->bits);
+		    r->bit = 0;
+
+		    /* Some frames end with a dominant last EOF bit */
+		    if(lane % 5 == 1 && rnd(&r->glitch_seed) % 4 == 0)
+			r->bits[r->n_bits - 1] = 0;
+		}
+		level = r->bits[r->bit];
+	    }
+
+	    /* Glitches */
+	    if(lane % 5 == 0 && rnd(&r->glitch_seed) % 20000 == 0)
+		level = 0;
+
+	    if(level)
+		CAN_XR_LANES_SET(stimulus[t], lane, 1);
+
+	    if(++r->tick == r->bit_ticks)
+	    {
+		r->tick = 0;
+		if(r->gap > 0)
+		    r->gap--;
+		else if(++r->bit == r->n_bits)
+		{
+		    r->n_bits = 0;
+		    r->gap = rnd(&r->seed) % 43;
+		}
+	    }
+	}
+}
+
+void init(void)
+{
+    int lane;
+
+    memset(logs, 0, sizeof(logs));
+    memset(nodes, 0, sizeof(nodes));
+
+    CAN_XR_Lanes_Init(&lanes, &parameters[0]);
+    CAN_XR_Lanes_Set_Data_Ind(&lanes, lanes_data_ind);
+    CAN_XR_Lanes_Set_Data_Conf(&lanes, lanes_data_conf);
+
+    for(lane=0; lane<CAN_XR_LANES; lane++)
+    {
+	lane_numbers[lane] = lane;
+
+	CAN_XR_PMA_Sim_Init(&nodes[lane].pma);
+	CAN_XR_PCS_Init(&nodes[lane].pcs, &parameters[lane], &nodes[lane].pma);
+	CAN_XR_MAC_Common_Init(&nodes[lane].mac, &nodes[lane].pcs);
+	CAN_XR_MAC_Set_LLC(&nodes[lane].mac,
+			   (struct CAN_XR_LLC *)&lane_numbers[lane]);
+	CAN_XR_MAC_Set_Data_Ind(&nodes[lane].mac, scalar_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(&nodes[lane].mac, scalar_data_conf);
+
+	CAN_XR_Lanes_Set_Parameters(&lanes, lane, &parameters[lane]);
+
+	if(TRANSMITS(lane))
+	{
+	    CAN_XR_MAC_Data_Req(&nodes[lane].mac, 0x100 + lane,
+				CAN_XR_FORMAT_CBFF, lane % 9, tx_payload);
+	    CAN_XR_Lanes_Data_Req(&lanes, lane, 0x100 + lane,
+				  CAN_XR_FORMAT_CBFF, lane % 9, tx_payload);
+	}
+    }
+}
+
+/* Compare the state of 'lane'.  Return non-zero if it differs. */
+int compare(unsigned long t, int lane)
+{
+    struct CAN_XR_PCS_State p;
+    struct CAN_XR_MAC_State m;
+    const struct CAN_XR_PCS_State *sp = &nodes[lane].pcs.state;
+    const struct CAN_XR_MAC_State *sm = &nodes[lane].mac.state;
+
+    CAN_XR_Lanes_Get_State(&lanes, lane, &p, &m);
+
+#define DIFF(field, a, b)					\
+    if((a) != (b))						\
+    {								\
+	printf("! tick %lu lane %d: %s %ld (scalar) vs. %ld\n",	\
+	       t, lane, field, (long)(a), (long)(b));		\
+	return 1;						\
+    }
+
+    DIFF("nodeclock_ts", sp->nodeclock_ts, p.nodeclock_ts);
+    DIFF("prescaler_m_cnt", sp->prescaler_m_cnt, p.prescaler_m_cnt);
+    DIFF("quantum_m_cnt", sp->quantum_m_cnt, p.quantum_m_cnt);
+    DIFF("prev_bus_level", sp->prev_bus_level, p.prev_bus_level);
+    DIFF("prev_sample", sp->prev_sample, p.prev_sample);
+    DIFF("sync_inhibit", sp->sync_inhibit, p.sync_inhibit);
+    DIFF("hard_sync_allowed", sp->hard_sync_allowed, p.hard_sync_allowed);
+    DIFF("output_unit_buf", sp->output_unit_buf, p.output_unit_buf);
+    DIFF("sending_level", sp->sending_level, p.sending_level);
+    DIFF("tx_bus_level", nodes[lane].pma.state.sim.tx_bus_level,
+	 p.sending_level);
+
+    DIFF("rx_fsm_state", sm->rx_fsm_state, m.rx_fsm_state);
+    DIFF("tx_fsm_state", sm->tx_fsm_state, m.tx_fsm_state);
+    DIFF("bus_integration_counter",
+	 sm->bus_integration_counter, m.bus_integration_counter);
+    DIFF("nc_bits", sm->nc_bits, m.nc_bits);
+    DIFF("nc_pol", sm->nc_pol, m.nc_pol);
+    DIFF("crc", sm->crc, m.crc);
+    DIFF("field_bits", sm->field_bits, m.field_bits);
+    DIFF("rx_identifier", sm->rx_identifier, m.rx_identifier);
+    DIFF("rx_rtr", sm->rx_rtr, m.rx_rtr);
+    DIFF("rx_ide", sm->rx_ide, m.rx_ide);
+    DIFF("rx_fdf", sm->rx_fdf, m.rx_fdf);
+    DIFF("rx_dlc", sm->rx_dlc, m.rx_dlc);
+    DIFF("rx_byte", sm->rx_byte, m.rx_byte);
+    DIFF("data_req_pending", sm->data_req_pending, m.data_req_pending);
+    DIFF("tx_bit_index", sm->tx_bit_index, m.tx_bit_index);
+    DIFF("tec", sm->tec, m.tec);
+    DIFF("rec", sm->rec, m.rec);
+    DIFF("error_tx", sm->error_tx, m.error_tx);
+    DIFF("tec_exception", sm->tec_exception, m.tec_exception);
+    DIFF("suspend_bits", sm->suspend_bits, m.suspend_bits);
+    DIFF("bus_off_count", sm->bus_off_count, m.bus_off_count);
+
+#undef DIFF
+
+    return 0;
+}
+
+/* Run the scalar controllers and/or the lanes on the whole stimulus,
+   checking the state if both run.  Return the elapsed time.
+*/
+double run(int scalar, int vector, int *errors)
+{
+    clock_t start = clock();
+    unsigned long t;
+    int lane;
+
+    for(t=0; t<N_TICKS; t++)
+    {
+	if(vector)
+	    CAN_XR_Lanes_NodeClock_Ind(&lanes, &stimulus[t]);
+
+	if(scalar)
+	    for(lane=0; lane<CAN_XR_LANES; lane++)
+		CAN_XR_PMA_Sim_NodeClock_Ind(
+		    &nodes[lane].pma, CAN_XR_LANES_GET(stimulus[t], lane));
+
+	if(scalar && vector && *errors == 0
+	   && (t < CHECK_TICKS || t % CHECK_EVERY == 0))
+	    for(lane=0; lane<CAN_XR_LANES && *errors == 0; lane++)
+		*errors += compare(t, lane);
+    }
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Validate and time one scenario.  Return the number of errors. */
+int test(enum scenario scenario)
+{
+    double t_scalar, t_lanes;
+    int errors = 0;
+    int n_data_ind = 0, n_data_conf = 0;
+    int lane;
+
+    build_scenario(scenario);
+
+    /* Validation */
+    init();
+    run(1, 1, &errors);
+
+    for(lane=0; lane<CAN_XR_LANES; lane++)
+    {
+	if(logs[0][lane].n_data_ind != logs[1][lane].n_data_ind
+	   || logs[0][lane].n_data_conf != logs[1][lane].n_data_conf
+	   || logs[0][lane].hash != logs[1][lane].hash)
+	{
+	    printf("! lane %d: %d/%d data_ind, %d/%d data_conf, upcalls %s\n",
+		   lane, logs[0][lane].n_data_ind, logs[1][lane].n_data_ind,
+		   logs[0][lane].n_data_conf, logs[1][lane].n_data_conf,
+		   logs[0][lane].hash != logs[1][lane].hash
+		   ? "differ" : "agree");
+	    errors++;
+	}
+
+	n_data_ind += logs[0][lane].n_data_ind;
+	n_data_conf += logs[0][lane].n_data_conf;
+    }
+
+    if(n_data_ind == 0 || n_data_conf == 0)
+    {
+	printf("! scenario too weak, %d data_ind, %d data_conf\n",
+	       n_data_ind, n_data_conf);
+	errors++;
+    }
+
+    printf("# %s: %d lanes, %d ticks, %d data_ind, %d data_conf, %d errors\n",
+	   scenario_names[scenario], CAN_XR_LANES, N_TICKS,
+	   n_data_ind, n_data_conf, errors);
+
+    /* Speed */
+    init();
+    t_scalar = run(1, 0, &errors);
+    init();
+    t_lanes = run(0, 1, &errors);
+
+    printf("# %s: scalar %.3fs, %.1fM controller-ticks/s\n",
+	   scenario_names[scenario], t_scalar, t_scalar > 0.0
+	   ? (double)N_TICKS * CAN_XR_LANES / t_scalar / 1e6 : 0.0);
+    printf("# %s: lanes %.3fs, %.1fM controller-ticks/s, speedup %.1fx\n",
+	   scenario_names[scenario], t_lanes, t_lanes > 0.0
+	   ? (double)N_TICKS * CAN_XR_LANES / t_lanes / 1e6 : 0.0,
+	   t_lanes > 0.0 ? t_scalar / t_lanes : 0.0);
+
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* No trace at all, the stimulus provokes errors on purpose. */
+    SET_TRACE_TRESHOLD(10);
+
+    stimulus = malloc(N_TICKS * sizeof(CAN_XR_Lanes_Word));
+
+    errors += test(MIXED);
+    errors += test(SWEEP);
+
+    free(stimulus);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,277 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CAN_XR_CRC.h>
+
+
+/* This program checks that all CRC-15 engines agree with the bit
+   engine on full 8-byte CBFF frames, placed at all bit offsets within
+   a byte, and on a long unaligned stream.  Then, it compares their
+   speed.
+*/
+
+#define N_FRAMES 200000
+#define FRAME_BITS (1 + 11 + 3 + 4 + 64) /* SOF to the end of data */
+#define FRAME_BYTES 14 /* FRAME_BITS + CRC + offset */
+
+#define STREAM_BYTES (1024 * 1024)
+#define STREAM_PASSES 4
+
+#define N_ENGINES 3
+const char *engine_names[N_ENGINES] = { "bit", "byte", "slice" };
+
+struct frame
+{
+    unsigned long offset; /* First bit in packed[] */
+    uint16_t crc; /* Reference CRC */
+    uint8_t packed[FRAME_BYTES];
+};
+
+struct frame *frames;
+uint8_t *stream;
+struct CAN_XR_CRC_Slice_Tables slice_tables;
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+static void put_bit(uint8_t *packed, unsigned long i, int b)
+{
+    if(b)
+	packed[i >> 3] |= 0x80 >> (i & 0x7);
+    else
+	packed[i >> 3] &= ~(0x80 >> (i & 0x7));
+}
+
+/* Run 'engine' on 'n_bits' bits of 'data', from 'first_bit'. */
+static uint16_t run_engine(
+    int engine, const uint8_t *data,
+    unsigned long first_bit, unsigned long n_bits)
+{
+    switch(engine)
+    {
+    case 0:
+	return CAN_XR_CRC_Bits_Update(0, data, first_bit, n_bits);
+    case 1:
+	return CAN_XR_CRC_Update(0, data, first_bit, n_bits);
+    default:
+	return CAN_XR_CRC_Slice_Update(
+	    &slice_tables, 0, data, first_bit, n_bits);
+    }
+}
+
+/* Build frame 'f', with a random identifier and data, at 'offset'.
+   The reference CRC is calculated on the unpacked bits, then
+   appended.
+*/
+void build_frame(struct frame *f, unsigned long offset, unsigned long *seed)
+{
+    uint8_t bits[FRAME_BITS + 15];
+    uint32_t identifier = rnd(seed) % 0x800;
+    int n = 0, i, j, byte;
+
+    bits[n++] = 0; /* SOF */
+    for(i=10; i>=0; i--)  bits[n++] = (identifier >> i) & 0x1;
+    for(i=0; i<3; i++)  bits[n++] = 0; /* RTR, IDE, FDF/r0 */
+    for(i=3; i>=0; i--)  bits[n++] = (8 >> i) & 0x1; /* DLC */
+    for(j=0; j<8; j++)
+    {
+	byte = rnd(seed) & 0xFF;
+	for(i=7; i>=0; i--)  bits[n++] = (byte >> i) & 0x1;
+    }
+
+    f->crc = 0;
+    for(i=0; i<FRAME_BITS; i++)
+	f->crc = CAN_XR_CRC_Bit(f->crc, bits[i]);
+    for(i=14; i>=0; i--)  bits[n++] = (f->crc >> i) & 0x1;
+
+    /* Garbage around the frame must not matter */
+    for(i=0; i<FRAME_BYTES; i++)
+	f->packed[i] = rnd(seed);
+    f->offset = offset;
+    for(i=0; i<n; i++)
+	put_bit(f->packed, offset + i, bits[i]);
+}
+
+/* Check that all engines compute the reference CRC of 'f', and zero
+   once the CRC is included.  Return the number of errors.
+*/
+int check_frame(const struct frame *f)
+{
+    uint16_t crc;
+    int errors = 0;
+    int e;
+
+    for(e=0; e<N_ENGINES; e++)
+    {
+	crc = run_engine(e, f->packed, f->offset, FRAME_BITS);
+	if(crc != f->crc)
+	{
+	    printf("! offset %lu, %s engine: 0x%04X vs. 0x%04X\n",
+		   f->offset, engine_names[e], crc, f->crc);
+	    errors++;
+	}
+
+	crc = run_engine(e, f->packed, f->offset, FRAME_BITS + 15);
+	if(crc != 0)
+	{
+	    printf("! offset %lu, %s engine: 0x%04X with CRC\n",
+		   f->offset, engine_names[e], crc);
+	    errors++;
+	}
+    }
+
+    return errors;
+}
+
+/* Check all engines on all head and tail alignments, on the first
+   bits of the stream, then on all of it.  Return the number of errors.
+*/
+int check_stream(void)
+{
+    unsigned long first_bit, n_bits;
+    uint16_t crc[N_ENGINES];
+    int errors = 0;
+    int e;
+
+    for(first_bit=0; first_bit<16; first_bit++)
+	for(n_bits=0; n_bits<=8*8*CAN_XR_CRC_SLICES; n_bits++)
+	    for(e=0; e<N_ENGINES; e++)
+	    {
+		crc[e] = run_engine(e, stream, first_bit, n_bits);
+		if(crc[e] != crc[0])
+		{
+		    printf("! stream %lu+%lu, %s engine: 0x%04X vs. 0x%04X\n",
+			   first_bit, n_bits, engine_names[e], crc[e], crc[0]);
+		    errors++;
+		}
+	    }
+
+    for(e=0; e<N_ENGINES; e++)
+    {
+	crc[e] = run_engine(e, stream, 3, 8*STREAM_BYTES-3);
+	if(crc[e] != crc[0])
+	{
+	    printf("! stream, %s engine: 0x%04X vs. 0x%04X\n",
+		   engine_names[e], crc[e], crc[0]);
+	    errors++;
+	}
+    }
+
+    return errors;
+}
+
+/* Time 'engine' on all frames, return the elapsed time. */
+double time_frames(int engine, uint16_t *sum)
+{
+    clock_t start = clock();
+    int i;
+
+    for(i=0; i<N_FRAMES; i++)
+	*sum ^= run_engine(engine, frames[i].packed, frames[i].offset,
+			   FRAME_BITS);
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Time 'engine' on the stream, return the elapsed time. */
+double time_stream(int engine, uint16_t *sum)
+{
+    clock_t start = clock();
+    int i;
+
+    for(i=0; i<STREAM_PASSES; i++)
+	*sum ^= run_engine(engine, stream, 3, 8*STREAM_BYTES-3);
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long seed = 1;
+    double t[N_ENGINES];
+    uint16_t sum[N_ENGINES];
+    int errors = 0;
+    int i, e;
+
+    CAN_XR_CRC_Slice_Init(&slice_tables);
+
+    frames = malloc(N_FRAMES * sizeof(struct frame));
+    stream = malloc(STREAM_BYTES);
+    for(i=0; i<N_FRAMES; i++)
+	build_frame(&frames[i], i % 8, &seed);
+    for(i=0; i<STREAM_BYTES; i++)
+	stream[i] = rnd(&seed);
+
+    for(i=0; i<N_FRAMES && errors < 10; i++)
+	errors += check_frame(&frames[i]);
+    errors += check_stream();
+
+    printf("# %d frames, %d-byte stream, %d errors\n",
+	   N_FRAMES, STREAM_BYTES, errors);
+
+    /* Speed.  The sums, which must agree, keep the compiler from
+       optimizing the calls away.
+    */
+    for(e=0; e<N_ENGINES; e++)
+    {
+	sum[e] = 0;
+	t[e] = time_frames(e, &sum[e]);
+	if(sum[e] != sum[0])
+	    errors++;
+    }
+
+    for(e=0; e<N_ENGINES; e++)
+	printf("# frames, %s engine: %.3fs, %.1fM frames/s, speedup %.1fx\n",
+	       engine_names[e], t[e],
+	       t[e] > 0.0 ? N_FRAMES / t[e] / 1e6 : 0.0,
+	       t[e] > 0.0 ? t[0] / t[e] : 0.0);
+
+    for(e=0; e<N_ENGINES; e++)
+    {
+	sum[e] = 0;
+	t[e] = time_stream(e, &sum[e]);
+	if(sum[e] != sum[0])
+	    errors++;
+    }
+
+    for(e=0; e<N_ENGINES; e++)
+	printf("# stream, %s engine: %.3fs, %.1fMB/s, speedup %.1fx\n",
+	       engine_names[e], t[e],
+	       t[e] > 0.0 ? STREAM_PASSES * STREAM_BYTES / t[e] / 1e6 : 0.0,
+	       t[e] > 0.0 ? t[0] / t[e] : 0.0);
+
+    free(frames);
+    free(stream);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_PMA_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Ref_Encoder.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the bit stream that MAC_Data.Request encodes
+   against a straightforward, bit-by-bit encoder, on random requests.
+   Identifiers come from a small set, so that the stuffed header cache
+   sees hits, misses, and entries shared by different identifiers and
+   DLCs.
+*/
+
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define N_REQUESTS 100000
+#define N_IDENTIFIERS 24
+
+#define MAX_FRAME_BITS (CAN_XR_MAC_TX_BITSTREAM_WORDS * 32)
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+int main(int argc, char *argv[])
+{
+    struct CAN_XR_PMA pma;
+    struct CAN_XR_PCS pcs;
+    struct CAN_XR_MAC mac;
+    const struct CAN_XR_MAC_TX_Slot *slot;
+    uint8_t bits[MAX_FRAME_BITS];
+    uint8_t data[8];
+    unsigned long seed = 1;
+    uint32_t identifier;
+    int dlc, n_bits, bit;
+    int errors = 0, max_bits = 0;
+    int i, j;
+
+    SET_TRACE_TRESHOLD(3);
+
+    CAN_XR_PMA_Sim_Init(&pma);
+    CAN_XR_PCS_Init(&pcs, &pcs_parameters, &pma);
+    CAN_XR_MAC_Common_Init(&mac, &pcs);
+
+    for(i=0; i<N_REQUESTS && errors < 10; i++)
+    {
+	identifier = (rnd(&seed) % N_IDENTIFIERS) * 0x55;
+	dlc = rnd(&seed) % 16;
+	for(j=0; j<8; j++)
+	    data[j] = (rnd(&seed) % 4 == 0) ? 0x00 : rnd(&seed);
+
+	/* No transmission takes place, abort the request once
+	   checked, to free its slot for the next one.
+	*/
+	CAN_XR_MAC_Data_Req(&mac, identifier, CAN_XR_FORMAT_CBFF, dlc, data);
+	slot = &mac.state.tx_slots[mac.state.tx_queue[0]];
+
+	n_bits = CAN_XR_Ref_Encode(identifier, dlc, data, 1, bits);
+	if(n_bits > max_bits)
+	    max_bits = n_bits;
+
+	if(slot->bitstream_bits != n_bits)
+	{
+	    printf("! request %d, id=%lu, dlc=%d: %d bits vs. %d\n",
+		   i, (unsigned long)identifier, dlc,
+		   slot->bitstream_bits, n_bits);
+	    errors++;
+	}
+
+	else
+	    for(j=0; j<n_bits; j++)
+	    {
+		bit = (slot->bitstream[j / 32] >> (31 - j % 32)) & 0x1;
+		if(bit != bits[j])
+		{
+		    printf("! request %d, id=%lu, dlc=%d: bit %d differs\n",
+			   i, (unsigned long)identifier, dlc, j);
+		    errors++;
+		    break;
+		}
+	    }
+
+	CAN_XR_MAC_Abort_Req(&mac, identifier);
+	if(mac.state.data_req_pending != 0)
+	{
+	    printf("! request %d, id=%lu: not aborted\n",
+		   i, (unsigned long)identifier);
+	    errors++;
+	}
+    }
+
+    printf("# %d requests, longest frame %d bits, %d errors\n",
+	   i, max_bits, errors);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
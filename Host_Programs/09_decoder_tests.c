@@ -0,0 +1,440 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CAN_XR_PMA_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Decoder.h>
+#include <CAN_XR_Ref_Encoder.h>
+#include <CAN_XR_Event_Log.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program synthesizes raw bus captures, with frames sent by
+   transmitters whose clock is slightly off, missing ACKs, corrupted
+   bits, error flags and glitches.  It decodes them with a
+   PMA/PCS/MAC stack fed one tick at a time, which is the reference,
+   and with CAN_XR_Decoder, both in one go and in chunks of random
+   size.  Frames and timestamps must be the same.
+
+   Then, it decodes them again with a pool of workers, with several
+   numbers of workers and tasks.  The frames and the final decoder
+   state must be exactly the same as in the single-threaded decode.
+
+   Last, it compares their speed.
+*/
+
+#define N_PARAMETERS 4
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters[N_PARAMETERS] = {
+    { .prescaler_m = 1, .sync_seg = 1, .prop_seg = 1,
+      .phase_seg1 = 2, .phase_seg2 = 2, .sjw = 1 },
+    { .prescaler_m = 1, .sync_seg = 1, .prop_seg = 2,
+      .phase_seg1 = 3, .phase_seg2 = 4, .sjw = 4 },
+    { .prescaler_m = 2, .sync_seg = 1, .prop_seg = 5,
+      .phase_seg1 = 2, .phase_seg2 = 2, .sjw = 2 },
+    { .prescaler_m = 3, .sync_seg = 1, .prop_seg = 8,
+      .phase_seg1 = 8, .phase_seg2 = 8, .sjw = 4 }
+};
+
+#define CAPTURE_BITS 500000UL
+#define MAX_CAPTURE_TICKS (CAPTURE_BITS * 3 * 25) /* Slowest bit rate */
+#define MAX_CHUNK 100000
+#define MAX_EVENTS 100000
+
+#define N_POOLS 4
+const int pool_workers[N_POOLS] = { 1, 2, 4, 8 };
+const unsigned long pool_tasks[N_POOLS] = { 1, 7, 64, 256 };
+#define MAX_WORKERS 8
+#define MAX_TASKS 256
+
+struct capture
+{
+    uint64_t *samples;
+    unsigned long n_samples;
+    unsigned long max_ticks;
+};
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+/* The LLC of both the reference MAC and the decoder is their event
+   log.
+*/
+static void log_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    CAN_XR_Event_Log_Add((struct CAN_XR_Event_Log *)llc, 0,
+			 CAN_XR_EVENT_DATA_IND, ts, identifier, dlc, data);
+}
+
+/* The reference MAC does not drive the bus, it only listens */
+static void no_data_req(struct CAN_XR_PMA *pma, int bus_level)
+{
+}
+
+/* Append 'ticks' ticks at 'level' to the capture, which is initially
+   all dominant, up to max_ticks.
+*/
+static void put_level(struct capture *c, int level, unsigned long ticks)
+{
+    unsigned long i;
+
+    if(c->n_samples + ticks > c->max_ticks)
+	ticks = c->max_ticks - c->n_samples;
+
+    if(level)
+	for(i=c->n_samples; i<c->n_samples + ticks; i++)
+	    c->samples[i >> 6] |= (uint64_t)1 << (i & 0x3F);
+
+    c->n_samples += ticks;
+}
+
+/* Invert 'ticks' ticks of the capture starting from 'first'. */
+static void glitch(struct capture *c, unsigned long first, unsigned long ticks)
+{
+    unsigned long i;
+
+    for(i=first; i<first + ticks && i<c->n_samples; i++)
+	c->samples[i >> 6] ^= (uint64_t)1 << (i & 0x3F);
+}
+
+/* Fill the capture with CAPTURE_BITS bits of random traffic, sent
+   with nominal bit time 'bit_ticks'.
+*/
+void build_capture(struct capture *c, unsigned long bit_ticks,
+		   unsigned long *seed)
+{
+    uint8_t bits[CAN_XR_REF_ENCODER_MAX_BITS];
+    uint8_t data[8];
+    unsigned long t, t_bit; /* Transmitter time and bit time, 1/256 tick */
+    unsigned long start, n_bits;
+    int i, truncate;
+
+    memset(c->samples, 0, MAX_CAPTURE_TICKS / 8 + 16);
+    c->n_samples = 0;
+    c->max_ticks = CAPTURE_BITS * bit_ticks;
+    t = 0;
+
+    /* Start with some idle time, so that bus integration completes */
+    put_level(c, 1, 20 * bit_ticks);
+    t = c->n_samples << 8;
+
+    while(c->n_samples < c->max_ticks)
+    {
+	for(i=0; i<8; i++)  data[i] = rnd(seed);
+	n_bits = CAN_XR_Ref_Encode(
+	    rnd(seed) % 0x800, rnd(seed) % 16, data, 0, bits);
+
+	/* Most transmitters are within 0.5% of the nominal bit time,
+	   a few are way off.
+	*/
+	t_bit = bit_ticks * 256;
+	if(rnd(seed) % 10 == 0)
+	    t_bit = t_bit + t_bit * (rnd(seed) % 81) / 1000 - t_bit * 4 / 100;
+	else
+	    t_bit = t_bit + t_bit * (rnd(seed) % 11) / 1000 - t_bit * 5 / 1000;
+
+	/* Corrupt a bit, drop the ACK, or cut the frame short with an
+	   error flag.
+	*/
+	truncate = 0;
+	switch(rnd(seed) % 24)
+	{
+	case 0:
+	    i = rnd(seed) % n_bits;
+	    bits[i] = 1 - bits[i];
+	    break;
+	case 1:
+	    bits[n_bits - 9] = 1;
+	    break;
+	case 2:
+	    truncate = 1 + rnd(seed) % (n_bits - 1);
+	    break;
+	}
+
+	start = c->n_samples;
+	for(i=0; i<n_bits && (!truncate || i < truncate); i++)
+	{
+	    put_level(c, bits[i], ((t + t_bit) >> 8) - (t >> 8));
+	    t += t_bit;
+	}
+
+	if(truncate)
+	{
+	    put_level(c, 0, ((t + 6 * t_bit) >> 8) - (t >> 8));
+	    t += 6 * t_bit;
+	    put_level(c, 1, ((t + 8 * t_bit) >> 8) - (t >> 8));
+	    t += 8 * t_bit;
+	}
+
+	/* Short glitch somewhere in the frame */
+	if(rnd(seed) % 10 == 0)
+	    glitch(c, start + rnd(seed) % (c->n_samples - start),
+		   1 + rnd(seed) % (bit_ticks / 2 + 1));
+
+	/* Interframe space, may be too short for bus integration */
+	switch(rnd(seed) % 16)
+	{
+	case 0:
+	    n_bits = rnd(seed) % 12;
+	    break;
+	case 1:
+	    n_bits = rnd(seed) % 2000;
+	    break;
+	default:
+	    n_bits = 3 + rnd(seed) % 20;
+	    break;
+	}
+	put_level(c, 1, ((t + n_bits * t_bit) >> 8) - (t >> 8));
+	t += n_bits * t_bit;
+    }
+}
+
+/* Decode 'c' with the reference stack, return the elapsed time. */
+double reference(const struct CAN_XR_PCS_Bit_Time_Parameters *parameters,
+		 const struct capture *c, struct CAN_XR_Event_Log *log)
+{
+    struct CAN_XR_PMA pma;
+    struct CAN_XR_PCS pcs;
+    struct CAN_XR_MAC mac;
+    clock_t start = clock();
+    unsigned long i;
+
+    CAN_XR_PMA_Sim_Init(&pma);
+    CAN_XR_PCS_Init(&pcs, parameters, &pma);
+    CAN_XR_MAC_Common_Init(&mac, &pcs);
+    CAN_XR_MAC_Set_LLC(&mac, (struct CAN_XR_LLC *)log);
+    CAN_XR_MAC_Set_Data_Ind(&mac, log_data_ind);
+    CAN_XR_MAC_Set_Bus_Monitoring(&mac, 1);
+    pma.primitives.data_req = no_data_req;
+
+    log->n_events = 0;
+    for(i=0; i<c->n_samples; i++)
+	CAN_XR_PMA_Sim_NodeClock_Ind(
+	    &pma, (int)(c->samples[i >> 6] >> (i & 0x3F)) & 0x1);
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Decode 'c' with CAN_XR_Decoder, in one go if 'seed' is NULL, in
+   chunks of random size otherwise.  Return the elapsed time.
+*/
+double decode(const struct CAN_XR_PCS_Bit_Time_Parameters *parameters,
+	      const struct capture *c, struct CAN_XR_Event_Log *log,
+	      unsigned long *seed, struct CAN_XR_Decoder *dec)
+{
+    uint64_t chunk[MAX_CHUNK / 64 + 2];
+    unsigned long first, n, i, shift;
+    clock_t start = clock();
+
+    CAN_XR_Decoder_Init(dec, parameters);
+    CAN_XR_Decoder_Set_LLC(dec, (struct CAN_XR_LLC *)log);
+    CAN_XR_Decoder_Set_Data_Ind(dec, log_data_ind);
+
+    log->n_events = 0;
+    if(seed == NULL)
+	CAN_XR_Decoder_Run(dec, c->samples, c->n_samples);
+
+    else
+	for(first=0; first<c->n_samples; first+=n)
+	{
+	    /* Move the chunk to the beginning of a word */
+	    n = 1 + rnd(seed) % MAX_CHUNK;
+	    if(n > c->n_samples - first)
+		n = c->n_samples - first;
+
+	    shift = first & 0x3F;
+	    for(i=0; i<(n + 63) / 64; i++)
+		chunk[i] = (c->samples[(first >> 6) + i] >> shift)
+		    | (shift ? c->samples[(first >> 6) + i + 1] << (64 - shift)
+		       : 0);
+
+	    CAN_XR_Decoder_Run(dec, chunk, n);
+	}
+
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Decode 'c' with a pool of 'n_workers' workers and 'n_tasks' tasks,
+   return the elapsed time.
+*/
+double decode_parallel(
+    const struct CAN_XR_PCS_Bit_Time_Parameters *parameters,
+    const struct capture *c, struct CAN_XR_Event_Log *log,
+    int n_workers, unsigned long n_tasks, struct CAN_XR_Decoder *dec)
+{
+    struct CAN_XR_Decoder_Worker workers[MAX_WORKERS];
+    struct CAN_XR_Decoder_Task tasks[MAX_TASKS + 1];
+    struct CAN_XR_Decoder_Pool pool;
+    struct CAN_XR_Decoder_Frame *frames;
+    unsigned long max_frames =
+	CAN_XR_DECODER_MAX_FRAMES(parameters, c->n_samples, n_tasks);
+    clock_t start;
+    double t;
+
+    frames = malloc(max_frames * sizeof(struct CAN_XR_Decoder_Frame));
+    CAN_XR_Decoder_Pool_Init(&pool, workers, n_workers,
+			     tasks, n_tasks, frames, max_frames);
+
+    start = clock();
+    CAN_XR_Decoder_Init(dec, parameters);
+    CAN_XR_Decoder_Set_LLC(dec, (struct CAN_XR_LLC *)log);
+    CAN_XR_Decoder_Set_Data_Ind(dec, log_data_ind);
+
+    log->n_events = 0;
+    CAN_XR_Decoder_Run_Parallel(dec, &pool, c->samples, c->n_samples);
+    t = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    free(frames);
+    return t;
+}
+
+/* Check that an event log and the final state of a decoder are
+   exactly the same as another's.  Return the number of differences.
+*/
+int compare_exact(const char *what,
+		  const struct CAN_XR_Event_Log *seq, const struct CAN_XR_Event_Log *log,
+		  const struct CAN_XR_Decoder_State *seq_state,
+		  const struct CAN_XR_Decoder_State *state)
+{
+    int errors = 0;
+
+    if(log->n_events != seq->n_events
+       || memcmp(log->events, seq->events,
+		 seq->n_events * sizeof(struct CAN_XR_Event)))
+    {
+	printf("! %s: events differ\n", what);
+	errors++;
+    }
+
+    if(state->nodeclock_ts != seq_state->nodeclock_ts
+       || state->quantum_ts != seq_state->quantum_ts
+       || state->quantum_m_cnt != seq_state->quantum_m_cnt
+       || state->prev_bus_level != seq_state->prev_bus_level
+       || state->rx_fsm_state != seq_state->rx_fsm_state
+       || state->edges != seq_state->edges
+       || state->frames != seq_state->frames
+       || state->errors != seq_state->errors)
+    {
+	printf("! %s: final state differs\n", what);
+	errors++;
+    }
+
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    struct capture c;
+    struct CAN_XR_Event_Log ref, seq, log;
+    struct CAN_XR_Decoder dec;
+    struct CAN_XR_Decoder_State seq_state;
+    unsigned long seed = 1;
+    double t_ref = 0.0, t_dec = 0.0, t_pool[N_POOLS] = { 0.0 };
+    unsigned long ticks = 0;
+    char what[64];
+    int errors = 0;
+    int p, i;
+
+    /* The reference MAC traces errors at level 9 */
+    SET_TRACE_TRESHOLD(10);
+
+    c.samples = malloc(MAX_CAPTURE_TICKS / 8 + 16);
+    CAN_XR_Event_Log_Init(
+	&ref, malloc(MAX_EVENTS * sizeof(struct CAN_XR_Event)), MAX_EVENTS);
+    CAN_XR_Event_Log_Init(
+	&seq, malloc(MAX_EVENTS * sizeof(struct CAN_XR_Event)), MAX_EVENTS);
+    CAN_XR_Event_Log_Init(
+	&log, malloc(MAX_EVENTS * sizeof(struct CAN_XR_Event)), MAX_EVENTS);
+
+    for(p=0; p<N_PARAMETERS; p++)
+    {
+	build_capture(
+	    &c,
+	    pcs_parameters[p].prescaler_m
+	    * (pcs_parameters[p].sync_seg + pcs_parameters[p].prop_seg
+	       + pcs_parameters[p].phase_seg1 + pcs_parameters[p].phase_seg2),
+	    &seed);
+
+	ticks += c.n_samples;
+	t_ref += reference(&pcs_parameters[p], &c, &ref);
+	t_dec += decode(&pcs_parameters[p], &c, &seq, NULL, &dec);
+	errors += CAN_XR_Event_Log_Compare("one go", &ref, &seq);
+	seq_state = dec.state;
+
+	printf("# parameters %d: %lu ticks, %lu edges, %lu frames, %lu errors\n",
+	       p, c.n_samples, seq_state.edges, seq_state.frames,
+	       seq_state.errors);
+
+	decode(&pcs_parameters[p], &c, &log, &seed, &dec);
+	errors += CAN_XR_Event_Log_Compare("chunks", &ref, &log);
+
+	for(i=0; i<N_POOLS; i++)
+	{
+	    t_pool[i] += decode_parallel(
+		&pcs_parameters[p], &c, &log,
+		pool_workers[i], pool_tasks[i], &dec);
+
+	    sprintf(what, "%d workers, %lu tasks",
+		    pool_workers[i], pool_tasks[i]);
+	    errors += compare_exact(what, &seq, &log, &seq_state, &dec.state);
+	}
+
+	/* The frames must not be too few, nor all good */
+	if(ref.n_events < 1000 || seq_state.errors < 100)
+	{
+	    printf("! parameters %d: scenario too weak\n", p);
+	    errors++;
+	}
+    }
+
+    printf("# %d errors\n", errors);
+    printf("# reference: %.3fs, %.1fMB/s\n", t_ref,
+	   t_ref > 0.0 ? ticks / 8 / t_ref / 1e6 : 0.0);
+    printf("# decoder: %.3fs, %.1fMB/s, speedup %.1fx\n", t_dec,
+	   t_dec > 0.0 ? ticks / 8 / t_dec / 1e6 : 0.0,
+	   t_dec > 0.0 ? t_ref / t_dec : 0.0);
+
+    /* clock() is the CPU time of all threads */
+    for(i=0; i<N_POOLS; i++)
+	printf("# %d workers, %lu tasks: %.3fs of CPU time\n",
+	       pool_workers[i], pool_tasks[i], t_pool[i]);
+
+    free(c.samples);
+    free(ref.events);
+    free(seq.events);
+    free(log.events);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
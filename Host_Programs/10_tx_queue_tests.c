@@ -0,0 +1,363 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_Frame_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Event_Log.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the TX slots of the MAC.  A node submits a
+   burst of frames, more than it has slots for, and aborts one of
+   them.  It also submits a late, high-priority frame from data_conf,
+   and tries to abort the frame being transmitted.  Another node
+   receives the frames.
+
+   The frames must go out in priority order, back to back, that is,
+   with just the 3 bits of intermission between the last EOF bit of a
+   frame and the SOF of the next one.  The same scenario runs on the
+   frame-level simulator, which must produce the same upcalls.
+*/
+
+/* 10 quanta per bit, like 03_bus_tests. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 10
+
+#define N_BURST (CAN_XR_MAC_TX_SLOTS + 2)
+#define LATE_ID 0x010
+#define ABORTED 5 /* Frame of the burst aborted before the run */
+#define MAX_TICKS 100000
+#define MAX_EVENTS (4 * N_BURST)
+
+/* Log of all MAC upcalls.  The first data byte of each frame is its
+   position in the burst, or N_BURST for the late frame.  Node 0
+   transmits, node 1 receives.
+*/
+struct CAN_XR_Event events[2][MAX_EVENTS];
+struct CAN_XR_Event_Log logs[2];
+
+struct CAN_XR_MAC_Frame burst[N_BURST];
+uint8_t payloads[N_BURST + 1][8];
+
+struct CAN_XR_MAC *tx_mac;
+int late_pending;
+
+/* Length of the frames confirmed by the bit-level MAC, in bits */
+int frame_bits[MAX_EVENTS];
+int n_frame_bits;
+
+/* The receiver logs frames, the transmitter does not. */
+void rx_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    CAN_XR_Event_Log_Add(CAN_XR_Event_Log_Current, 1, CAN_XR_EVENT_DATA_IND,
+			 ts, identifier, dlc, data);
+}
+
+/* The transmitter submits the late frame when the first frame of the
+   burst is confirmed.  The bit-level MAC still has the length of the
+   frame just transmitted in tx_bitstream_bits.
+*/
+void tx_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    CAN_XR_Event_Log_Add(CAN_XR_Event_Log_Current, 0, CAN_XR_EVENT_DATA_CONF,
+			 ts, identifier, transmission_status, NULL);
+
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS
+       && ts > 0 && n_frame_bits < MAX_EVENTS)
+	frame_bits[n_frame_bits++] = tx_mac->state.tx_bitstream_bits;
+
+    if(late_pending && transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	late_pending = 0;
+	CAN_XR_MAC_Data_Req(tx_mac, LATE_ID, CAN_XR_FORMAT_CBFF, 8,
+			    payloads[N_BURST]);
+    }
+}
+
+/* Identifiers are distinct, except for frames 1 and 3, which must go
+   out in the order they were submitted.
+*/
+void build_burst(void)
+{
+    int k, j;
+
+    for(k=0; k<=N_BURST; k++)
+	for(j=0; j<8; j++)
+	    payloads[k][j] = (j == 0) ? k : (uint8_t)(k * 0x35 + j);
+
+    for(k=0; k<N_BURST; k++)
+    {
+	burst[k].identifier = 0x100 + (k * 0x2B5) % 0x600;
+	burst[k].format = CAN_XR_FORMAT_CBFF;
+	burst[k].dlc = 1 + k % 8;
+	burst[k].data = payloads[k];
+    }
+    burst[3].identifier = burst[1].identifier;
+}
+
+/* Submit the burst to 'mac', then abort frame ABORTED. */
+void submit(struct CAN_XR_MAC *mac)
+{
+    tx_mac = mac;
+    late_pending = 1;
+    n_frame_bits = 0;
+
+    CAN_XR_MAC_Data_Req_Burst(mac, burst, N_BURST);
+    CAN_XR_MAC_Abort_Req(mac, burst[ABORTED].identifier);
+}
+
+void setup(struct CAN_XR_MAC *tx, struct CAN_XR_MAC *rx)
+{
+    CAN_XR_MAC_Set_Data_Conf(tx, tx_data_conf);
+    CAN_XR_MAC_Set_Data_Ind(rx, rx_data_ind);
+}
+
+/* Bit-level run.  The bus goes one tick at a time, and the
+   transmitter tries to abort the frame it is transmitting right after
+   it starts the second one.  Return the number of errors.
+*/
+int run_bus(void)
+{
+    struct CAN_XR_Bus_Node nodes[2];
+    struct CAN_XR_Bus bus;
+    struct CAN_XR_MAC *mac;
+    int n_events, n_started = 0, prev_slot = -1;
+    int errors = 0;
+    unsigned long t;
+
+    CAN_XR_Event_Log_Init(&logs[0], events[0], MAX_EVENTS);
+    CAN_XR_Event_Log_Current = &logs[0];
+
+    CAN_XR_Bus_Init(&bus, nodes, 2, &pcs_parameters);
+    mac = CAN_XR_Bus_MAC(&bus, 0);
+    setup(mac, CAN_XR_Bus_MAC(&bus, 1));
+    submit(mac);
+
+    for(t=0; t<MAX_TICKS; t++)
+    {
+	CAN_XR_Bus_Run(&bus, 1);
+
+	if(mac->state.tx_slot >= 0 && prev_slot < 0 && ++n_started == 2)
+	{
+	    n_events = CAN_XR_Event_Log_Current->n_events;
+	    CAN_XR_MAC_Abort_Req(mac, mac->state.tx_identifier);
+	    if(CAN_XR_Event_Log_Current->n_events != n_events)
+	    {
+		printf("! frame %lu aborted while being transmitted\n",
+		       (unsigned long)mac->state.tx_identifier);
+		errors++;
+	    }
+	}
+	prev_slot = mac->state.tx_slot;
+    }
+
+    if(!CAN_XR_MAC_Is_Idle(mac))
+    {
+	printf("! transmitter not idle at the end\n");
+	errors++;
+    }
+
+    return errors;
+}
+
+struct CAN_XR_Frame_Sim_Node sim_nodes[2];
+struct CAN_XR_Bus_Node replay_nodes[2];
+struct CAN_XR_Frame_Sim sim;
+
+/* Frame-level run of the same scenario, without the abort of the
+   frame being transmitted, which has no effect anyway.
+*/
+void run_frame_sim(void)
+{
+    CAN_XR_Event_Log_Init(&logs[1], events[1], MAX_EVENTS);
+    CAN_XR_Event_Log_Current = &logs[1];
+
+    CAN_XR_Frame_Sim_Init(&sim, sim_nodes, 2, &pcs_parameters);
+    CAN_XR_Frame_Sim_Set_Verification(&sim, 1, replay_nodes);
+    setup(CAN_XR_Frame_Sim_MAC(&sim, 0), CAN_XR_Frame_Sim_MAC(&sim, 1));
+    submit(CAN_XR_Frame_Sim_MAC(&sim, 0));
+
+    CAN_XR_Frame_Sim_Run(&sim, MAX_TICKS);
+}
+
+/* Build the expected sequence of frames on the bus, as burst
+   positions.  Return its length.
+*/
+int expected_order(int *order)
+{
+    int n = 0;
+    int i, k;
+
+    /* Frames that fit in the slots and were not aborted, stable
+       insertion sort by identifier.
+    */
+    for(k=0; k<N_BURST && k<CAN_XR_MAC_TX_SLOTS; k++)
+    {
+	if(k == ABORTED)
+	    continue;
+
+	for(i=n; i>0 && burst[order[i-1]].identifier > burst[k].identifier; i--)
+	    order[i] = order[i-1];
+	order[i] = k;
+	n++;
+    }
+
+    /* The late frame goes right after the first one. */
+    for(i=n; i>1; i--)
+	order[i] = order[i-1];
+    order[1] = N_BURST;
+    return n + 1;
+}
+
+/* Check the bit-level log.  Return the number of errors. */
+int check(void)
+{
+    const struct CAN_XR_Event_Log *l = &logs[0];
+    int order[N_BURST + 1];
+    int n_order = expected_order(order);
+    int n_rejected = 0, n_aborted = 0, n_ind = 0, n_conf = 0;
+    unsigned long prev_ts = 0;
+    int errors = 0;
+    int i;
+
+    for(i=0; i<l->n_events; i++)
+    {
+	const struct CAN_XR_Event *e = &(l->events[i]);
+
+	if(e->kind == CAN_XR_EVENT_DATA_CONF
+	   && e->dlc_or_status != CAN_XR_MAC_TX_STATUS_SUCCESS)
+	{
+	    /* Immediate confirmations, overflow first, then abort */
+	    if(e->ts != 0)
+		errors++;
+	    else if(i < N_BURST - CAN_XR_MAC_TX_SLOTS)
+		n_rejected += (e->identifier
+			       == burst[CAN_XR_MAC_TX_SLOTS + i].identifier);
+	    else
+		n_aborted += (e->identifier == burst[ABORTED].identifier);
+	}
+
+	else if(e->kind == CAN_XR_EVENT_DATA_IND)
+	{
+	    if(n_ind >= n_order || e->data[0] != order[n_ind]
+	       || e->identifier != (order[n_ind] == N_BURST
+				    ? LATE_ID : burst[order[n_ind]].identifier))
+	    {
+		printf("! frame #%d is %lu (%d), expected %d\n", n_ind,
+		       (unsigned long)e->identifier, e->data[0],
+		       n_ind < n_order ? order[n_ind] : -1);
+		errors++;
+	    }
+	    n_ind++;
+	}
+
+	else
+	{
+	    /* Back to back: the frame takes frame_bits bits, plus
+	       intermission.  The transmitter decides to send SOF at
+	       its last bit.
+	    */
+	    if(n_conf > 0 && n_conf < n_frame_bits
+	       && e->ts - prev_ts != (frame_bits[n_conf] + 3) * BIT_TICKS)
+	    {
+		printf("! frame #%d confirmed @%lu, %lu ticks after the "
+		       "previous one, %d bits long\n",
+		       n_conf, e->ts, e->ts - prev_ts, frame_bits[n_conf]);
+		errors++;
+	    }
+	    prev_ts = e->ts;
+	    n_conf++;
+	}
+    }
+
+    if(n_rejected != N_BURST - CAN_XR_MAC_TX_SLOTS || n_aborted != 1
+       || n_ind != n_order || n_conf != n_order)
+    {
+	printf("! %d rejected, %d aborted, %d/%d frames received, "
+	       "%d confirmed\n", n_rejected, n_aborted, n_ind, n_order, n_conf);
+	errors++;
+    }
+
+    printf("# bit level: %d slots, %d frames, %d rejected, %d aborted, "
+	   "%d errors\n", CAN_XR_MAC_TX_SLOTS, n_ind, n_rejected, n_aborted,
+	   errors);
+
+    return errors;
+}
+
+/* Compare the frame-level log with the bit-level one. */
+int compare(void)
+{
+    int errors = 0;
+
+    errors += CAN_XR_Event_Log_Compare("frame level", &logs[0], &logs[1]);
+
+    if(sim.divergences != 0)
+    {
+	printf("! %lu divergences out of %lu verified frames\n",
+	       sim.divergences, sim.verified_frames);
+	errors++;
+    }
+
+    printf("# frame level: %d events, %d errors\n", logs[1].n_events, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors only */
+    SET_TRACE_TRESHOLD(9);
+
+    build_burst();
+
+    errors += run_bus();
+    errors += check();
+
+    run_frame_sim();
+    errors += compare();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,403 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_Frame_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_RX_FIFO.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the RX FIFO.  First, it fills a FIFO past its
+   size, from a single thread, and checks what comes out of it.  Then,
+   a producer thread puts sequence-numbered records into a FIFO as
+   fast as it can, while a consumer thread gets them, and checks that
+   records are neither reordered, nor corrupted, nor lost without
+   being counted.
+
+   Last, a simulation thread runs a transmitter and a receiver on the
+   bit-level bus and on the frame-level simulator, and a consumer
+   thread gets the frames the receiver puts into its FIFO.
+*/
+
+/* 10 quanta per bit, like 03_bus_tests. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define N_STRESS 8000000UL
+#define N_FRAMES 200
+#define FRAME_TICKS 1300 /* Upper bound of an 8-byte frame, in ticks */
+
+/* Payload of record 'seq'. */
+static void fill_data(uint8_t *data, unsigned long seq)
+{
+    int j;
+
+    for(j=0; j<8; j++)
+	data[j] = (uint8_t)(seq * 0x9D + j * 0x35);
+}
+
+/* Check record 'r', which must be 'seq', or come after 'seq' and the
+   records lost right before it.  Return the number of errors.
+*/
+static int check_record(const struct CAN_XR_RX_FIFO_Record *r,
+			unsigned long seq)
+{
+    uint8_t data[8];
+    int errors = 0;
+
+    if(r->identifier != (uint32_t)(seq + r->lost))
+    {
+	printf("! record %lu, expected %lu + %lu lost\n",
+	       (unsigned long)r->identifier, seq, r->lost);
+	errors++;
+    }
+
+    fill_data(data, r->identifier);
+    if(r->ts != r->identifier || r->format != CAN_XR_FORMAT_CBFF
+       || r->dlc != 8 || memcmp(r->data, data, sizeof(data)))
+    {
+	printf("! record %lu corrupted\n", (unsigned long)r->identifier);
+	errors++;
+    }
+
+    return errors;
+}
+
+static int put_seq(struct CAN_XR_RX_FIFO *fifo, unsigned long seq)
+{
+    uint8_t data[8];
+
+    fill_data(data, seq);
+    return CAN_XR_RX_FIFO_Put(fifo, seq, seq, CAN_XR_FORMAT_CBFF, 8, data);
+}
+
+/* Single thread.  Return the number of errors. */
+int check_overflow(void)
+{
+    struct CAN_XR_RX_FIFO fifo;
+    struct CAN_XR_RX_FIFO_Record r;
+    unsigned long seq, next = 0;
+    int errors = 0;
+
+    CAN_XR_RX_FIFO_Init(&fifo);
+    if(CAN_XR_RX_FIFO_Get(&fifo, &r))
+	errors++;
+
+    for(seq=0; seq<CAN_XR_RX_FIFO_SIZE+3; seq++)
+	if(put_seq(&fifo, seq) != (seq < CAN_XR_RX_FIFO_SIZE))
+	    errors++;
+
+    if(CAN_XR_RX_FIFO_Overflows(&fifo) != 3)
+	errors++;
+
+    /* Make room for one, the next record carries the loss */
+    if(!CAN_XR_RX_FIFO_Get(&fifo, &r))
+	errors++;
+    else
+	errors += check_record(&r, next++);
+    if(!put_seq(&fifo, seq++) || put_seq(&fifo, seq++))
+	errors++;
+
+    while(CAN_XR_RX_FIFO_Get(&fifo, &r))
+    {
+	errors += check_record(&r, next);
+	next = r.identifier + 1;
+    }
+
+    if(next != CAN_XR_RX_FIFO_SIZE + 4 || r.lost != 3
+       || CAN_XR_RX_FIFO_Overflows(&fifo) != 4)
+    {
+	printf("! overflow: last %lu, lost %lu, overflows %lu\n",
+	       next, r.lost, CAN_XR_RX_FIFO_Overflows(&fifo));
+	errors++;
+    }
+
+    printf("# overflow: %d errors\n", errors);
+    return errors;
+}
+
+/* Two threads sharing a FIFO.  'done' is set by the producer when it
+   has nothing more to put, 'produced' tells how many records it tried
+   to put.
+*/
+struct stress
+{
+    struct CAN_XR_RX_FIFO fifo;
+    int done;
+    unsigned long produced;
+    unsigned long received;
+    int errors;
+};
+
+struct stress stress;
+
+/* In the first half of the run, the producer yields to the consumer
+   every half FIFO, so that most records get through even on a single
+   CPU.  In the second half, it never yields, and many records are
+   lost.
+*/
+void *stress_producer(void *arg)
+{
+    struct stress *s = arg;
+    unsigned long seq;
+
+    for(seq=0; seq<N_STRESS; seq++)
+    {
+	put_seq(&s->fifo, seq);
+	if(seq < N_STRESS/2 && seq % (CAN_XR_RX_FIFO_SIZE/2) == 0)
+	    sched_yield();
+    }
+
+    s->produced = seq;
+    __atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Get records until the producer is done and the FIFO is empty. */
+void *stress_consumer(void *arg)
+{
+    struct stress *s = arg;
+    struct CAN_XR_RX_FIFO_Record r;
+    unsigned long next = 0;
+    int done;
+
+    do
+    {
+	done = __atomic_load_n(&s->done, __ATOMIC_ACQUIRE);
+
+	while(CAN_XR_RX_FIFO_Get(&s->fifo, &r))
+	{
+	    if(s->errors < 10)
+		s->errors += check_record(&r, next);
+	    next = r.identifier + 1;
+	    s->received++;
+	}
+
+	if(!done)
+	    sched_yield();
+    } while(!done);
+
+    return NULL;
+}
+
+/* Return the number of errors. */
+int check_stress(void)
+{
+    pthread_t producer, consumer;
+    clock_t start;
+    double t;
+    unsigned long overflows;
+
+    CAN_XR_RX_FIFO_Init(&stress.fifo);
+
+    start = clock();
+    pthread_create(&consumer, NULL, stress_consumer, &stress);
+    pthread_create(&producer, NULL, stress_producer, &stress);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    /* CPU time of both threads */
+    t = (double)(clock() - start) / CLOCKS_PER_SEC;
+    overflows = CAN_XR_RX_FIFO_Overflows(&stress.fifo);
+
+    if(stress.received + overflows != stress.produced)
+    {
+	printf("! %lu records received, %lu lost, of %lu\n",
+	       stress.received, overflows, stress.produced);
+	stress.errors++;
+    }
+
+    printf("# stress: %lu records, %lu received, %lu lost, %.3fs, "
+	   "%.1fM records/s, %d errors\n",
+	   stress.produced, stress.received, overflows, t,
+	   t > 0.0 ? stress.produced / t / 1e6 : 0.0, stress.errors);
+    return stress.errors;
+}
+
+/* Simulation runs.  The transmitter keeps its slots full with frames
+   numbered in data[0..1], and the receiver puts them into rx_fifo.
+   The consumer thread gets them until the simulation is over.
+*/
+struct CAN_XR_MAC *tx_mac;
+int n_submitted, n_confirmed;
+uint8_t payloads[N_FRAMES][8];
+
+struct stress sim_stress;
+
+void submit_next(void)
+{
+    if(n_submitted < N_FRAMES)
+    {
+	CAN_XR_MAC_Data_Req(tx_mac, 0x100, CAN_XR_FORMAT_CBFF, 8,
+			    payloads[n_submitted]);
+	n_submitted++;
+    }
+}
+
+void tx_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	n_confirmed++;
+	submit_next();
+    }
+}
+
+/* Frames carry their number in the first two data bytes. */
+void *sim_consumer(void *arg)
+{
+    struct stress *s = arg;
+    struct CAN_XR_RX_FIFO_Record r;
+    unsigned long next = 0, seq;
+    int done;
+
+    do
+    {
+	done = __atomic_load_n(&s->done, __ATOMIC_ACQUIRE);
+
+	while(CAN_XR_RX_FIFO_Get(&s->fifo, &r))
+	{
+	    seq = r.data[0] | (r.data[1] << 8);
+	    if(seq != next + r.lost || r.identifier != 0x100 || r.dlc != 8
+	       || memcmp(r.data, payloads[seq % N_FRAMES], 8))
+	    {
+		printf("! frame %lu, expected %lu + %lu lost\n",
+		       seq, next, r.lost);
+		s->errors++;
+	    }
+	    next = seq + 1;
+	    s->received++;
+	}
+
+	if(!done)
+	    sched_yield();
+    } while(!done);
+
+    return NULL;
+}
+
+void setup(struct CAN_XR_MAC *tx, struct CAN_XR_MAC *rx)
+{
+    int k;
+
+    for(k=0; k<N_FRAMES; k++)
+    {
+	fill_data(payloads[k], k);
+	payloads[k][0] = k & 0xFF;
+	payloads[k][1] = k >> 8;
+    }
+
+    tx_mac = tx;
+    n_submitted = n_confirmed = 0;
+    CAN_XR_MAC_Set_Data_Conf(tx, tx_data_conf);
+
+    memset(&sim_stress, 0, sizeof(sim_stress));
+    CAN_XR_RX_FIFO_Init(&sim_stress.fifo);
+    CAN_XR_MAC_Set_RX_FIFO(rx, &sim_stress.fifo);
+
+    for(k=0; k<CAN_XR_MAC_TX_SLOTS; k++)
+	submit_next();
+}
+
+/* Run the simulation with 'run' in this thread while the consumer
+   thread gets frames.  Return the number of errors.
+*/
+int check_sim(const char *name, void (*run)(void))
+{
+    pthread_t consumer;
+    unsigned long overflows;
+
+    pthread_create(&consumer, NULL, sim_consumer, &sim_stress);
+    run();
+    __atomic_store_n(&sim_stress.done, 1, __ATOMIC_RELEASE);
+    pthread_join(consumer, NULL);
+
+    overflows = CAN_XR_RX_FIFO_Overflows(&sim_stress.fifo);
+    if(n_confirmed != N_FRAMES
+       || sim_stress.received + overflows != N_FRAMES)
+    {
+	printf("! %s: %d frames confirmed, %lu received, %lu lost\n",
+	       name, n_confirmed, sim_stress.received, overflows);
+	sim_stress.errors++;
+    }
+
+    printf("# %s: %lu frames received, %lu lost, %d errors\n",
+	   name, sim_stress.received, overflows, sim_stress.errors);
+    return sim_stress.errors;
+}
+
+struct CAN_XR_Bus_Node bus_nodes[2];
+struct CAN_XR_Bus bus;
+
+void run_bus(void)
+{
+    CAN_XR_Bus_Run(&bus, (unsigned long)N_FRAMES * FRAME_TICKS);
+}
+
+struct CAN_XR_Frame_Sim_Node sim_nodes[2];
+struct CAN_XR_Frame_Sim sim;
+
+void run_frame_sim(void)
+{
+    CAN_XR_Frame_Sim_Run(&sim, (unsigned long)N_FRAMES * FRAME_TICKS);
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    SET_TRACE_TRESHOLD(9);
+
+    errors += check_overflow();
+    errors += check_stress();
+
+    CAN_XR_Bus_Init(&bus, bus_nodes, 2, &pcs_parameters);
+    setup(CAN_XR_Bus_MAC(&bus, 0), CAN_XR_Bus_MAC(&bus, 1));
+    errors += check_sim("bus", run_bus);
+
+    CAN_XR_Frame_Sim_Init(&sim, sim_nodes, 2, &pcs_parameters);
+    setup(CAN_XR_Frame_Sim_MAC(&sim, 0), CAN_XR_Frame_Sim_MAC(&sim, 1));
+    errors += check_sim("frame sim", run_frame_sim);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,391 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_Frame_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Filter.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the acceptance filter.  First, it compares
+   filters built from random identifiers and code/mask pairs with a
+   brute-force evaluation of the same rules, over the whole identifier
+   space.
+
+   Then, a node transmits frames with many different identifiers to a
+   node with a filter and to a node without.  All frames must be
+   acknowledged and confirmed, the node without a filter must receive
+   all of them, and the node with a filter exactly those it accepts,
+   with the same contents.  The same scenario runs on the frame-level
+   simulator, which must produce the same upcalls.
+*/
+
+/* 10 quanta per bit, like 03_bus_tests. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define N_RANDOM 1000
+#define MAX_RULES 8
+#define N_FRAMES 160
+#define MAX_TICKS (N_FRAMES * 1300UL)
+
+/* Filter rules, identifiers (mask 0x7FF) or code/mask pairs.  Rules
+   with remove set remove an identifier instead.
+*/
+struct rule
+{
+    uint32_t code;
+    uint32_t mask;
+    int remove;
+};
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+/* Brute-force evaluation of 'rules', applied in order. */
+static int brute_force(const struct rule *rules, int n_rules, uint32_t id)
+{
+    int accept = 0;
+    int i;
+
+    for(i=0; i<n_rules; i++)
+	if((id & rules[i].mask) == (rules[i].code & rules[i].mask))
+	    accept = !rules[i].remove;
+
+    return accept;
+}
+
+static void build_filter(struct CAN_XR_Filter *filter,
+			 const struct rule *rules, int n_rules)
+{
+    int i;
+
+    CAN_XR_Filter_Init(filter, 0);
+    for(i=0; i<n_rules; i++)
+    {
+	if(rules[i].remove)
+	    CAN_XR_Filter_Remove_Id(filter, rules[i].code);
+	else if(rules[i].mask == 0x7FF)
+	    CAN_XR_Filter_Add_Id(filter, rules[i].code);
+	else
+	    CAN_XR_Filter_Add_Mask(filter, rules[i].code, rules[i].mask);
+    }
+}
+
+/* Return the number of errors. */
+int check_random(void)
+{
+    struct CAN_XR_Filter filter;
+    struct rule rules[MAX_RULES];
+    unsigned long seed = 1;
+    int n_rules, errors = 0;
+    int i, k;
+    uint32_t id;
+
+    CAN_XR_Filter_Init(&filter, 1);
+    for(id=0; id<CAN_XR_FILTER_IDS; id++)
+	errors += !CAN_XR_Filter_Accepts(&filter, id);
+    errors += CAN_XR_Filter_Accepts(&filter, CAN_XR_FILTER_IDS);
+
+    for(k=0; k<N_RANDOM && errors < 10; k++)
+    {
+	n_rules = 1 + rnd(&seed) % MAX_RULES;
+	for(i=0; i<n_rules; i++)
+	{
+	    rules[i].code = rnd(&seed) & 0x7FF;
+	    rules[i].remove = (rnd(&seed) % 4 == 0);
+	    rules[i].mask = (rules[i].remove || rnd(&seed) % 2)
+		? 0x7FF : rnd(&seed) & 0x7FF;
+	}
+
+	build_filter(&filter, rules, n_rules);
+	for(id=0; id<CAN_XR_FILTER_IDS; id++)
+	    if(CAN_XR_Filter_Accepts(&filter, id)
+	       != brute_force(rules, n_rules, id))
+	    {
+		printf("! filter %d, identifier %lu\n", k, (unsigned long)id);
+		errors++;
+		break;
+	    }
+    }
+
+    printf("# %d random filters, %d errors\n", k, errors);
+    return errors;
+}
+
+/* Rules of the receiving node: a few identifiers, the 0x120-0x12F
+   range, all odd identifiers in 0x400-0x43F, except for 0x421.
+*/
+const struct rule node_rules[] = {
+    { 0x005, 0x7FF, 0 },
+    { 0x2B7, 0x7FF, 0 },
+    { 0x6F0, 0x7FF, 0 },
+    { 0x120, 0x7F0, 0 },
+    { 0x401, 0x7C1, 0 },
+    { 0x421, 0x7FF, 1 }
+};
+
+#define N_NODE_RULES (sizeof(node_rules) / sizeof(node_rules[0]))
+
+/* Log of the upcalls of node 1 (filtered) and node 2 (unfiltered),
+   one per simulator.  The first two data bytes of each frame are its
+   number.
+*/
+struct event
+{
+    unsigned long ts;
+    uint32_t identifier;
+    int seq;
+    int node;
+};
+
+struct event_log
+{
+    struct event events[3 * N_FRAMES];
+    int n_events;
+    int n_conf;
+    int n_failed;
+};
+
+struct event_log logs[2];
+struct event_log *current_log;
+
+struct CAN_XR_Filter node_filter;
+struct CAN_XR_MAC *tx_mac;
+int n_submitted;
+uint32_t identifiers[N_FRAMES];
+uint8_t payloads[N_FRAMES][8];
+
+void submit_next(void)
+{
+    if(n_submitted < N_FRAMES)
+    {
+	CAN_XR_MAC_Data_Req(tx_mac, identifiers[n_submitted],
+			    CAN_XR_FORMAT_CBFF, 1 + n_submitted % 8,
+			    payloads[n_submitted]);
+	n_submitted++;
+    }
+}
+
+void tx_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    current_log->n_conf++;
+    if(transmission_status != CAN_XR_MAC_TX_STATUS_SUCCESS)
+	current_log->n_failed++;
+    submit_next();
+}
+
+/* The LLC pointer of the receiving nodes tells them apart. */
+void rx_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct event *e;
+    int seq = data[0] | (data[1] << 8);
+
+    if(current_log->n_events >= 3 * N_FRAMES)
+	return;
+
+    e = &(current_log->events[current_log->n_events++]);
+    e->ts = ts;
+    e->identifier = identifier;
+    e->node = (int)(long)llc;
+    e->seq = seq;
+
+    /* Contents must be intact, whether the frame has been filtered
+       or not.
+    */
+    if(seq >= N_FRAMES || identifier != identifiers[seq]
+       || dlc != 1 + seq % 8 || memcmp(data, payloads[seq], dlc))
+	e->seq = -1;
+}
+
+void setup(struct CAN_XR_MAC *tx, struct CAN_XR_MAC *filtered,
+	   struct CAN_XR_MAC *unfiltered)
+{
+    int k;
+
+    memset(current_log, 0, sizeof(*current_log));
+
+    CAN_XR_MAC_Set_Data_Conf(tx, tx_data_conf);
+    CAN_XR_MAC_Set_LLC(filtered, (struct CAN_XR_LLC *)1L);
+    CAN_XR_MAC_Set_Data_Ind(filtered, rx_data_ind);
+    CAN_XR_MAC_Set_Filter(filtered, &node_filter);
+    CAN_XR_MAC_Set_LLC(unfiltered, (struct CAN_XR_LLC *)2L);
+    CAN_XR_MAC_Set_Data_Ind(unfiltered, rx_data_ind);
+
+    tx_mac = tx;
+    n_submitted = 0;
+    for(k=0; k<CAN_XR_MAC_TX_SLOTS; k++)
+	submit_next();
+}
+
+struct CAN_XR_Bus_Node bus_nodes[3];
+struct CAN_XR_Bus bus;
+
+struct CAN_XR_Frame_Sim_Node sim_nodes[3];
+struct CAN_XR_Frame_Sim sim;
+
+/* Check 'l'.  Return the number of errors. */
+int check_log(const char *name, const struct event_log *l)
+{
+    int n_filtered = 0, n_unfiltered = 0, n_accepted = 0;
+    int errors = 0;
+    int i, j = -1;
+
+    for(i=0; i<l->n_events; i++)
+    {
+	const struct event *e = &(l->events[i]);
+
+	if(e->seq < 0)
+	{
+	    printf("! %s: node %d, frame %lu corrupted\n",
+		   name, e->node, (unsigned long)e->identifier);
+	    errors++;
+	}
+
+	else if(e->node == 2)
+	{
+	    n_unfiltered++;
+	    n_accepted += brute_force(node_rules, N_NODE_RULES,
+				      e->identifier);
+	}
+
+	else
+	{
+	    /* The filtered node must receive the same frame as the
+	       unfiltered one, at the same time, and only if accepted.
+	    */
+	    for(j=j+1; j<l->n_events; j++)
+		if(l->events[j].node == 2
+		   && l->events[j].ts == e->ts
+		   && l->events[j].seq == e->seq)
+		    break;
+
+	    if(j == l->n_events
+	       || !brute_force(node_rules, N_NODE_RULES, e->identifier))
+	    {
+		printf("! %s: frame %lu not expected @%lu\n",
+		       name, (unsigned long)e->identifier, e->ts);
+		errors++;
+		j = -1;
+	    }
+	    n_filtered++;
+	}
+    }
+
+    if(l->n_conf != N_FRAMES || l->n_failed != 0
+       || n_unfiltered != N_FRAMES || n_filtered != n_accepted)
+    {
+	printf("! %s: %d confirmed, %d failed, %d received, "
+	       "%d filtered out of %d accepted\n",
+	       name, l->n_conf, l->n_failed, n_unfiltered,
+	       n_filtered, n_accepted);
+	errors++;
+    }
+
+    printf("# %s: %d frames, %d accepted, %d errors\n",
+	   name, n_unfiltered, n_filtered, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long seed = 7;
+    int errors = 0;
+    int k, j;
+
+    SET_TRACE_TRESHOLD(9);
+
+    errors += check_random();
+
+    /* Most identifiers are close to those node_rules accept */
+    for(k=0; k<N_FRAMES; k++)
+    {
+	switch(k % 4)
+	{
+	case 0:
+	    identifiers[k] = rnd(&seed) & 0x7FF;
+	    break;
+	case 1:
+	    identifiers[k] = 0x120 | (rnd(&seed) & 0x1F);
+	    break;
+	case 2:
+	    identifiers[k] = 0x400 | (rnd(&seed) & 0x3F);
+	    break;
+	default:
+	    identifiers[k] = node_rules[rnd(&seed) % 3].code ^ (k & 0x1);
+	}
+
+	for(j=0; j<8; j++)
+	    payloads[k][j] = rnd(&seed);
+	payloads[k][0] = k & 0xFF;
+	payloads[k][1] = k >> 8;
+    }
+
+    build_filter(&node_filter, node_rules, N_NODE_RULES);
+
+    current_log = &logs[0];
+    CAN_XR_Bus_Init(&bus, bus_nodes, 3, &pcs_parameters);
+    setup(CAN_XR_Bus_MAC(&bus, 0), CAN_XR_Bus_MAC(&bus, 1),
+	  CAN_XR_Bus_MAC(&bus, 2));
+    CAN_XR_Bus_Run(&bus, MAX_TICKS);
+    errors += check_log("bit level", &logs[0]);
+
+    current_log = &logs[1];
+    CAN_XR_Frame_Sim_Init(&sim, sim_nodes, 3, &pcs_parameters);
+    setup(CAN_XR_Frame_Sim_MAC(&sim, 0), CAN_XR_Frame_Sim_MAC(&sim, 1),
+	  CAN_XR_Frame_Sim_MAC(&sim, 2));
+    CAN_XR_Frame_Sim_Run(&sim, MAX_TICKS);
+    errors += check_log("frame level", &logs[1]);
+
+    if(logs[0].n_events != logs[1].n_events
+       || memcmp(logs[0].events, logs[1].events,
+		 logs[0].n_events * sizeof(struct event)))
+    {
+	printf("! bit and frame level upcalls differ\n");
+	errors++;
+    }
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
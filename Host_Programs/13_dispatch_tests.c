@@ -0,0 +1,416 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_Frame_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Dispatch.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the dispatch table.  It makes hundreds of
+   subscriptions, single identifiers and ranges that overlap, and
+   checks that every identifier reaches the subscriber of the last
+   subscription that covers it, with its context.  Then, it compares
+   the speed of the table with a linear search of the subscriptions,
+   like a chain of identifier checks in data_ind would do.
+
+   Last, a node transmits frames to a node with the same subscriptions,
+   on the bit-level bus and on the frame-level simulator, and every
+   subscriber must get exactly the frames it subscribed to.
+*/
+
+/* 10 quanta per bit, like 03_bus_tests. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define N_SUBSCRIPTIONS 400
+#define N_CONTEXTS 48 /* Distinct subscribers, 2 callbacks each */
+#define N_DISPATCH 20000000UL
+#define N_SEARCH 2000000UL
+#define N_FRAMES 200
+#define MAX_TICKS (N_FRAMES * 1300UL)
+
+struct subscription
+{
+    uint32_t first;
+    uint32_t last;
+    int callback;
+    int ctx;
+};
+
+struct subscription subscriptions[N_SUBSCRIPTIONS];
+
+/* Subscriber contexts.  Callbacks count the frames they get and
+   remember the last one.
+*/
+struct context
+{
+    unsigned long frames[2]; /* By callback */
+    unsigned long sum;
+    uint32_t last_identifier;
+    int last_callback;
+};
+
+struct context contexts[N_CONTEXTS];
+
+void callback_0(
+    void *ctx, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct context *c = ctx;
+
+    c->frames[0]++;
+    c->sum += identifier + ts;
+    c->last_identifier = identifier;
+    c->last_callback = 0;
+}
+
+void callback_1(
+    void *ctx, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct context *c = ctx;
+
+    c->frames[1]++;
+    c->sum += identifier + ts;
+    c->last_identifier = identifier;
+    c->last_callback = 1;
+}
+
+CAN_XR_Dispatch_Callback_t callbacks[2] = { callback_0, callback_1 };
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+/* Two thirds single identifiers, the others ranges up to 64 long. */
+void build_subscriptions(void)
+{
+    unsigned long seed = 3;
+    int k;
+
+    for(k=0; k<N_SUBSCRIPTIONS; k++)
+    {
+	subscriptions[k].first = rnd(&seed) % CAN_XR_DISPATCH_IDS;
+	subscriptions[k].last = subscriptions[k].first;
+	if(k % 3 == 2)
+	    subscriptions[k].last += rnd(&seed) % 64;
+	if(subscriptions[k].last >= CAN_XR_DISPATCH_IDS)
+	    subscriptions[k].last = CAN_XR_DISPATCH_IDS - 1;
+
+	subscriptions[k].callback = rnd(&seed) % 2;
+	subscriptions[k].ctx = rnd(&seed) % (N_CONTEXTS / 2);
+	if(subscriptions[k].callback)
+	    subscriptions[k].ctx += N_CONTEXTS / 2;
+    }
+}
+
+/* Subscribe to all subscriptions in 'dispatch', then drop the
+   subscriptions of a few identifiers.  Return the number of errors.
+*/
+int subscribe(struct CAN_XR_Dispatch *dispatch)
+{
+    const struct subscription *s;
+    int errors = 0;
+    int k;
+
+    CAN_XR_Dispatch_Init(dispatch);
+    for(k=0; k<N_SUBSCRIPTIONS; k++)
+    {
+	s = &subscriptions[k];
+	if(CAN_XR_Dispatch_Subscribe(dispatch, s->first, s->last,
+				     callbacks[s->callback],
+				     &contexts[s->ctx]) < 0)
+	    errors++;
+    }
+
+    CAN_XR_Dispatch_Unsubscribe(dispatch, 0x100, 0x10F);
+    return errors;
+}
+
+/* Linear search, last subscription first.  Return its index, -1 if
+   'identifier' has no subscription.
+*/
+static int search(uint32_t identifier)
+{
+    int k;
+
+    if(identifier >= 0x100 && identifier <= 0x10F)
+	return -1;
+
+    for(k=N_SUBSCRIPTIONS-1; k>=0; k--)
+	if(identifier >= subscriptions[k].first
+	   && identifier <= subscriptions[k].last)
+	    return k;
+
+    return -1;
+}
+
+struct CAN_XR_Dispatch dispatch;
+
+/* Dispatch all identifiers, one at a time.  Return the number of
+   errors.
+*/
+int check_table(void)
+{
+    struct CAN_XR_Dispatch small;
+    uint8_t data[8] = { 0 };
+    int n_subscribed = 0, errors = 0;
+    uint32_t id;
+    int k, found;
+
+    errors += subscribe(&dispatch);
+
+    for(id=0; id<CAN_XR_DISPATCH_IDS; id++)
+    {
+	memset(contexts, 0, sizeof(contexts));
+	found = CAN_XR_Dispatch_Ind(&dispatch, 0, id, CAN_XR_FORMAT_CBFF,
+				    0, data);
+	k = search(id);
+
+	if(found != (k >= 0)
+	   || (k >= 0
+	       && (contexts[subscriptions[k].ctx].last_identifier != id
+		   || contexts[subscriptions[k].ctx].last_callback
+		   != subscriptions[k].callback
+		   || contexts[subscriptions[k].ctx].frames[
+		       subscriptions[k].callback] != 1)))
+	{
+	    printf("! identifier %lu, subscription %d\n",
+		   (unsigned long)id, k);
+	    errors++;
+	}
+	n_subscribed += found;
+    }
+
+    /* Bad ranges and too many subscribers */
+    CAN_XR_Dispatch_Init(&small);
+    errors += (CAN_XR_Dispatch_Subscribe(&small, 5, 4, callback_0, NULL)
+	       != -1);
+    errors += (CAN_XR_Dispatch_Subscribe(&small, 0, CAN_XR_DISPATCH_IDS,
+					 callback_0, NULL) != -1);
+    for(k=0; k<CAN_XR_DISPATCH_SUBSCRIBERS; k++)
+	errors += (CAN_XR_Dispatch_Subscribe(&small, k, k, callback_0,
+					     (char *)&small + k) != k);
+    errors += (CAN_XR_Dispatch_Subscribe(&small, 0, 0, callback_1, NULL)
+	       != -1);
+    errors += (CAN_XR_Dispatch_Subscribe(&small, 9, 9, callback_0,
+					 (char *)&small + 1) != 1);
+
+    printf("# %d subscriptions, %d subscribers, %d identifiers "
+	   "subscribed, %d errors\n",
+	   N_SUBSCRIPTIONS, dispatch.n_subscribers, n_subscribed, errors);
+    return errors;
+}
+
+/* Speed of the table and of the linear search, on random identifiers.
+   The context sums, which must agree, keep the compiler from
+   optimizing the calls away.  Return the number of errors.
+*/
+int check_speed(void)
+{
+    uint32_t *ids = malloc(N_DISPATCH * sizeof(uint32_t));
+    uint8_t data[8] = { 0 };
+    unsigned long seed = 11, sum[2];
+    double t[2];
+    clock_t start;
+    unsigned long i;
+    int k;
+
+    for(i=0; i<N_DISPATCH; i++)
+	ids[i] = rnd(&seed) % CAN_XR_DISPATCH_IDS;
+
+    memset(contexts, 0, sizeof(contexts));
+    start = clock();
+    for(i=0; i<N_SEARCH; i++)
+	if((k = search(ids[i])) >= 0)
+	    callbacks[subscriptions[k].callback](
+		&contexts[subscriptions[k].ctx], i, ids[i],
+		CAN_XR_FORMAT_CBFF, 0, data);
+    t[0] = (double)(clock() - start) / CLOCKS_PER_SEC;
+    for(sum[0]=0, k=0; k<N_CONTEXTS; k++)
+	sum[0] += contexts[k].sum;
+
+    memset(contexts, 0, sizeof(contexts));
+    start = clock();
+    for(i=0; i<N_DISPATCH; i++)
+	CAN_XR_Dispatch_Ind(&dispatch, i, ids[i], CAN_XR_FORMAT_CBFF, 0, data);
+    t[1] = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    /* Same number of dispatches for the sums */
+    memset(contexts, 0, sizeof(contexts));
+    for(i=0; i<N_SEARCH; i++)
+	CAN_XR_Dispatch_Ind(&dispatch, i, ids[i], CAN_XR_FORMAT_CBFF, 0, data);
+    for(sum[1]=0, k=0; k<N_CONTEXTS; k++)
+	sum[1] += contexts[k].sum;
+
+    printf("# linear search: %.1fns/frame\n",
+	   t[0] > 0.0 ? t[0] / N_SEARCH * 1e9 : 0.0);
+    printf("# table: %.1fns/frame, speedup %.1fx\n",
+	   t[1] > 0.0 ? t[1] / N_DISPATCH * 1e9 : 0.0,
+	   t[1] > 0.0 ? (t[0] / N_SEARCH) / (t[1] / N_DISPATCH) : 0.0);
+
+    free(ids);
+    return sum[0] != sum[1];
+}
+
+/* Simulation runs.  The transmitter sends frames with random
+   identifiers, the receiver dispatches them.
+*/
+uint32_t identifiers[N_FRAMES];
+uint8_t payload[8] = { 0x55 };
+struct CAN_XR_MAC *tx_mac;
+int n_submitted;
+
+void submit_next(void)
+{
+    if(n_submitted < N_FRAMES)
+	CAN_XR_MAC_Data_Req(tx_mac, identifiers[n_submitted++],
+			    CAN_XR_FORMAT_CBFF, 1, payload);
+}
+
+void tx_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    submit_next();
+}
+
+struct CAN_XR_Dispatch node_dispatch;
+
+void setup(struct CAN_XR_MAC *tx, struct CAN_XR_MAC *rx)
+{
+    int k;
+
+    memset(contexts, 0, sizeof(contexts));
+    CAN_XR_MAC_Set_Data_Conf(tx, tx_data_conf);
+
+    CAN_XR_Dispatch_Init(&node_dispatch);
+    CAN_XR_MAC_Set_Dispatch(rx, &node_dispatch);
+    for(k=0; k<N_SUBSCRIPTIONS; k++)
+	CAN_XR_MAC_Subscribe(rx, subscriptions[k].first,
+			     subscriptions[k].last,
+			     callbacks[subscriptions[k].callback],
+			     &contexts[subscriptions[k].ctx]);
+    CAN_XR_Dispatch_Unsubscribe(&node_dispatch, 0x100, 0x10F);
+
+    tx_mac = tx;
+    n_submitted = 0;
+    for(k=0; k<CAN_XR_MAC_TX_SLOTS; k++)
+	submit_next();
+}
+
+/* Compare the frame counts of all subscribers with the expected ones.
+   Return the number of errors.
+*/
+int check_counts(const char *name, const struct context *saved)
+{
+    unsigned long expected[N_CONTEXTS][2];
+    unsigned long n_dispatched = 0;
+    int errors = 0;
+    int i, k;
+
+    memset(expected, 0, sizeof(expected));
+    for(i=0; i<N_FRAMES; i++)
+	if((k = search(identifiers[i])) >= 0)
+	    expected[subscriptions[k].ctx][subscriptions[k].callback]++;
+
+    for(k=0; k<N_CONTEXTS; k++)
+    {
+	if(contexts[k].frames[0] != expected[k][0]
+	   || contexts[k].frames[1] != expected[k][1])
+	{
+	    printf("! %s: subscriber %d got %lu+%lu frames, "
+		   "expected %lu+%lu\n", name, k,
+		   contexts[k].frames[0], contexts[k].frames[1],
+		   expected[k][0], expected[k][1]);
+	    errors++;
+	}
+
+	/* Same frames at the same time in both simulators */
+	if(saved && saved[k].sum != contexts[k].sum)
+	    errors++;
+
+	n_dispatched += contexts[k].frames[0] + contexts[k].frames[1];
+    }
+
+    printf("# %s: %d frames, %lu dispatched, %d errors\n",
+	   name, N_FRAMES, n_dispatched, errors);
+    return errors;
+}
+
+struct CAN_XR_Bus_Node bus_nodes[2];
+struct CAN_XR_Bus bus;
+
+struct CAN_XR_Frame_Sim_Node sim_nodes[2];
+struct CAN_XR_Frame_Sim sim;
+
+int main(int argc, char *argv[])
+{
+    struct context bus_contexts[N_CONTEXTS];
+    unsigned long seed = 5;
+    int errors = 0;
+    int i;
+
+    SET_TRACE_TRESHOLD(9);
+
+    build_subscriptions();
+    errors += check_table();
+    errors += check_speed();
+
+    for(i=0; i<N_FRAMES; i++)
+	identifiers[i] = (i % 2)
+	    ? subscriptions[rnd(&seed) % N_SUBSCRIPTIONS].last
+	    : rnd(&seed) % CAN_XR_DISPATCH_IDS;
+
+    CAN_XR_Bus_Init(&bus, bus_nodes, 2, &pcs_parameters);
+    setup(CAN_XR_Bus_MAC(&bus, 0), CAN_XR_Bus_MAC(&bus, 1));
+    CAN_XR_Bus_Run(&bus, MAX_TICKS);
+    errors += check_counts("bit level", NULL);
+    memcpy(bus_contexts, contexts, sizeof(contexts));
+
+    CAN_XR_Frame_Sim_Init(&sim, sim_nodes, 2, &pcs_parameters);
+    setup(CAN_XR_Frame_Sim_MAC(&sim, 0), CAN_XR_Frame_Sim_MAC(&sim, 1));
+    CAN_XR_Frame_Sim_Run(&sim, MAX_TICKS);
+    errors += check_counts("frame level", bus_contexts);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
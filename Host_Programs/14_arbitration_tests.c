@@ -0,0 +1,356 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_Frame_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Event_Log.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks bit monitoring in the MAC.  First, several
+   nodes contend for the bus, all of them with a full set of TX slots
+   and more frames to send from data_conf.  The losers of each
+   arbitration must back off and retry, so the bit-level bus must
+   produce exactly the same upcalls as the frame-level simulator,
+   which resolves arbitration by construction, and all frames must be
+   confirmed.
+
+   Then, an external device drives the bus dominant during a
+   recessive data bit of a frame.  The transmitter must detect the
+   bit error, signal it with an error frame, and transmit the frame
+   again right after it.
+*/
+
+/* 10 quanta per bit, like 03_bus_tests. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 10
+
+#define N_NODES 8
+#define N_PER_NODE 40 /* Frames sent by each node */
+#define N_FRAMES (N_NODES * N_PER_NODE)
+#define MAX_TICKS (N_FRAMES * 1300UL)
+#define MAX_EVENTS (N_FRAMES * (N_NODES + 1))
+
+#define N_ERROR_FRAMES 3
+#define ERROR_BIT 40 /* Corrupt the first recessive bit from here on */
+
+/* Log of all MAC upcalls, to compare the runs. */
+struct CAN_XR_Event events[2][MAX_EVENTS];
+struct CAN_XR_Event_Log logs[2];
+
+/* Frames, by node.  The identifier of frame k of node n is unique;
+   its first data byte is n, the second k.
+*/
+uint32_t identifiers[N_NODES][N_PER_NODE];
+uint8_t payloads[N_NODES][N_PER_NODE][8];
+int n_submitted[N_NODES];
+int n_per_node = N_PER_NODE;
+
+struct CAN_XR_MAC *macs[N_NODES];
+int node_numbers[N_NODES];
+
+/* Last bit of the last frame, to compute the bus load */
+unsigned long last_ts;
+unsigned long busy_bits;
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+void submit_next(int node)
+{
+    int k = n_submitted[node];
+
+    if(k < n_per_node)
+    {
+	CAN_XR_MAC_Data_Req(macs[node], identifiers[node][k],
+			    CAN_XR_FORMAT_CBFF, 1 + (k + node) % 8,
+			    payloads[node][k]);
+	n_submitted[node]++;
+    }
+}
+
+void log_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    int node = *(int *)llc;
+
+    CAN_XR_Event_Log_Data_Conf(llc, ts, identifier, transmission_status);
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	last_ts = ts;
+	busy_bits += macs[node]->state.tx_bitstream_bits;
+	submit_next(node);
+    }
+}
+
+/* Link the upcalls to 'mac' of node 'node' and fill its slots, if
+   it is a transmitter.
+*/
+void setup(int node, struct CAN_XR_MAC *mac, int transmitter)
+{
+    int k;
+
+    macs[node] = mac;
+    node_numbers[node] = node;
+    n_submitted[node] = 0;
+    CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[node]);
+    CAN_XR_MAC_Set_Data_Ind(mac, CAN_XR_Event_Log_Data_Ind);
+    CAN_XR_MAC_Set_Data_Conf(mac, log_data_conf);
+
+    for(k=0; k<CAN_XR_MAC_TX_SLOTS && transmitter; k++)
+	submit_next(node);
+}
+
+void build_frames(void)
+{
+    unsigned long seed = 17;
+    int n, k, j;
+    uint32_t id;
+    int used[0x800];
+
+    memset(used, 0, sizeof(used));
+    for(n=0; n<N_NODES; n++)
+	for(k=0; k<N_PER_NODE; k++)
+	{
+	    do
+		id = rnd(&seed) % 0x800;
+	    while(used[id]);
+	    used[id] = 1;
+	    identifiers[n][k] = id;
+
+	    payloads[n][k][0] = n;
+	    payloads[n][k][1] = k;
+	    for(j=2; j<8; j++)
+		payloads[n][k][j] = rnd(&seed);
+	}
+}
+
+struct CAN_XR_Bus_Node bus_nodes[N_NODES];
+struct CAN_XR_Bus bus;
+
+struct CAN_XR_Frame_Sim_Node sim_nodes[N_NODES];
+struct CAN_XR_Frame_Sim sim;
+
+/* Compare the logs of the two runs, and check that all frames have
+   been confirmed.  Return the number of errors.
+*/
+int check_contended(void)
+{
+    const struct CAN_XR_Event_Log *b = &logs[0], *f = &logs[1];
+    int n_success = 0, errors;
+    int i;
+
+    errors = CAN_XR_Event_Log_Compare("frame level", b, f);
+
+    for(i=0; i<b->n_events; i++)
+	if(b->events[i].kind == CAN_XR_EVENT_DATA_CONF)
+	{
+	    if(b->events[i].dlc_or_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+		n_success++;
+	    else
+		errors++;
+	}
+
+    if(b->n_events != f->n_events || n_success != N_FRAMES)
+    {
+	printf("! %d vs. %d events, %d frames confirmed\n",
+	       b->n_events, f->n_events, n_success);
+	errors++;
+    }
+
+    return errors;
+}
+
+int run_contended(void)
+{
+    int errors;
+    int n;
+
+    CAN_XR_Event_Log_Init(&logs[0], events[0], MAX_EVENTS);
+    CAN_XR_Event_Log_Current = &logs[0];
+    busy_bits = 0;
+    CAN_XR_Bus_Init(&bus, bus_nodes, N_NODES, &pcs_parameters);
+    for(n=0; n<N_NODES; n++)
+	setup(n, CAN_XR_Bus_MAC(&bus, n), 1);
+    CAN_XR_Bus_Run(&bus, MAX_TICKS);
+
+    CAN_XR_Event_Log_Init(&logs[1], events[1], MAX_EVENTS);
+    CAN_XR_Event_Log_Current = &logs[1];
+    CAN_XR_Frame_Sim_Init(&sim, sim_nodes, N_NODES, &pcs_parameters);
+    for(n=0; n<N_NODES; n++)
+	setup(n, CAN_XR_Frame_Sim_MAC(&sim, n), 1);
+    CAN_XR_Frame_Sim_Run(&sim, MAX_TICKS);
+
+    errors = check_contended();
+    printf("# contended: %d nodes, %d frames, %d events, bus load %.1f%%, "
+	   "%d errors\n", N_NODES, N_FRAMES, logs[0].n_events,
+	   last_ts > 0 ? 100.0 * busy_bits * BIT_TICKS / last_ts : 0.0,
+	   errors);
+    return errors;
+}
+
+/* Node 0 sends N_ERROR_FRAMES frames to node 1, and the first one is
+   hit by a dominant bit.  Return the number of errors.
+*/
+int run_bit_error(void)
+{
+    struct CAN_XR_Bus_Edge glitch[2];
+    const struct CAN_XR_MAC_TX_Slot *slot;
+    struct CAN_XR_MAC *mac;
+    unsigned long first_conf_ts[2];
+    int n_ind, n_conf, n_fail, bit, prev_index = 0, hit;
+    int errors = 0;
+    int run, i;
+    unsigned long t;
+
+    n_per_node = N_ERROR_FRAMES;
+
+    for(run=0; run<2; run++)
+    {
+	CAN_XR_Event_Log_Init(&logs[run], events[run], MAX_EVENTS);
+	CAN_XR_Event_Log_Current = &logs[run];
+	CAN_XR_Bus_Init(&bus, bus_nodes, 2, &pcs_parameters);
+	setup(0, CAN_XR_Bus_MAC(&bus, 0), 1);
+	setup(1, CAN_XR_Bus_MAC(&bus, 1), 0);
+	mac = macs[0];
+
+	/* The first recessive bit from ERROR_BIT on, in the data
+	   field of the first frame.
+	*/
+	slot = &(mac->state.tx_slots[mac->state.tx_queue[0]]);
+	for(bit=ERROR_BIT; bit<slot->bitstream_bits; bit++)
+	    if((slot->bitstream[bit >> 5] << (bit & 0x1F)) >> 31)
+		break;
+
+	/* When the transmitter requests that bit, drive the bus
+	   dominant from the next tick through the sample point of the
+	   bit, once, in the first run only.
+	*/
+	hit = (run != 0);
+	for(t=0; t<MAX_TICKS; t++)
+	{
+	    CAN_XR_Bus_Run(&bus, 1);
+	    if(!hit && prev_index == bit && mac->state.tx_bit_index == bit + 1)
+	    {
+		hit = 1;
+		glitch[0].ts = bus.nodeclock_ts + 1;
+		glitch[0].level = 0;
+		glitch[1].ts = bus.nodeclock_ts + 1 + BIT_TICKS + 2;
+		glitch[1].level = 1;
+		CAN_XR_Bus_Set_Stimulus(&bus, glitch, 2);
+	    }
+	    prev_index = mac->state.tx_bit_index;
+	}
+
+	n_ind = n_conf = n_fail = 0;
+	first_conf_ts[run] = 0;
+	for(i=0; i<logs[run].n_events; i++)
+	{
+	    const struct CAN_XR_Event *e = &(logs[run].events[i]);
+
+	    if(e->kind == CAN_XR_EVENT_DATA_IND && e->node == 1)
+	    {
+		/* In priority order, not in request order */
+		if(e->data[1] >= N_ERROR_FRAMES
+		   || e->identifier != identifiers[0][e->data[1]]
+		   || memcmp(e->data, payloads[0][e->data[1]],
+			     e->dlc_or_status))
+		{
+		    printf("! frame %lu corrupted\n",
+			   (unsigned long)e->identifier);
+		    errors++;
+		}
+		n_ind++;
+	    }
+
+	    else if(e->kind == CAN_XR_EVENT_DATA_CONF)
+	    {
+		if(e->dlc_or_status != CAN_XR_MAC_TX_STATUS_SUCCESS)
+		    n_fail++;
+		else if(n_conf++ == 0)
+		    first_conf_ts[run] = e->ts;
+	    }
+	}
+
+	if(n_ind != N_ERROR_FRAMES || n_conf != N_ERROR_FRAMES || n_fail)
+	{
+	    printf("! %s: %d frames received, %d confirmed, %d failed\n",
+		   run == 0 ? "bit error" : "reference", n_ind, n_conf, n_fail);
+	    errors++;
+	}
+    }
+
+    /* The retransmission takes at least the length of the first
+       frame, minus the part transmitted before the error.  It starts
+       at most after the error flag, 6 bits plus up to 6 superposed by
+       the receiver, the 8-bit error delimiter and a 3-bit
+       intermission, [1] 10.4.4.
+    */
+    if(first_conf_ts[0] < first_conf_ts[1] + (unsigned long)bit * BIT_TICKS
+       || first_conf_ts[0] > first_conf_ts[1]
+       + (unsigned long)(bit + 1 + 12 + 8 + 3) * BIT_TICKS)
+    {
+	printf("! first frame confirmed @%lu with bit error, @%lu without\n",
+	       first_conf_ts[0], first_conf_ts[1]);
+	errors++;
+    }
+
+    printf("# bit error @bit %d: first frame confirmed @%lu instead of @%lu, "
+	   "%d errors\n", bit, first_conf_ts[0], first_conf_ts[1], errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Bit errors are traced at level 9, on purpose */
+    SET_TRACE_TRESHOLD(10);
+
+    build_frames();
+    errors += run_contended();
+    errors += run_bit_error();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,285 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the error counters and the fault confinement
+   states of the MAC, [1] 12.1.4, on the bit-level bus simulator.
+
+   - A lone transmitter never gets an acknowledgment.  It must become
+     error passive after 16 ACK errors and stay there, with its
+     transmit error counter at 128, because an ACK error of an error
+     passive transmitter does not count, [1] 12.1.4.2 c) 1).
+
+   - A single bit error in the data field of a frame.  After the
+     retransmission, the transmitter must be left with a transmit
+     error counter of 7, and the receiver with a receive error counter
+     of 0.
+
+   - An external device drives the bus dominant for a long time in the
+     data field of a frame.  The transmitter must go bus off, the
+     receiver must not, and both must recover once the bus is released
+     for 128 sequences of 11 recessive bits.  Then, the frame must be
+     transmitted successfully.
+*/
+
+/* 10 quanta per bit, like 03_bus_tests. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 10
+
+#define IDENTIFIER 0x2A5
+#define ERROR_BIT 40 /* Corrupt the first recessive bit from here on */
+
+#define NO_ACK_BITS 5000 /* About 40 attempts */
+#define STUCK_BITS 400 /* Enough for 32 error counts */
+#define RECOVERY_BITS (128 * 11)
+
+uint8_t payload[8] = { 0xA5, 0x5A, 0x00, 0xFF, 0x12, 0x34, 0x56, 0x78 };
+
+struct CAN_XR_Bus_Node bus_nodes[2];
+struct CAN_XR_Bus bus;
+struct CAN_XR_Bus_Edge edges[2];
+
+int node_numbers[2] = { 0, 1 };
+int n_ind[2], n_conf[2], n_fail[2];
+
+void count_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int node = *(int *)llc;
+
+    if(identifier == IDENTIFIER && dlc == 8 && !memcmp(data, payload, 8))
+	n_ind[node]++;
+    else
+	n_fail[node]++;
+}
+
+void count_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    int node = *(int *)llc;
+
+    if(identifier == IDENTIFIER
+       && transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+	n_conf[node]++;
+    else
+	n_fail[node]++;
+}
+
+/* Set up a bus with 'n_nodes' nodes, node 0 transmits one frame. */
+void setup(int n_nodes)
+{
+    struct CAN_XR_MAC *mac;
+    int n;
+
+    CAN_XR_Bus_Init(&bus, bus_nodes, n_nodes, &pcs_parameters);
+    for(n=0; n<n_nodes; n++)
+    {
+	mac = CAN_XR_Bus_MAC(&bus, n);
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(mac, count_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, count_data_conf);
+	n_ind[n] = n_conf[n] = n_fail[n] = 0;
+    }
+
+    CAN_XR_MAC_Data_Req(CAN_XR_Bus_MAC(&bus, 0), IDENTIFIER,
+			CAN_XR_FORMAT_CBFF, 8, payload);
+}
+
+/* Run the bus until the transmitter requests the first recessive bit
+   of its frame from ERROR_BIT on, then drive the bus dominant from the
+   next tick for 'ticks' ticks.  Return the bit, or -1 if the
+   transmitter never got there.
+*/
+int drive_dominant(unsigned long ticks)
+{
+    struct CAN_XR_MAC *mac = CAN_XR_Bus_MAC(&bus, 0);
+    const struct CAN_XR_MAC_TX_Slot *slot =
+	&(mac->state.tx_slots[mac->state.tx_queue[0]]);
+    int prev_index = 0, bit;
+    unsigned long t;
+
+    for(bit=ERROR_BIT; bit<slot->bitstream_bits; bit++)
+	if((slot->bitstream[bit >> 5] << (bit & 0x1F)) >> 31)
+	    break;
+
+    for(t=0; t<100UL * BIT_TICKS; t++)
+    {
+	CAN_XR_Bus_Run(&bus, 1);
+	if(prev_index == bit && mac->state.tx_bit_index == bit + 1)
+	{
+	    edges[0].ts = bus.nodeclock_ts + 1;
+	    edges[0].level = 0;
+	    edges[1].ts = bus.nodeclock_ts + 1 + ticks;
+	    edges[1].level = 1;
+	    CAN_XR_Bus_Set_Stimulus(&bus, edges, 2);
+	    return bit;
+	}
+	prev_index = mac->state.tx_bit_index;
+    }
+
+    return -1;
+}
+
+/* Check the fault confinement state and the error counters of node
+   'node', return the number of errors.
+*/
+int check_node(const char *what, int node,
+	       enum CAN_XR_MAC_Fault_State fault_state, int tec, int rec)
+{
+    const struct CAN_XR_MAC *mac = CAN_XR_Bus_MAC(&bus, node);
+
+    if(CAN_XR_MAC_Get_Fault_State(mac) != fault_state
+       || mac->state.tec != tec || mac->state.rec != rec)
+    {
+	printf("! %s, node %d: fault state %d, TEC %d, REC %d "
+	       "instead of %d, %d, %d\n", what, node,
+	       CAN_XR_MAC_Get_Fault_State(mac),
+	       mac->state.tec, mac->state.rec, fault_state, tec, rec);
+	return 1;
+    }
+
+    return 0;
+}
+
+int run_no_ack(void)
+{
+    int errors = 0;
+
+    setup(1);
+    CAN_XR_Bus_Run(&bus, NO_ACK_BITS * BIT_TICKS);
+
+    errors += check_node("no ACK", 0, CAN_XR_MAC_FAULT_ERROR_PASSIVE, 128, 0);
+    if(n_conf[0] || n_fail[0])
+    {
+	printf("! no ACK: %d confirmed, %d failed\n", n_conf[0], n_fail[0]);
+	errors++;
+    }
+
+    printf("# no ACK: %d errors\n", errors);
+    return errors;
+}
+
+int run_bit_error(void)
+{
+    int errors = 0;
+    int bit;
+
+    setup(2);
+    bit = drive_dominant(BIT_TICKS + 2);
+    CAN_XR_Bus_Run(&bus, 1000UL * BIT_TICKS);
+
+    errors += check_node("bit error", 0, CAN_XR_MAC_FAULT_ERROR_ACTIVE, 7, 0);
+    errors += check_node("bit error", 1, CAN_XR_MAC_FAULT_ERROR_ACTIVE, 0, 0);
+    if(bit < 0 || n_conf[0] != 1 || n_ind[1] != 1
+       || n_fail[0] || n_fail[1])
+    {
+	printf("! bit error @bit %d: %d confirmed, %d received, "
+	       "%d + %d failed\n", bit, n_conf[0], n_ind[1],
+	       n_fail[0], n_fail[1]);
+	errors++;
+    }
+
+    printf("# bit error @bit %d: %d errors\n", bit, errors);
+    return errors;
+}
+
+int run_bus_off(void)
+{
+    int errors = 0;
+    int bit;
+
+    setup(2);
+    bit = drive_dominant(STUCK_BITS * BIT_TICKS);
+    CAN_XR_Bus_Run(&bus, STUCK_BITS * BIT_TICKS);
+
+    /* The transmitter keeps its TEC until it recovers, the receiver
+       is error passive and its REC saturates.
+    */
+    errors += check_node("bus stuck", 0, CAN_XR_MAC_FAULT_BUS_OFF, 256, 0);
+    errors += check_node(
+	"bus stuck", 1, CAN_XR_MAC_FAULT_ERROR_PASSIVE, 0, 255);
+
+    /* Not yet */
+    CAN_XR_Bus_Run(&bus, (RECOVERY_BITS - 11) * BIT_TICKS);
+    errors += check_node("recovery", 0, CAN_XR_MAC_FAULT_BUS_OFF, 256, 0);
+    if(n_conf[0])
+    {
+	printf("! frame confirmed while bus off\n");
+	errors++;
+    }
+
+    /* A successful reception sets the REC of an error passive
+       receiver between 119 and 127, [1] 12.1.4.2 h).
+    */
+    CAN_XR_Bus_Run(&bus, 200UL * BIT_TICKS);
+    errors += check_node("recovered", 0, CAN_XR_MAC_FAULT_ERROR_ACTIVE, 0, 0);
+    errors += check_node(
+	"recovered", 1, CAN_XR_MAC_FAULT_ERROR_ACTIVE, 0, 119);
+    if(bit < 0 || n_conf[0] != 1 || n_ind[1] != 1
+       || n_fail[0] || n_fail[1])
+    {
+	printf("! bus off @bit %d: %d confirmed, %d received, "
+	       "%d + %d failed\n", bit, n_conf[0], n_ind[1],
+	       n_fail[0], n_fail[1]);
+	errors++;
+    }
+
+    printf("# bus off @bit %d: %d errors\n", bit, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors are traced at levels 2 and 9, on purpose */
+    SET_TRACE_TRESHOLD(10);
+
+    errors += run_no_ack();
+    errors += run_bit_error();
+    errors += run_bus_off();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
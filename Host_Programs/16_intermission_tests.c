@@ -0,0 +1,261 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks intermission and overload frames, [1] 10.4.5
+   and 10.4.6, on the bit-level bus simulator.  Node 0 transmits the
+   same frame over and over, back to back, and node 1 receives them.
+
+   - Without disturbances, the last EOF bit of a frame and the SOF of
+     the next one must be exactly 3 bits of intermission apart.
+
+   - A dominant bit at the first or second bit of intermission is an
+     overload condition.  Both nodes send an overload frame, 6 + 8
+     bits, and the next frame is delayed accordingly.
+
+   - A dominant last EOF bit does not invalidate the frame, which is
+     received and confirmed, but it is an overload condition as well.
+
+   - A dominant third bit of intermission is a SOF.  Node 0 takes it
+     as the SOF of its next frame, which starts one bit earlier.
+
+   No error counter may change.
+*/
+
+/* 10 quanta per bit, like 03_bus_tests. */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 10
+
+/* Ticks from a sample point, as seen by run, to the next bit */
+#define TO_BIT_END 4
+
+#define IDENTIFIER 0x3C6
+#define N_FRAMES 20
+#define MAX_TICKS (N_FRAMES * 200UL * BIT_TICKS)
+
+#define OVERLOAD_BITS (6 + 8) /* Overload flag and delimiter */
+
+uint8_t payload[8] = { 0xA5, 0x5A, 0x00, 0xFF, 0x12, 0x34, 0x56, 0x78 };
+
+struct CAN_XR_Bus_Node bus_nodes[2];
+struct CAN_XR_Bus bus;
+struct CAN_XR_Bus_Edge edges[2];
+
+int node_numbers[2] = { 0, 1 };
+int n_ind, n_conf, n_fail;
+unsigned long conf_ts[N_FRAMES];
+int saw_overload[2];
+
+void count_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    /* Node 0 receives its own frames as well */
+    if(*(int *)llc == 0)
+	return;
+
+    if(identifier == IDENTIFIER && dlc == 8 && !memcmp(data, payload, 8))
+	n_ind++;
+    else
+	n_fail++;
+}
+
+/* Confirmations also submit the next frame. */
+void count_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(*(int *)llc != 0 || identifier != IDENTIFIER
+       || transmission_status != CAN_XR_MAC_TX_STATUS_SUCCESS
+       || n_conf == N_FRAMES)
+    {
+	n_fail++;
+	return;
+    }
+
+    conf_ts[n_conf++] = ts;
+    if(n_conf < N_FRAMES)
+	CAN_XR_MAC_Data_Req(CAN_XR_Bus_MAC(&bus, 0), IDENTIFIER,
+			    CAN_XR_FORMAT_CBFF, 8, payload);
+}
+
+void setup(void)
+{
+    struct CAN_XR_MAC *mac;
+    int n;
+
+    CAN_XR_Bus_Init(&bus, bus_nodes, 2, &pcs_parameters);
+    for(n=0; n<2; n++)
+    {
+	mac = CAN_XR_Bus_MAC(&bus, n);
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(mac, count_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, count_data_conf);
+	saw_overload[n] = 0;
+    }
+
+    n_ind = n_conf = n_fail = 0;
+    CAN_XR_MAC_Data_Req(CAN_XR_Bus_MAC(&bus, 0), IDENTIFIER,
+			CAN_XR_FORMAT_CBFF, 8, payload);
+}
+
+/* Run the bus one tick at a time, for at most 'ticks' ticks or until
+   'done' returns non-zero, and take note of the overload flags.
+*/
+void run(unsigned long ticks, int (*done)(void))
+{
+    unsigned long t;
+    int n;
+
+    for(t=0; t<ticks && !(done && done()); t++)
+    {
+	CAN_XR_Bus_Run(&bus, 1);
+	for(n=0; n<2; n++)
+	    if(CAN_XR_Bus_MAC(&bus, n)->state.rx_fsm_state
+	       == CAN_XR_MAC_RX_FSM_OVERLOAD_FLAG)
+		saw_overload[n] = 1;
+    }
+}
+
+/* Sample point of the second to last EOF bit of the first frame. */
+int last_eof_bit_next(void)
+{
+    const struct CAN_XR_MAC *mac = CAN_XR_Bus_MAC(&bus, 1);
+
+    return mac->state.rx_fsm_state == CAN_XR_MAC_RX_FSM_RX_EOF
+	&& mac->state.field_bits == 0;
+}
+
+/* Sample point of the last EOF bit of the first frame. */
+int first_conf(void)
+{
+    return n_conf > 0;
+}
+
+/* Drive the bus dominant for bit 'bit' after the current one. */
+void drive_dominant_bit(int bit)
+{
+    edges[0].ts = bus.nodeclock_ts + TO_BIT_END + bit * BIT_TICKS;
+    edges[0].level = 0;
+    edges[1].ts = edges[0].ts + BIT_TICKS;
+    edges[1].level = 1;
+    CAN_XR_Bus_Set_Stimulus(&bus, edges, 2);
+}
+
+/* Run a scenario, in which the dominant bit 'bit' after the
+   'trigger', if any, must delay the second frame by 'delay_bits'
+   and, if 'overload' is set, cause an overload frame.  Return the
+   number of errors.
+*/
+int scenario(const char *what, int (*trigger)(void), int bit,
+	     int delay_bits, int overload)
+{
+    const struct CAN_XR_MAC *mac;
+    unsigned long period;
+    int frame_bits;
+    int errors = 0;
+    int i, n;
+
+    setup();
+    mac = CAN_XR_Bus_MAC(&bus, 0);
+    frame_bits = mac->state.tx_slots[mac->state.tx_queue[0]].bitstream_bits;
+    period = (frame_bits + 3) * BIT_TICKS;
+
+    if(trigger)
+    {
+	run(MAX_TICKS, trigger);
+	drive_dominant_bit(bit);
+    }
+
+    run(MAX_TICKS, NULL);
+
+    if(n_conf != N_FRAMES || n_ind != N_FRAMES || n_fail)
+    {
+	printf("! %s: %d confirmed, %d received, %d failed\n",
+	       what, n_conf, n_ind, n_fail);
+	errors++;
+    }
+
+    for(i=1; i<n_conf; i++)
+	if(conf_ts[i] - conf_ts[i-1]
+	   != period + (i == 1 ? delay_bits * BIT_TICKS : 0))
+	{
+	    printf("! %s: frame %d confirmed %lu ticks after frame %d\n",
+		   what, i, conf_ts[i] - conf_ts[i-1], i - 1);
+	    errors++;
+	}
+
+    for(n=0; n<2; n++)
+    {
+	mac = CAN_XR_Bus_MAC(&bus, n);
+	if(mac->state.tec || mac->state.rec || saw_overload[n] != overload)
+	{
+	    printf("! %s, node %d: TEC %d, REC %d, overload flag %d\n",
+		   what, n, mac->state.tec, mac->state.rec, saw_overload[n]);
+	    errors++;
+	}
+    }
+
+    printf("# %s: %d-bit frames every %lu bits, bus load %.1f%%, "
+	   "%d errors\n", what, frame_bits, period / BIT_TICKS,
+	   100.0 * frame_bits * BIT_TICKS / period, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    SET_TRACE_TRESHOLD(10);
+
+    errors += scenario("back to back", NULL, 0, 0, 0);
+    errors += scenario("intermission bit 1", first_conf, 0,
+		       1 + OVERLOAD_BITS, 1);
+    errors += scenario("intermission bit 2", first_conf, 1,
+		       2 + OVERLOAD_BITS, 1);
+    errors += scenario("last EOF bit", last_eof_bit_next, 0,
+		       OVERLOAD_BITS, 1);
+    errors += scenario("intermission bit 3", first_conf, 2, -1, 0);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
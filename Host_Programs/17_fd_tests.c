@@ -0,0 +1,568 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks FD frames with bit rate switching, [1] 10.4.2
+   and 11.3.1.2, on the bit-level bus simulator.  The data phase is 8
+   times as fast as the arbitration phase.
+
+   - The bitstream of FBFF frames with all DLCs, with and without bit
+     rate switching, must match the one built by an independent
+     reference encoder.
+
+   - Node 0 transmits them to nodes 1 and 2, which must receive them
+     intact, along with a CBFF frame.
+
+   - Node 0 transmits 64-byte frames back to back, then 8-byte CBFF
+     frames.  The payload throughput of the former must be more than
+     6 times the throughput of the latter.
+
+   - Node 0 transmits FBFF and CBFF frames, and node 2 has FD frames
+     disabled.  Node 2 must ignore the FBFF frames without
+     signalling errors, and receive the CBFF frames that follow
+     them, while node 1 receives all of them.
+
+   - A dominant pulse in the data phase.  The transmitter, which
+     checks its bits at the secondary sample point, must signal the
+     error and transmit the frame again at the nominal bit rate first.
+     Afterwards, the error counters must be the same as for classical
+     frames.
+*/
+
+/* Nominal and data phase bit time, 10 quanta per bit */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+const struct CAN_XR_PCS_Bit_Time_Parameters data_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1,
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 80
+#define DATA_BIT_TICKS 10
+#define SSP_OFFSET 7 /* At the data phase sample point */
+
+#define N_NODES 3
+#define N_RANDOM 200
+#define N_BACK_TO_BACK 20
+#define ERROR_BIT 60 /* Corrupt the first recessive bit from here on */
+
+struct CAN_XR_Bus_Node bus_nodes[N_NODES];
+struct CAN_XR_Bus bus;
+struct CAN_XR_Bus_Edge edges[2];
+
+/* Frames node 0 transmits in a row, see next_frame */
+struct frame
+{
+    uint32_t identifier;
+    enum CAN_XR_Format format;
+    int dlc;
+    uint8_t data[64];
+};
+
+struct frame frames[2 * 16 + 1];
+int n_frames, next_req;
+
+int node_numbers[N_NODES] = { 0, 1, 2 };
+int n_ind[N_NODES], n_conf, n_fail;
+unsigned long first_conf_ts, last_conf_ts;
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+static int data_length(enum CAN_XR_Format format, int dlc)
+{
+    return CAN_XR_DATA_LENGTH(format, dlc);
+}
+
+/* Reference encoder, following [1] 10.4.2, 10.4.2.6 and 10.5 to the
+   letter, one bit per byte of 'bits'.  Return the number of bits.
+*/
+static uint32_t ref_crc(uint32_t crc, int bit, int n, uint32_t polynomial)
+{
+    int crcnxt = ((crc >> (n - 1)) & 0x1) ^ bit;
+
+    crc = (crc << 1) & ((1UL << n) - 1);
+    return crcnxt ? crc ^ polynomial : crc;
+}
+
+int ref_encode(uint8_t *bits, const struct frame *f, int brs)
+{
+    uint8_t raw[22 + 512];
+    int n_raw = 0, n = 0, run = 0, n_stuff = 0;
+    int n_data = data_length(f->format, f->dlc);
+    int crc_n = (n_data > 16) ? 21 : 17;
+    uint32_t polynomial = (crc_n == 21) ? 0x102899 : 0x1685B;
+    uint32_t crc = 1UL << (crc_n - 1);
+    int i, j, sc, tail[25];
+
+    raw[n_raw++] = 0; /* SOF */
+    for(i=10; i>=0; i--)  raw[n_raw++] = (f->identifier >> i) & 0x1;
+    raw[n_raw++] = 0; /* RRS */
+    raw[n_raw++] = 0; /* IDE */
+    raw[n_raw++] = 1; /* FDF */
+    raw[n_raw++] = 0; /* res */
+    raw[n_raw++] = brs;
+    raw[n_raw++] = 0; /* ESI, error active */
+    for(i=3; i>=0; i--)  raw[n_raw++] = (f->dlc >> i) & 0x1;
+    for(j=0; j<n_data; j++)
+	for(i=7; i>=0; i--)  raw[n_raw++] = (f->data[j] >> i) & 0x1;
+
+    /* Dynamic stuff bits after 5 equal bits, stuff bits included, but
+       not at the end of the data field, where the first fixed stuff
+       bit comes anyway.
+    */
+    for(i=0; i<n_raw; i++)
+    {
+	bits[n] = raw[i];
+	run = (n > 0 && bits[n] == bits[n-1]) ? run + 1 : 1;
+	n++;
+	if(run == 5 && i < n_raw - 1)
+	{
+	    bits[n] = 1 - bits[n-1];
+	    n++;
+	    run = 1;
+	    n_stuff++;
+	}
+    }
+
+    for(i=0; i<n; i++)
+	crc = ref_crc(crc, bits[i], crc_n, polynomial);
+
+    /* Stuff count, Gray code and even parity */
+    sc = (n_stuff % 8) ^ ((n_stuff % 8) >> 1);
+    tail[0] = (sc >> 2) & 0x1;
+    tail[1] = (sc >> 1) & 0x1;
+    tail[2] = sc & 0x1;
+    tail[3] = tail[0] ^ tail[1] ^ tail[2];
+    for(i=0; i<4; i++)
+	crc = ref_crc(crc, tail[i], crc_n, polynomial);
+    for(i=0; i<crc_n; i++)
+	tail[4+i] = (crc >> (crc_n - 1 - i)) & 0x1;
+
+    for(i=0; i<4+crc_n; i++)
+    {
+	if(i % 4 == 0)
+	{
+	    bits[n] = 1 - bits[n-1];
+	    n++;
+	}
+	bits[n++] = tail[i];
+    }
+
+    for(i=0; i<10; i++)
+	bits[n++] = 1; /* CDEL to EOF */
+
+    return n;
+}
+
+void make_frame(struct frame *f, enum CAN_XR_Format format, int dlc,
+		unsigned long *seed)
+{
+    int i;
+
+    f->identifier = rnd(seed) & 0x7FF;
+    f->format = format;
+    f->dlc = dlc;
+    for(i=0; i<64; i++)
+	f->data[i] = (i < data_length(format, dlc)) ? rnd(seed) : 0;
+}
+
+void next_frame(void)
+{
+    struct frame *f;
+
+    if(next_req < n_frames)
+    {
+	f = &frames[next_req++];
+	CAN_XR_MAC_Data_Req(CAN_XR_Bus_MAC(&bus, 0), f->identifier,
+			    f->format, f->dlc, f->data);
+    }
+}
+
+void check_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int node = *(int *)llc;
+    const struct frame *f = &frames[n_ind[node] % n_frames];
+
+    if(node == 0)
+	return;
+
+    if(identifier == f->identifier && format == f->format && dlc == f->dlc
+       && !memcmp(data, f->data, data_length(format, dlc)))
+	n_ind[node]++;
+    else
+    {
+	printf("! node %d: frame %d id 0x%03x dlc %d format %d mismatch\n",
+	       node, n_ind[node], (unsigned int)identifier, dlc, format);
+	n_fail++;
+    }
+}
+
+void check_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	if(n_conf++ == 0)
+	    first_conf_ts = ts;
+	last_conf_ts = ts;
+	next_frame();
+    }
+    else
+	n_fail++;
+}
+
+/* Set up the bus, with FD frames in 'fd_mode' on all nodes. */
+void setup(enum CAN_XR_MAC_FD_Mode fd_mode)
+{
+    struct CAN_XR_MAC *mac;
+    int n;
+
+    CAN_XR_Bus_Init(&bus, bus_nodes, N_NODES, &pcs_parameters);
+    for(n=0; n<N_NODES; n++)
+    {
+	CAN_XR_PCS_Set_Data_Bit_Time(
+	    &bus_nodes[n].pcs, &data_parameters, SSP_OFFSET);
+	mac = CAN_XR_Bus_MAC(&bus, n);
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(mac, check_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, check_data_conf);
+	CAN_XR_MAC_Set_FD_Mode(mac, fd_mode);
+	n_ind[n] = 0;
+    }
+
+    n_conf = n_fail = 0;
+    n_frames = next_req = 0;
+}
+
+/* Compare the bitstream MAC_Data.Request encodes for 'f' with the
+   reference one.  Return the number of errors.
+*/
+int check_bitstream(const struct frame *f, int brs)
+{
+    struct CAN_XR_MAC *mac;
+    const struct CAN_XR_MAC_TX_Slot *slot;
+    uint8_t bits[800];
+    int n, i;
+
+    setup(brs ? CAN_XR_MAC_FD_BRS : CAN_XR_MAC_FD_ENABLED);
+    mac = CAN_XR_Bus_MAC(&bus, 0);
+    CAN_XR_MAC_Data_Req(mac, f->identifier, f->format, f->dlc,
+			(uint8_t *)f->data);
+    slot = &mac->state.tx_slots[mac->state.tx_queue[0]];
+
+    n = ref_encode(bits, f, brs);
+    if(mac->state.data_req_pending != 1 || slot->bitstream_bits != n)
+    {
+	printf("! id 0x%03x dlc %d brs %d: %d bits instead of %d\n",
+	       (unsigned int)f->identifier, f->dlc, brs,
+	       slot->bitstream_bits, n);
+	return 1;
+    }
+
+    for(i=0; i<n; i++)
+	if(((slot->bitstream[i >> 5] << (i & 0x1F)) >> 31) != bits[i])
+	{
+	    printf("! id 0x%03x dlc %d brs %d: bit %d differs\n",
+		   (unsigned int)f->identifier, f->dlc, brs, i);
+	    return 1;
+	}
+
+    return 0;
+}
+
+int run_bitstream(void)
+{
+    unsigned long seed = 17;
+    struct frame f;
+    int errors = 0;
+    int i;
+
+    for(i=0; i<N_RANDOM; i++)
+    {
+	make_frame(&f, CAN_XR_FORMAT_FBFF, i % 16, &seed);
+
+	/* Long runs of equal bits, for stuff bits everywhere */
+	if(i % 3 == 0)
+	    memset(f.data, (i & 0x4) ? 0xFF : 0x00, 64);
+
+	errors += check_bitstream(&f, i & 0x1);
+    }
+
+    printf("# bitstream: %d frames, %d errors\n", N_RANDOM, errors);
+    return errors;
+}
+
+/* Transmit frames[] from node 0, return the number of errors. */
+int transfer(const char *what, unsigned long max_ticks)
+{
+    int errors = 0;
+    int n;
+
+    next_frame();
+    CAN_XR_Bus_Run(&bus, max_ticks);
+
+    for(n=1; n<N_NODES; n++)
+	if(n_ind[n] != n_frames)
+	    errors++;
+    if(n_conf != n_frames || n_fail)
+	errors++;
+    for(n=0; n<N_NODES; n++)
+	if(bus_nodes[n].pcs.state.data_phase
+	   || bus_nodes[n].mac.state.tec || bus_nodes[n].mac.state.rec)
+	    errors++;
+
+    if(errors)
+	printf("! %s: %d frames, %d confirmed, %d + %d received, "
+	       "%d failed\n", what, n_frames, n_conf, n_ind[1], n_ind[2],
+	       n_fail);
+    return errors;
+}
+
+int run_all_dlcs(void)
+{
+    unsigned long seed = 1;
+    int errors = 0;
+    int brs, dlc;
+
+    for(brs=0; brs<2; brs++)
+    {
+	setup(brs ? CAN_XR_MAC_FD_BRS : CAN_XR_MAC_FD_ENABLED);
+	for(dlc=0; dlc<16; dlc++)
+	    make_frame(&frames[n_frames++], CAN_XR_FORMAT_FBFF, dlc, &seed);
+	make_frame(&frames[n_frames++], CAN_XR_FORMAT_CBFF, 8, &seed);
+
+	errors += transfer(brs ? "all DLCs, BRS" : "all DLCs, no BRS",
+			   n_frames * 700UL * BIT_TICKS);
+    }
+
+    printf("# all DLCs: %d frames, with and without BRS, %d errors\n",
+	   n_frames, errors);
+    return errors;
+}
+
+/* Transmit N_BACK_TO_BACK frames with 'format' and 'dlc', return the
+   payload bytes per nominal bit.
+*/
+double back_to_back(enum CAN_XR_Format format, int dlc, int *errors)
+{
+    unsigned long seed = 5;
+    double bits;
+
+    setup(CAN_XR_MAC_FD_BRS);
+    while(n_frames < N_BACK_TO_BACK)
+	make_frame(&frames[n_frames++], format, dlc, &seed);
+
+    *errors += transfer("back to back", N_BACK_TO_BACK * 700UL * BIT_TICKS);
+
+    bits = (double)(last_conf_ts - first_conf_ts) / BIT_TICKS
+	/ (N_BACK_TO_BACK - 1);
+    printf("# %s, %d bytes: %.1f nominal bits per frame\n",
+	   format == CAN_XR_FORMAT_FBFF ? "FBFF with BRS" : "CBFF",
+	   data_length(format, dlc), bits);
+
+    return data_length(format, dlc) / bits;
+}
+
+int run_throughput(void)
+{
+    int errors = 0;
+    double fd, classical;
+
+    fd = back_to_back(CAN_XR_FORMAT_FBFF, 15, &errors);
+    classical = back_to_back(CAN_XR_FORMAT_CBFF, 8, &errors);
+
+    if(fd <= 6.0 * classical)
+	errors++;
+
+    printf("# throughput: %.3f vs. %.3f bytes per nominal bit, "
+	   "speedup %.1fx, %d errors\n",
+	   fd, classical, fd / classical, errors);
+    return errors;
+}
+
+/* Node 2 has FD frames disabled, and only counts the frames it
+   receives, which must all be CBFF.
+*/
+void classical_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int node = *(int *)llc;
+
+    if(format == CAN_XR_FORMAT_CBFF)
+	n_ind[node]++;
+    else
+	n_fail++;
+}
+
+int run_fd_disabled(void)
+{
+    struct CAN_XR_MAC *mac;
+    unsigned long seed = 7;
+    int n_classical = 0, errors = 0;
+    int n;
+
+    setup(CAN_XR_MAC_FD_BRS);
+    mac = CAN_XR_Bus_MAC(&bus, 2);
+    CAN_XR_MAC_Set_FD_Mode(mac, CAN_XR_MAC_FD_DISABLED);
+    CAN_XR_MAC_Set_Data_Ind(mac, classical_data_ind);
+
+    for(n=0; n<8; n++)
+    {
+	make_frame(&frames[n_frames++],
+		   (n % 2) ? CAN_XR_FORMAT_CBFF : CAN_XR_FORMAT_FBFF,
+		   (n % 2) ? 8 : 9 + n, &seed);
+	n_classical += (n % 2);
+    }
+
+    next_frame();
+    CAN_XR_Bus_Run(&bus, n_frames * 700UL * BIT_TICKS);
+
+    if(n_conf != n_frames || n_ind[1] != n_frames
+       || n_ind[2] != n_classical || n_fail)
+	errors++;
+    for(n=0; n<N_NODES; n++)
+	if(bus_nodes[n].mac.state.tec || bus_nodes[n].mac.state.rec)
+	    errors++;
+
+    if(errors)
+	printf("! FD disabled: %d frames, %d confirmed, %d + %d received, "
+	       "%d failed\n", n_frames, n_conf, n_ind[1], n_ind[2], n_fail);
+
+    printf("# FD disabled: %d frames, %d CBFF received by node 2, "
+	   "%d errors\n", n_frames, n_ind[2], errors);
+    return errors;
+}
+
+/* Run the bus until node 0 requests the first recessive bit of its
+   frame from ERROR_BIT on, then drive the bus dominant from the next
+   tick for a bit and a half.  Return the bit, or -1 if node 0 never
+   got there.
+*/
+int drive_dominant(void)
+{
+    struct CAN_XR_MAC *mac = CAN_XR_Bus_MAC(&bus, 0);
+    const struct CAN_XR_MAC_TX_Slot *slot =
+	&(mac->state.tx_slots[mac->state.tx_queue[0]]);
+    int prev_index = 0, bit;
+    unsigned long t;
+
+    for(bit=ERROR_BIT; bit<slot->bitstream_bits; bit++)
+	if((slot->bitstream[bit >> 5] << (bit & 0x1F)) >> 31)
+	    break;
+
+    for(t=0; t<100UL * BIT_TICKS; t++)
+    {
+	CAN_XR_Bus_Run(&bus, 1);
+	if(prev_index == bit && mac->state.tx_bit_index == bit + 1)
+	{
+	    edges[0].ts = bus.nodeclock_ts + 1;
+	    edges[0].level = 0;
+	    edges[1].ts = bus.nodeclock_ts + 1 + 3 * DATA_BIT_TICKS / 2;
+	    edges[1].level = 1;
+	    CAN_XR_Bus_Set_Stimulus(&bus, edges, 2);
+	    return bit;
+	}
+	prev_index = mac->state.tx_bit_index;
+    }
+
+    return -1;
+}
+
+int run_data_phase_error(void)
+{
+    unsigned long seed = 9;
+    int errors = 0;
+    int bit, delay;
+
+    setup(CAN_XR_MAC_FD_BRS);
+    make_frame(&frames[n_frames++], CAN_XR_FORMAT_FBFF, 15, &seed);
+    next_frame();
+
+    bit = drive_dominant();
+    delay = bus_nodes[0].pcs.state.tdc_delay;
+    CAN_XR_Bus_Run(&bus, 1000UL * BIT_TICKS);
+
+    if(bit < 0 || delay != 1 || n_conf != 1 || n_ind[1] != 1
+       || n_ind[2] != 1 || n_fail
+       || bus_nodes[0].mac.state.tec != 7 || bus_nodes[0].mac.state.rec
+       || bus_nodes[1].mac.state.tec || bus_nodes[1].mac.state.rec
+       || bus_nodes[2].mac.state.tec || bus_nodes[2].mac.state.rec)
+    {
+	printf("! data phase error @bit %d: delay %d, %d confirmed, "
+	       "%d + %d received, %d failed, TEC %d\n",
+	       bit, delay, n_conf, n_ind[1], n_ind[2], n_fail,
+	       bus_nodes[0].mac.state.tec);
+	errors++;
+    }
+
+    printf("# data phase error @bit %d: transmitter delay %d tick, "
+	   "%d errors\n", bit, delay, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors are traced at levels 2 and 9, on purpose */
+    SET_TRACE_TRESHOLD(10);
+
+    errors += run_bitstream();
+    errors += run_all_dlcs();
+    errors += run_throughput();
+    errors += run_fd_disabled();
+    errors += run_data_phase_error();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
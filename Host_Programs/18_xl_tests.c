@@ -0,0 +1,591 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks XL frames, [2], on the bit-level bus
+   simulator, with the host build room for 2048 data bytes.  The XL
+   data phase is 8 times as fast as the arbitration phase, like the FD
+   one.
+
+   - The bitstream of XL frames with random lengths and additional
+     fields must match the one built by an independent reference
+     encoder.
+
+   - Node 0 transmits XL frames, up to 2048 bytes long, to nodes 1
+     and 2, mixed with FBFF and CBFF frames.  Node 1 receives XL
+     frames through xl_data_ind, with their additional fields, node 2
+     through data_ind.
+
+   - An XLFF request is refused when XL frames are disabled.
+
+   - Node 0 transmits 2048-byte XL frames back to back, then 64-byte
+     FBFF frames with bit rate switching.  The payload throughput of
+     the former must be higher.
+
+   - A dominant pulse in the XL data phase.  The transmitter must
+     signal the error and transmit the frame again.
+*/
+
+/* Nominal and data phase bit time, 10 quanta per bit */
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+const struct CAN_XR_PCS_Bit_Time_Parameters data_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1,
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 80
+#define DATA_BIT_TICKS 10
+#define SSP_OFFSET 7 /* At the data phase sample point */
+
+#define N_NODES 3
+#define N_RANDOM 100
+#define N_BACK_TO_BACK 5
+#define MAX_BITS 20000 /* More than any XL frame */
+#define ERROR_BIT 200 /* Corrupt the first recessive bit from here on */
+
+struct CAN_XR_Bus_Node bus_nodes[N_NODES];
+struct CAN_XR_Bus bus;
+struct CAN_XR_Bus_Edge edges[2];
+
+/* Frames node 0 transmits in a row, see next_frame */
+struct frame
+{
+    uint32_t identifier;
+    enum CAN_XR_Format format;
+    int dlc;
+    struct CAN_XR_XL_Control xl;
+    uint8_t data[2048];
+};
+
+struct frame frames[16];
+int n_frames, next_req;
+
+int node_numbers[N_NODES] = { 0, 1, 2 };
+int n_ind[N_NODES], n_conf, n_fail;
+unsigned long first_conf_ts, last_conf_ts;
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+static int data_length(enum CAN_XR_Format format, int dlc)
+{
+    return CAN_XR_DATA_LENGTH(format, dlc);
+}
+
+/* Reference encoder, following [2] to the letter, one bit per byte of
+   'bits'.  Return the number of bits.
+*/
+static uint32_t ref_crc(uint32_t crc, int bit, int n, uint32_t polynomial)
+{
+    uint32_t mask = 0xFFFFFFFFUL >> (32 - n);
+    int crcnxt = ((crc >> (n - 1)) & 0x1) ^ bit;
+
+    crc = (crc << 1) & mask;
+    return crcnxt ? (crc ^ polynomial) & mask : crc;
+}
+
+static int put_field(uint8_t *bits, int n, uint32_t v, int n_bits)
+{
+    while(n_bits-- > 0)
+	bits[n++] = (v >> n_bits) & 0x1;
+    return n;
+}
+
+int ref_encode(uint8_t *bits, const struct frame *f)
+{
+    static uint8_t raw[MAX_BITS];
+    uint8_t head[17];
+    int n_head = 0, n_raw = 0, n = 0, run = 0, n_stuff = 0;
+    int n_data = data_length(f->format, f->dlc);
+    uint32_t pcrc = 0x1FFF, fcrc = 0xFFFFFFFF;
+    int i, sc;
+
+    head[n_head++] = 0; /* SOF */
+    for(i=10; i>=0; i--)  head[n_head++] = (f->identifier >> i) & 0x1;
+    head[n_head++] = 0; /* RRS */
+    head[n_head++] = 0; /* IDE */
+    head[n_head++] = 1; /* FDF */
+    head[n_head++] = 1; /* XLF */
+    head[n_head++] = 0; /* resXL */
+
+    /* Dynamic stuff bits after 5 equal bits, stuff bits included */
+    for(i=0; i<n_head; i++)
+    {
+	bits[n] = head[i];
+	run = (n > 0 && bits[n] == bits[n-1]) ? run + 1 : 1;
+	n++;
+	if(run == 5 && i < n_head - 1)
+	{
+	    bits[n] = 1 - bits[n-1];
+	    n++;
+	    run = 1;
+	    n_stuff++;
+	}
+    }
+
+    /* Stuff bit count, Gray code and even parity, as in FD frames */
+    sc = (n_stuff % 8) ^ ((n_stuff % 8) >> 1);
+    sc = (sc << 1) | (((sc >> 2) ^ (sc >> 1) ^ sc) & 0x1);
+
+    /* The fields from SDT to the end of the data field */
+    n_raw = put_field(raw, n_raw, f->xl.sdt, 8);
+    n_raw = put_field(raw, n_raw, f->xl.sec, 1);
+    n_raw = put_field(raw, n_raw, f->dlc, 11);
+    n_raw = put_field(raw, n_raw, sc, 4);
+    for(i=0; i<n; i++)
+	pcrc = ref_crc(pcrc, bits[i], 13, 0x1C1F);
+    for(i=0; i<n_raw; i++)
+	pcrc = ref_crc(pcrc, raw[i], 13, 0x1C1F);
+    n_raw = put_field(raw, n_raw, pcrc, 13);
+    n_raw = put_field(raw, n_raw, f->xl.vcid, 8);
+    n_raw = put_field(raw, n_raw, f->xl.af, 32);
+    for(i=0; i<n_data; i++)
+	n_raw = put_field(raw, n_raw, f->data[i], 8);
+
+    for(i=0; i<n; i++)
+	fcrc = ref_crc(fcrc, bits[i], 32, 0xF1922815);
+    for(i=0; i<n_raw; i++)
+	fcrc = ref_crc(fcrc, raw[i], 32, 0xF1922815);
+    n_raw = put_field(raw, n_raw, fcrc, 32);
+
+    /* ADS, then everything else with a fixed stuff bit every 10 bits,
+       not after the last one.
+    */
+    n = put_field(bits, n, 0xE, 4);
+    for(i=0; i<n_raw; i++)
+    {
+	if(i > 0 && i % 10 == 0)
+	{
+	    bits[n] = 1 - bits[n-1];
+	    n++;
+	}
+	bits[n++] = raw[i];
+    }
+
+    /* FCP, DAS, ACK to EOF */
+    n = put_field(bits, n, 0xC, 4);
+    n = put_field(bits, n, 0xD, 4);
+    n = put_field(bits, n, 0x1FF, 9);
+
+    return n;
+}
+
+void make_frame(struct frame *f, enum CAN_XR_Format format, int dlc,
+		unsigned long *seed)
+{
+    int i;
+
+    f->identifier = rnd(seed) & 0x7FF;
+    f->format = format;
+    f->dlc = dlc;
+    f->xl.sdt = rnd(seed);
+    f->xl.sec = rnd(seed) & 0x1;
+    f->xl.vcid = rnd(seed);
+    f->xl.af = ((uint32_t)rnd(seed) << 8) ^ rnd(seed);
+    for(i=0; i<2048; i++)
+	f->data[i] = (i < data_length(format, dlc)) ? rnd(seed) : 0;
+}
+
+void next_frame(void)
+{
+    struct frame *f;
+
+    if(next_req < n_frames)
+    {
+	f = &frames[next_req++];
+	if(f->format == CAN_XR_FORMAT_XLFF)
+	    CAN_XR_MAC_XL_Data_Req(CAN_XR_Bus_MAC(&bus, 0), f->identifier,
+				   &f->xl, f->dlc, f->data);
+	else
+	    CAN_XR_MAC_Data_Req(CAN_XR_Bus_MAC(&bus, 0), f->identifier,
+				f->format, f->dlc, f->data);
+    }
+}
+
+/* Check the next frame 'node' receives, 'xl' is NULL if unknown */
+void check_frame(
+    int node, uint32_t identifier, enum CAN_XR_Format format,
+    const struct CAN_XR_XL_Control *xl, int dlc, uint8_t *data)
+{
+    const struct frame *f = &frames[n_ind[node] % n_frames];
+
+    if(identifier == f->identifier && format == f->format && dlc == f->dlc
+       && !memcmp(data, f->data, data_length(format, dlc))
+       && (!xl || (xl->sdt == f->xl.sdt && xl->sec == f->xl.sec
+		   && xl->vcid == f->xl.vcid && xl->af == f->xl.af)))
+	n_ind[node]++;
+    else
+    {
+	printf("! node %d: frame %d id 0x%03x dlc %d format %d mismatch\n",
+	       node, n_ind[node], (unsigned int)identifier, dlc, format);
+	n_fail++;
+    }
+}
+
+void check_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int node = *(int *)llc;
+
+    if(node == 0)
+	return;
+
+    /* Node 1 must get XL frames through xl_data_ind */
+    if(node == 1 && format == CAN_XR_FORMAT_XLFF)
+    {
+	printf("! node 1: XL frame through data_ind\n");
+	n_fail++;
+    }
+
+    check_frame(node, identifier, format, NULL, dlc, data);
+}
+
+void check_xl_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    const struct CAN_XR_XL_Control *xl, int dlc, uint8_t *data)
+{
+    int node = *(int *)llc;
+
+    if(node == 0)
+	return;
+
+    check_frame(node, identifier, CAN_XR_FORMAT_XLFF, xl, dlc, data);
+}
+
+void check_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	if(n_conf++ == 0)
+	    first_conf_ts = ts;
+	last_conf_ts = ts;
+	next_frame();
+    }
+    else
+	n_fail++;
+}
+
+/* Set up the bus, with FD frames with bit rate switching and XL
+   frames enabled on all nodes.
+*/
+void setup(void)
+{
+    struct CAN_XR_MAC *mac;
+    int n;
+
+    CAN_XR_Bus_Init(&bus, bus_nodes, N_NODES, &pcs_parameters);
+    for(n=0; n<N_NODES; n++)
+    {
+	CAN_XR_PCS_Set_Data_Bit_Time(
+	    &bus_nodes[n].pcs, &data_parameters, SSP_OFFSET);
+	CAN_XR_PCS_Set_XL_Data_Bit_Time(
+	    &bus_nodes[n].pcs, &data_parameters, SSP_OFFSET);
+	mac = CAN_XR_Bus_MAC(&bus, n);
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(mac, check_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, check_data_conf);
+	CAN_XR_MAC_Set_FD_Mode(mac, CAN_XR_MAC_FD_BRS);
+	CAN_XR_MAC_Set_XL_Mode(mac, 1);
+	n_ind[n] = 0;
+    }
+
+    CAN_XR_MAC_Set_XL_Data_Ind(CAN_XR_Bus_MAC(&bus, 1), check_xl_data_ind);
+    n_conf = n_fail = 0;
+    n_frames = next_req = 0;
+}
+
+/* Compare the bitstream MAC_XL_Data.Request encodes for 'f' with the
+   reference one.  Return the number of errors.
+*/
+int check_bitstream(const struct frame *f)
+{
+    static uint8_t bits[MAX_BITS];
+    struct CAN_XR_MAC *mac;
+    const struct CAN_XR_MAC_TX_Slot *slot;
+    int n, i;
+
+    setup();
+    mac = CAN_XR_Bus_MAC(&bus, 0);
+    CAN_XR_MAC_XL_Data_Req(mac, f->identifier, &f->xl, f->dlc,
+			   (uint8_t *)f->data);
+    slot = &mac->state.tx_slots[mac->state.tx_queue[0]];
+
+    n = ref_encode(bits, f);
+    if(mac->state.data_req_pending != 1 || slot->bitstream_bits != n)
+    {
+	printf("! id 0x%03x dlc %d: %d bits instead of %d\n",
+	       (unsigned int)f->identifier, f->dlc,
+	       slot->bitstream_bits, n);
+	return 1;
+    }
+
+    for(i=0; i<n; i++)
+	if(((slot->bitstream[i >> 5] << (i & 0x1F)) >> 31) != bits[i])
+	{
+	    printf("! id 0x%03x dlc %d: bit %d differs\n",
+		   (unsigned int)f->identifier, f->dlc, i);
+	    return 1;
+	}
+
+    return 0;
+}
+
+int run_bitstream(void)
+{
+    unsigned long seed = 17;
+    struct frame f;
+    int errors = 0;
+    int i, dlc;
+
+    for(i=0; i<N_RANDOM; i++)
+    {
+	dlc = (i == 0) ? 2047 : (i == 1) ? 0 : rnd(&seed) & 0x7FF;
+	make_frame(&f, CAN_XR_FORMAT_XLFF, dlc, &seed);
+
+	/* Long runs of equal bits, for stuff bits everywhere */
+	if(i % 3 == 0)
+	{
+	    f.identifier = (i & 0x4) ? 0x7FF : 0x000;
+	    memset(f.data, (i & 0x4) ? 0xFF : 0x00, sizeof(f.data));
+	}
+
+	errors += check_bitstream(&f);
+    }
+
+    printf("# bitstream: %d frames, %d errors\n", N_RANDOM, errors);
+    return errors;
+}
+
+/* Transmit frames[] from node 0, return the number of errors. */
+int transfer(const char *what, unsigned long max_ticks)
+{
+    int errors = 0;
+    int n;
+
+    next_frame();
+    CAN_XR_Bus_Run(&bus, max_ticks);
+
+    for(n=1; n<N_NODES; n++)
+	if(n_ind[n] != n_frames)
+	    errors++;
+    if(n_conf != n_frames || n_fail)
+	errors++;
+    for(n=0; n<N_NODES; n++)
+	if(bus_nodes[n].pcs.state.data_phase
+	   || bus_nodes[n].mac.state.tec || bus_nodes[n].mac.state.rec)
+	    errors++;
+
+    if(errors)
+	printf("! %s: %d frames, %d confirmed, %d + %d received, "
+	       "%d failed\n", what, n_frames, n_conf, n_ind[1], n_ind[2],
+	       n_fail);
+    return errors;
+}
+
+int run_mixed(void)
+{
+    static const int xl_dlcs[] = { 0, 7, 63, 255, 1000, 2047 };
+    unsigned long seed = 1;
+    int errors = 0;
+    int i;
+
+    setup();
+    for(i=0; i<6; i++)
+    {
+	make_frame(&frames[n_frames++], CAN_XR_FORMAT_XLFF, xl_dlcs[i],
+		   &seed);
+	make_frame(&frames[n_frames++],
+		   (i & 0x1) ? CAN_XR_FORMAT_CBFF : CAN_XR_FORMAT_FBFF,
+		   (i & 0x1) ? 8 : 15, &seed);
+    }
+
+    errors += transfer("mixed", 200000UL * BIT_TICKS);
+    printf("# mixed: %d frames, XL up to 2048 bytes, %d errors\n",
+	   n_frames, errors);
+    return errors;
+}
+
+/* An XLFF request must be refused if XL frames are disabled. */
+int run_xl_disabled(void)
+{
+    unsigned long seed = 3;
+    int errors = 0;
+
+    setup();
+    CAN_XR_MAC_Set_XL_Mode(CAN_XR_Bus_MAC(&bus, 0), 0);
+    make_frame(&frames[n_frames++], CAN_XR_FORMAT_XLFF, 7, &seed);
+    next_frame();
+
+    if(n_fail != 1 || bus_nodes[0].mac.state.data_req_pending)
+	errors++;
+
+    printf("# XL disabled: %d refused, %d errors\n", n_fail, errors);
+    return errors;
+}
+
+/* Transmit N_BACK_TO_BACK frames with 'format' and 'dlc', return the
+   payload bytes per nominal bit.
+*/
+double back_to_back(enum CAN_XR_Format format, int dlc, int *errors)
+{
+    unsigned long seed = 5;
+    double bits;
+
+    setup();
+    while(n_frames < N_BACK_TO_BACK)
+	make_frame(&frames[n_frames++], format, dlc, &seed);
+
+    *errors += transfer("back to back",
+			N_BACK_TO_BACK * 30000UL * BIT_TICKS);
+
+    bits = (double)(last_conf_ts - first_conf_ts) / BIT_TICKS
+	/ (N_BACK_TO_BACK - 1);
+    printf("# %s, %d bytes: %.1f nominal bits per frame\n",
+	   format == CAN_XR_FORMAT_XLFF ? "XLFF" : "FBFF with BRS",
+	   data_length(format, dlc), bits);
+
+    return data_length(format, dlc) / bits;
+}
+
+int run_throughput(void)
+{
+    int errors = 0;
+    double xl, fd;
+
+    xl = back_to_back(CAN_XR_FORMAT_XLFF, 2047, &errors);
+    fd = back_to_back(CAN_XR_FORMAT_FBFF, 15, &errors);
+
+    if(xl <= fd)
+	errors++;
+
+    printf("# throughput: %.3f vs. %.3f bytes per nominal bit, "
+	   "speedup %.2fx, %d errors\n",
+	   xl, fd, xl / fd, errors);
+    return errors;
+}
+
+/* Same as in 17_fd_tests.c */
+int drive_dominant(void)
+{
+    struct CAN_XR_MAC *mac = CAN_XR_Bus_MAC(&bus, 0);
+    const struct CAN_XR_MAC_TX_Slot *slot =
+	&(mac->state.tx_slots[mac->state.tx_queue[0]]);
+    int prev_index = 0, bit;
+    unsigned long t;
+
+    for(bit=ERROR_BIT; bit<slot->bitstream_bits; bit++)
+	if((slot->bitstream[bit >> 5] << (bit & 0x1F)) >> 31)
+	    break;
+
+    for(t=0; t<1000UL * BIT_TICKS; t++)
+    {
+	CAN_XR_Bus_Run(&bus, 1);
+	if(prev_index == bit && mac->state.tx_bit_index == bit + 1)
+	{
+	    edges[0].ts = bus.nodeclock_ts + 1;
+	    edges[0].level = 0;
+	    edges[1].ts = bus.nodeclock_ts + 1 + 3 * DATA_BIT_TICKS / 2;
+	    edges[1].level = 1;
+	    CAN_XR_Bus_Set_Stimulus(&bus, edges, 2);
+	    return bit;
+	}
+	prev_index = mac->state.tx_bit_index;
+    }
+
+    return -1;
+}
+
+int run_data_phase_error(void)
+{
+    unsigned long seed = 9;
+    int errors = 0;
+    int bit;
+
+    setup();
+    make_frame(&frames[n_frames++], CAN_XR_FORMAT_XLFF, 255, &seed);
+    next_frame();
+
+    bit = drive_dominant();
+    CAN_XR_Bus_Run(&bus, 5000UL * BIT_TICKS);
+
+    if(bit < 0 || n_conf != 1 || n_ind[1] != 1 || n_ind[2] != 1 || n_fail
+       || bus_nodes[0].mac.state.tec != 7 || bus_nodes[0].mac.state.rec
+       || bus_nodes[1].mac.state.tec || bus_nodes[1].mac.state.rec
+       || bus_nodes[2].mac.state.tec || bus_nodes[2].mac.state.rec)
+    {
+	printf("! data phase error @bit %d: %d confirmed, "
+	       "%d + %d received, %d failed, TEC %d\n",
+	       bit, n_conf, n_ind[1], n_ind[2], n_fail,
+	       bus_nodes[0].mac.state.tec);
+	errors++;
+    }
+
+    printf("# data phase error @bit %d: %d errors\n", bit, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors are traced at levels 2 and 9, on purpose */
+    SET_TRACE_TRESHOLD(10);
+
+    errors += run_bitstream();
+    errors += run_mixed();
+    errors += run_xl_disabled();
+    errors += run_throughput();
+    errors += run_data_phase_error();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the stream indications for cut-through
+   processing and early frame validation on the bit-level bus
+   simulator.  Node 0 transmits, node 1 streams with early validation
+   and node 2 is a plain receiver.
+
+   - For CBFF, FBFF and XL frames, node 1 must get the header, each
+     data byte in order and the CRC indication, in this order, before
+     data_ind.  The header must come well before data_ind.
+
+   - Node 1 must get data_ind exactly one bit before node 2, at the
+     last but one bit of EOF.
+
+   - A 7-bit dominant pulse in the data field.  Node 1 must get a
+     stream abort, then the whole sequence again for the
+     retransmission, and the frame only once.
+*/
+
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+const struct CAN_XR_PCS_Bit_Time_Parameters data_parameters = {
+    .prescaler_m = 1,
+    .sync_seg = 1,
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 80
+#define SSP_OFFSET 7
+
+#define N_NODES 3
+
+struct CAN_XR_Bus_Node bus_nodes[N_NODES];
+struct CAN_XR_Bus bus;
+struct CAN_XR_Bus_Edge edges[2];
+
+struct frame
+{
+    uint32_t identifier;
+    enum CAN_XR_Format format;
+    int dlc;
+    uint8_t data[256];
+};
+
+struct frame frames[3];
+int n_frames, next_req;
+
+/* What node 1 and 2 have seen so far */
+int node_numbers[N_NODES] = { 0, 1, 2 };
+int n_header, n_bytes, n_crc, n_abort, n_fail;
+int n_ind[N_NODES], n_conf;
+unsigned long header_ts, ind_ts[N_NODES];
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+void make_frame(struct frame *f, enum CAN_XR_Format format, int dlc,
+		unsigned long *seed)
+{
+    int i;
+
+    f->identifier = rnd(seed) & 0x7FF;
+    f->format = format;
+    f->dlc = dlc;
+    for(i=0; i<256; i++)
+	f->data[i] = rnd(seed);
+}
+
+void next_frame(void)
+{
+    struct frame *f;
+
+    if(next_req < n_frames)
+    {
+	f = &frames[next_req++];
+	CAN_XR_MAC_Data_Req(CAN_XR_Bus_MAC(&bus, 0), f->identifier,
+			    f->format, f->dlc, f->data);
+    }
+}
+
+static void fail(const char *what)
+{
+    printf("! frame %d: %s\n", n_ind[1], what);
+    n_fail++;
+}
+
+void header_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc)
+{
+    const struct frame *f = &frames[n_ind[1] % n_frames];
+
+    if(*(int *)llc != 1)
+	return;
+
+    if(identifier != f->identifier || format != f->format || dlc != f->dlc
+       || n_bytes || n_crc)
+	fail("bad header");
+
+    n_header++;
+    header_ts = ts;
+}
+
+void byte_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, int index, uint8_t byte)
+{
+    const struct frame *f = &frames[n_ind[1] % n_frames];
+
+    if(*(int *)llc != 1)
+	return;
+
+    if(index != n_bytes || byte != f->data[index] || !n_header || n_crc)
+	fail("bad byte");
+
+    n_bytes++;
+}
+
+void crc_ind(struct CAN_XR_LLC *llc, unsigned long ts)
+{
+    const struct frame *f = &frames[n_ind[1] % n_frames];
+
+    if(*(int *)llc != 1)
+	return;
+
+    if(n_bytes != CAN_XR_DATA_LENGTH(f->format, f->dlc) || n_crc)
+	fail("bad CRC indication");
+
+    n_crc++;
+}
+
+void abort_ind(struct CAN_XR_LLC *llc, unsigned long ts)
+{
+    if(*(int *)llc != 1)
+	return;
+
+    n_abort++;
+    n_header = n_bytes = n_crc = 0;
+}
+
+void check_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int node = *(int *)llc;
+    const struct frame *f = &frames[n_ind[node] % n_frames];
+
+    if(node == 0)
+	return;
+
+    if(identifier != f->identifier || format != f->format || dlc != f->dlc
+       || memcmp(data, f->data, CAN_XR_DATA_LENGTH(format, dlc)))
+	fail("data_ind mismatch");
+
+    if(node == 1)
+    {
+	if(n_header != 1 || !n_crc)
+	    fail("data_ind before stream indications");
+	if(ts - header_ts < 10 * BIT_TICKS)
+	    fail("header too late");
+	n_header = n_bytes = n_crc = 0;
+    }
+
+    ind_ts[node] = ts;
+    n_ind[node]++;
+}
+
+void check_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	n_conf++;
+	next_frame();
+    }
+    else
+	n_fail++;
+}
+
+void setup(void)
+{
+    struct CAN_XR_MAC *mac;
+    int n;
+
+    CAN_XR_Bus_Init(&bus, bus_nodes, N_NODES, &pcs_parameters);
+    for(n=0; n<N_NODES; n++)
+    {
+	CAN_XR_PCS_Set_Data_Bit_Time(
+	    &bus_nodes[n].pcs, &data_parameters, SSP_OFFSET);
+	CAN_XR_PCS_Set_XL_Data_Bit_Time(
+	    &bus_nodes[n].pcs, &data_parameters, SSP_OFFSET);
+	mac = CAN_XR_Bus_MAC(&bus, n);
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(mac, check_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, check_data_conf);
+	CAN_XR_MAC_Set_FD_Mode(mac, CAN_XR_MAC_FD_BRS);
+	CAN_XR_MAC_Set_XL_Mode(mac, 1);
+	n_ind[n] = 0;
+	ind_ts[n] = 0;
+    }
+
+    mac = CAN_XR_Bus_MAC(&bus, 1);
+    CAN_XR_MAC_Set_Stream_Ind(mac, header_ind, byte_ind, crc_ind, abort_ind);
+    CAN_XR_MAC_Set_Early_Validation(mac, 1);
+
+    n_header = n_bytes = n_crc = n_abort = n_fail = 0;
+    n_conf = 0;
+    n_frames = next_req = 0;
+}
+
+/* Transmit one frame with 'format' and 'dlc' */
+int run_format(enum CAN_XR_Format format, int dlc, const char *what)
+{
+    unsigned long seed = dlc + 1;
+    int errors = 0;
+
+    setup();
+    make_frame(&frames[n_frames++], format, dlc, &seed);
+    next_frame();
+    CAN_XR_Bus_Run(&bus, 5000UL * BIT_TICKS);
+
+    if(n_conf != 1 || n_ind[1] != 1 || n_ind[2] != 1 || n_abort || n_fail
+       || ind_ts[2] - ind_ts[1] != BIT_TICKS)
+    {
+	printf("! %s: %d confirmed, %d + %d received, %d aborted, "
+	       "%d failed, node 1 @%lu, node 2 @%lu\n", what,
+	       n_conf, n_ind[1], n_ind[2], n_abort, n_fail,
+	       ind_ts[1], ind_ts[2]);
+	errors++;
+    }
+
+    printf("# %s: header %lu nominal bits before validation, "
+	   "%d errors\n", what, (ind_ts[1] - header_ts) / BIT_TICKS, errors);
+    return errors;
+}
+
+/* Corrupt the frame with a 7-bit dominant pulse after its third data
+   byte, a stuff error for everybody.
+*/
+int run_abort(void)
+{
+    unsigned long seed = 11;
+    unsigned long t;
+    int errors = 0;
+
+    setup();
+    make_frame(&frames[n_frames++], CAN_XR_FORMAT_CBFF, 8, &seed);
+    next_frame();
+
+    for(t=0; t<1000UL * BIT_TICKS && n_bytes < 3; t++)
+	CAN_XR_Bus_Run(&bus, 1);
+
+    edges[0].ts = bus.nodeclock_ts + 1;
+    edges[0].level = 0;
+    edges[1].ts = bus.nodeclock_ts + 1 + 7 * BIT_TICKS;
+    edges[1].level = 1;
+    CAN_XR_Bus_Set_Stimulus(&bus, edges, 2);
+    CAN_XR_Bus_Run(&bus, 1000UL * BIT_TICKS);
+
+    if(n_abort != 1 || n_conf != 1 || n_ind[1] != 1 || n_ind[2] != 1
+       || n_fail)
+    {
+	printf("! abort: %d aborted, %d confirmed, %d + %d received, "
+	       "%d failed\n", n_abort, n_conf, n_ind[1], n_ind[2], n_fail);
+	errors++;
+    }
+
+    printf("# abort: %d aborted, %d errors\n", n_abort, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors are traced at levels 2 and 9, on purpose */
+    SET_TRACE_TRESHOLD(10);
+
+    errors += run_format(CAN_XR_FORMAT_CBFF, 8, "CBFF");
+    errors += run_format(CAN_XR_FORMAT_FBFF, 15, "FBFF");
+    errors += run_format(CAN_XR_FORMAT_XLFF, 255, "XLFF");
+    errors += run_abort();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
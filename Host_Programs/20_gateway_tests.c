@@ -0,0 +1,313 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Gateway.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the store-and-forward gateway on two bit-level
+   bus simulators, A and B, run in lockstep so that they share the
+   same time base.  Node 0 of each bus is one side of the gateway,
+   node 1 is an application node.
+
+   - Route A 0x100-0x10F to B 0x200-0x20F, XOR-ing the payload, and
+     route B 0x200-0x20F back to A 0x100-0x10F.  A burst of four
+     frames from A must reach B translated and transformed, in order,
+     and must not bounce back to A.  The latency of the route must be
+     measured for all of them, and be sane.
+
+   - Route B 0x300 to A 0x050, truncating the payload to 2 bytes, and
+     B 0x301 to A 0x051 with a transform that drops the frame.
+
+   - Identifier 0x400 is not routed and must not be forwarded.
+*/
+
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 80
+
+#define N_NODES 2
+
+struct CAN_XR_Bus_Node nodes_a[N_NODES], nodes_b[N_NODES];
+struct CAN_XR_Bus bus_a, bus_b;
+struct CAN_XR_Gateway gw;
+
+/* Frames received by the application nodes */
+struct frame
+{
+    uint32_t identifier;
+    int dlc;
+    uint8_t data[8];
+};
+
+#define MAX_RX 16
+
+struct rx
+{
+    struct CAN_XR_MAC *mac;
+    int n;
+    struct frame frames[MAX_RX];
+};
+
+struct rx rx_a, rx_b;
+int n_fail;
+
+void app_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct rx *rx = (struct rx *)llc;
+    struct frame *f;
+
+    /* Skip our own frames */
+    if(rx->mac->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME)
+	return;
+
+    if(rx->n == MAX_RX)
+    {
+	n_fail++;
+	return;
+    }
+
+    f = &rx->frames[rx->n++];
+    f->identifier = identifier;
+    f->dlc = dlc;
+    memcpy(f->data, data, (dlc > 8) ? 8 : dlc);
+}
+
+void app_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status != CAN_XR_MAC_TX_STATUS_SUCCESS)
+	n_fail++;
+}
+
+int xor_transform(
+    void *ctx, uint32_t identifier, enum CAN_XR_Format format, int dlc,
+    uint8_t *data)
+{
+    int i;
+
+    for(i=0; i<dlc && i<8; i++)
+	data[i] ^= 0xFF;
+    return dlc;
+}
+
+int truncate_transform(
+    void *ctx, uint32_t identifier, enum CAN_XR_Format format, int dlc,
+    uint8_t *data)
+{
+    return (dlc > 2) ? 2 : dlc;
+}
+
+int drop_transform(
+    void *ctx, uint32_t identifier, enum CAN_XR_Format format, int dlc,
+    uint8_t *data)
+{
+    return -1;
+}
+
+void setup(void)
+{
+    CAN_XR_Bus_Init(&bus_a, nodes_a, N_NODES, &pcs_parameters);
+    CAN_XR_Bus_Init(&bus_b, nodes_b, N_NODES, &pcs_parameters);
+    CAN_XR_Gateway_Init(&gw, CAN_XR_Bus_MAC(&bus_a, 0),
+			CAN_XR_Bus_MAC(&bus_b, 0));
+
+    rx_a.mac = CAN_XR_Bus_MAC(&bus_a, 1);
+    rx_a.n = 0;
+    CAN_XR_MAC_Set_LLC(rx_a.mac, (struct CAN_XR_LLC *)&rx_a);
+    CAN_XR_MAC_Set_Data_Ind(rx_a.mac, app_data_ind);
+    CAN_XR_MAC_Set_Data_Conf(rx_a.mac, app_data_conf);
+
+    rx_b.mac = CAN_XR_Bus_MAC(&bus_b, 1);
+    rx_b.n = 0;
+    CAN_XR_MAC_Set_LLC(rx_b.mac, (struct CAN_XR_LLC *)&rx_b);
+    CAN_XR_MAC_Set_Data_Ind(rx_b.mac, app_data_ind);
+    CAN_XR_MAC_Set_Data_Conf(rx_b.mac, app_data_conf);
+
+    n_fail = 0;
+}
+
+/* Run both buses in lockstep */
+void run(unsigned long ticks)
+{
+    unsigned long t;
+
+    for(t=0; t<ticks; t++)
+    {
+	CAN_XR_Bus_Run(&bus_a, 1);
+	CAN_XR_Bus_Run(&bus_b, 1);
+    }
+}
+
+int run_range(void)
+{
+    const struct CAN_XR_Gateway_Route *r;
+    uint8_t data[4][8];
+    int errors = 0;
+    int i, j;
+
+    setup();
+    if(CAN_XR_Gateway_Add_Route(&gw, 0, 0x100, 0x10F, 0x200,
+				xor_transform, NULL) != 0
+       || CAN_XR_Gateway_Add_Route(&gw, 1, 0x200, 0x20F, 0x100,
+				   NULL, NULL) != 1
+       || CAN_XR_Gateway_Add_Route(&gw, 0, 0x7F0, 0x7FF, 0x7F8,
+				   NULL, NULL) != -1)
+    {
+	printf("! range: bad Add_Route\n");
+	return 1;
+    }
+
+    for(i=0; i<4; i++)
+    {
+	for(j=0; j<8; j++)
+	    data[i][j] = i * 16 + j;
+	CAN_XR_MAC_Data_Req(rx_a.mac, 0x100 + i, CAN_XR_FORMAT_CBFF, 8,
+			    data[i]);
+    }
+
+    run(1000UL * BIT_TICKS);
+
+    r = CAN_XR_Gateway_Get_Route(&gw, 0);
+    if(rx_b.n != 4 || rx_a.n != 0 || n_fail || r->n_forwarded != 4
+       || r->n_measured != 4 || r->n_dropped || r->n_failed
+       || CAN_XR_Gateway_Get_Route(&gw, 1)->n_forwarded)
+    {
+	printf("! range: %d received on B, %d on A, %d failed, "
+	       "%lu forwarded, %lu measured\n", rx_b.n, rx_a.n, n_fail,
+	       r->n_forwarded, r->n_measured);
+	errors++;
+    }
+
+    for(i=0; i<rx_b.n && i<4; i++)
+    {
+	if(rx_b.frames[i].identifier != 0x200 + i || rx_b.frames[i].dlc != 8)
+	    errors++;
+	for(j=0; j<8; j++)
+	    if(rx_b.frames[i].data[j] != (data[i][j] ^ 0xFF))
+		errors++;
+    }
+
+    /* B is idle when the first frame arrives, and gets the others as
+       fast as A, give or take some stuff bits.  A frame must never
+       wait for a whole frame on B.
+    */
+    if(r->latency_min > r->latency_max
+       || r->latency_max > 16 * BIT_TICKS)
+    {
+	printf("! range: latency %lu-%lu\n", r->latency_min, r->latency_max);
+	errors++;
+    }
+
+    printf("# range: latency %lu-%lu bits, average %lu ticks, %d errors\n",
+	   r->latency_min / BIT_TICKS, r->latency_max / BIT_TICKS,
+	   r->n_measured ? r->latency_sum / r->n_measured : 0, errors);
+    return errors;
+}
+
+int run_transform(void)
+{
+    const struct CAN_XR_Gateway_Route *r0, *r1;
+    uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    int errors = 0;
+
+    setup();
+    CAN_XR_Gateway_Add_Route(&gw, 1, 0x300, 0x300, 0x050,
+			     truncate_transform, NULL);
+    CAN_XR_Gateway_Add_Route(&gw, 1, 0x301, 0x301, 0x051,
+			     drop_transform, NULL);
+    CAN_XR_MAC_Data_Req(rx_b.mac, 0x300, CAN_XR_FORMAT_CBFF, 8, data);
+    CAN_XR_MAC_Data_Req(rx_b.mac, 0x301, CAN_XR_FORMAT_CBFF, 8, data);
+
+    run(1000UL * BIT_TICKS);
+
+    r0 = CAN_XR_Gateway_Get_Route(&gw, 0);
+    r1 = CAN_XR_Gateway_Get_Route(&gw, 1);
+    if(rx_a.n != 1 || rx_b.n != 0 || n_fail
+       || rx_a.frames[0].identifier != 0x050 || rx_a.frames[0].dlc != 2
+       || rx_a.frames[0].data[0] != 1 || rx_a.frames[0].data[1] != 2
+       || r0->n_forwarded != 1 || r1->n_forwarded || r1->n_dropped != 1)
+    {
+	printf("! transform: %d received on A, %d on B, %d failed, "
+	       "%lu dropped\n", rx_a.n, rx_b.n, n_fail, r1->n_dropped);
+	errors++;
+    }
+
+    printf("# transform: %d errors\n", errors);
+    return errors;
+}
+
+int run_unrouted(void)
+{
+    uint8_t data[8] = { 0 };
+    int errors = 0;
+
+    setup();
+    CAN_XR_Gateway_Add_Route(&gw, 0, 0x100, 0x10F, 0x200, NULL, NULL);
+    CAN_XR_MAC_Data_Req(rx_a.mac, 0x400, CAN_XR_FORMAT_CBFF, 8, data);
+
+    run(500UL * BIT_TICKS);
+
+    if(rx_a.n || rx_b.n || n_fail
+       || CAN_XR_Gateway_Get_Route(&gw, 0)->n_forwarded)
+    {
+	printf("! unrouted: %d received on B\n", rx_b.n);
+	errors++;
+    }
+
+    printf("# unrouted: %d errors\n", errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    SET_TRACE_TRESHOLD(10);
+
+    errors += run_range();
+    errors += run_transform();
+    errors += run_unrouted();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,405 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_Bus.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Pool.h>
+#include <CAN_XR_Gateway.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks the frame pool, by itself and for zero-copy
+   fan-out of received frames on the bit-level bus simulator.
+
+   - Allocation, references and handle lookup.
+
+   - Node 0 transmits a sequence of frames, node 1 has a pool.  Both
+     data_ind and a dispatch subscriber get the same buffer for each
+     frame and keep it.  When the pool runs out, the MAC must fall
+     back to rx_data[] and CAN_XR_Pool_Hold must fail.  When all
+     buffers are released, they must be back in the pool.
+
+   - A gateway forwards frames from bus A to bus B, which is busy
+     with higher-priority traffic.  Without a pool, the frames that
+     do not fit into the TX slots are dropped.  With a pool on bus A,
+     they wait in the backlog and all of them reach bus B, in order.
+*/
+
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 80
+
+#define N_NODES 2
+
+struct CAN_XR_Bus_Node nodes_a[N_NODES], nodes_b[N_NODES];
+struct CAN_XR_Bus bus_a, bus_b;
+struct CAN_XR_Gateway gw;
+struct CAN_XR_Pool pool;
+struct CAN_XR_Dispatch dispatch;
+
+int n_fail;
+
+static void fill(uint8_t *data, int n)
+{
+    int i;
+
+    for(i=0; i<8; i++)
+	data[i] = n * 8 + i;
+}
+
+/* --- Pool by itself --- */
+
+int run_pool(void)
+{
+    int frames[CAN_XR_POOL_FRAMES];
+    uint8_t other[8];
+    int errors = 0;
+    int i;
+
+    CAN_XR_Pool_Init(&pool);
+    for(i=0; i<CAN_XR_POOL_FRAMES; i++)
+    {
+	frames[i] = CAN_XR_Pool_Alloc(&pool);
+	if(frames[i] < 0 || CAN_XR_Pool_Refs(&pool, frames[i]) != 1
+	   || CAN_XR_Pool_Handle(
+	       &pool, CAN_XR_Pool_Data(&pool, frames[i])) != frames[i])
+	    errors++;
+    }
+
+    if(CAN_XR_Pool_Alloc(&pool) != -1 || pool.exhausted != 1
+       || CAN_XR_Pool_Free(&pool) != 0)
+	errors++;
+
+    /* Not in the pool, or not at the beginning of a buffer */
+    if(CAN_XR_Pool_Handle(&pool, other) != -1
+       || CAN_XR_Pool_Handle(&pool, CAN_XR_Pool_Data(&pool, 0) + 1) != -1
+       || CAN_XR_Pool_Handle(NULL, other) != -1)
+	errors++;
+
+    /* Two references, the buffer returns with the second release */
+    if(CAN_XR_Pool_Hold(&pool, CAN_XR_Pool_Data(&pool, frames[3]))
+       != frames[3])
+	errors++;
+    CAN_XR_Pool_Release(&pool, frames[3]);
+    if(CAN_XR_Pool_Free(&pool) != 0)
+	errors++;
+    CAN_XR_Pool_Release(&pool, frames[3]);
+    if(CAN_XR_Pool_Free(&pool) != 1
+       || CAN_XR_Pool_Handle(&pool, CAN_XR_Pool_Data(&pool, frames[3]))
+       != -1
+       || CAN_XR_Pool_Alloc(&pool) != frames[3])
+	errors++;
+
+    for(i=0; i<CAN_XR_POOL_FRAMES; i++)
+	CAN_XR_Pool_Release(&pool, frames[i]);
+    if(CAN_XR_Pool_Free(&pool) != CAN_XR_POOL_FRAMES)
+	errors++;
+
+    if(errors)
+	printf("! pool: %d errors\n", errors);
+    printf("# pool: %d errors\n", errors);
+    return errors;
+}
+
+/* --- Fan-out --- */
+
+#define N_FANOUT (CAN_XR_POOL_FRAMES + 2)
+
+int node_numbers[N_NODES] = { 0, 1 };
+uint8_t tx_data[N_FANOUT][8];
+int next_req, n_ind, n_held;
+uint8_t *ind_data;
+int held[N_FANOUT];
+
+void fanout_next(void)
+{
+    if(next_req < N_FANOUT)
+    {
+	fill(tx_data[next_req], next_req);
+	CAN_XR_MAC_Data_Req(CAN_XR_Bus_MAC(&bus_a, 0), 0x100 + next_req,
+			    CAN_XR_FORMAT_CBFF, 8, tx_data[next_req]);
+	next_req++;
+    }
+}
+
+void fanout_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    if(*(int *)llc != 1)
+	return;
+
+    if(identifier != 0x100 + n_ind || dlc != 8
+       || memcmp(data, tx_data[n_ind], 8))
+	n_fail++;
+
+    ind_data = data;
+    held[n_ind] = CAN_XR_Pool_Hold(&pool, data);
+    if(held[n_ind] >= 0)
+	n_held++;
+}
+
+void fanout_dispatch(
+    void *ctx, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    /* Same buffer as data_ind, and the same verdict */
+    if(data != ind_data
+       || CAN_XR_Pool_Hold(&pool, data) != held[n_ind])
+	n_fail++;
+
+    n_ind++;
+}
+
+void fanout_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status != CAN_XR_MAC_TX_STATUS_SUCCESS)
+	n_fail++;
+    else
+	fanout_next();
+}
+
+int run_fanout(void)
+{
+    struct CAN_XR_MAC *mac;
+    int errors = 0;
+    int i, j;
+
+    CAN_XR_Bus_Init(&bus_a, nodes_a, N_NODES, &pcs_parameters);
+    for(i=0; i<N_NODES; i++)
+    {
+	mac = CAN_XR_Bus_MAC(&bus_a, i);
+	CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)&node_numbers[i]);
+	CAN_XR_MAC_Set_Data_Ind(mac, fanout_data_ind);
+	CAN_XR_MAC_Set_Data_Conf(mac, fanout_data_conf);
+    }
+
+    mac = CAN_XR_Bus_MAC(&bus_a, 1);
+    CAN_XR_Pool_Init(&pool);
+    CAN_XR_MAC_Set_Pool(mac, &pool);
+    CAN_XR_Dispatch_Init(&dispatch);
+    CAN_XR_MAC_Set_Dispatch(mac, &dispatch);
+    CAN_XR_MAC_Subscribe(mac, 0, CAN_XR_DISPATCH_IDS - 1,
+			 fanout_dispatch, NULL);
+
+    n_fail = next_req = n_ind = n_held = 0;
+    fanout_next();
+    CAN_XR_Bus_Run(&bus_a, (N_FANOUT + 2) * 150UL * BIT_TICKS);
+
+    /* The first CAN_XR_POOL_FRAMES frames are kept, in distinct
+       buffers, and the others are not.
+    */
+    if(n_ind != N_FANOUT || n_held != CAN_XR_POOL_FRAMES || n_fail
+       || CAN_XR_Pool_Free(&pool) != 0 || pool.exhausted == 0)
+    {
+	printf("! fanout: %d received, %d held, %d failed, %d free\n",
+	       n_ind, n_held, n_fail, CAN_XR_Pool_Free(&pool));
+	errors++;
+    }
+
+    for(i=0; i<n_held; i++)
+    {
+	if(CAN_XR_Pool_Refs(&pool, held[i]) != 2
+	   || memcmp(CAN_XR_Pool_Data(&pool, held[i]), tx_data[i], 8))
+	    errors++;
+	for(j=0; j<i; j++)
+	    if(held[j] == held[i])
+		errors++;
+    }
+
+    /* Release both references to each buffer */
+    for(i=0; i<n_held; i++)
+    {
+	CAN_XR_Pool_Release(&pool, held[i]);
+	CAN_XR_Pool_Release(&pool, held[i]);
+    }
+
+    if(CAN_XR_Pool_Free(&pool) != CAN_XR_POOL_FRAMES)
+    {
+	printf("! fanout: %d buffers free after release\n",
+	       CAN_XR_Pool_Free(&pool));
+	errors++;
+    }
+
+    printf("# fanout: %d frames, %d held, %d errors\n",
+	   n_ind, n_held, errors);
+    return errors;
+}
+
+/* --- Gateway backlog --- */
+
+#define N_FORWARD 12
+#define N_BUSY 16
+
+struct app
+{
+    struct CAN_XR_MAC *mac;
+    uint32_t identifier;
+    int n_req, n_max;
+    uint8_t data[N_BUSY][8];
+    int n_rx;
+};
+
+struct app app_a, app_b;
+
+void app_next(struct app *app)
+{
+    if(app->n_req < app->n_max
+       && app->mac->state.data_req_pending < CAN_XR_MAC_TX_SLOTS)
+    {
+	fill(app->data[app->n_req], app->n_req);
+	CAN_XR_MAC_Data_Req(app->mac, app->identifier + app->n_req,
+			    CAN_XR_FORMAT_CBFF, 8, app->data[app->n_req]);
+	app->n_req++;
+    }
+}
+
+void app_data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct app *app = (struct app *)llc;
+    uint8_t expected[8];
+
+    if(app->mac->state.tx_fsm_state == CAN_XR_MAC_TX_FSM_TX_FRAME)
+	return;
+
+    /* Only B receives, from the gateway */
+    fill(expected, app->n_rx);
+    if(app != &app_b || identifier != 0x200 + app->n_rx || dlc != 8
+       || memcmp(data, expected, 8))
+	n_fail++;
+
+    app->n_rx++;
+}
+
+void app_data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status != CAN_XR_MAC_TX_STATUS_SUCCESS)
+	n_fail++;
+
+    app_next((struct app *)llc);
+}
+
+void app_init(struct app *app, struct CAN_XR_MAC *mac,
+	      uint32_t identifier, int n_max)
+{
+    app->mac = mac;
+    app->identifier = identifier;
+    app->n_req = 0;
+    app->n_max = n_max;
+    app->n_rx = 0;
+    CAN_XR_MAC_Set_LLC(mac, (struct CAN_XR_LLC *)app);
+    CAN_XR_MAC_Set_Data_Ind(mac, app_data_ind);
+    CAN_XR_MAC_Set_Data_Conf(mac, app_data_conf);
+}
+
+int run_backlog(int with_pool, const char *what)
+{
+    const struct CAN_XR_Gateway_Route *r;
+    unsigned long t;
+    int errors = 0;
+    int i;
+
+    CAN_XR_Bus_Init(&bus_a, nodes_a, N_NODES, &pcs_parameters);
+    CAN_XR_Bus_Init(&bus_b, nodes_b, N_NODES, &pcs_parameters);
+    CAN_XR_Gateway_Init(&gw, CAN_XR_Bus_MAC(&bus_a, 0),
+			CAN_XR_Bus_MAC(&bus_b, 0));
+    CAN_XR_Gateway_Add_Route(&gw, 0, 0x100, 0x1FF, 0x200, NULL, NULL);
+    CAN_XR_Pool_Init(&pool);
+    if(with_pool)
+	CAN_XR_MAC_Set_Pool(CAN_XR_Bus_MAC(&bus_a, 0), &pool);
+
+    /* B has higher-priority traffic to send */
+    app_init(&app_a, CAN_XR_Bus_MAC(&bus_a, 1), 0x100, N_FORWARD);
+    app_init(&app_b, CAN_XR_Bus_MAC(&bus_b, 1), 0x010, N_BUSY);
+    n_fail = 0;
+    for(i=0; i<CAN_XR_MAC_TX_SLOTS; i++)
+    {
+	app_next(&app_a);
+	app_next(&app_b);
+    }
+
+    for(t=0; t<(N_FORWARD + N_BUSY + 4) * 150UL * BIT_TICKS; t++)
+    {
+	CAN_XR_Bus_Run(&bus_a, 1);
+	CAN_XR_Bus_Run(&bus_b, 1);
+    }
+
+    /* With a pool, the MAC may still have its own buffer */
+    r = CAN_XR_Gateway_Get_Route(&gw, 0);
+    if(with_pool
+       ? (app_b.n_rx != N_FORWARD || r->n_dropped || !r->n_backlogged
+	  || CAN_XR_Pool_Free(&pool) < CAN_XR_POOL_FRAMES - 1)
+       : (r->n_dropped == 0 || app_b.n_rx + r->n_dropped != N_FORWARD))
+    {
+	printf("! %s: %d forwarded, %lu backlogged, %lu dropped, "
+	       "%d buffers free\n", what, app_b.n_rx, r->n_backlogged,
+	       r->n_dropped, CAN_XR_Pool_Free(&pool));
+	errors++;
+    }
+
+    /* Without a pool, the frames received on B are not in sequence */
+    if(n_fail && with_pool)
+    {
+	printf("! %s: %d failed\n", what, n_fail);
+	errors++;
+    }
+
+    printf("# %s: %d forwarded, %lu backlogged, %lu dropped, %d errors\n",
+	   what, app_b.n_rx, r->n_backlogged, r->n_dropped, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    SET_TRACE_TRESHOLD(10);
+
+    errors += run_pool();
+    errors += run_fanout();
+    errors += run_backlog(0, "no pool");
+    errors += run_backlog(1, "pool");
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+/* This program measures the per-nodeclock cost of the protocol stack
+   with two simulated nodes on the same bus, node 0 transmitting
+   frames back to back and node 1 receiving them.  It is built three
+   times:
+
+   - Host_Programs/22_stack_bench uses the function-pointer API, like
+     the simulators do.
+
+   - Host_Programs/22_stack_bench_fast is built with
+     -DCAN_XR_BENCH_FAST_STACK and uses CAN_XR_Fast_Stack.h.
+
+   - Host_Programs/22_stack_bench_fixed is also built with
+     -DCAN_XR_BENCH_FIXED_BIT_TIME, so the PCS is specialized for the
+     bit time below, see CAN_XR_PCS_FIXED_PRESCALER_M.
+
+   All are built with optimization, from the sources rather than
+   from the host library, see the Makefile.  All check that node 1
+   receives all frames and that the digest of what it received,
+   timestamps included, is the expected one, so that the three modes
+   are known to behave the same.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <CAN_XR_PMA_Sim.h>
+#include <CAN_XR_Trace.h>
+
+#ifdef CAN_XR_BENCH_FIXED_BIT_TIME
+#define CAN_XR_PCS_FIXED_PRESCALER_M 8
+#define CAN_XR_PCS_FIXED_PROP_SEG 3
+#define CAN_XR_PCS_FIXED_PHASE_SEG1 3
+#define CAN_XR_PCS_FIXED_PHASE_SEG2 3
+#define CAN_XR_PCS_FIXED_SJW 1
+#endif
+
+#ifdef CAN_XR_BENCH_FAST_STACK
+#define CAN_XR_FAST_PMA_DATA_REQ(pma, bus_level) \
+    ((pma)->state.sim.tx_bus_level = (bus_level))
+#include <CAN_XR_Fast_Stack.h>
+#ifdef CAN_XR_BENCH_FIXED_BIT_TIME
+#define MODE "fixed bit time"
+#else
+#define MODE "fast stack"
+#endif
+#else
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#define MODE "function pointers"
+#endif
+
+#ifdef CAN_XR_BENCH_FIXED_BIT_TIME
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters =
+    CAN_XR_PCS_FIXED_PARAMETERS;
+#else
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+#endif
+
+#define N_NODES 2
+#define N_FRAMES 1000
+#define TICKS (N_FRAMES * 140UL * 80UL)
+
+/* Digest of the frames received by node 1, see data_ind */
+#define EXPECTED_DIGEST 0x5e4bbaccUL
+
+struct CAN_XR_PMA pma[N_NODES];
+struct CAN_XR_PCS pcs[N_NODES];
+struct CAN_XR_MAC mac[N_NODES];
+
+int node_numbers[N_NODES] = { 0, 1 };
+uint8_t tx_data[8];
+int n_req, n_conf, n_ind, n_fail;
+unsigned long digest;
+
+void next_frame(void)
+{
+    int i;
+
+    if(n_req < N_FRAMES)
+    {
+	for(i=0; i<8; i++)
+	    tx_data[i] = n_req * 8 + i;
+	CAN_XR_MAC_Data_Req(&mac[0], 0x100 + (n_req & 0xFF),
+			    CAN_XR_FORMAT_CBFF, 8, tx_data);
+	n_req++;
+    }
+}
+
+void data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int i;
+
+    if(*(int *)llc != 1)
+	return;
+
+    digest = digest * 31 + ts;
+    digest = digest * 31 + identifier;
+    for(i=0; i<dlc && i<8; i++)
+	digest = digest * 31 + data[i];
+    n_ind++;
+}
+
+void data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	n_conf++;
+	next_frame();
+    }
+    else
+	n_fail++;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long t;
+    clock_t start, stop;
+    double ns_per_tick;
+    int bus_level;
+    int n;
+
+    SET_TRACE_TRESHOLD(10);
+
+    for(n=0; n<N_NODES; n++)
+    {
+	CAN_XR_PMA_Sim_Init(&pma[n]);
+	CAN_XR_PCS_Init(&pcs[n], &pcs_parameters, &pma[n]);
+	CAN_XR_MAC_Common_Init(&mac[n], &pcs[n]);
+	CAN_XR_MAC_Set_LLC(&mac[n], (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(&mac[n], data_ind);
+	CAN_XR_MAC_Set_Data_Conf(&mac[n], data_conf);
+    }
+
+    next_frame();
+
+    start = clock();
+    for(t=0; t<TICKS; t++)
+    {
+	/* Wired AND, like CAN_XR_Bus_Run */
+	bus_level = 1;
+	for(n=0; n<N_NODES; n++)
+	    bus_level &= pma[n].state.sim.tx_bus_level;
+
+	for(n=0; n<N_NODES; n++)
+#ifdef CAN_XR_BENCH_FAST_STACK
+	    CAN_XR_Fast_NodeClock_Ind(&pcs[n], bus_level);
+#else
+	    CAN_XR_PMA_Sim_NodeClock_Ind(&pma[n], bus_level);
+#endif
+    }
+    stop = clock();
+
+    ns_per_tick = (double)(stop - start) * 1e9 / CLOCKS_PER_SEC
+	/ ((double)TICKS * N_NODES);
+
+    printf("# %s: %d frames, digest 0x%08lx, %.1f ns per node and tick\n",
+	   MODE, n_ind, digest & 0xFFFFFFFFUL, ns_per_tick);
+
+    if(n_ind != N_FRAMES || n_conf != N_FRAMES || n_fail
+       || (digest & 0xFFFFFFFFUL) != EXPECTED_DIGEST)
+    {
+	printf("! %s: %d received, %d confirmed, %d failed\n",
+	       MODE, n_ind, n_conf, n_fail);
+	return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_PMA_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks that driving the PCS with quantumclock
+   indications, the simulator doing the prescaling, gives the same
+   results as driving it with nodeclock indications.  Two nodes,
+   node 0 transmitting a mix of CBFF frames and FBFF frames with bit
+   rate switching to node 1, are simulated both ways, and the digests
+   of what node 1 receives and node 0 confirms, timestamps included,
+   must be the same.
+
+   - Same prescaler in the nominal and data phase.
+
+   - Data phase prescaler 2, without transmitter delay compensation.
+
+   - Same, with transmitter delay compensation.
+
+   The quantum-rate simulation is event-driven, each node getting its
+   next indication as many ticks later as its PCS says.
+*/
+
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+const struct CAN_XR_PCS_Bit_Time_Parameters fast_parameters = {
+    .prescaler_m = 2,
+    .sync_seg = 1,
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define N_NODES 2
+#define N_FRAMES 40
+#define TICKS (N_FRAMES * 500UL * 80UL)
+
+struct CAN_XR_PMA pma[N_NODES];
+struct CAN_XR_PCS pcs[N_NODES];
+struct CAN_XR_MAC mac[N_NODES];
+
+int node_numbers[N_NODES] = { 0, 1 };
+uint8_t tx_data[64];
+int n_req, n_conf, n_ind, n_fail;
+unsigned long digest, calls;
+
+void next_frame(void)
+{
+    int i;
+
+    if(n_req < N_FRAMES)
+    {
+	for(i=0; i<64; i++)
+	    tx_data[i] = n_req * 7 + i;
+	if(n_req & 1)
+	    CAN_XR_MAC_Data_Req(&mac[0], 0x200 + n_req,
+				CAN_XR_FORMAT_FBFF, 15, tx_data);
+	else
+	    CAN_XR_MAC_Data_Req(&mac[0], 0x100 + n_req,
+				CAN_XR_FORMAT_CBFF, 8, tx_data);
+	n_req++;
+    }
+}
+
+void data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int i;
+
+    if(*(int *)llc != 1)
+	return;
+
+    digest = digest * 31 + ts;
+    digest = digest * 31 + identifier;
+    for(i=0; i<CAN_XR_DATA_LENGTH(format, dlc); i++)
+	digest = digest * 31 + data[i];
+    n_ind++;
+}
+
+void data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    if(transmission_status == CAN_XR_MAC_TX_STATUS_SUCCESS)
+    {
+	digest = digest * 31 + ts;
+	n_conf++;
+	next_frame();
+    }
+    else
+	n_fail++;
+}
+
+void setup(const struct CAN_XR_PCS_Bit_Time_Parameters *data_parameters,
+	   int ssp_offset)
+{
+    int n;
+
+    for(n=0; n<N_NODES; n++)
+    {
+	CAN_XR_PMA_Sim_Init(&pma[n]);
+	CAN_XR_PCS_Init(&pcs[n], &pcs_parameters, &pma[n]);
+	CAN_XR_PCS_Set_Data_Bit_Time(&pcs[n], data_parameters, ssp_offset);
+	CAN_XR_MAC_Common_Init(&mac[n], &pcs[n]);
+	CAN_XR_MAC_Set_LLC(&mac[n], (struct CAN_XR_LLC *)&node_numbers[n]);
+	CAN_XR_MAC_Set_Data_Ind(&mac[n], data_ind);
+	CAN_XR_MAC_Set_Data_Conf(&mac[n], data_conf);
+	CAN_XR_MAC_Set_FD_Mode(&mac[n], CAN_XR_MAC_FD_BRS);
+    }
+
+    n_req = n_conf = n_ind = n_fail = 0;
+    digest = 0;
+    calls = 0;
+    next_frame();
+}
+
+/* Wired AND, like CAN_XR_Bus_Run */
+static int bus_level(void)
+{
+    int level = 1;
+    int n;
+
+    for(n=0; n<N_NODES; n++)
+	level &= pma[n].state.sim.tx_bus_level;
+    return level;
+}
+
+void run_nodeclock(void)
+{
+    unsigned long t;
+    int level;
+    int n;
+
+    for(t=0; t<TICKS; t++)
+    {
+	level = bus_level();
+	for(n=0; n<N_NODES; n++)
+	{
+	    CAN_XR_PMA_Sim_NodeClock_Ind(&pma[n], level);
+	    calls++;
+	}
+    }
+}
+
+void run_quantumclock(void)
+{
+    unsigned long next[N_NODES];
+    unsigned long t;
+    int level;
+    int n;
+
+    /* The first quantum clock edge is one quantum after the epoch */
+    for(n=0; n<N_NODES; n++)
+	next[n] = pcs_parameters.prescaler_m;
+
+    while(1)
+    {
+	t = next[0];
+	for(n=1; n<N_NODES; n++)
+	    if(next[n] < t)  t = next[n];
+	if(t > TICKS)
+	    break;
+
+	level = bus_level();
+	for(n=0; n<N_NODES; n++)
+	    if(next[n] == t)
+	    {
+		next[n] += CAN_XR_PMA_Sim_QuantumClock_Ind(&pma[n], level);
+		calls++;
+	    }
+    }
+}
+
+int run(const struct CAN_XR_PCS_Bit_Time_Parameters *data_parameters,
+	int ssp_offset, const char *what)
+{
+    unsigned long nodeclock_digest, nodeclock_calls;
+    int errors = 0;
+
+    setup(data_parameters, ssp_offset);
+    run_nodeclock();
+    if(n_ind != N_FRAMES || n_conf != N_FRAMES || n_fail)
+    {
+	printf("! %s, nodeclock: %d received, %d confirmed, %d failed\n",
+	       what, n_ind, n_conf, n_fail);
+	errors++;
+    }
+
+    nodeclock_digest = digest;
+    nodeclock_calls = calls;
+
+    setup(data_parameters, ssp_offset);
+    run_quantumclock();
+    if(n_ind != N_FRAMES || n_conf != N_FRAMES || n_fail
+       || digest != nodeclock_digest)
+    {
+	printf("! %s, quantumclock: %d received, %d confirmed, %d failed, "
+	       "digest 0x%08lx instead of 0x%08lx\n",
+	       what, n_ind, n_conf, n_fail,
+	       digest & 0xFFFFFFFFUL, nodeclock_digest & 0xFFFFFFFFUL);
+	errors++;
+    }
+
+    printf("# %s: %lu vs. %lu indications, %.1fx fewer, %d errors\n",
+	   what, calls, nodeclock_calls, (double)nodeclock_calls / calls,
+	   errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    SET_TRACE_TRESHOLD(10);
+
+    errors += run(&pcs_parameters, 0, "same prescaler");
+    errors += run(&fast_parameters, 0, "data prescaler 2");
+    errors += run(&fast_parameters, 7, "data prescaler 2, TDC");
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,349 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CAN_XR_PMA_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks that CAN_XR_PCS_NodeClock_Batch and
+   CAN_XR_PCS_NodeClock_Batch_Packed give the same results as
+   feeding samples one at a time.  It first records the bus of two
+   simulated nodes, node 0 transmitting CBFF frames and FBFF frames
+   with bit rate switching to node 1, then replays the recording to
+   a third node three times: one sample at a time through
+   nodeclock_ind, in batches of random size, and packed in batches of
+   random size.  The three replays must see the same sample points,
+   receive the same frames and end in the same PCS state.
+
+   - The recording as is.
+
+   - The recording stretched by one tick every 61 ticks, so that the
+     replay node must resynchronize.
+
+   - Same, with 9-tick dominant glitches on top, so that the replay
+     node also sees edges out of place and errors.
+*/
+
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 2
+};
+
+const struct CAN_XR_PCS_Bit_Time_Parameters data_parameters = {
+    .prescaler_m = 2,
+    .sync_seg = 1,
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 2
+};
+
+#define N_NODES 2
+#define N_FRAMES 20
+#define TICKS (N_FRAMES * 200UL * 80UL)
+#define MAX_BATCH 4096
+
+struct CAN_XR_PMA pma[N_NODES + 1];
+struct CAN_XR_PCS pcs[N_NODES + 1];
+struct CAN_XR_MAC mac[N_NODES + 1];
+
+int node_numbers[N_NODES + 1] = { 0, 1, 2 };
+uint8_t tx_data[64];
+int n_req, n_ind;
+
+/* Recording, one level per tick, and the replay input */
+uint8_t recording[TICKS];
+uint8_t levels[TICKS + TICKS / 61 + 1];
+uint8_t bits[sizeof(levels) / 8 + 1];
+size_t n_levels;
+
+/* What the replay node sees */
+CAN_XR_PCS_Data_Ind_t mac_data_ind;
+unsigned long digest;
+unsigned long n_samples;
+
+static unsigned long rnd(unsigned long *seed)
+{
+    *seed = *seed * 1103515245UL + 12345UL;
+    return (*seed >> 8) & 0xFFFFFF;
+}
+
+void next_frame(void)
+{
+    int i;
+
+    if(n_req < N_FRAMES)
+    {
+	for(i=0; i<64; i++)
+	    tx_data[i] = n_req * 13 + i;
+	if(n_req & 1)
+	    CAN_XR_MAC_Data_Req(&mac[0], 0x200 + n_req,
+				CAN_XR_FORMAT_FBFF, 15, tx_data);
+	else
+	    CAN_XR_MAC_Data_Req(&mac[0], 0x100 + n_req,
+				CAN_XR_FORMAT_CBFF, 8, tx_data);
+	n_req++;
+    }
+}
+
+void data_ind(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    int i;
+
+    if(*(int *)llc != 2)
+	return;
+
+    digest = digest * 31 + ts;
+    digest = digest * 31 + identifier;
+    for(i=0; i<CAN_XR_DATA_LENGTH(format, dlc); i++)
+	digest = digest * 31 + data[i];
+    n_ind++;
+}
+
+void data_conf(
+    struct CAN_XR_LLC *llc, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    next_frame();
+}
+
+/* PCS_Data.Indicate of the replay node, on its way to the MAC */
+void sample_ind(struct CAN_XR_MAC *m, unsigned long ts, int bus_level)
+{
+    digest = digest * 31 + ts * 2 + bus_level;
+    n_samples++;
+    mac_data_ind(m, ts, bus_level);
+}
+
+void init_node(int n)
+{
+    CAN_XR_PMA_Sim_Init(&pma[n]);
+    CAN_XR_PCS_Init(&pcs[n], &pcs_parameters, &pma[n]);
+    CAN_XR_PCS_Set_Data_Bit_Time(&pcs[n], &data_parameters, 0);
+    CAN_XR_MAC_Common_Init(&mac[n], &pcs[n]);
+    CAN_XR_MAC_Set_LLC(&mac[n], (struct CAN_XR_LLC *)&node_numbers[n]);
+    CAN_XR_MAC_Set_Data_Ind(&mac[n], data_ind);
+    CAN_XR_MAC_Set_Data_Conf(&mac[n], data_conf);
+    CAN_XR_MAC_Set_FD_Mode(&mac[n], CAN_XR_MAC_FD_BRS);
+}
+
+/* Run nodes 0 and 1 on the bus and record it */
+void record(void)
+{
+    unsigned long t;
+    int level;
+    int n;
+
+    for(n=0; n<N_NODES; n++)
+	init_node(n);
+    n_req = 0;
+    next_frame();
+
+    for(t=0; t<TICKS; t++)
+    {
+	level = 1;
+	for(n=0; n<N_NODES; n++)
+	    level &= pma[n].state.sim.tx_bus_level;
+
+	recording[t] = level;
+	for(n=0; n<N_NODES; n++)
+	    CAN_XR_PMA_Sim_NodeClock_Ind(&pma[n], level);
+    }
+}
+
+/* Make the replay input from the recording */
+void make_levels(int stretch, int glitches)
+{
+    unsigned long seed = 5;
+    unsigned long t;
+    int glitch = 0;
+
+    n_levels = 0;
+    for(t=0; t<TICKS; t++)
+    {
+	levels[n_levels++] = recording[t];
+	if(stretch && t % 61 == 60)
+	    levels[n_levels++] = recording[t];
+	if(glitches && rnd(&seed) % 4000 == 0)
+	    glitch = 9;
+	if(glitch > 0)
+	{
+	    levels[n_levels - 1] = 0;
+	    glitch--;
+	}
+    }
+
+    memset(bits, 0, sizeof(bits));
+    for(t=0; t<n_levels; t++)
+	bits[t >> 3] |= levels[t] << (t & 7);
+}
+
+enum mode { SINGLE, BATCH, PACKED };
+static const char *mode_name[] = { "single", "batch", "packed" };
+
+struct result
+{
+    unsigned long digest;
+    unsigned long n_samples;
+    int n_ind;
+    struct CAN_XR_PCS_State state;
+    double ns_per_tick;
+};
+
+/* Replay the input to node 2 */
+void replay(enum mode mode, struct result *r)
+{
+    unsigned long seed = 7;
+    clock_t start, stop;
+    size_t i, n;
+
+    memset(&pcs[N_NODES], 0, sizeof(pcs[N_NODES]));
+    init_node(N_NODES);
+    mac_data_ind = pcs[N_NODES].primitives.data_ind;
+    CAN_XR_PCS_Set_Data_Ind(&pcs[N_NODES], sample_ind);
+    digest = 0;
+    n_samples = 0;
+    n_ind = 0;
+
+    start = clock();
+    for(i=0; i<n_levels; i+=n)
+    {
+	n = rnd(&seed) % MAX_BATCH + 1;
+	if(n > n_levels - i)
+	    n = n_levels - i;
+
+	switch(mode)
+	{
+	case SINGLE:
+	    n = 1;
+	    pma[N_NODES].primitives.nodeclock_ind(&pcs[N_NODES], levels[i]);
+	    break;
+
+	case BATCH:
+	    CAN_XR_PCS_NodeClock_Batch(&pcs[N_NODES], levels + i, n);
+	    break;
+
+	case PACKED:
+	    /* Start at a byte boundary, then keep going */
+	    if(i == 0 && n > 8)  n &= ~(size_t)7;
+	    if(i & 7)
+	    {
+		n = 1;
+		CAN_XR_PCS_NodeClock_Batch(&pcs[N_NODES], levels + i, n);
+	    }
+	    else
+		CAN_XR_PCS_NodeClock_Batch_Packed(
+		    &pcs[N_NODES], bits + (i >> 3), n);
+	    break;
+	}
+    }
+    stop = clock();
+
+    r->digest = digest;
+    r->n_samples = n_samples;
+    r->n_ind = n_ind;
+    r->state = pcs[N_NODES].state;
+    r->ns_per_tick = (double)(stop - start) * 1e9 / CLOCKS_PER_SEC
+	/ (double)n_levels;
+}
+
+int same_state(const struct CAN_XR_PCS_State *a,
+	       const struct CAN_XR_PCS_State *b)
+{
+    return a->nodeclock_ts == b->nodeclock_ts
+	&& a->prescaler_m_cnt == b->prescaler_m_cnt
+	&& a->quantum_m_cnt == b->quantum_m_cnt
+	&& a->prev_bus_level == b->prev_bus_level
+	&& a->prev_sample == b->prev_sample
+	&& a->sync_inhibit == b->sync_inhibit
+	&& a->sending_level == b->sending_level
+	&& a->data_phase == b->data_phase;
+}
+
+int run(int stretch, int glitches, const char *what)
+{
+    struct result r[3];
+    int errors = 0;
+    int m;
+
+    make_levels(stretch, glitches);
+    for(m=SINGLE; m<=PACKED; m++)
+	replay(m, &r[m]);
+
+    for(m=BATCH; m<=PACKED; m++)
+	if(r[m].digest != r[SINGLE].digest
+	   || r[m].n_samples != r[SINGLE].n_samples
+	   || r[m].n_ind != r[SINGLE].n_ind
+	   || !same_state(&r[m].state, &r[SINGLE].state))
+	{
+	    printf("! %s, %s: %lu samples, %d frames, digest 0x%08lx "
+		   "instead of %lu, %d, 0x%08lx\n", what, mode_name[m],
+		   r[m].n_samples, r[m].n_ind, r[m].digest & 0xFFFFFFFFUL,
+		   r[SINGLE].n_samples, r[SINGLE].n_ind,
+		   r[SINGLE].digest & 0xFFFFFFFFUL);
+	    errors++;
+	}
+
+    /* Without glitches, all frames must get through */
+    if(!glitches && r[SINGLE].n_ind != N_FRAMES)
+    {
+	printf("! %s: %d frames received\n", what, r[SINGLE].n_ind);
+	errors++;
+    }
+
+    printf("# %s: %d frames, %.1f/%.1f/%.1f ns per tick, %d errors\n",
+	   what, r[SINGLE].n_ind, r[SINGLE].ns_per_tick,
+	   r[BATCH].ns_per_tick, r[PACKED].ns_per_tick, errors);
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors are traced at levels 2 and 9, on purpose */
+    SET_TRACE_TRESHOLD(10);
+
+    record();
+    errors += run(0, 0, "as recorded");
+    errors += run(1, 0, "stretched");
+    errors += run(1, 1, "stretched with glitches");
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,312 @@
+/*+
+    SDCC - A Software-Defined CAN Controller
+    Copyright (C) 2018 National Research Council of Italy and
+      University of Luxembourg
+
+    Authors: Ivan Cibrario Bertolotti and Tingting Hu
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2
+    as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    The use of the program may be restricted in certain countries by
+    intellectual property rights owned by Bosch.  For more information, see:
+
+    http://www.bosch-semiconductors.com/ip-modules/can-ip-modules/can-protocol/
++*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CAN_XR_PMA_Sim.h>
+#include <CAN_XR_PCS.h>
+#include <CAN_XR_MAC.h>
+#include <CAN_XR_Trace.h>
+
+
+/* This program checks that CAN_XR_PCS_Advance gives the same results
+   as feeding the same constant-level runs one tick at a time.  Two
+   nodes get the same sequence of runs, node 0 tick by tick and node
+   1 with CAN_XR_PCS_Advance, and they must deliver the same frames
+   and confirmations at the same time and end in the same PCS and MAC
+   state.
+
+   - Sparse traffic, recorded from a simulated bus in which a node
+     transmits a frame every 2000 bits.  The two nodes receive it.
+
+   - A transmitter that goes bus off on a bus stuck dominant, then
+     recovers, with a frame pending all along.  Since the replay does
+     not put its own bits on the bus, its next attempts fail, too.
+
+   - A receiver that starts on a bus stuck dominant, then sees a
+     dominant pulse that starts a frame and an error.
+*/
+
+const struct CAN_XR_PCS_Bit_Time_Parameters pcs_parameters = {
+    .prescaler_m = 8,
+    .sync_seg = 1, /* Always this way */
+    .prop_seg = 3,
+    .phase_seg1 = 3,
+    .phase_seg2 = 3,
+    .sjw = 1
+};
+
+#define BIT_TICKS 80
+#define N_FRAMES 10
+#define GAP_BITS 2000
+#define TICKS ((N_FRAMES + 1) * GAP_BITS * (unsigned long)BIT_TICKS)
+#define MAX_RUNS 20000
+
+struct run
+{
+    unsigned long ticks;
+    int level;
+};
+
+struct run runs[MAX_RUNS];
+int n_runs;
+
+/* Nodes 0 and 1 are under test, 2 and 3 make the recording */
+#define N_NODES 4
+struct CAN_XR_PMA pma[N_NODES];
+struct CAN_XR_PCS pcs[N_NODES];
+struct CAN_XR_MAC mac[N_NODES];
+
+struct node_llc
+{
+    int node;
+    unsigned long digest;
+    int n_ind, n_conf;
+    unsigned long n_mac_ind; /* PCS to MAC indications */
+} llc[N_NODES];
+
+uint8_t tx_data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+int n_req;
+
+CAN_XR_PCS_Data_Ind_t mac_data_ind;
+CAN_XR_PCS_Bulk_Data_Ind_t mac_bulk_data_ind;
+
+void data_ind(
+    struct CAN_XR_LLC *l, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_Format format, int dlc, uint8_t *data)
+{
+    struct node_llc *n = (struct node_llc *)l;
+    int i;
+
+    n->digest = n->digest * 31 + ts;
+    n->digest = n->digest * 31 + identifier;
+    for(i=0; i<CAN_XR_DATA_LENGTH(format, dlc); i++)
+	n->digest = n->digest * 31 + data[i];
+    n->n_ind++;
+}
+
+void data_conf(
+    struct CAN_XR_LLC *l, unsigned long ts, uint32_t identifier,
+    enum CAN_XR_MAC_Tx_Status transmission_status)
+{
+    struct node_llc *n = (struct node_llc *)l;
+
+    n->digest = n->digest * 31 + ts;
+    n->digest = n->digest * 31 + transmission_status;
+    n->n_conf++;
+}
+
+/* Count the indications the MAC gets */
+void count_data_ind(struct CAN_XR_MAC *m, unsigned long ts, int bus_level)
+{
+    ((struct node_llc *)m->llc)->n_mac_ind++;
+    mac_data_ind(m, ts, bus_level);
+}
+
+unsigned long count_bulk_data_ind(
+    struct CAN_XR_MAC *m, unsigned long ts, int bus_level, unsigned long n)
+{
+    ((struct node_llc *)m->llc)->n_mac_ind++;
+    return mac_bulk_data_ind(m, ts, bus_level, n);
+}
+
+void init_node(int n)
+{
+    CAN_XR_PMA_Sim_Init(&pma[n]);
+    CAN_XR_PCS_Init(&pcs[n], &pcs_parameters, &pma[n]);
+    CAN_XR_MAC_Common_Init(&mac[n], &pcs[n]);
+    memset(&llc[n], 0, sizeof(llc[n]));
+    llc[n].node = n;
+    CAN_XR_MAC_Set_LLC(&mac[n], (struct CAN_XR_LLC *)&llc[n]);
+    CAN_XR_MAC_Set_Data_Ind(&mac[n], data_ind);
+    CAN_XR_MAC_Set_Data_Conf(&mac[n], data_conf);
+
+    mac_data_ind = pcs[n].primitives.data_ind;
+    mac_bulk_data_ind = pcs[n].primitives.bulk_data_ind;
+    CAN_XR_PCS_Set_Data_Ind(&pcs[n], count_data_ind);
+    CAN_XR_PCS_Set_Bulk_Data_Ind(&pcs[n], count_bulk_data_ind);
+}
+
+static void add_run(int level, unsigned long ticks)
+{
+    if(n_runs > 0 && runs[n_runs - 1].level == level)
+	runs[n_runs - 1].ticks += ticks;
+    else if(n_runs < MAX_RUNS)
+    {
+	runs[n_runs].level = level;
+	runs[n_runs].ticks = ticks;
+	n_runs++;
+    }
+}
+
+/* Record a bus on which node 2 sends a frame to node 3 every
+   GAP_BITS bits.
+*/
+void record(void)
+{
+    unsigned long t;
+    int level;
+    int n;
+
+    for(n=2; n<N_NODES; n++)
+	init_node(n);
+
+    n_runs = 0;
+    n_req = 0;
+    for(t=0; t<TICKS; t++)
+    {
+	if(t % (GAP_BITS * BIT_TICKS) == GAP_BITS * BIT_TICKS / 2
+	   && n_req < N_FRAMES)
+	{
+	    CAN_XR_MAC_Data_Req(&mac[2], 0x123 + n_req, CAN_XR_FORMAT_CBFF,
+				8, tx_data);
+	    n_req++;
+	}
+
+	level = pma[2].state.sim.tx_bus_level & pma[3].state.sim.tx_bus_level;
+	add_run(level, 1);
+	for(n=2; n<N_NODES; n++)
+	    CAN_XR_PMA_Sim_NodeClock_Ind(&pma[n], level);
+    }
+}
+
+/* Feed the runs to nodes 0 and 1 */
+void replay(void)
+{
+    unsigned long t;
+    int r;
+
+    for(r=0; r<n_runs; r++)
+    {
+	for(t=0; t<runs[r].ticks; t++)
+	    pma[0].primitives.nodeclock_ind(&pcs[0], runs[r].level);
+	CAN_XR_PCS_Advance(&pcs[1], runs[r].ticks, runs[r].level);
+    }
+}
+
+int same_state(void)
+{
+    const struct CAN_XR_PCS_State *p0 = &pcs[0].state, *p1 = &pcs[1].state;
+    const struct CAN_XR_MAC_State *m0 = &mac[0].state, *m1 = &mac[1].state;
+
+    return p0->nodeclock_ts == p1->nodeclock_ts
+	&& p0->prescaler_m_cnt == p1->prescaler_m_cnt
+	&& p0->quantum_m_cnt == p1->quantum_m_cnt
+	&& p0->prev_bus_level == p1->prev_bus_level
+	&& p0->prev_sample == p1->prev_sample
+	&& p0->sync_inhibit == p1->sync_inhibit
+	&& p0->hard_sync_allowed == p1->hard_sync_allowed
+	&& p0->output_unit_buf == p1->output_unit_buf
+	&& p0->sending_level == p1->sending_level
+	&& m0->rx_fsm_state == m1->rx_fsm_state
+	&& m0->tx_fsm_state == m1->tx_fsm_state
+	&& m0->bus_integration_counter == m1->bus_integration_counter
+	&& m0->field_bits == m1->field_bits
+	&& m0->tec == m1->tec
+	&& m0->rec == m1->rec
+	&& m0->suspend_bits == m1->suspend_bits
+	&& m0->bus_off_count == m1->bus_off_count;
+}
+
+int check(const char *what, int n_ind, int n_conf)
+{
+    int errors = 0;
+
+    if(llc[0].digest != llc[1].digest || !same_state()
+       || llc[0].n_ind != n_ind || llc[1].n_ind != n_ind
+       || llc[0].n_conf != n_conf || llc[1].n_conf != n_conf)
+    {
+	printf("! %s: %d/%d received, %d/%d confirmed, digest 0x%08lx/0x%08lx,"
+	       " rx_fsm_state %d/%d, tec %d/%d\n", what,
+	       llc[0].n_ind, llc[1].n_ind, llc[0].n_conf, llc[1].n_conf,
+	       llc[0].digest & 0xFFFFFFFFUL, llc[1].digest & 0xFFFFFFFFUL,
+	       mac[0].state.rx_fsm_state, mac[1].state.rx_fsm_state,
+	       mac[0].state.tec, mac[1].state.tec);
+	errors++;
+    }
+
+    printf("# %s: %d runs, %lu vs. %lu MAC indications, %d errors\n",
+	   what, n_runs, llc[1].n_mac_ind, llc[0].n_mac_ind, errors);
+    return errors;
+}
+
+int run_sparse(void)
+{
+    record();
+
+    init_node(0);
+    init_node(1);
+    replay();
+    return check("sparse traffic", N_FRAMES, 0);
+}
+
+int run_bus_off(void)
+{
+    init_node(0);
+    init_node(1);
+    CAN_XR_MAC_Data_Req(&mac[0], 0x55, CAN_XR_FORMAT_CBFF, 8, tx_data);
+    CAN_XR_MAC_Data_Req(&mac[1], 0x55, CAN_XR_FORMAT_CBFF, 8, tx_data);
+
+    /* Idle, then the transmission starts and sees a stuck bus */
+    n_runs = 0;
+    add_run(1, 20 * BIT_TICKS + 37);
+    add_run(0, 400 * BIT_TICKS + 11);
+    add_run(1, 2000 * BIT_TICKS + 5);
+    add_run(0, 3 * BIT_TICKS);
+    add_run(1, 100 * BIT_TICKS);
+    replay();
+    return check("bus off", 0, 0);
+}
+
+int run_stuck(void)
+{
+    init_node(0);
+    init_node(1);
+
+    n_runs = 0;
+    add_run(0, 300 * BIT_TICKS + 3);
+    add_run(1, 30 * BIT_TICKS + 41);
+    add_run(0, 20 * BIT_TICKS);
+    add_run(1, 500 * BIT_TICKS + 17);
+    replay();
+    return check("stuck dominant", 0, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    /* Errors are traced at levels 2 and 9, on purpose */
+    SET_TRACE_TRESHOLD(10);
+
+    errors += run_sparse();
+    errors += run_bus_off();
+    errors += run_stuck();
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}